@@ -0,0 +1,186 @@
+#include "CRtspFramer.h"
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+
+CRtspFramer::CRtspFramer()
+{
+    reset();
+}
+
+void CRtspFramer::reset()
+{
+    m_start    = 0;
+    m_len      = 0;
+    m_skip     = 0;
+    m_savedPos = -1;
+    m_savedChar = 0;
+    m_buf[0]   = '\0';
+}
+
+void CRtspFramer::releaseFrame()
+{
+    // Put back the first byte of the following message
+    if (m_savedPos >= 0)
+    {
+        m_buf[m_savedPos] = m_savedChar;
+        m_savedPos = -1;
+    }
+}
+
+void CRtspFramer::compact()
+{
+    if (m_start == 0) return;
+    memmove(m_buf, m_buf + m_start, m_len - m_start);
+    m_len -= m_start;
+    m_start = 0;
+}
+
+char * CRtspFramer::writePtr()
+{
+    releaseFrame();
+    compact();
+    return m_buf + m_len;
+}
+
+unsigned CRtspFramer::writeSpace()
+{
+    releaseFrame();
+    compact();
+    return RTSP_FRAMER_BUFFER_SIZE - m_len;
+}
+
+void CRtspFramer::commit(unsigned n)
+{
+    if (n > RTSP_FRAMER_BUFFER_SIZE - m_len) n = RTSP_FRAMER_BUFFER_SIZE - m_len;
+    m_len += n;
+}
+
+unsigned CRtspFramer::feed(const char * data, unsigned len)
+{
+    char * dst = writePtr();
+    unsigned n = writeSpace();
+    if (len < n) n = len;
+    memcpy(dst, data, n);
+    commit(n);
+    return n;
+}
+
+// Offset just past the blank line ending the headers, -1 if not there yet
+int CRtspFramer::findHeaderEnd(const char * buf, unsigned len)
+{
+    for (unsigned i = 0; i + 1 < len; ++i)
+    {
+        if (buf[i] != '\n') continue;
+        if (buf[i + 1] == '\n') return i + 2;                      // bare LF
+        if (buf[i + 1] == '\r' && i + 2 < len && buf[i + 2] == '\n')
+            return i + 3;                                           // CRLF CRLF
+    }
+    return -1;
+}
+
+unsigned CRtspFramer::contentLength(const char * headers, unsigned len)
+{
+    static const char NAME[] = "content-length:";
+    const unsigned nameLen = sizeof(NAME) - 1;
+
+    unsigned i = 0;
+    while (i < len)
+    {
+        // i is at the start of a line
+        if (len - i > nameLen && strncasecmp(headers + i, NAME, nameLen) == 0)
+            return (unsigned)strtoul(headers + i + nameLen, nullptr, 10);
+        while (i < len && headers[i] != '\n') ++i;
+        ++i;
+    }
+    return 0;
+}
+
+bool CRtspFramer::next(RtspFrame & frame)
+{
+    releaseFrame();
+    frame.type = RTSP_FRAME_NONE;
+    frame.data = nullptr;
+    frame.size = 0;
+    frame.channel = 0;
+
+    for (;;)
+    {
+        // Tail of a message too large to buffer
+        if (m_skip)
+        {
+            unsigned n = m_len - m_start;
+            if (n > m_skip) n = m_skip;
+            m_start += n;
+            m_skip  -= n;
+            if (m_skip) break;
+        }
+
+        // Stray CR/LF between messages (some clients send them as keep-alive)
+        while (m_start < m_len && (m_buf[m_start] == '\r' || m_buf[m_start] == '\n'))
+            ++m_start;
+
+        char * p = m_buf + m_start;
+        unsigned avail = m_len - m_start;
+        if (avail == 0) break;
+
+        if (p[0] == '$')
+        {
+            // Interleaved binary data: '$' <channel> <16-bit length> <payload>
+            if (avail < 4) break;
+            unsigned payload = ((uint8_t)p[2] << 8) | (uint8_t)p[3];
+            if (4 + payload > RTSP_FRAMER_BUFFER_SIZE)
+            {
+                m_skip = 4 + payload;
+                continue;
+            }
+            if (avail < 4 + payload) break;
+
+            frame.type = RTSP_FRAME_INTERLEAVED;
+            frame.channel = (uint8_t)p[1];
+            frame.data = p + 4;
+            frame.size = payload;
+            m_start += 4 + payload;
+            return true;
+        }
+
+        int headerLen = findHeaderEnd(p, avail);
+        if (headerLen < 0)
+        {
+            if (avail < RTSP_FRAMER_BUFFER_SIZE) break;
+            // A full buffer without a header end is not RTSP
+            m_start = m_len = 0;
+            frame.type = RTSP_FRAME_ERROR;
+            return true;
+        }
+
+        unsigned total = headerLen + contentLength(p, headerLen);
+        if (total > RTSP_FRAMER_BUFFER_SIZE)
+        {
+            // Drop the request and whatever of its body is still to come
+            if (total > avail)
+            {
+                m_skip = total - avail;
+                m_start = m_len;
+            }
+            else m_start += total;
+            frame.type = RTSP_FRAME_ERROR;
+            return true;
+        }
+        if (avail < total) break;
+
+        // NUL-terminate in place; the overwritten byte comes back on the next call
+        m_savedPos = m_start + total;
+        m_savedChar = m_buf[m_savedPos];
+        m_buf[m_savedPos] = '\0';
+
+        frame.type = RTSP_FRAME_REQUEST;
+        frame.data = p;
+        frame.size = total;
+        m_start += total;
+        return true;
+    }
+
+    compact();
+    return false;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Input buffer per RTSP session — large enough for any request we accept
+// (SETUP with a long Transport header, SET_PARAMETER bodies) plus one
+// interleaved RTCP packet.
+#define RTSP_FRAMER_BUFFER_SIZE 2048
+
+enum RTSP_FRAME_TYPES
+{
+    RTSP_FRAME_NONE,        // need more bytes
+    RTSP_FRAME_REQUEST,     // complete request: headers + Content-Length body
+    RTSP_FRAME_INTERLEAVED, // '$' channel length payload (RTCP over TCP)
+    RTSP_FRAME_ERROR        // oversized/garbled input, buffer was dropped
+};
+
+struct RtspFrame
+{
+    RTSP_FRAME_TYPES type;
+    char * data;       // request: NUL-terminated text; interleaved: payload
+    unsigned size;
+    uint8_t channel;   // interleaved only
+};
+
+/**
+   Splits the RTSP control connection into messages.
+
+   TCP hands us arbitrary slices of the stream: a request may arrive in
+   several reads, and a client may pipeline SETUP+PLAY (or send RTCP
+   receiver reports as '$' frames between requests) in one read. Bytes
+   are appended with write()/commit(), and next() returns one complete
+   message at a time, in order.
+
+   No platform dependencies, so the framer also builds on a host.
+ */
+class CRtspFramer
+{
+public:
+    CRtspFramer();
+
+    void reset();
+
+    // Free space to read into, then commit() the number of bytes read
+    char * writePtr();
+    unsigned writeSpace();
+    void commit(unsigned n);
+
+    // Copies as much of data as fits; returns the number of bytes taken
+    unsigned feed(const char * data, unsigned len);
+
+    /**
+       Extracts the next complete message. frame.data points into the
+       buffer and stays valid until the next call to next(), write or
+       feed.
+     */
+    bool next(RtspFrame & frame);
+
+    unsigned buffered() const { return m_len - m_start; }
+
+private:
+    void compact();
+    void releaseFrame();
+    static int findHeaderEnd(const char * buf, unsigned len);
+    static unsigned contentLength(const char * headers, unsigned len);
+
+    char m_buf[RTSP_FRAMER_BUFFER_SIZE + 1]; // +1 for the terminating NUL
+    unsigned m_start;     // first unconsumed byte
+    unsigned m_len;       // bytes in the buffer
+    unsigned m_skip;      // rest of an oversized '$' frame still to discard
+    int m_savedPos;       // byte overwritten by the last request's NUL
+    char m_savedChar;
+};
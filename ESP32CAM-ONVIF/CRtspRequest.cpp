@@ -0,0 +1,243 @@
+#include "CRtspRequest.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static bool isLineEnd(char c)
+{
+    return c == '\r' || c == '\n';
+}
+
+CRtspRequest::CRtspRequest()
+{
+    method = url = version = "";
+    body = "";
+    bodySize = 0;
+    headerCount = 0;
+}
+
+bool CRtspRequest::parse(char * data, unsigned size)
+{
+    method = url = version = "";
+    body = "";
+    bodySize = 0;
+    headerCount = 0;
+
+    char * p = data;
+    char * end = data + size;
+
+    // Request line: METHOD SP URL SP VERSION, up to the first line end
+    char * lineEnd = p;
+    while (lineEnd < end && !isLineEnd(*lineEnd)) ++lineEnd;
+    char * next = lineEnd;
+    if (next < end && *next == '\r') ++next;
+    if (next < end && *next == '\n') ++next;
+    if (lineEnd < end) *lineEnd = '\0';
+
+    char * fields[3];
+    int n = 0;
+    while (n < 3)
+    {
+        while (p < lineEnd && isSpace(*p)) ++p;
+        if (p == lineEnd) break;
+        fields[n++] = p;
+        while (p < lineEnd && !isSpace(*p)) ++p;
+        if (p < lineEnd) *p++ = '\0';
+    }
+    if (n < 3) return false;
+    p = next;
+
+    method  = fields[0];
+    url     = fields[1];
+    version = fields[2];
+
+    // Header lines up to the blank line
+    while (p < end)
+    {
+        if (isLineEnd(*p))
+        {
+            if (*p == '\r' && p + 1 < end && p[1] == '\n') ++p;
+            ++p;
+            break;
+        }
+
+        char * name = p;
+        while (p < end && *p != ':' && !isLineEnd(*p)) ++p;
+        if (p == end || *p != ':')
+        {
+            // Not a header; skip the line
+            while (p < end && !isLineEnd(*p)) ++p;
+            if (p < end && *p == '\r') ++p;
+            if (p < end && *p == '\n') ++p;
+            continue;
+        }
+        char * nameEnd = p++;
+        while (nameEnd > name && isSpace(nameEnd[-1])) --nameEnd;
+        *nameEnd = '\0';
+
+        while (p < end && isSpace(*p)) ++p;
+        char * value = p;
+        while (p < end && !isLineEnd(*p)) ++p;
+        char * valueEnd = p;
+        while (valueEnd > value && isSpace(valueEnd[-1])) --valueEnd;
+
+        bool cr = p < end && *p == '\r';
+        if (p < end) ++p;
+        if (cr && p < end && *p == '\n') ++p;
+        *valueEnd = '\0';
+
+        if (headerCount < RTSP_MAX_HEADERS && *name)
+        {
+            headers[headerCount].name = name;
+            headers[headerCount].value = value;
+            ++headerCount;
+        }
+    }
+
+    body = p;
+    bodySize = (unsigned)(end - p);
+    return true;
+}
+
+const char * CRtspRequest::header(const char * name) const
+{
+    for (unsigned i = 0; i < headerCount; ++i)
+    {
+        if (strcasecmp(headers[i].name, name) == 0)
+            return headers[i].value;
+    }
+    return nullptr;
+}
+
+static void copyRange(char * dst, size_t dstSize, const char * src, size_t len)
+{
+    if (!dstSize) return;
+    if (len >= dstSize) len = dstSize - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+bool CRtspRequest::urlParts(char * hostPort, size_t hostPortSize, char * path, size_t pathSize) const
+{
+    const char * p = url;
+    const char * scheme = strstr(p, "://");
+    const char * host = scheme ? scheme + 3 : p;
+    const char * slash = strchr(host, '/');
+    if (!scheme) slash = p;   // absolute path or "*"
+
+    copyRange(hostPort, hostPortSize, host, scheme ? (slash ? (size_t)(slash - host) : strlen(host)) : 0);
+
+    const char * start = slash ? slash : host + strlen(host);
+    while (*start == '/') ++start;
+    size_t len = strlen(start);
+    while (len && start[len - 1] == '/') --len;   // "mjpeg/1/" == "mjpeg/1"
+    copyRange(path, pathSize, start, len);
+    return scheme != nullptr || *url == '/';
+}
+
+// "a-b" or "a"; b defaults to a + 1
+static void parseRange(const char * v, uint16_t out[2])
+{
+    char * end;
+    out[0] = (uint16_t)strtoul(v, &end, 10);
+    out[1] = (*end == '-') ? (uint16_t)strtoul(end + 1, nullptr, 10) : out[0] + 1;
+}
+
+void CRtspRequest::parseTransport(const char * value, RtspTransport & t)
+{
+    memset(&t, 0, sizeof(t));
+    if (!value) return;
+
+    const char * spec = value;
+    while (*spec)
+    {
+        // One transport-spec runs to the next ','
+        const char * specEnd = strchr(spec, ',');
+        if (!specEnd) specEnd = spec + strlen(spec);
+
+        RtspTransport cur;
+        memset(&cur, 0, sizeof(cur));
+
+        const char * p = spec;
+        while (p < specEnd && isSpace(*p)) ++p;
+        const char * protoEnd = p;
+        while (protoEnd < specEnd && *protoEnd != ';') ++protoEnd;
+        size_t protoLen = protoEnd - p;
+
+        if (protoLen >= 7 && strncasecmp(p, "RTP/AVP", 7) == 0)
+        {
+            cur.valid = true;
+            cur.tcp = (protoLen == 11 && strncasecmp(p + 7, "/TCP", 4) == 0);
+
+            // Parameters: name[=value] separated by ';'
+            p = protoEnd;
+            while (p < specEnd)
+            {
+                ++p;    // skip ';'
+                const char * param = p;
+                while (p < specEnd && *p != ';') ++p;
+                const char * eq = (const char *)memchr(param, '=', p - param);
+                size_t nameLen = (eq ? eq : p) - param;
+                const char * v = eq ? eq + 1 : "";
+
+                if (nameLen == 9 && strncasecmp(param, "multicast", 9) == 0)
+                    cur.multicast = true;
+                else if (nameLen == 7 && strncasecmp(param, "unicast", 7) == 0)
+                    cur.multicast = false;
+                else if (eq && nameLen == 11 && strncasecmp(param, "interleaved", 11) == 0)
+                {
+                    uint16_t ch[2];
+                    parseRange(v, ch);
+                    cur.hasInterleaved = true;
+                    cur.interleaved[0] = (uint8_t)ch[0];
+                    cur.interleaved[1] = (uint8_t)ch[1];
+                }
+                else if (eq && nameLen == 11 && strncasecmp(param, "client_port", 11) == 0)
+                {
+                    cur.hasClientPort = true;
+                    parseRange(v, cur.clientPort);
+                }
+                else if (eq && nameLen == 4 && strncasecmp(param, "port", 4) == 0)
+                {
+                    cur.hasPort = true;
+                    parseRange(v, cur.port);
+                }
+                else if (eq && nameLen == 4 && strncasecmp(param, "ssrc", 4) == 0)
+                {
+                    cur.hasSsrc = true;
+                    cur.ssrc = (uint32_t)strtoul(v, nullptr, 16);
+                }
+                else if (eq && nameLen == 3 && strncasecmp(param, "ttl", 3) == 0)
+                {
+                    cur.hasTtl = true;
+                    cur.ttl = (uint8_t)atoi(v);
+                }
+                else if (eq && nameLen == 11 && strncasecmp(param, "destination", 11) == 0)
+                {
+                    copyRange(cur.destination, sizeof(cur.destination), v, p - v);
+                }
+            }
+        }
+
+        if (cur.valid)
+        {
+            t = cur;
+            return;
+        }
+        spec = *specEnd ? specEnd + 1 : specEnd;
+    }
+}
+
+bool CRtspRequest::parseSession(const char * value, char * id, size_t idSize)
+{
+    if (!value || !idSize) return false;
+    size_t len = 0;
+    while (value[len] && value[len] != ';' && !isSpace(value[len])) ++len;
+    copyRange(id, idSize, value, len);
+    return len > 0;
+}
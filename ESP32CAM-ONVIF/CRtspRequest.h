@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Headers kept per request; RTSP clients send well under ten
+#define RTSP_MAX_HEADERS 16
+
+struct RtspHeader
+{
+    const char * name;
+    const char * value;   // leading/trailing whitespace trimmed
+};
+
+// One transport-spec of a Transport header (RFC 2326 12.39)
+struct RtspTransport
+{
+    bool valid;
+    bool tcp;             // RTP/AVP/TCP
+    bool multicast;
+    bool hasInterleaved;
+    uint8_t interleaved[2];
+    bool hasClientPort;
+    uint16_t clientPort[2];
+    bool hasPort;         // multicast port=
+    uint16_t port[2];
+    bool hasSsrc;
+    uint32_t ssrc;
+    bool hasTtl;
+    uint8_t ttl;
+    char destination[40];
+};
+
+/**
+   Single-pass, in-place RTSP request tokenizer.
+
+   parse() walks the request once, splitting the request line and each
+   header line by writing NUL terminators into the buffer, so method, URL
+   and every header name/value are plain C strings pointing into it. The
+   buffer must be writable, NUL-terminated at data[size] and stay alive
+   while the request is used (CRtspFramer hands out exactly that).
+
+   No platform dependencies, so it builds (and can be fuzzed) on a host.
+ */
+class CRtspRequest
+{
+public:
+    CRtspRequest();
+
+    // False if the request line is malformed; extra headers are ignored
+    bool parse(char * data, unsigned size);
+
+    const char * method;
+    const char * url;       // as sent, e.g. rtsp://host:554/mjpeg/1/track1
+    const char * version;   // RTSP/1.0
+    const char * body;      // after the blank line, bodySize bytes
+    unsigned bodySize;
+
+    unsigned headerCount;
+    RtspHeader headers[RTSP_MAX_HEADERS];
+
+    // Case-insensitive lookup; nullptr if absent
+    const char * header(const char * name) const;
+
+    // Splits url into host[:port] and path (without the leading '/');
+    // copies are NUL-terminated and truncated to the given sizes
+    bool urlParts(char * hostPort, size_t hostPortSize, char * path, size_t pathSize) const;
+
+    // Parses the first transport-spec we can serve (RTP/AVP over UDP or
+    // TCP); fills t.valid = false if none
+    static void parseTransport(const char * value, RtspTransport & t);
+
+    // Session: <id>[;timeout=<n>] - copies the id part
+    static bool parseSession(const char * value, char * id, size_t idSize);
+};
@@ -1,12 +1,18 @@
 #include "CRtspSession.h"
 #include <stdio.h>
 #include <time.h>
-#include "esp_camera.h"
+#include "media_config.h"
+#include "config.h"
+#include "event_queue.h"
+#include "rtsp_auth.h"
 
 // Shared RTSP response buffers — single-threaded, no concurrency risk.
-static char s_RtspResponse[1024];
 static char s_RtspSDP[1024];
-static char s_RtspURL[256];
+// "rtsp://" + host:port + "/" + stream name (see Handle_RtspDESCRIBE)
+static char s_RtspURL[sizeof("rtsp://") + MAX_HOSTNAME_LEN + 16];
+// Largest reply is DESCRIBE's: status line, CSeq, Date, Content-Base,
+// Content-Type and Content-Length (fixed text within 256 bytes), then the SDP
+static char s_RtspResponse[256 + RTSP_PARAM_STRING_MAX + sizeof(s_RtspURL) + sizeof(s_RtspSDP)];
 
 CRtspSession::CRtspSession(SOCKET aRtspClient, CStreamer * aStreamer)
     : m_RtspClient(aRtspClient), m_Streamer(aStreamer)
@@ -16,20 +22,29 @@ CRtspSession::CRtspSession(SOCKET aRtspClient, CStreamer * aStreamer)
 
     m_RtspSessionID  = getRandom();
     m_RtspSessionID |= 0x80000000;
+    snprintf(m_SessionId, sizeof(m_SessionId), "%08X", (unsigned)m_RtspSessionID);
     m_StreamID       = -1;
     m_ClientRTPPort  =  0;
     m_ClientRTCPPort =  0;
     m_TcpTransport   =  false;
+    m_Interleaved[0] =  0;
+    m_Interleaved[1] =  1;
+    m_Multicast      =  false;
+    m_HoldsTransport =  false;
+    memset(&m_Transport, 0, sizeof(m_Transport));
+    rtsp_auth_reset(m_Auth);
+    m_LastActivityMs = platmillis();
     m_streaming = false;
     m_stopped = false;
 };
 
 CRtspSession::~CRtspSession()
 {
+    if (m_HoldsTransport && m_Streamer)
+        m_Streamer->ReleaseTransport(this, m_Multicast);
     if (m_RtspClient) {
-        m_RtspClient->stop();
-        delete m_RtspClient;
-        m_RtspClient = nullptr;
+        closesocket(m_RtspClient);
+        m_RtspClient = NULLSOCKET;
     }
 };
 
@@ -45,181 +60,120 @@ void CRtspSession::Init()
 
 bool CRtspSession::ParseRtspRequest(char const * aRequest, unsigned aRequestSize)
 {
-    // NOTE: We parse directly from aRequest (which is the RecvBuf in handleRequests).
-    // Previously a separate static CurRequest[RTSP_BUFFER_SIZE] was used as a copy,
-    // wasting 2KB of BSS. Eliminated by making the receive buffer mutable.
-    char * CurRequest = (char *)aRequest;  // Cast away const — we own this buffer
-    unsigned CurRequestSize = aRequestSize;
-
+    // aRequest points into m_Framer's buffer: one complete, NUL-terminated
+    // request that the tokenizer may split in place.
     Init();
-
-    // Extract client_port from SETUP request
-    char * ClientPortPtr = strstr(CurRequest, "client_port");
-    if (ClientPortPtr != nullptr)
-    {
-        char * TmpPtr = strstr(ClientPortPtr, "\r\n");
-        if (TmpPtr != nullptr)
-        {
-            char saved = TmpPtr[0];
-            TmpPtr[0] = '\0';
-            char * pEq = strstr(ClientPortPtr, "=");
-            if (pEq != nullptr)
-            {
-                pEq++;
-                m_ClientRTPPort = atoi(pEq);
-                m_ClientRTCPPort = m_ClientRTPPort + 1;
-            }
-            TmpPtr[0] = saved;  // Restore for further parsing
-        }
-    }
-
-    // Read command name (up to first space)
-    char CmdName[RTSP_PARAM_STRING_MAX];
-    bool parseSucceeded = false;
-    unsigned i;
-    for (i = 0; i < sizeof(CmdName)-1 && i < CurRequestSize; ++i)
+    if (!m_Request.parse((char *)aRequest, aRequestSize)) return false;
+
+    printf("RTSP received %s\n", m_Request.method);
+
+    const char * Method = m_Request.method;
+    if      (strcmp(Method, "OPTIONS") == 0)       m_RtspCmdType = RTSP_OPTIONS;
+    else if (strcmp(Method, "DESCRIBE") == 0)      m_RtspCmdType = RTSP_DESCRIBE;
+    else if (strcmp(Method, "SETUP") == 0)         m_RtspCmdType = RTSP_SETUP;
+    else if (strcmp(Method, "PLAY") == 0)          m_RtspCmdType = RTSP_PLAY;
+    else if (strcmp(Method, "TEARDOWN") == 0)      m_RtspCmdType = RTSP_TEARDOWN;
+    else if (strcmp(Method, "GET_PARAMETER") == 0) m_RtspCmdType = RTSP_GET_PARAMETER;
+
+    const char * CSeq = m_Request.header("CSeq");
+    if (!CSeq) return false;
+    snprintf(m_CSeq, sizeof(m_CSeq), "%s", CSeq);
+
+    // rtsp://host:port/<prefix>/<suffix>, e.g. mjpeg/1 or mjpeg/1/track1
+    char Path[RTSP_PARAM_STRING_MAX];
+    m_Request.urlParts(m_URLHostPort, sizeof(m_URLHostPort), Path, sizeof(Path));
+    char * Slash = strrchr(Path, '/');
+    if (Slash)
     {
-        char c = CurRequest[i];
-        if (c == ' ' || c == '\t')
-        {
-            parseSucceeded = true;
-            break;
-        }
-        CmdName[i] = c;
+        *Slash = '\0';
+        snprintf(m_URLPreSuffix, sizeof(m_URLPreSuffix), "%s", Path);
+        snprintf(m_URLSuffix, sizeof(m_URLSuffix), "%s", Slash + 1);
     }
-    CmdName[i] = '\0';
-    if (!parseSucceeded) return false;
-
-    printf("RTSP received %s\n", CmdName);
+    else snprintf(m_URLSuffix, sizeof(m_URLSuffix), "%s", Path);
 
-    // Identify command type — use strcmp for exact match (faster, no false substring hits)
-    if      (strcmp(CmdName, "OPTIONS") == 0)       m_RtspCmdType = RTSP_OPTIONS;
-    else if (strcmp(CmdName, "DESCRIBE") == 0)      m_RtspCmdType = RTSP_DESCRIBE;
-    else if (strcmp(CmdName, "SETUP") == 0)         m_RtspCmdType = RTSP_SETUP;
-    else if (strcmp(CmdName, "PLAY") == 0)          m_RtspCmdType = RTSP_PLAY;
-    else if (strcmp(CmdName, "TEARDOWN") == 0)      m_RtspCmdType = RTSP_TEARDOWN;
-    else if (strcmp(CmdName, "GET_PARAMETER") == 0) m_RtspCmdType = RTSP_GET_PARAMETER;
+    m_ContentLength = m_Request.bodySize;
 
-    // Check transport type for SETUP
     if (m_RtspCmdType == RTSP_SETUP)
     {
-        m_TcpTransport = (strstr(CurRequest, "RTP/AVP/TCP") != nullptr);
-    }
-
-    // Skip over the "rtsp://" URL prefix
-    unsigned j = i+1;
-    while (j < CurRequestSize && (CurRequest[j] == ' ' || CurRequest[j] == '\t')) ++j;
-    for (; (int)j < (int)(CurRequestSize-8); ++j)
-    {
-        if ((CurRequest[j]   == 'r' || CurRequest[j]   == 'R') &&
-            (CurRequest[j+1] == 't' || CurRequest[j+1] == 'T') &&
-            (CurRequest[j+2] == 's' || CurRequest[j+2] == 'S') &&
-            (CurRequest[j+3] == 'p' || CurRequest[j+3] == 'P') &&
-            CurRequest[j+4] == ':' && CurRequest[j+5] == '/')
+        CRtspRequest::parseTransport(m_Request.header("Transport"), m_Transport);
+        m_TcpTransport = m_Transport.valid && m_Transport.tcp;
+        if (m_Transport.hasClientPort)
         {
-            j += 6;
-            if (CurRequest[j] == '/')
-            {
-                ++j;
-                unsigned uidx = 0;
-                while (j < CurRequestSize && CurRequest[j] != '/' && CurRequest[j] != ' ' && uidx < sizeof(m_URLHostPort) - 1)
-                {
-                    m_URLHostPort[uidx++] = CurRequest[j++];
-                }
-            }
-            else --j;
-            i = j;
-            break;
+            m_ClientRTPPort  = m_Transport.clientPort[0];
+            m_ClientRTCPPort = m_Transport.clientPort[1];
         }
     }
+    return true;
+};
 
-    // Extract URL suffix (before "RTSP/")
-    parseSucceeded = false;
-    for (unsigned k = i+1; (int)k < (int)(CurRequestSize-5); ++k)
-    {
-        if (CurRequest[k]   == 'R' && CurRequest[k+1] == 'T' &&
-            CurRequest[k+2] == 'S' && CurRequest[k+3] == 'P' &&
-            CurRequest[k+4] == '/')
-        {
-            while (--k >= i && CurRequest[k] == ' ') {}
-            unsigned k1 = k;
-            while (k1 > i && CurRequest[k1] != '/') --k1;
-            if (k - k1 + 1 > sizeof(m_URLSuffix)) return false;
-            unsigned n = 0, k2 = k1+1;
-            while (k2 <= k) m_URLSuffix[n++] = CurRequest[k2++];
-            m_URLSuffix[n] = '\0';
-
-            if (k1 - i > sizeof(m_URLPreSuffix)) return false;
-            n = 0; k2 = i + 1;
-            while (k2 <= k1 - 1) m_URLPreSuffix[n++] = CurRequest[k2++];
-            m_URLPreSuffix[n] = '\0';
-            i = k + 7;
-            parseSucceeded = true;
-            break;
-        }
-    }
-    if (!parseSucceeded) return false;
+// PLAY/TEARDOWN/GET_PARAMETER must carry the Session id SETUP handed out
+bool CRtspSession::SessionMatches()
+{
+    char Id[sizeof(m_SessionId)];
+    if (!CRtspRequest::parseSession(m_Request.header("Session"), Id, sizeof(Id)))
+        return m_RtspCmdType != RTSP_PLAY;   // keep-alives may omit it
+    return strcmp(Id, m_SessionId) == 0;
+}
 
-    // Extract CSeq header
-    parseSucceeded = false;
-    for (j = i; (int)j < (int)(CurRequestSize-5); ++j)
-    {
-        if (CurRequest[j]   == 'C' && CurRequest[j+1] == 'S' &&
-            CurRequest[j+2] == 'e' && CurRequest[j+3] == 'q' &&
-            CurRequest[j+4] == ':')
-        {
-            j += 5;
-            while (j < CurRequestSize && (CurRequest[j] == ' ' || CurRequest[j] == '\t')) ++j;
-            unsigned n;
-            for (n = 0; n < sizeof(m_CSeq)-1 && j < CurRequestSize; ++n, ++j)
-            {
-                char c = CurRequest[j];
-                if (c == '\r' || c == '\n')
-                {
-                    parseSucceeded = true;
-                    break;
-                }
-                m_CSeq[n] = c;
-            }
-            m_CSeq[n] = '\0';
-            break;
-        }
+#if RTSP_AUTH_ENABLED
+// Digest check; answers 401 with a (fresh or stale) nonce on failure
+bool CRtspSession::Authorized()
+{
+    uint32_t Now = platmillis();
+    RtspAuthResult r = rtsp_auth_check(m_Auth, m_Request.method,
+                                       m_Request.header("Authorization"), Now);
+    if (r == RTSP_AUTH_OK) return true;
+    if (r != RTSP_AUTH_MISSING && r != RTSP_AUTH_STALE) {
+        printf("[WARN] RTSP auth: %s\n", rtsp_auth_result_str(r));
+        event_auth_failure("rtsp");
     }
-    if (!parseSucceeded) return false;
 
-    // Extract Content-Length (optional)
-    for (j = i; (int)j < (int)(CurRequestSize-15); ++j)
-    {
-        if (CurRequest[j]    == 'C'  && CurRequest[j+1]  == 'o'  &&
-            CurRequest[j+2]  == 'n'  && CurRequest[j+3]  == 't'  &&
-            CurRequest[j+4]  == 'e'  && CurRequest[j+5]  == 'n'  &&
-            CurRequest[j+6]  == 't'  && CurRequest[j+7]  == '-'  &&
-            (CurRequest[j+8] == 'L' || CurRequest[j+8]   == 'l') &&
-            CurRequest[j+9]  == 'e'  && CurRequest[j+10] == 'n'  &&
-            CurRequest[j+11] == 'g'  && CurRequest[j+12] == 't'  &&
-            CurRequest[j+13] == 'h'  && CurRequest[j+14] == ':')
-        {
-            j += 15;
-            while (j < CurRequestSize && (CurRequest[j] == ' ' || CurRequest[j] == '\t')) ++j;
-            unsigned num;
-            if (sscanf(&CurRequest[j], "%u", &num) == 1) m_ContentLength = num;
-        }
-    }
-    return true;
-};
+    static char Challenge[128];
+    rtsp_auth_challenge(m_Auth, r == RTSP_AUTH_STALE, Now, Challenge, sizeof(Challenge));
+    snprintf(s_RtspResponse, sizeof(s_RtspResponse),
+             "RTSP/1.0 401 Unauthorized\r\nCSeq: %s\r\n"
+             "%s\r\n"
+             "WWW-Authenticate: %s\r\n\r\n",
+             m_CSeq, DateHeader(), Challenge);
+    SendResponse();
+    return false;
+}
+#endif
+
+void CRtspSession::Handle_RtspError(char const * aStatus)
+{
+    snprintf(s_RtspResponse, sizeof(s_RtspResponse),
+             "RTSP/1.0 %s\r\nCSeq: %s\r\n%s\r\n\r\n",
+             aStatus, m_CSeq, DateHeader());
+    SendResponse();
+}
 
 RTSP_CMD_TYPES CRtspSession::Handle_RtspRequest(char const * aRequest, unsigned aRequestSize)
 {
     if (ParseRtspRequest(aRequest, aRequestSize))
     {
+        if ((m_RtspCmdType == RTSP_PLAY || m_RtspCmdType == RTSP_TEARDOWN ||
+             m_RtspCmdType == RTSP_GET_PARAMETER) && !SessionMatches())
+        {
+            Handle_RtspError("454 Session Not Found");
+            return RTSP_UNKNOWN;
+        }
+
+#if RTSP_AUTH_ENABLED
+        if ((m_RtspCmdType == RTSP_DESCRIBE || m_RtspCmdType == RTSP_SETUP ||
+             m_RtspCmdType == RTSP_PLAY) && !Authorized())
+            return RTSP_UNKNOWN;
+#endif
+
         switch (m_RtspCmdType)
         {
         case RTSP_OPTIONS:       Handle_RtspOPTION();        break;
         case RTSP_DESCRIBE:      Handle_RtspDESCRIBE();      break;
         case RTSP_SETUP:         Handle_RtspSETUP();         break;
         case RTSP_PLAY:          Handle_RtspPLAY();          break;
+        case RTSP_TEARDOWN:      Handle_RtspTEARDOWN();      break;
         case RTSP_GET_PARAMETER: Handle_RtspGET_PARAMETER(); break;
-        default: break;
+        default: Handle_RtspError("501 Not Implemented");   break;
         }
     }
     return m_RtspCmdType;
@@ -230,7 +184,7 @@ void CRtspSession::Handle_RtspOPTION()
     snprintf(s_RtspResponse, sizeof(s_RtspResponse),
              "RTSP/1.0 200 OK\r\nCSeq: %s\r\n"
              "Public: DESCRIBE, SETUP, TEARDOWN, PLAY, GET_PARAMETER\r\n\r\n", m_CSeq);
-    socketsend(m_RtspClient, s_RtspResponse, strlen(s_RtspResponse));
+    SendResponse();
 }
 
 void CRtspSession::Handle_RtspDESCRIBE()
@@ -250,7 +204,7 @@ void CRtspSession::Handle_RtspDESCRIBE()
         snprintf(s_RtspResponse, sizeof(s_RtspResponse),
                  "RTSP/1.0 404 Stream Not Found\r\nCSeq: %s\r\n%s\r\n",
                  m_CSeq, DateHeader());
-        socketsend(m_RtspClient, s_RtspResponse, strlen(s_RtspResponse));
+        SendResponse();
         return;
     }
 
@@ -260,8 +214,21 @@ void CRtspSession::Handle_RtspDESCRIBE()
     char * ColonPtr = strstr(OBuf, ":");
     if (ColonPtr != nullptr) ColonPtr[0] = '\0';
 
-    // Determine codec
+    // Determine codec; /1 is the main stream, /2 the substream
     bool useH264 = (m_StreamID >= 2);
+    MediaStreamId mediaStream = (m_StreamID % 2) ? MEDIA_SUB : MEDIA_MAIN;
+    // The sensor serves one stream: switching it would change what the
+    // viewers already playing get
+    if (mediaStream != media_config_active() && m_Streamer &&
+        m_Streamer->HeldByOthers(this, m_HoldsTransport && m_Multicast))
+    {
+        printf("[WARN] RTSP: DESCRIBE of stream %s refused, %s is playing\n",
+               media_stream_name(mediaStream), media_stream_name(media_config_active()));
+        Handle_RtspError("453 Not Enough Bandwidth");
+        return;
+    }
+    media_config_activate(mediaStream);
+    const VideoEncoderConfig &enc = media_config_get(mediaStream);
 
     if (useH264) {
         snprintf(s_RtspSDP, sizeof(s_RtspSDP),
@@ -275,12 +242,12 @@ void CRtspSession::Handle_RtspDESCRIBE()
                  "a=range:npt=0-\r\n"
                  "m=video 0 RTP/AVP 96\r\n"
                  "c=IN IP4 0.0.0.0\r\n"
-                 "b=AS:2000\r\n"
+                 "b=AS:%u\r\n"
                  "a=rtpmap:96 H264/90000\r\n"
                  "a=fmtp:96 packetization-mode=1;profile-level-id=42E01F\r\n"
-                 "a=framerate:25\r\n"
+                 "a=framerate:%u\r\n"
                  "a=control:track1\r\n",
-                 rand(), OBuf);
+                 rand(), OBuf, (unsigned)enc.bitrateKbps, enc.fps);
     } else {
         snprintf(s_RtspSDP, sizeof(s_RtspSDP),
                  "v=0\r\n"
@@ -293,12 +260,13 @@ void CRtspSession::Handle_RtspDESCRIBE()
                  "a=range:npt=0-\r\n"
                  "m=video 0 RTP/AVP 26\r\n"
                  "c=IN IP4 0.0.0.0\r\n"
-                 "b=AS:4096\r\n"
+                 "b=AS:%u\r\n"
                  "a=rtpmap:26 JPEG/90000\r\n"
-                 "a=fmtp:26 width=640;height=480;quality=10\r\n"
-                 "a=framerate:20\r\n"
+                 "a=fmtp:26 width=%u;height=%u;quality=%d\r\n"
+                 "a=framerate:%u\r\n"
                  "a=control:track1\r\n",
-                 rand(), OBuf);
+                 rand(), OBuf, (unsigned)enc.bitrateKbps, enc.width, enc.height,
+                 media_jpeg_quality(enc.quality), enc.fps);
     }
 
     // Build stream name for Content-Base
@@ -311,15 +279,22 @@ void CRtspSession::Handle_RtspDESCRIBE()
     default: strcpy(StreamName, "1");      break;
     }
     snprintf(s_RtspURL, sizeof(s_RtspURL), "rtsp://%s/%s", m_URLHostPort, StreamName);
-    snprintf(s_RtspResponse, sizeof(s_RtspResponse),
-             "RTSP/1.0 200 OK\r\nCSeq: %s\r\n"
-             "%s\r\n"
-             "Content-Base: %s/\r\n"
-             "Content-Type: application/sdp\r\n"
-             "Content-Length: %d\r\n\r\n"
-             "%s",
-             m_CSeq, DateHeader(), s_RtspURL, (int)strlen(s_RtspSDP), s_RtspSDP);
-    socketsend(m_RtspClient, s_RtspResponse, strlen(s_RtspResponse));
+    int len = snprintf(s_RtspResponse, sizeof(s_RtspResponse),
+                       "RTSP/1.0 200 OK\r\nCSeq: %s\r\n"
+                       "%s\r\n"
+                       "Content-Base: %s/\r\n"
+                       "Content-Type: application/sdp\r\n"
+                       "Content-Length: %d\r\n\r\n"
+                       "%s",
+                       m_CSeq, DateHeader(), s_RtspURL, (int)strlen(s_RtspSDP), s_RtspSDP);
+    // A cut SDP would go out under a Content-Length it doesn't match
+    if (len < 0 || len >= (int)sizeof(s_RtspResponse))
+    {
+        printf("[ERROR] RTSP: DESCRIBE reply doesn't fit (%d bytes)\n", len);
+        Handle_RtspError("500 Internal Server Error");
+        return;
+    }
+    SendResponse();
 }
 
 void CRtspSession::Handle_RtspSETUP()
@@ -329,11 +304,46 @@ void CRtspSession::Handle_RtspSETUP()
         return;
     }
 
-    m_Streamer->InitTransport(m_ClientRTPPort, m_ClientRTCPPort, m_TcpTransport);
+    bool Multicast = m_Transport.valid && m_Transport.multicast;
+#if !RTSP_MULTICAST_ENABLED
+    if (Multicast)
+    {
+        Handle_RtspError("461 Unsupported Transport");
+        return;
+    }
+#endif
+
+    // Re-SETUP while playing keeps the transport the sender task is using
+    if (!m_streaming)
+    {
+        if (m_HoldsTransport)
+            m_Streamer->ReleaseTransport(this, m_Multicast);
+        m_Multicast = Multicast;
+        // Channels as the client asked for them, 0-1 if it didn't say
+        m_Interleaved[0] = m_Transport.hasInterleaved ? m_Transport.interleaved[0] : 0;
+        m_Interleaved[1] = m_Transport.hasInterleaved ? m_Transport.interleaved[1] : 1;
+        m_HoldsTransport = Multicast
+            ? m_Streamer->JoinMulticast(RTSP_MULTICAST_GROUP, RTSP_MULTICAST_PORT, RTSP_MULTICAST_TTL)
+            : m_Streamer->InitTransport(this, m_RtspClient, m_ClientRTPPort, m_ClientRTCPPort, m_TcpTransport,
+                                        m_Interleaved[0]);
+        if (!m_HoldsTransport)
+        {
+            // Another client owns the unicast stream, or viewers the group
+            printf("[WARN] RTSP: %s SETUP refused, streamer in use\n", Multicast ? "multicast" : "unicast");
+            Handle_RtspError("453 Not Enough Bandwidth");
+            return;
+        }
+    }
 
     static char Transport[255];
-    if (m_TcpTransport)
-        snprintf(Transport, sizeof(Transport), "RTP/AVP/TCP;unicast;interleaved=0-1");
+    if (m_Multicast)
+        snprintf(Transport, sizeof(Transport),
+                 "RTP/AVP;multicast;destination=%s;port=%u-%u;ttl=%u",
+                 RTSP_MULTICAST_GROUP, (unsigned)RTSP_MULTICAST_PORT,
+                 (unsigned)RTSP_MULTICAST_PORT + 1, (unsigned)RTSP_MULTICAST_TTL);
+    else if (m_TcpTransport)
+        snprintf(Transport, sizeof(Transport), "RTP/AVP/TCP;unicast;interleaved=%u-%u",
+                 (unsigned)m_Interleaved[0], (unsigned)m_Interleaved[1]);
     else
         snprintf(Transport, sizeof(Transport),
                  "RTP/AVP;unicast;destination=127.0.0.1;source=127.0.0.1;client_port=%i-%i;server_port=%i-%i",
@@ -345,13 +355,19 @@ void CRtspSession::Handle_RtspSETUP()
              "RTSP/1.0 200 OK\r\nCSeq: %s\r\n"
              "%s\r\n"
              "Transport: %s\r\n"
-             "Session: %i;timeout=60\r\n\r\n",
-             m_CSeq, DateHeader(), Transport, m_RtspSessionID);
-    socketsend(m_RtspClient, s_RtspResponse, strlen(s_RtspResponse));
+             "Session: %s;timeout=%u\r\n\r\n",
+             m_CSeq, DateHeader(), Transport, m_SessionId, (unsigned)RTSP_SESSION_TIMEOUT_S);
+    SendResponse();
 }
 
 void CRtspSession::Handle_RtspPLAY()
 {
+    if (!m_HoldsTransport)
+    {
+        Handle_RtspError("455 Method Not Valid in This State");
+        return;
+    }
+
     char StreamPath[16];
     switch (m_StreamID) {
     case 0: strcpy(StreamPath, "mjpeg/1"); break;
@@ -361,14 +377,38 @@ void CRtspSession::Handle_RtspPLAY()
     default: strcpy(StreamPath, "mjpeg/1"); break;
     }
 
+    // Where the stream resumes: frames are stamped from the capture clock
+    // and the sequence carries on from earlier sessions of this streamer
+    unsigned Seq = m_Streamer->nextRtpSequence();
+    uint32_t RtpTime = CStreamer::rtpTimestamp(platmicros64());
+
     snprintf(s_RtspResponse, sizeof(s_RtspResponse),
              "RTSP/1.0 200 OK\r\nCSeq: %s\r\n"
              "%s\r\n"
              "Range: npt=0.000-\r\n"
-             "Session: %i;timeout=60\r\n"
-             "RTP-Info: url=rtsp://%s/%s/track1;seq=0;rtptime=0\r\n\r\n",
-             m_CSeq, DateHeader(), m_RtspSessionID, m_URLHostPort, StreamPath);
+             "Session: %s;timeout=%u\r\n"
+             "RTP-Info: url=rtsp://%s/%s/track1;seq=%u;rtptime=%lu\r\n\r\n",
+             m_CSeq, DateHeader(), m_SessionId, (unsigned)RTSP_SESSION_TIMEOUT_S, m_URLHostPort, StreamPath,
+             Seq, (unsigned long)RtpTime);
+    SendResponse();
+}
+
+void CRtspSession::Handle_RtspTEARDOWN()
+{
+    snprintf(s_RtspResponse, sizeof(s_RtspResponse),
+             "RTSP/1.0 200 OK\r\nCSeq: %s\r\n"
+             "%s\r\n"
+             "Session: %s\r\n\r\n",
+             m_CSeq, DateHeader(), m_SessionId);
+    SendResponse();
+}
+
+// Replies share the connection with interleaved RTP from the sender task
+void CRtspSession::SendResponse()
+{
+    if (m_Streamer) m_Streamer->lockTx();
     socketsend(m_RtspClient, s_RtspResponse, strlen(s_RtspResponse));
+    if (m_Streamer) m_Streamer->unlockTx();
 }
 
 char const * CRtspSession::DateHeader()
@@ -388,9 +428,9 @@ void CRtspSession::Handle_RtspGET_PARAMETER()
 {
     snprintf(s_RtspResponse, sizeof(s_RtspResponse),
              "RTSP/1.0 200 OK\r\nCSeq: %s\r\n"
-             "Session: %i\r\n\r\n",
-             m_CSeq, m_RtspSessionID);
-    socketsend(m_RtspClient, s_RtspResponse, strlen(s_RtspResponse));
+             "Session: %s\r\n\r\n",
+             m_CSeq, m_SessionId);
+    SendResponse();
 }
 
 bool CRtspSession::handleRequests(uint32_t readTimeoutMs)
@@ -398,22 +438,48 @@ bool CRtspSession::handleRequests(uint32_t readTimeoutMs)
     if (m_stopped)
         return false;
 
-    // Single receive buffer — ParseRtspRequest now operates on this directly
-    // (no more redundant memcpy to a separate CurRequest buffer)
-    static char RecvBuf[RTSP_BUFFER_SIZE];
+    // The sender task gave up on a client that stopped reading
+    if (m_streaming && !m_Multicast && m_Streamer && m_Streamer->transportFailed()) {
+        printf("[WARN] RTSP: client stopped reading, closing session\n");
+        m_stopped = true;
+        return false;
+    }
 
-    memset(RecvBuf, 0x00, sizeof(RecvBuf));
-    int res = socketread(m_RtspClient, RecvBuf, sizeof(RecvBuf), readTimeoutMs);
+    // Any request or RTCP report (interleaved, or on our UDP RTCP port)
+    // keeps the session alive. Group RTCP isn't attributable to a session;
+    // multicast viewers stay alive through their RTSP keep-alives.
+    uint32_t Now = platmillis();
+    if (m_HoldsTransport && !m_Multicast && m_Streamer && m_Streamer->pollRtcp())
+        m_LastActivityMs = Now;
+
+    // Append whatever arrived to the session's input buffer. A request may
+    // span several reads, and one read may hold several requests (pipelined
+    // SETUP+PLAY) or interleaved RTCP frames from TCP clients.
+    int res = socketread(m_RtspClient, m_Framer.writePtr(), m_Framer.writeSpace(), readTimeoutMs);
     if (res > 0) {
-        // Filter: valid RTSP commands start with O, D, S, P, T, or G
-        char first = RecvBuf[0];
-        if (first == 'O' || first == 'D' || first == 'S' || first == 'P' || first == 'T' || first == 'G')
-        {
-            RTSP_CMD_TYPES C = Handle_RtspRequest(RecvBuf, res);
-            if (C == RTSP_PLAY)
-                m_streaming = true;
-            else if (C == RTSP_TEARDOWN)
-                m_stopped = true;
+        m_LastActivityMs = Now;
+        m_Framer.commit(res);
+
+        RtspFrame frame;
+        while (!m_stopped && m_Framer.next(frame)) {
+            switch (frame.type) {
+            case RTSP_FRAME_REQUEST: {
+                RTSP_CMD_TYPES C = Handle_RtspRequest(frame.data, frame.size);
+                if (C == RTSP_PLAY && m_HoldsTransport)
+                    m_streaming = true;
+                else if (C == RTSP_TEARDOWN)
+                    m_stopped = true;
+                break;
+            }
+            case RTSP_FRAME_INTERLEAVED:
+                // RTCP receiver reports on m_Interleaved[1]; nothing to act on
+                break;
+            case RTSP_FRAME_ERROR:
+                printf("[WARN] RTSP: dropped oversized or malformed request\n");
+                break;
+            default:
+                break;
+            }
         }
         return true;
     }
@@ -423,12 +489,11 @@ bool CRtspSession::handleRequests(uint32_t readTimeoutMs)
     }
     else {
         // Timeout
+        if (Now - m_LastActivityMs > RTSP_SESSION_TIMEOUT_S * 1000UL) {
+            printf("[WARN] RTSP: no keep-alive for %us, closing session\n",
+                   (unsigned)RTSP_SESSION_TIMEOUT_S);
+            m_stopped = true;
+        }
         return false;
     }
 }
-
-void CRtspSession::broadcastCurrentFrame(uint32_t curMsec) {
-    if (m_streaming && !m_stopped && m_Streamer) {
-        m_Streamer->streamImage(curMsec);
-    }
-}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "CStreamer.h"
+#include "CRtspFramer.h"
+#include "CRtspRequest.h"
+#include "rtsp_auth.h"
 #include "platglue.h"
 
 // supported command types
@@ -16,8 +19,7 @@ enum RTSP_CMD_TYPES
 };
 
 // Buffer sizes — tuned for ESP32 SRAM constraints.
-// RTSP requests are typically <500 bytes; 2KB is generous.
-#define RTSP_BUFFER_SIZE       2048
+// RTSP requests are typically <500 bytes; the framer holds 2KB (CRtspFramer.h).
 #define RTSP_PARAM_STRING_MAX  200
 #define MAX_HOSTNAME_LEN       256
 
@@ -36,37 +38,46 @@ public:
      */
     bool handleRequests(uint32_t readTimeoutMs);
 
-    /**
-       broadcast a current frame
-     */
-    void broadcastCurrentFrame(uint32_t curMsec);
-
     bool m_streaming;
     bool m_stopped;
 
 private:
     void Init();
     bool ParseRtspRequest(char const * aRequest, unsigned aRequestSize);
+    bool SessionMatches();
+    bool Authorized();
     char const * DateHeader();
+    void SendResponse();
 
     // RTSP request command handlers
     void Handle_RtspOPTION();
     void Handle_RtspDESCRIBE();
     void Handle_RtspSETUP();
     void Handle_RtspPLAY();
+    void Handle_RtspTEARDOWN();
     void Handle_RtspGET_PARAMETER();
+    void Handle_RtspError(char const * aStatus);
 
     // Session state
     int m_RtspSessionID;
+    char m_SessionId[12];                                     // m_RtspSessionID as sent (hex)
     SOCKET m_RtspClient;                                      // RTSP socket (WiFiClient*)
     int m_StreamID;                                           // stream index
     IPPORT m_ClientRTPPort;                                   // client RTP port (UDP)
     IPPORT m_ClientRTCPPort;                                  // client RTCP port (UDP)
     bool m_TcpTransport;                                      // true = RTP-over-TCP
+    uint8_t m_Interleaved[2];                                 // RTP/RTCP '$' channels (TCP)
+    bool m_Multicast;                                         // watching the group stream
+    bool m_HoldsTransport;                                    // SETUP claimed the streamer
     CStreamer * m_Streamer;                                    // media streamer
+    CRtspFramer m_Framer;                                     // partial/pipelined input
+    uint32_t m_LastActivityMs;                                // last request/RTCP from client
+    CRtspRequest m_Request;                                   // tokenized current request
+    RtspAuthState m_Auth;                                     // Digest nonce of this client
 
     // Last parsed RTSP request fields
     RTSP_CMD_TYPES m_RtspCmdType;
+    RtspTransport m_Transport;                                // SETUP Transport as requested
     char m_URLPreSuffix[RTSP_PARAM_STRING_MAX];
     char m_URLSuffix[RTSP_PARAM_STRING_MAX];
     char m_CSeq[RTSP_PARAM_STRING_MAX];
@@ -1,4 +1,5 @@
 #include "CStreamer.h"
+#include "metrics.h"
 
 #include <stdio.h>
 
@@ -14,27 +15,47 @@ CStreamer::CStreamer(SOCKET aClient, u_short width, u_short height) : m_Client(a
     m_Timestamp      = 0;
     m_SendIdx        = 0;
     m_TCPTransport   = false;
+    m_RtpChannel     = 0;
+    m_SendFailures   = 0;
+    m_SendStalls     = 0;
 
     m_RtpSocket = NULLSOCKET;
     m_RtcpSocket = NULLSOCKET;
+    m_McastSocket = NULLMCASTSOCKET;
+
+    m_Owner        = nullptr;
+    m_McastViewers = 0;
+    m_McastGroup   = 0;
+    m_McastPort    = 0;
 
     m_width = width;
     m_height = height;
-    m_prevMsec = 0;
+    m_TxLock = platmutexcreate();
 };
 
 CStreamer::~CStreamer()
 {
     udpsocketclose(m_RtpSocket);
     udpsocketclose(m_RtcpSocket);
+    mcastsocketclose(m_McastSocket);
+    platmutexdelete(m_TxLock);
 };
 
+void CStreamer::streamImage()
+{
+    StreamFrame frame;
+    if (!captureFrame(frame)) return;
+    sendFrame(frame);
+    releaseFrame(frame);
+}
+
 int CStreamer::SendRtpPacket(unsigned const char * jpeg, int jpegLen, int fragmentOffset, BufPtr quant0tbl, BufPtr quant1tbl)
 {
 #define KRtpHeaderSize 12           // size of the RTP header
 #define KJpegHeaderSize 8           // size of the special JPEG payload header
 
 #define MAX_FRAGMENT_SIZE 1280 // Safe MTU for WiFi (1500 - headers)
+    uint32_t packetizeStart = metrics_cycles();
     int fragmentLen = MAX_FRAGMENT_SIZE;
     if(fragmentLen + fragmentOffset > jpegLen) // Shrink last fragment if needed
         fragmentLen = jpegLen - fragmentOffset;
@@ -52,7 +73,7 @@ int CStreamer::SendRtpPacket(unsigned const char * jpeg, int jpegLen, int fragme
     memset(RtpBuf,0x00,sizeof(RtpBuf));
     // Prepare the first 4 byte of the packet. This is the Rtp over Rtsp header in case of TCP based transport
     RtpBuf[0]  = '$';        // magic number
-    RtpBuf[1]  = 0;          // number of multiplexed subchannel on RTPS connection - here the RTP channel
+    RtpBuf[1]  = m_RtpChannel; // number of multiplexed subchannel on RTPS connection - here the RTP channel
     RtpBuf[2]  = (RtpPacketSize & 0x0000FF00) >> 8;
     RtpBuf[3]  = (RtpPacketSize & 0x000000FF);
     // Prepare the 12 byte RTP header
@@ -109,25 +130,79 @@ int CStreamer::SendRtpPacket(unsigned const char * jpeg, int jpegLen, int fragme
     fragmentOffset += fragmentLen;
 
     m_SequenceNumber++;                              // prepare the packet counter for the next packet
+    metrics_record_cycles(MT_PACKETIZE, packetizeStart);
 
-    IPADDRESS otherip;
-    IPPORT otherport;
-    socketpeeraddr(m_Client, &otherip, &otherport);
-
-    // RTP marker bit must be set on last fragment
-    if (m_TCPTransport) // RTP over RTSP - we send the buffer + 4 byte additional header
-        socketsend(m_Client,RtpBuf,RtpPacketSize + 4);
-    else                // UDP - we send just the buffer by skipping the 4 byte RTP over RTSP header
-        udpsocketsend(m_RtpSocket,&RtpBuf[4],RtpPacketSize, otherip, m_RtpClientPort);
+    uint32_t sendStart = metrics_cycles();
+    sendRtp((const uint8_t *)RtpBuf, RtpPacketSize + 4);
+    metrics_record_cycles(MT_SOCKET_SEND, sendStart);
 
     return isLastFragment ? 0 : fragmentOffset;
 };
 
-void CStreamer::InitTransport(u_short aRtpPort, u_short aRtcpPort, bool TCP)
+void CStreamer::sendRtp(const uint8_t *buf, size_t len)
+{
+    if (m_McastViewers)      // once to the group, whoever is watching
+        mcastsocketsend(m_McastSocket, buf + 4, len - 4, m_McastGroup, m_McastPort);
+    else if (m_TCPTransport) // RTP over RTSP - we send the buffer + 4 byte additional header
+        sendTcp(buf, len);
+    else                     // UDP - we send just the buffer by skipping the 4 byte RTP over RTSP header
+    {
+        IPADDRESS otherip;
+        IPPORT otherport;
+        socketpeeraddr(m_Client, &otherip, &otherport);
+        udpsocketsend(m_RtpSocket, buf + 4, len - 4, otherip, m_RtpClientPort);
+    }
+}
+
+bool CStreamer::sendTcp(const void *buf, size_t len)
+{
+    // Don't keep blocking on a client already written off
+    if (transportFailed()) return false;
+
+    // A half-open connection still accepts writes until the send buffer is
+    // full, then every write blocks; treat slow writes like failed ones.
+    uint32_t start = platmillis();
+    lockTx();
+    bool ok = socketsend(m_Client, buf, len) == (ssize_t)len;
+    unlockTx();
+    ok = ok && platmillis() - start < RTSP_SEND_TIMEOUT_MS;
+    m_SendFailures = ok ? 0 : m_SendFailures + 1;
+    if (!ok) m_SendStalls++;
+    return ok;
+}
+
+bool CStreamer::pollRtcp()
+{
+    if (m_TCPTransport || !m_RtcpSocket) return false;
+
+    static uint8_t RtcpBuf[256];
+    bool Received = false;
+    while (udpsocketrecv(m_RtcpSocket, RtcpBuf, sizeof(RtcpBuf)) > 0)
+        Received = true;
+    return Received;
+}
+
+bool CStreamer::InitTransport(const void *owner, SOCKET client, u_short aRtpPort, u_short aRtcpPort, bool TCP,
+                              uint8_t rtpChannel)
 {
+    if (m_McastViewers || (m_Owner && m_Owner != owner))
+        return false;
+    m_Owner = owner;
+    m_Client = client;
+    m_SendFailures = 0;
+
     m_RtpClientPort  = aRtpPort;
     m_RtcpClientPort = aRtcpPort;
     m_TCPTransport   = TCP;
+    m_RtpChannel     = rtpChannel;
+
+    // The streamer outlives sessions; release the previous client's ports
+    if (m_RtpSocket)  udpsocketclose(m_RtpSocket);
+    if (m_RtcpSocket) udpsocketclose(m_RtcpSocket);
+    m_RtpSocket  = NULLSOCKET;
+    m_RtcpSocket = NULLSOCKET;
+    m_RtpServerPort  = 0;
+    m_RtcpServerPort = 0;
 
     if (!m_TCPTransport)
     {   // allocate port pairs for RTP/RTCP ports in UDP transport mode
@@ -151,8 +226,61 @@ void CStreamer::InitTransport(u_short aRtpPort, u_short aRtcpPort, bool TCP)
             }
         };
     };
+    return true;
 };
 
+bool CStreamer::JoinMulticast(const char *group, u_short port, uint8_t ttl)
+{
+    if (m_Owner)
+        return false;
+    if (m_McastViewers == 0)
+    {
+        uint32_t addr = inet_addr(group);
+        uint8_t first = ((const uint8_t *)&addr)[0];
+        if (first < 224 || first > 239)
+        {
+            printf("[ERROR] %s is not a multicast group\n", group);
+            return false;
+        }
+        m_McastSocket = mcastsocketcreate(ttl);
+        if (m_McastSocket == NULLMCASTSOCKET)
+            return false;
+        m_McastGroup = addr;
+        m_McastPort  = port;
+    }
+    m_McastViewers++;
+    return true;
+}
+
+void CStreamer::ReleaseTransport(const void *owner, bool multicast)
+{
+    if (multicast)
+    {
+        if (m_McastViewers && --m_McastViewers == 0)
+        {
+            mcastsocketclose(m_McastSocket);
+            m_McastSocket = NULLMCASTSOCKET;
+        }
+    }
+    else if (m_Owner == owner)
+    {
+        m_Owner = nullptr;
+        m_Client = NULLSOCKET;
+        if (m_RtpSocket)  udpsocketclose(m_RtpSocket);
+        if (m_RtcpSocket) udpsocketclose(m_RtcpSocket);
+        m_RtpSocket  = NULLSOCKET;
+        m_RtcpSocket = NULLSOCKET;
+        m_RtpServerPort  = 0;
+        m_RtcpServerPort = 0;
+    }
+}
+
+bool CStreamer::HeldByOthers(const void *owner, bool ownViewer) const
+{
+    if (m_Owner && m_Owner != owner) return true;
+    return m_McastViewers > (ownViewer ? 1 : 0);
+}
+
 u_short CStreamer::GetRtpServerPort()
 {
     return m_RtpServerPort;
@@ -164,19 +292,18 @@ u_short CStreamer::GetRtcpServerPort()
 };
 
 
-void CStreamer::streamFrame(unsigned const char *data, uint32_t dataLen, uint32_t curMsec)
+void CStreamer::streamFrame(unsigned const char *data, uint32_t dataLen, uint32_t rtpTimestamp)
 {
-    if(m_prevMsec == 0) // first frame init our timestamp
-        m_prevMsec = curMsec;
-
-    // compute deltat (being careful to handle clock rollover with a little lie)
-    uint32_t deltams = (curMsec >= m_prevMsec) ? curMsec - m_prevMsec : 100;
-    m_prevMsec = curMsec;
+    // Every fragment of the frame carries its capture instant
+    m_Timestamp = rtpTimestamp;
 
     // locate quant tables if possible
     BufPtr qtable0, qtable1;
 
-    if(!decodeJPEGfile(&data, &dataLen, &qtable0, &qtable1)) {
+    uint32_t parseStart = metrics_cycles();
+    bool decoded = decodeJPEGfile(&data, &dataLen, &qtable0, &qtable1);
+    metrics_record_cycles(MT_JPEG_PARSE, parseStart);
+    if(!decoded) {
         printf("can't decode jpeg data\n");
         return;
     }
@@ -192,10 +319,6 @@ void CStreamer::streamFrame(unsigned const char *data, uint32_t dataLen, uint32_
         delayMicroseconds(500); 
     } while(offset != 0);
 
-    // Increment ONLY after a full frame
-    uint32_t units = 90000; // Hz per RFC 2435
-    m_Timestamp += (units * deltams / 1000);                             // fixed timestamp increment for a frame rate of 25fps
-
     m_SendIdx++;
     if (m_SendIdx > 1) m_SendIdx = 0;
 };
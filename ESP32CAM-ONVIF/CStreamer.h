@@ -1,32 +1,132 @@
 #pragma once
 
 #include "platglue.h"
+#include "config.h"
+#include <sys/time.h>
 
 typedef unsigned const char *BufPtr;
 
+// One captured (for H.264: encoded) frame on its way from the capture stage
+// to the sender stage, see frame_pipeline.h
+struct StreamFrame
+{
+    const uint8_t *data;
+    uint32_t len;
+    uint16_t width;
+    uint16_t height;
+    uint64_t captureTimeUs; // sensor capture time (platmicros64), RTP timestamp source
+    uint32_t captureUs;     // pipeline latency accounting
+    void *owner;            // buffer to hand back in releaseFrame()
+};
+
 class CStreamer
 {
 public:
     CStreamer(SOCKET aClient, u_short width, u_short height);
     virtual ~CStreamer();
 
-    void    InitTransport(u_short aRtpPort, u_short aRtcpPort, bool TCP);
+    // The streamer feeds either one unicast client or the multicast group,
+    // which any number of sessions may watch at once.
+
+    // Unicast RTP to owner's client (UDP ports or interleaved on the RTSP
+    // connection, '$' channel rtpChannel); false while another session or
+    // multicast viewers hold it
+    bool    InitTransport(const void *owner, SOCKET client, u_short aRtpPort, u_short aRtcpPort, bool TCP,
+                          uint8_t rtpChannel = 0);
+
+    // One more viewer of the group stream; the first one opens the socket.
+    // False while a unicast session holds the streamer
+    bool    JoinMulticast(const char *group, u_short port, uint8_t ttl);
+
+    // Gives up owner's unicast transport, or one multicast viewer
+    void    ReleaseTransport(const void *owner, bool multicast);
+
+    // Whether sessions other than owner hold the unicast transport or watch
+    // the group (ownViewer: owner is one of the group's viewers)
+    bool    HeldByOthers(const void *owner, bool ownViewer) const;
+
     u_short GetRtpServerPort();
     u_short GetRtcpServerPort();
-    
-    // Updates the TCP client socket for RTP-over-RTSP
-    void setClientSocket(SOCKET client) { m_Client = client; }
 
-    virtual void    streamImage(uint32_t curMsec) = 0; // send a new image to the client
+    // Drains RTCP packets (receiver reports) from a UDP client; true if any
+    bool    pollRtcp();
+
+    // RTP-over-TCP writes kept failing or stalling: the client is gone
+    bool    transportFailed() const { return m_SendFailures >= RTSP_SEND_FAIL_LIMIT; }
+
+    // Failed or too slow TCP writes so far (rate controller input)
+    uint32_t sendStalls() const { return m_SendStalls; }
+
+    // Capture/encode stage: grabs the next frame; false if none was produced
+    virtual bool    captureFrame(StreamFrame &frame) = 0;
+
+    // Sender stage: packetizes one frame to the client
+    virtual void    sendFrame(const StreamFrame &frame) = 0;
+
+    // Hands the frame's buffer back once it was sent or dropped
+    virtual void    releaseFrame(StreamFrame &frame) { (void)frame; }
+
+    // Frames that may be captured and not yet released at the same time
+    virtual uint8_t maxFramesInFlight() const { return 1; }
+
+    // Whether a captured frame may be skipped without breaking the stream
+    // (true for JPEG; an H.264 P-frame depends on the one before)
+    virtual bool    framesDroppable() const { return true; }
+
+    // Capture, send and release in the caller's context
+    void    streamImage();
+
+    // 90 kHz media clock: RTP timestamp of a frame captured at captureTimeUs.
+    // A pure function of the monotonic capture clock, so send-side jitter never
+    // reaches the timestamps and the mapping holds for RTCP SR / other streams.
+    static uint32_t rtpTimestamp(uint64_t captureTimeUs) { return (uint32_t)(captureTimeUs * 9 / 100); }
+
+    // Sequence number the next RTP packet will carry (PLAY's RTP-Info)
+    virtual u_short nextRtpSequence() const { return m_SequenceNumber; }
+
+    // Serializes writes on the RTSP connection: RTSP replies from the control
+    // task must not land in the middle of an interleaved RTP packet
+    void    lockTx()   { platmutexlock(m_TxLock); }
+    void    unlockTx() { platmutexunlock(m_TxLock); }
 protected:
 
-    void    streamFrame(unsigned const char *data, uint32_t dataLen, uint32_t curMsec);
+    void    streamFrame(unsigned const char *data, uint32_t dataLen, uint32_t rtpTimestamp);
+
+    // camera_fb_t::timestamp (esp_timer based) as platmicros64; now if unset
+    static uint64_t frameTimeUs(const struct timeval &tv)
+    {
+        if (tv.tv_sec == 0 && tv.tv_usec == 0) return platmicros64();
+        return (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+    }
+
+    // One RTP packet to the current transport; buf starts with the 4-byte
+    // interleave header ('$', rtpChannel(), length), which UDP skips
+    void    sendRtp(const uint8_t *buf, size_t len);
+
+    // Interleaved channel the client asked for in SETUP
+    uint8_t rtpChannel() const { return m_RtpChannel; }
+
+    // RTP/JPEG headers carry the frame size; it changes with the active stream
+    void    setImageSize(u_short width, u_short height) { m_width = width; m_height = height; }
 
 private:
+    // Interleaved RTP on the RTSP connection; false if short or too slow
+    bool    sendTcp(const void *buf, size_t len);
+
     int    SendRtpPacket(unsigned const char *jpeg, int jpegLen, int fragmentOffset, BufPtr quant0tbl = NULL, BufPtr quant1tbl = NULL);// returns new fragmentOffset or 0 if finished with frame
 
+    bool   m_TCPTransport;       // RTP over the RTSP connection
+    uint8_t m_RtpChannel;        // its '$' channel
+    SOCKET m_Client;             // RTSP connection of the unicast owner
+
     UDPSOCKET m_RtpSocket;           // RTP socket for streaming RTP packets to client
     UDPSOCKET m_RtcpSocket;          // RTCP socket for sending/receiving RTCP packages
+    MCASTSOCKET m_McastSocket;       // group sender, open while viewers watch
+
+    const void *m_Owner;           // session holding the unicast transport
+    uint8_t  m_McastViewers;       // sessions watching the group
+    uint32_t m_McastGroup;         // network byte order
+    uint16_t m_McastPort;
 
     uint16_t m_RtpClientPort;      // RTP receiver port on client (in host byte order!)
     uint16_t m_RtcpClientPort;     // RTCP receiver port on client (in host byte order!)
@@ -36,9 +136,9 @@ private:
     u_short m_SequenceNumber;
     uint32_t m_Timestamp;
     int m_SendIdx;
-    bool m_TCPTransport;
-    SOCKET m_Client;
-    uint32_t m_prevMsec;
+    uint8_t m_SendFailures;      // consecutive failed/stalled TCP writes
+    uint32_t m_SendStalls;       // all failed/stalled TCP writes
+    PLATMUTEX m_TxLock;
 
     u_short m_width; // image data info
     u_short m_height;
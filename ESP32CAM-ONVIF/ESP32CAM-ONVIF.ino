@@ -23,6 +23,12 @@
 #include "auto_flash.h"
 #include "status_led.h"
 #include "mqtt_manager.h"
+#include "telegram_manager.h"
+#include "gdrive_manager.h"
+#include "metrics.h"
+#include "heap_monitor.h"
+#include "task_manifest.h"
+#include "cloud_outbox.h"
 #ifdef BLUETOOTH_ENABLED
   #include "bluetooth_manager.h"
 #endif
@@ -103,6 +109,7 @@ void setup() {
   #endif
   Serial.println("[INFO] WDT Enabled");
   printBanner();
+  metrics_init();
   
   // Initialize camera
   if (!camera_init()) fatalError("Camera init failed!");
@@ -149,12 +156,12 @@ void setup() {
   Serial.println("[INFO] System Ready.");
   Serial.printf("[INFO] Free Heap: %u bytes | PSRAM: %u bytes\n", ESP.getFreeHeap(), ESP.getFreePsram());
   
-  // --- Create FreeRTOS Tasks ---
-  xTaskCreatePinnedToCore(rtsp_stream_task, "RTSP_Task", 6144, NULL, 4, &rtspTaskHandle, 0);
-  xTaskCreatePinnedToCore(onvif_http_task, "ONVIF_HTTP_Task", 6144, NULL, 3, &onvifTaskHandle, 1);
-  xTaskCreatePinnedToCore(wifi_mgmt_task, "WiFi_Mgmt_Task", 4096, NULL, 6, &wifiTaskHandle, 1);
-  xTaskCreatePinnedToCore(watchdog_task, "WDT_Task", 2048, NULL, 7, &wdtTaskHandle, 1);
-  xTaskCreatePinnedToCore(low_prio_task, "Low_Prio_Task", 4096, NULL, 2, &lowPrioTaskHandle, 1);
+  // --- Create FreeRTOS Tasks (placement in task_manifest.cpp) ---
+  task_spawn(TASK_RTSP, rtsp_stream_task, &rtspTaskHandle);
+  task_spawn(TASK_ONVIF_HTTP, onvif_http_task, &onvifTaskHandle);
+  task_spawn(TASK_WIFI, wifi_mgmt_task, &wifiTaskHandle);
+  task_spawn(TASK_WDT, watchdog_task, &wdtTaskHandle);
+  task_spawn(TASK_LOW_PRIO, low_prio_task, &lowPrioTaskHandle);
   
   // MQTT is spawned dynamically by Watchdog Task to save RAM if disabled
 }
@@ -170,8 +177,10 @@ void rtsp_stream_task(void *pvParameters) {
     esp_task_wdt_add(NULL);
     while (1) {
         esp_task_wdt_reset();
+        uint32_t start = micros();
         rtsp_server_loop();   // Highest priority for streaming
-        vTaskDelay(pdMS_TO_TICKS(5)); // Small delay to prevent starving other tasks
+        task_busy_add(TASK_RTSP, micros() - start);
+        vTaskDelay(pdMS_TO_TICKS(task_placement(TASK_RTSP).periodMs)); // Small delay to prevent starving other tasks
     }
 }
 
@@ -179,9 +188,11 @@ void onvif_http_task(void *pvParameters) {
     esp_task_wdt_add(NULL);
     while (1) {
         esp_task_wdt_reset();
-        web_config_loop();    // Web UI
-        onvif_server_loop();  // Discovery/SOAP
-        vTaskDelay(pdMS_TO_TICKS(20)); // Web tasks can sleep a bit longer
+        uint32_t start = micros();
+        web_config_loop();    // Web UI bookkeeping
+        uint32_t busy = micros() - start;
+        busy += onvif_server_loop(20); // Web UI/API, SOAP, discovery; waits up to 20ms for traffic
+        task_busy_add(TASK_ONVIF_HTTP, busy);
     }
 }
 
@@ -189,8 +200,10 @@ void wifi_mgmt_task(void *pvParameters) {
     esp_task_wdt_add(NULL);
     while (1) {
         esp_task_wdt_reset();
+        uint32_t start = micros();
         wifiManager.loop();   // Connectivity checks
-        vTaskDelay(pdMS_TO_TICKS(100)); // Run every 100ms
+        task_busy_add(TASK_WIFI, micros() - start);
+        vTaskDelay(pdMS_TO_TICKS(task_placement(TASK_WIFI).periodMs)); // Run every 100ms
     }
 }
 
@@ -198,28 +211,32 @@ void watchdog_task(void *pvParameters) {
     esp_task_wdt_add(NULL);
     while (1) {
         esp_task_wdt_reset();
+        uint32_t start = micros();
         
-        // Memory Leak Audit
-        uint32_t free_heap = esp_get_free_heap_size();
-        uint32_t min_free = esp_get_minimum_free_heap_size();
+        // Fragmentation telemetry; sheds load step by step under memory
+        // pressure and restarts only as the last step (heap_monitor.h)
+        heap_monitor_sample();
         
-        if (free_heap < 20480) { // Under 20KB free heap
-            Serial.printf("[CRITICAL] Low Heap Memory! Free: %u. Forcing restart for stability.\n", free_heap);
-            esp_restart();
-        }
+        // Per-task CPU share for /api/tasks
+        task_stats_sample();
         
         // Dynamic Task Manager
         if (appSettings.mqttEnabled && mqttTaskHandle == NULL) {
             Serial.println("[INFO] Dynamic Task Manager: Spawning MQTT_Task");
-            xTaskCreatePinnedToCore(mqtt_task, "MQTT_Task", 4096, NULL, 2, &mqttTaskHandle, 1);
+            task_spawn(TASK_MQTT, mqtt_task, &mqttTaskHandle);
         }
+        // Motion snapshots to Telegram/Drive, journaled on SD (cloud_outbox.h)
+        cloud_outbox_start();
 
         // Stack HWM Logging (Optional, runs once every 30s)
         static uint32_t last_stack_log = 0;
         if (millis() - last_stack_log > 30000) {
             last_stack_log = millis();
-            Serial.printf("[INFO] Free heap: %u | Min free: %u | PSRAM free: %u\n",
-                free_heap, min_free, ESP.getFreePsram());
+            HeapStatus heap;
+            heap_monitor_status(&heap);
+            Serial.printf("[INFO] Free heap: %u | Largest block: %u (%u%% frag) | Min free: %u | PSRAM free: %u | Level: %s\n",
+                heap.internal.freeBytes, heap.internal.largestBlock, heap.internal.fragPct,
+                heap.internal.minFreeEver, heap.spiram.freeBytes, heap_level_str(heap.level));
             
             UBaseType_t hwm = uxTaskGetStackHighWaterMark(NULL);
             Serial.printf("[INFO] WDT_Task HWM: %u bytes\n", hwm * sizeof(StackType_t));
@@ -230,22 +247,37 @@ void watchdog_task(void *pvParameters) {
             if(mqttTaskHandle) { hwm = uxTaskGetStackHighWaterMark(mqttTaskHandle); Serial.printf("[INFO] MQTT_Task HWM: %u bytes\n", hwm * sizeof(StackType_t)); }
         }
         
-        vTaskDelay(pdMS_TO_TICKS(2000)); // Feed every 2s
+        task_busy_add(TASK_WDT, micros() - start);
+        vTaskDelay(pdMS_TO_TICKS(task_placement(TASK_WDT).periodMs)); // Feed every 2s
     }
 }
 
+#ifdef BLUETOOTH_ENABLED
+static void bluetooth_loop() { btManager.loop(); }
+#endif
+
+// Cooperative subtasks of Low_Prio_Task: name, run, period, deadline (ms).
+// Each must be done within its deadline of falling due; misses show up in
+// /api/tasks. The modules keep their own finer intervals (motion 1s,
+// auto-flash 2s, SD frames 500ms) - the period here is how often they're asked.
+static CoopSubtask lowPrioSubtasks[] = {
+    {"motion", motion_detection_loop, 100, 250},  // analytics: frame grab + luma
+    {"sd_recorder", sd_recorder_loop, 100, 250},
+    {"serial_console", serial_console_loop, 100, 1200}, // line read may wait 1s
+    {"auto_flash", auto_flash_loop, 500, 500},
+    {"status_led", status_led_loop, 100, 50},     // 100ms fast blink
+    #ifdef BLUETOOTH_ENABLED
+    {"bluetooth", bluetooth_loop, 100, 250},
+    #endif
+};
+
 void low_prio_task(void *pvParameters) {
     esp_task_wdt_add(NULL);
+    const uint32_t maxSleep = task_placement(TASK_LOW_PRIO).periodMs;
     while (1) {
         esp_task_wdt_reset();
-        motion_detection_loop();
-        sd_recorder_loop();
-        serial_console_loop();
-        auto_flash_loop();
-        status_led_loop();
-        #ifdef BLUETOOTH_ENABLED
-            btManager.loop();
-        #endif
-        vTaskDelay(pdMS_TO_TICKS(100)); // 100ms cycle
+        uint32_t wait = task_coop_run(TASK_LOW_PRIO, lowPrioSubtasks,
+                                      sizeof(lowPrioSubtasks) / sizeof(lowPrioSubtasks[0]));
+        vTaskDelay(pdMS_TO_TICKS(wait < 1 ? 1 : (wait > maxSleep ? maxSleep : wait)));
     }
 }
@@ -18,6 +18,7 @@
 #include <Arduino.h>
 #include "esp_camera.h"
 #include "h264_encoder.h"
+#include "metrics.h"
 
 // RTP Header size
 #define RTP_HEADER_SIZE 12
@@ -34,8 +35,9 @@
 #define NAL_TYPE_FU_A    28
 
 H264Streamer::H264Streamer() 
-    : CStreamer(NULL, 640, 480), 
+    : CStreamer(NULLSOCKET, 640, 480), 
       m_initialized(false),
+      m_rtpSequence(0),
       m_spsSize(0),
       m_ppsSize(0),
       m_spsPpsValid(false) {
@@ -51,15 +53,16 @@ H264Streamer::~H264Streamer() {
     }
 }
 
-bool H264Streamer::init(uint16_t width, uint16_t height) {
+bool H264Streamer::init(uint16_t width, uint16_t height, uint8_t fps,
+                        uint32_t bitrate, uint8_t gop) {
     Serial.printf("[INFO] H264Streamer: Initializing %dx%d\n", width, height);
     
     // Configure encoder
     m_config.width = width;
     m_config.height = height;
-    m_config.fps = H264_FPS;
-    m_config.bitrate = H264_BITRATE;
-    m_config.gop = H264_GOP;
+    m_config.fps = fps;
+    m_config.bitrate = bitrate;
+    m_config.gop = gop;
     m_config.qp_min = H264_QP_MIN;
     m_config.qp_max = H264_QP_MAX;
     
@@ -87,23 +90,29 @@ bool H264Streamer::init(uint16_t width, uint16_t height) {
     return true;
 }
 
-void H264Streamer::streamImage(uint32_t curMsec) {
+bool H264Streamer::captureFrame(StreamFrame &frame) {
     if (!m_initialized) {
         Serial.println("[ERROR] H264Streamer: Not initialized");
-        return;
+        return false;
     }
     
     // Get camera frame
+    uint32_t t0 = metrics_cycles();
     camera_fb_t *fb = esp_camera_fb_get();
+    metrics_record_cycles(MT_FB_RTSP, t0);
     if (!fb) {
         Serial.println("[ERROR] H264Streamer: Failed to get camera frame");
-        return;
+        return false;
     }
     
+    // Stamp with the sensor capture time, not the (variable) encode time
+    uint64_t captureTimeUs = frameTimeUs(fb->timestamp);
+
     h264_frame_t encoded_frame;
     h264_status_t status;
     
     // Check frame format
+    t0 = metrics_cycles();
     if (fb->format == PIXFORMAT_JPEG) {
         // Need to decode JPEG first - not ideal for performance
         // For best H.264 performance, configure camera for YUV output
@@ -112,6 +121,7 @@ void H264Streamer::streamImage(uint32_t curMsec) {
         // Raw YUV - direct encoding (preferred)
         status = h264_encoder_encode(fb->buf, fb->len, &encoded_frame);
     }
+    metrics_record_cycles(MT_H264_ENCODE, t0);
     
     esp_camera_fb_return(fb);
     
@@ -119,44 +129,47 @@ void H264Streamer::streamImage(uint32_t curMsec) {
         if (status != H264_ERR_NOT_SUPPORTED) {
             Serial.printf("[ERROR] H264Streamer: Encoding failed (status=%d)\n", status);
         }
-        return;
+        return false;
     }
     
     // Extract SPS/PPS if this is an IDR frame
     if (encoded_frame.contains_sps_pps) {
         extractSPSPPS(encoded_frame.data, encoded_frame.size);
     }
-    
-    // Calculate RTP timestamp (90kHz clock)
-    static uint32_t lastMsec = 0;
-    static uint32_t rtpTimestamp = 0;
-    
-    if (lastMsec == 0) {
-        lastMsec = curMsec;
-    }
-    
-    uint32_t deltaMsec = curMsec - lastMsec;
-    rtpTimestamp += (deltaMsec * 90); // 90kHz = 90 ticks per ms
-    lastMsec = curMsec;
+
+    frame.data = encoded_frame.data;
+    frame.len = encoded_frame.size;
+    frame.width = m_config.width;
+    frame.height = m_config.height;
+    frame.captureTimeUs = captureTimeUs;
+    frame.owner = nullptr;
+    return true;
+}
+
+void H264Streamer::sendFrame(const StreamFrame &frame) {
+    const uint8_t *data = frame.data;
+    size_t size = frame.len;
+    // All NAL units of the access unit share its capture timestamp (90kHz)
+    uint32_t timestamp = rtpTimestamp(frame.captureTimeUs);
     
     // Parse and send NAL units
     size_t offset = 0;
-    while (offset < encoded_frame.size) {
+    while (offset < size) {
         // Find NAL unit start code (0x00 0x00 0x00 0x01 or 0x00 0x00 0x01)
-        int nalStart = findNextNALUnit(encoded_frame.data, encoded_frame.size, offset);
+        int nalStart = findNextNALUnit(data, size, offset);
         if (nalStart < 0) break;
         
         // Find end of this NAL unit (start of next, or end of buffer)
-        int nalEnd = findNextNALUnit(encoded_frame.data, encoded_frame.size, nalStart + 4);
+        int nalEnd = findNextNALUnit(data, size, nalStart + 4);
         if (nalEnd < 0) {
-            nalEnd = encoded_frame.size;
+            nalEnd = size;
         }
         
         size_t nalSize = nalEnd - nalStart;
-        bool isLast = (nalEnd >= (int)encoded_frame.size);
+        bool isLast = (nalEnd >= (int)size);
         
         // Send the NAL unit
-        sendNALUnit(encoded_frame.data + nalStart, nalSize, isLast, rtpTimestamp);
+        sendNALUnit(data + nalStart, nalSize, isLast, timestamp);
         
         offset = nalEnd;
     }
@@ -238,13 +251,13 @@ void H264Streamer::sendNALUnit(const uint8_t* nalData, size_t nalSize, bool isLa
 void H264Streamer::sendH264RtpPacket(const uint8_t* data, size_t size, bool marker, uint32_t timestamp) {
     // Buffer for RTP packet (interleaved header + RTP header + payload)
     static uint8_t rtpBuf[1600];
-    static uint16_t sequenceNumber = 0;
+    uint32_t packetizeStart = metrics_cycles();
     
     size_t rtpPacketSize = RTP_HEADER_SIZE + size;
     
     // RTP-over-RTSP interleaved header (4 bytes)
     rtpBuf[0] = '$';        // Magic
-    rtpBuf[1] = 0;          // Channel (RTP)
+    rtpBuf[1] = rtpChannel(); // Channel (RTP)
     rtpBuf[2] = (rtpPacketSize >> 8) & 0xFF;
     rtpBuf[3] = rtpPacketSize & 0xFF;
     
@@ -254,9 +267,9 @@ void H264Streamer::sendH264RtpPacket(const uint8_t* data, size_t size, bool mark
     if (marker) rtpBuf[5] |= 0x80;  // Marker bit
     
     // Sequence number (big endian)
-    rtpBuf[6] = (sequenceNumber >> 8) & 0xFF;
-    rtpBuf[7] = sequenceNumber & 0xFF;
-    sequenceNumber++;
+    rtpBuf[6] = (m_rtpSequence >> 8) & 0xFF;
+    rtpBuf[7] = m_rtpSequence & 0xFF;
+    m_rtpSequence++;
     
     // Timestamp (big endian)
     rtpBuf[8]  = (timestamp >> 24) & 0xFF;
@@ -272,12 +285,12 @@ void H264Streamer::sendH264RtpPacket(const uint8_t* data, size_t size, bool mark
     
     // Copy payload
     memcpy(rtpBuf + 4 + RTP_HEADER_SIZE, data, size);
+    metrics_record_cycles(MT_PACKETIZE, packetizeStart);
     
-    // Send via TCP (RTP-over-RTSP)
-    if (m_TCPTransport && m_Client) {
-        socketsend(m_Client, (char*)rtpBuf, rtpPacketSize + 4);
-    }
-    // Note: UDP path would need additional implementation
+    // Interleaved TCP, unicast UDP or the multicast group
+    uint32_t sendStart = metrics_cycles();
+    sendRtp(rtpBuf, rtpPacketSize + 4);
+    metrics_record_cycles(MT_SOCKET_SEND, sendStart);
 }
 
 void H264Streamer::extractSPSPPS(const uint8_t* data, size_t size) {
@@ -18,11 +18,24 @@ public:
     H264Streamer();
     virtual ~H264Streamer();
     
-    // Initialize the H.264 encoder with default settings
-    bool init(uint16_t width = 640, uint16_t height = 480);
+    // Initialize (or re-initialize) the H.264 encoder
+    bool init(uint16_t width = 640, uint16_t height = 480,
+              uint8_t fps = H264_FPS, uint32_t bitrate = H264_BITRATE,
+              uint8_t gop = H264_GOP);
+
+    // Current encoder settings (after SW resolution clamping)
+    const h264_encoder_config_t &config() const { return m_config; }
     
-    // Stream a new frame (overrides base class)
-    virtual void streamImage(uint32_t curMsec) override;
+    // Capture + encode stage; the encoded frame stays in the encoder's
+    // output buffer, so only one may be in flight
+    virtual bool captureFrame(StreamFrame &frame) override;
+
+    // Packetizes the encoded frame as RFC 6184 NAL units / FU-A fragments
+    virtual void sendFrame(const StreamFrame &frame) override;
+
+    virtual bool framesDroppable() const override { return false; }
+
+    virtual u_short nextRtpSequence() const override { return m_rtpSequence; }
     
     // Get SPS for SDP generation
     bool getSPS(uint8_t* buffer, size_t* size);
@@ -46,8 +59,12 @@ private:
     // Parse NAL units from encoded frame
     int findNextNALUnit(const uint8_t* data, size_t size, size_t offset);
     
+    // Cache SPS/PPS from an IDR access unit for SDP
+    void extractSPSPPS(const uint8_t* data, size_t size);
+    
     bool m_initialized;
     h264_encoder_config_t m_config;
+    uint16_t m_rtpSequence; // per stream, so each client sees a gapless sequence
     
     // SPS/PPS cache for SDP
     uint8_t m_sps[64];
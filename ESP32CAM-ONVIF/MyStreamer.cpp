@@ -1,26 +1,50 @@
 // MyStreamer.cpp
 #include "MyStreamer.h"
+#include "metrics.h"
 
-// The `resolution` array is a standard part of the esp32-camera driver component.
-// It maps the framesize enum to width and height.
-extern "C" {
-    #include "ll_cam.h"
-}
+// The `resolution` array (framesize_t -> width/height) is declared by the
+// esp32-camera driver's sensor.h, which esp_camera.h includes.
 
-MyStreamer::MyStreamer() : CStreamer(NULL, resolution[esp_camera_sensor_get()->status.framesize].width, resolution[esp_camera_sensor_get()->status.framesize].height) {
+MyStreamer::MyStreamer() : CStreamer(NULLSOCKET, resolution[esp_camera_sensor_get()->status.framesize].width, resolution[esp_camera_sensor_get()->status.framesize].height) {
     // The CStreamer base class constructor needs the image width and height.
     // We get it from the currently configured camera sensor.
 }
 
-void MyStreamer::streamImage(uint32_t curMsec) {
+bool MyStreamer::captureFrame(StreamFrame &frame) {
+    uint32_t t0 = metrics_cycles();
     camera_fb_t *fb = esp_camera_fb_get();
+    metrics_record_cycles(MT_FB_RTSP, t0);
     if (!fb) {
         Serial.println("Camera frame buffer could not be acquired");
-        return;
+        return false;
     }
-    
-    if (fb->format == PIXFORMAT_JPEG && fb->len > 0) {
-        streamFrame(fb->buf, fb->len, curMsec);
+    if (fb->format != PIXFORMAT_JPEG || fb->len == 0) {
+        esp_camera_fb_return(fb);
+        return false;
     }
-    esp_camera_fb_return(fb);
+
+    // The JPEG goes out straight from the driver's buffer
+    frame.data = fb->buf;
+    frame.len = fb->len;
+    frame.width = fb->width;
+    frame.height = fb->height;
+    frame.captureTimeUs = frameTimeUs(fb->timestamp);
+    frame.owner = fb;
+    return true;
+}
+
+void MyStreamer::sendFrame(const StreamFrame &frame) {
+    setImageSize(frame.width, frame.height);
+    streamFrame(frame.data, frame.len, rtpTimestamp(frame.captureTimeUs));
+}
+
+void MyStreamer::releaseFrame(StreamFrame &frame) {
+    if (frame.owner) esp_camera_fb_return((camera_fb_t *)frame.owner);
+    frame.owner = nullptr;
+}
+
+uint8_t MyStreamer::maxFramesInFlight() const {
+    // One frame on the wire while the next is captured needs both camera
+    // frame buffers; camera_init() only allocates two with PSRAM
+    return psramFound() ? 2 : 1;
 }
@@ -7,5 +7,8 @@ class MyStreamer : public CStreamer {
 public:
     MyStreamer();
     virtual ~MyStreamer() {}
-    virtual void streamImage(uint32_t curMsec) override;
+    virtual bool captureFrame(StreamFrame &frame) override;
+    virtual void sendFrame(const StreamFrame &frame) override;
+    virtual void releaseFrame(StreamFrame &frame) override;
+    virtual uint8_t maxFramesInFlight() const override;
 };
@@ -4,11 +4,8 @@
 #include "esp_camera.h"
 #include "config.h"
 #include "board_config.h"
-#if PTZ_ENABLED
-#include <ESP32Servo.h>
-Servo servoPan;   // Match names used in web_config.cpp
-Servo servoTilt;  // Match names used in web_config.cpp
-#endif
+#include "media_config.h"
+#include "ptz_control.h"
 
 bool camera_init() {
   camera_config_t config;
@@ -66,6 +63,9 @@ bool camera_init() {
       s->set_hmirror(s, 0);
       s->set_vflip(s, 0);
   }
+
+  // Main stream frame size/quality (ONVIF encoder configuration)
+  media_config_init();
   
   if (FLASH_LED_ENABLED) {
     init_flash_led();
@@ -90,39 +90,3 @@ void set_flash_led(bool on) {
     digitalWrite(FLASH_LED_PIN, state);
 }
 
-#if PTZ_ENABLED
-void ptz_init() {
-    // Basic Servo init
-    servoPan.setPeriodHertz(50); 
-    servoPan.attach(SERVO_PAN_PIN, 500, 2400);
-    servoTilt.setPeriodHertz(50);
-    servoTilt.attach(SERVO_TILT_PIN, 500, 2400);
-    
-    // Center alignment
-    servoPan.write(90);
-    servoTilt.write(90);
-    Serial.println("[INFO] PTZ Servos initialized.");
-}
-
-// x, y are -1.0 to 1.0 (ONVIF standard usually) or 0.0 to 1.0
-// We'll assume input 0.0 to 1.0 for absolute move
-void ptz_set_absolute(float x, float y) {
-    int panAngle = (int)(x * 180.0f);
-    int tiltAngle = (int)(y * 180.0f);
-    
-    // Constrain
-    if (panAngle < 0) panAngle = 0; if (panAngle > 180) panAngle = 180;
-    if (tiltAngle < 0) tiltAngle = 0; if (tiltAngle > 180) tiltAngle = 180;
-    
-    servoPan.write(panAngle);
-    servoTilt.write(tiltAngle);
-}
-
-// Simple step move for continuous simulation
-void ptz_move(float x_speed, float y_speed) {
-    // Read current? Servo libs don't usually read back position easily.
-    // We'll skip continuous move logic for now and stick to Absolute or Presets
-    // since we don't track state well without a wrapper class.
-}
-#endif
-
@@ -0,0 +1,515 @@
+#include "cloud_outbox.h"
+#include "config.h"
+#include "event_queue.h"
+#include "gdrive_manager.h"
+#include "https_client.h"
+#include "sd_recorder.h"
+#include "task_manifest.h"
+#include "telegram_manager.h"
+#include <Arduino.h>
+#include <FS.h>
+#include <SD_MMC.h>
+#include <WiFi.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define JOURNAL_PATH OUTBOX_DIR "/journal.bin"
+#define JOURNAL_TMP_PATH OUTBOX_DIR "/journal.tmp"
+#define RECORD_MAGIC 0x3158424Fu // "OBX1"
+
+static_assert(OUTBOX_BATCH_MAX >= 1 && OUTBOX_BATCH_MAX <= TELEGRAM_MEDIA_GROUP_MAX,
+              "sendMediaGroup takes up to 10 photos");
+
+enum OutboxDest : uint8_t { DEST_TELEGRAM = 0, DEST_GDRIVE, DEST_COUNT };
+#define DEST_BIT(d) (1u << (d))
+
+enum RecordOp : uint8_t { OP_ADD = 1, OP_DONE = 2 };
+
+// On-card journal record. ADD carries the destinations wanted, DONE the
+// ones delivered (or given up on) since.
+struct JournalRecord {
+  uint32_t magic;
+  uint8_t op;
+  uint8_t dests;
+  uint16_t reserved;
+  uint32_t id;    // names OUTBOX_DIR/<id>.jpg
+  uint32_t utc;   // event wall clock, 0 before time sync
+  uint32_t len;   // JPEG size
+  uint32_t check; // FNV-1a of the fields above
+};
+
+struct OutboxEntry {
+  uint32_t id;
+  uint32_t utc;
+  uint32_t len;
+  uint8_t pending; // DEST_BIT()s not delivered yet
+};
+
+struct DestState {
+  const char *name;
+  uint32_t backoffMs; // 0: not failing
+  uint32_t retryAtMs;
+  uint8_t batch; // photos per request; 1 while finding a rejected photo
+};
+
+static OutboxEntry s_entries[OUTBOX_MAX_PENDING]; // oldest first
+static size_t s_count = 0;
+static uint32_t s_nextId = 1;
+static bool s_durable = false;
+static uint32_t s_delivered = 0;
+static uint32_t s_dropped = 0;
+static size_t s_journalBytes = 0; // kept here, not asked of the card
+static DestState s_dests[DEST_COUNT] = {
+    {"Telegram", 0, 0, OUTBOX_BATCH_MAX},
+    {"Drive", 0, 0, 1},
+};
+static TaskHandle_t s_task = NULL;
+
+static uint32_t record_check(const JournalRecord &r) {
+  const uint8_t *p = (const uint8_t *)&r;
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < offsetof(JournalRecord, check); i++)
+    h = (h ^ p[i]) * 16777619u;
+  return h;
+}
+
+static bool record_write(File &f, RecordOp op, const OutboxEntry &e,
+                         uint8_t dests) {
+  JournalRecord r = {};
+  r.magic = RECORD_MAGIC;
+  r.op = op;
+  r.dests = dests;
+  r.id = e.id;
+  r.utc = e.utc;
+  r.len = e.len;
+  r.check = record_check(r);
+  return f.write((const uint8_t *)&r, sizeof(r)) == sizeof(r);
+}
+
+static bool journal_write(RecordOp op, const OutboxEntry &e, uint8_t dests) {
+  File f = SD_MMC.open(JOURNAL_PATH, FILE_APPEND);
+  if (!f)
+    return false;
+  bool ok = record_write(f, op, e, dests);
+  f.close(); // commits the new length to the FAT
+  if (ok)
+    s_journalBytes += sizeof(JournalRecord);
+  return ok;
+}
+
+// Rewrites the journal as one ADD per pending entry. The old journal is
+// only removed once the new one is complete; outbox_load() finishes an
+// interrupted rename.
+static void journal_compact() {
+  File f = SD_MMC.open(JOURNAL_TMP_PATH, FILE_WRITE);
+  if (!f)
+    return;
+  bool ok = true;
+  for (size_t i = 0; i < s_count && ok; i++)
+    ok = record_write(f, OP_ADD, s_entries[i], s_entries[i].pending);
+  f.close();
+  if (!ok) {
+    SD_MMC.remove(JOURNAL_TMP_PATH);
+    return;
+  }
+  SD_MMC.remove(JOURNAL_PATH);
+  SD_MMC.rename(JOURNAL_TMP_PATH, JOURNAL_PATH);
+  s_journalBytes = s_count * sizeof(JournalRecord);
+}
+
+// Drops a journal nothing is pending in, and compacts one grown past
+// OUTBOX_COMPACT_BYTES. Works from s_journalBytes: only a write changes
+// anything, and the card isn't touched otherwise.
+static void journal_maintain() {
+  if (!s_count) {
+    if (s_journalBytes) {
+      SD_MMC.remove(JOURNAL_PATH);
+      s_journalBytes = 0;
+    }
+    return;
+  }
+  if (s_journalBytes > OUTBOX_COMPACT_BYTES)
+    journal_compact();
+}
+
+static void jpeg_path(char *buf, size_t size, uint32_t id) {
+  snprintf(buf, size, OUTBOX_DIR "/%08lx.jpg", (unsigned long)id);
+}
+
+// Marks dests of entry i finished (delivered or given up) and forgets the
+// entry once nothing is left. True when the entry was removed.
+static bool entry_finish(size_t i, uint8_t dests) {
+  OutboxEntry &e = s_entries[i];
+  dests &= e.pending;
+  if (!dests)
+    return false;
+  if (!journal_write(OP_DONE, e, dests))
+    Serial.println("[OUTBOX] Journal write failed; may deliver twice after reboot.");
+  e.pending &= ~dests;
+  if (e.pending)
+    return false;
+  char path[32];
+  jpeg_path(path, sizeof(path), e.id);
+  SD_MMC.remove(path);
+  memmove(&s_entries[i], &s_entries[i + 1],
+          (s_count - i - 1) * sizeof(OutboxEntry));
+  s_count--;
+  return true;
+}
+
+static bool entry_known(uint32_t id) {
+  for (size_t i = 0; i < s_count; i++)
+    if (s_entries[i].id == id)
+      return true;
+  return false;
+}
+
+// Removes snapshot files no pending entry refers to: a power cut between
+// writing the JPEG and its ADD record, or an entry dropped at replay
+static void sweep_orphans() {
+  File dir = SD_MMC.open(OUTBOX_DIR);
+  if (!dir)
+    return;
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    const char *name = strrchr(f.name(), '/');
+    name = name ? name + 1 : f.name();
+    char *end;
+    uint32_t id = strtoul(name, &end, 16);
+    bool orphan = end != name && !strcmp(end, ".jpg") && !entry_known(id);
+    f.close();
+    if (orphan)
+      SD_MMC.remove(String(OUTBOX_DIR "/") + name);
+  }
+  dir.close();
+}
+
+// Replays the journal into s_entries
+static void outbox_load() {
+  if (!SD_MMC.exists(OUTBOX_DIR))
+    SD_MMC.mkdir(OUTBOX_DIR);
+  if (SD_MMC.exists(JOURNAL_TMP_PATH)) {
+    if (SD_MMC.exists(JOURNAL_PATH))
+      SD_MMC.remove(JOURNAL_TMP_PATH); // compaction didn't complete
+    else
+      SD_MMC.rename(JOURNAL_TMP_PATH, JOURNAL_PATH); // only its rename didn't
+  }
+
+  s_count = 0;
+  size_t records = 0;
+  bool torn = false;
+  File f = SD_MMC.open(JOURNAL_PATH, FILE_READ);
+  if (f) {
+    JournalRecord r;
+    size_t size = f.size();
+    while (f.read((uint8_t *)&r, sizeof(r)) == sizeof(r)) {
+      if (r.magic != RECORD_MAGIC || r.check != record_check(r))
+        break;
+      records++;
+      if (r.id >= s_nextId)
+        s_nextId = r.id + 1;
+      if (r.op == OP_ADD) {
+        if (s_count == OUTBOX_MAX_PENDING) {
+          memmove(&s_entries[0], &s_entries[1],
+                  (s_count - 1) * sizeof(OutboxEntry));
+          s_count--;
+          s_dropped++;
+        }
+        s_entries[s_count++] = {r.id, r.utc, r.len, r.dests};
+      } else {
+        for (size_t i = 0; i < s_count; i++)
+          if (s_entries[i].id == r.id)
+            s_entries[i].pending &= ~r.dests;
+      }
+    }
+    torn = records * sizeof(JournalRecord) != size;
+    s_journalBytes = size;
+    f.close();
+  }
+  if (torn)
+    Serial.println("[OUTBOX] Journal ends in a torn record; recovered up to it.");
+
+  size_t kept = 0;
+  for (size_t i = 0; i < s_count; i++)
+    if (s_entries[i].pending)
+      s_entries[kept++] = s_entries[i];
+  s_count = kept;
+
+  if (!s_count)
+    journal_maintain();
+  else if (torn || records != s_count)
+    journal_compact();
+  sweep_orphans();
+}
+
+static uint8_t wanted_dests() {
+  return (telegram_is_configured() ? DEST_BIT(DEST_TELEGRAM) : 0) |
+         (gDriveMotionUploads() ? DEST_BIT(DEST_GDRIVE) : 0);
+}
+
+static bool dest_ready(OutboxDest dest) {
+  return dest == DEST_TELEGRAM ? telegram_is_configured() : gDriveMotionUploads();
+}
+
+static bool delivered(OutboxDest dest, int status) {
+  return dest == DEST_TELEGRAM ? status == 200 : status >= 200 && status < 400;
+}
+
+// The request itself was refused (bad or oversized photo), or didn't fit
+// the multipart buffers here: retrying it as is can't succeed
+static bool rejected(int status) {
+  return status == 400 || status == 413 || status == HTTPS_BODY_TOO_LARGE;
+}
+
+static void caption_for(char *buf, size_t size, uint32_t utc) {
+  time_t t = utc;
+  struct tm tm;
+  if (utc && localtime_r(&t, &tm))
+    strftime(buf, size, "Motion %Y-%m-%d %H:%M:%S", &tm);
+  else
+    snprintf(buf, size, "Motion");
+}
+
+// Without the journal (no card, or it failed): one attempt per destination
+static void deliver_direct(const uint8_t *jpeg, size_t len, uint32_t utc,
+                           uint8_t dests) {
+  char caption[32];
+  caption_for(caption, sizeof(caption), utc);
+  const char *cap = caption;
+  for (int d = 0; d < DEST_COUNT; d++) {
+    if (!(dests & DEST_BIT(d)))
+      continue;
+    int status = d == DEST_TELEGRAM ? telegram_send_media(&jpeg, &len, &cap, 1)
+                                    : gDriveUploadJpeg(jpeg, len);
+    if (delivered((OutboxDest)d, status))
+      s_delivered++;
+    else
+      s_dropped++;
+  }
+}
+
+static void outbox_add(const CamEvent &ev, const uint8_t *jpeg, size_t len,
+                       uint8_t dests) {
+  if (s_count == OUTBOX_MAX_PENDING) {
+    Serial.println("[OUTBOX] Full, dropping the oldest snapshot.");
+    entry_finish(0, s_entries[0].pending);
+    s_dropped++;
+  }
+  OutboxEntry e = {s_nextId++, (uint32_t)ev.utc, (uint32_t)len, dests};
+  char path[32];
+  jpeg_path(path, sizeof(path), e.id);
+  File f = SD_MMC.open(path, FILE_WRITE);
+  bool ok = f && f.write(jpeg, len) == len;
+  if (f)
+    f.close();
+  // The JPEG is complete before any record refers to it
+  if (ok)
+    ok = journal_write(OP_ADD, e, dests);
+  if (!ok) {
+    SD_MMC.remove(path);
+    Serial.println("[OUTBOX] SD write failed, sending without the journal.");
+    deliver_direct(jpeg, len, e.utc, dests);
+    return;
+  }
+  s_entries[s_count++] = e;
+}
+
+// True when the entry's JPEG is on the card at full length, its name in
+// path. Uploads read it from there as they send: a batch never needs its
+// photos in memory.
+static bool entry_check(const OutboxEntry &e, char *path, size_t size) {
+  jpeg_path(path, size, e.id);
+  File f = SD_MMC.open(path, FILE_READ);
+  if (!f)
+    return false;
+  bool ok = f.size() == e.len;
+  f.close();
+  return ok;
+}
+
+static void dest_failed(DestState &d, int status) {
+  d.backoffMs = d.backoffMs ? d.backoffMs * 2 : OUTBOX_BACKOFF_MIN_MS;
+  if (d.backoffMs > OUTBOX_BACKOFF_MAX_MS)
+    d.backoffMs = OUTBOX_BACKOFF_MAX_MS;
+  // Jitter, so cameras sharing an uplink don't retry in step
+  d.retryAtMs = millis() + d.backoffMs + random(d.backoffMs / 4 + 1);
+  Serial.printf("[OUTBOX] %s delivery failed (HTTP %d), retry in %us\n", d.name,
+                status, (unsigned)(d.backoffMs / 1000));
+}
+
+// Sends the oldest entries pending for dest in one request. False when
+// there was nothing to send or it isn't due yet.
+static bool drain_dest(OutboxDest dest) {
+  DestState &d = s_dests[dest];
+  if (d.backoffMs && (int32_t)(millis() - d.retryAtMs) < 0)
+    return false;
+  bool ready = dest_ready(dest);
+
+  size_t idx[OUTBOX_BATCH_MAX];
+  char paths[OUTBOX_BATCH_MAX][32];
+  const char *files[OUTBOX_BATCH_MAX];
+  size_t lens[OUTBOX_BATCH_MAX];
+  char captions[OUTBOX_BATCH_MAX][TELEGRAM_CAPTION_MAX];
+  const char *caps[OUTBOX_BATCH_MAX];
+  size_t n = 0;
+  size_t batch = dest == DEST_TELEGRAM ? d.batch : 1;
+  for (size_t i = 0; i < s_count && n < batch;) {
+    OutboxEntry &e = s_entries[i];
+    if (!(e.pending & DEST_BIT(dest))) {
+      i++;
+      continue;
+    }
+    if (!ready) {
+      // Disabled since the snapshot was taken
+      if (!entry_finish(i, DEST_BIT(dest)))
+        i++;
+      continue;
+    }
+    if (!entry_check(e, paths[n], sizeof(paths[n]))) {
+      Serial.printf("[OUTBOX] Snapshot %lu unreadable, dropped\n",
+                    (unsigned long)e.id);
+      s_dropped++;
+      entry_finish(i, e.pending); // removes it: i is the next entry now
+      continue;
+    }
+    idx[n] = i;
+    files[n] = paths[n];
+    lens[n] = e.len;
+    caption_for(captions[n], sizeof(captions[n]), e.utc);
+    caps[n] = captions[n];
+    n++;
+    i++;
+  }
+  if (!n)
+    return false;
+
+  int status = dest == DEST_TELEGRAM
+                   ? telegram_send_files(SD_MMC, files, lens, caps, n)
+                   : gDriveUploadFile(SD_MMC, files[0], lens[0]);
+
+  if (delivered(dest, status)) {
+    // Back to front: removing an entry moves the ones after it
+    for (size_t k = n; k-- > 0;)
+      entry_finish(idx[k], DEST_BIT(dest));
+    s_delivered += n;
+    d.backoffMs = 0;
+    d.batch = OUTBOX_BATCH_MAX;
+  } else if (rejected(status) && n > 1) {
+    d.batch = 1; // one at a time finds the photo it objects to
+  } else if (rejected(status)) {
+    Serial.printf("[OUTBOX] %s rejected snapshot %lu (HTTP %d), dropped\n",
+                  d.name, (unsigned long)s_entries[idx[0]].id, status);
+    entry_finish(idx[0], DEST_BIT(dest));
+    s_dropped++;
+  } else {
+    dest_failed(d, status);
+  }
+  return true;
+}
+
+// One request per destination at most, so new snapshots are journaled in
+// between
+static bool outbox_drain() {
+  if (!s_count || WiFi.status() != WL_CONNECTED)
+    return false;
+  bool worked = false;
+  for (int d = 0; d < DEST_COUNT; d++)
+    worked |= drain_dest((OutboxDest)d);
+  journal_maintain();
+  return worked;
+}
+
+static bool outbox_wanted() {
+  return telegram_is_configured() || gDriveMotionUploads();
+}
+
+static void cloud_outbox_task(void *) {
+  s_durable = sd_recorder_is_mounted();
+  if (s_durable) {
+    outbox_load();
+    Serial.printf("[OUTBOX] Journal on SD, %u snapshot(s) pending\n",
+                  (unsigned)s_count);
+  } else {
+    Serial.println("[OUTBOX] No SD card: snapshots are sent once, not kept.");
+  }
+
+  EventSubscriber motion;
+  EventSubscriber wifi;
+  event_subscribe(&motion, EVENT_MASK(EVENT_MOTION), EVENT_POLICY_ALL, true);
+  event_subscribe(&wifi, EVENT_MASK(EVENT_WIFI), EVENT_POLICY_LATEST);
+  EventFrameQueue queue = {};
+  while (outbox_wanted()) {
+    bool worked = false;
+    // Idle TLS connections close here rather than on a small stack
+    https_maintain();
+    event_frame_queue_fill(&queue, &motion);
+    while (const EventFramePending *p = event_frame_queue_front(&queue)) {
+      uint8_t dests = wanted_dests();
+      if (dests && s_durable)
+        outbox_add(p->ev, p->jpeg, p->len, dests);
+      else if (dests)
+        deliver_direct(p->jpeg, p->len, p->ev.utc, dests);
+      event_frame_queue_pop(&queue);
+      worked = true;
+      if (!s_durable)
+        break; // slow: take newer events in between
+    }
+    uint32_t lost = motion.skipped + queue.dropped;
+    if (lost) {
+      Serial.printf("[OUTBOX] %u motion snapshot(s) dropped, queue full\n",
+                    (unsigned)lost);
+      s_dropped += lost;
+      motion.skipped = queue.dropped = 0;
+    }
+
+    // Uplink back: retry everything now instead of at the backoff
+    CamEvent ev;
+    if (event_subscriber_next(&wifi, &ev) && ev.state)
+      for (int d = 0; d < DEST_COUNT; d++)
+        s_dests[d].backoffMs = 0;
+
+    if (s_durable && outbox_drain())
+      worked = true;
+    if (!worked)
+      vTaskDelay(pdMS_TO_TICKS(200));
+  }
+  event_frame_queue_clear(&queue);
+  https_close_idle(); // nothing left to reuse them for
+  s_task = NULL;
+  vTaskDelete(NULL);
+}
+
+void cloud_outbox_start() {
+  if (outbox_wanted() && s_task == NULL) {
+    Serial.println("[INFO] Dynamic Task Manager: Spawning Cloud_Outbox");
+    task_spawn(TASK_OUTBOX, cloud_outbox_task, &s_task);
+  }
+}
+
+size_t cloud_outbox_json(char *buf, size_t size) {
+  if (!size)
+    return 0;
+  unsigned pending[DEST_COUNT] = {};
+  for (size_t i = 0; i < s_count; i++)
+    for (int d = 0; d < DEST_COUNT; d++)
+      if (s_entries[i].pending & DEST_BIT(d))
+        pending[d]++;
+  uint32_t now = millis();
+  uint32_t retryIn[DEST_COUNT];
+  for (int d = 0; d < DEST_COUNT; d++) {
+    int32_t left = (int32_t)(s_dests[d].retryAtMs - now);
+    retryIn[d] = s_dests[d].backoffMs && left > 0 ? left : 0;
+  }
+  int n = snprintf(buf, size,
+                   "{\"durable\":%s,\"pending\":%u,\"delivered\":%u,"
+                   "\"dropped\":%u,\"telegram\":{\"pending\":%u,"
+                   "\"retry_in_ms\":%u},\"gdrive\":{\"pending\":%u,"
+                   "\"retry_in_ms\":%u}}",
+                   s_durable ? "true" : "false", (unsigned)s_count,
+                   (unsigned)s_delivered, (unsigned)s_dropped,
+                   pending[DEST_TELEGRAM], (unsigned)retryIn[DEST_TELEGRAM],
+                   pending[DEST_GDRIVE], (unsigned)retryIn[DEST_GDRIVE]);
+  return n < 0 ? 0 : ((size_t)n < size ? n : size - 1);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ==============================================================================
+//   Cloud outbox - motion snapshots to Telegram and Google Drive, durably
+// ==============================================================================
+// Cloud_Outbox is the only consumer of motion snapshots from the event bus.
+// With an SD card mounted, each snapshot is written to OUTBOX_DIR as
+// <id>.jpg, followed by an ADD record in an append-only journal. The record
+// lists the destinations that were enabled at the time. A DONE record is
+// appended for every delivery. After a reboot the journal is replayed, so
+// whatever wasn't delivered is still pending. A record torn by a power cut
+// fails its checksum and ends the replay.
+//
+// The same task then drains the outbox, one request at a time:
+//  - Telegram gets up to OUTBOX_BATCH_MAX photos per sendMediaGroup.
+//  - Drive gets one photo per upload.
+//  - Each destination has its own exponential backoff, from
+//    OUTBOX_BACKOFF_MIN_MS to OUTBOX_BACKOFF_MAX_MS, with jitter.
+//  - The backoff is reset when WiFi reconnects.
+//  - A photo the server rejects as malformed (400/413) is retried on its own
+//    and then dropped, so it can't block the queue. A batch whose request
+//    doesn't fit the multipart buffers is split the same way, without
+//    waiting out a backoff.
+//
+// Past OUTBOX_MAX_PENDING, the oldest snapshot is dropped. The journal is
+// rewritten with the pending entries only once it exceeds
+// OUTBOX_COMPACT_BYTES, and removed once nothing is pending.
+//
+// Without a card, snapshots are delivered straight from their pinned event
+// slot, with one attempt per destination.
+//
+// Capture never waits for any of this. Motion detection only publishes the
+// event, and the SD writes and uploads happen in Cloud_Outbox.
+// ==============================================================================
+
+// Starts Cloud_Outbox when Telegram or Drive motion uploads are enabled and
+// it isn't running. It ends itself once both are disabled.
+void cloud_outbox_start();
+
+// JSON object: {"durable":..,"pending":..,"delivered":..,"dropped":..,
+// "telegram":{"pending":..,"retry_in_ms":..},"gdrive":{...}}
+size_t cloud_outbox_json(char *buf, size_t size);
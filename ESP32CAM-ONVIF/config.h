@@ -110,6 +110,29 @@
 #define RTSP_PORT 554   // RTSP Streaming (standard: 554)
 #define ONVIF_PORT 8000 // ONVIF Device Management (standard: 80/8000/8080)
 
+// --- RTSP Session Liveness ---
+// Clients keep a session alive with requests (GET_PARAMETER/OPTIONS) or
+// RTCP receiver reports; a session silent for longer is closed so a client
+// that vanished without TEARDOWN doesn't hold the slot until reboot.
+#define RTSP_SESSION_TIMEOUT_S 60 // Advertised as Session: ...;timeout=
+#define RTSP_SEND_TIMEOUT_MS 1000 // A TCP write slower than this is a failure
+#define RTSP_SEND_FAIL_LIMIT 3    // Consecutive failed writes drop the client
+
+// --- RTSP Multicast ---
+// Clients that SETUP with "RTP/AVP;multicast" all watch one RTP stream sent
+// once to the group, however many have joined - one stream of airtime on
+// APs with IGMP snooping. Unicast and multicast don't mix: while viewers
+// watch the group a unicast SETUP is refused (453), and vice versa.
+// The group carries the stream (/1 or /2) its first viewer described; a
+// DESCRIBE of the other one is refused while anyone watches.
+// Off by default: one player joining the group would lock an NVR's unicast
+// recording out. Enable it only where every viewer can take multicast.
+#define RTSP_MULTICAST_ENABLED 0
+#define RTSP_MULTICAST_GROUP "239.255.42.42" // 239.0.0.0/8 = site-local scope
+#define RTSP_MULTICAST_PORT 5004             // RTP; RTCP is PORT + 1
+#define RTSP_MULTICAST_TTL 4                 // Router hops the group may cross
+#define RTSP_MAX_CLIENTS 4                   // RTSP connections at once
+
 // ┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓
 // ┃ SECTION 4: SECURITY & AUTHENTICATION [REQUIRED]                        ┃
 // ┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛
@@ -118,6 +141,21 @@
 #define WEB_USER "admin"
 #define WEB_PASS "esp123"
 
+// --- ONVIF WS-Security (UsernameToken) ---
+#define WSSE_MAX_CLOCK_SKEW_S 300    // Reject <Created> older/newer than 5 min
+                                     // (only enforced once NTP time is valid)
+#define WSSE_NONCE_CACHE_SIZE 64     // Remembered tokens for replay detection
+#define WSSE_REUSE_WINDOW_MS 10000   // Same client may resend a verified token
+                                     // within this window (NVR token reuse)
+
+// --- RTSP Digest authentication (RFC 2617) ---
+// DESCRIBE/SETUP/PLAY require WEB_USER/WEB_PASS; players take them in the
+// URL (rtsp://admin:esp123@<ip>:554/mjpeg/1), NVRs reuse the ONVIF login.
+#define RTSP_AUTH_ENABLED 1
+#define RTSP_AUTH_REALM "ESP32-CAM"
+#define RTSP_AUTH_NONCE_TTL_S 300    // Nonce lifetime; expiry re-challenges
+                                     // with stale=TRUE (no credential prompt)
+
 // ⚠️ SECURITY WARNING: Change default credentials before deploying!
 
 // ┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓
@@ -132,6 +170,40 @@
 
 // Note: Settings are handled by esp_camera library at runtime
 
+// --- ONVIF Video Encoder Configurations (main stream / substream) ---
+// NVRs pick a profile per purpose (e.g. substream for motion analysis or
+// low-bitrate recording) and may change these via SetVideoEncoderConfiguration.
+// Changes made by an NVR are saved to NVS and override these defaults.
+// Quality uses the ONVIF scale 1..100 (higher = better).
+#define MEDIA_MAIN_WIDTH 640
+#define MEDIA_MAIN_HEIGHT 480
+#define MEDIA_MAIN_QUALITY 80
+#define MEDIA_MAIN_FPS 20
+#define MEDIA_MAIN_BITRATE_KBPS 4096
+
+#define MEDIA_SUB_WIDTH 320
+#define MEDIA_SUB_HEIGHT 240
+#define MEDIA_SUB_QUALITY 50
+#define MEDIA_SUB_FPS 10
+#define MEDIA_SUB_BITRATE_KBPS 512
+
+#define MEDIA_MAX_FPS 25           // Upper bound advertised to NVRs
+#define MEDIA_JPEG_QUALITY_BEST 6  // esp_camera quality for ONVIF quality 100
+#define MEDIA_JPEG_QUALITY_WORST 40 // esp_camera quality for ONVIF quality 1
+
+// --- Adaptive rate control (rate_controller.h) ---
+// While streaming, JPEG quality and frame rate back off from the configured
+// values when the link can't keep up (slow sends, dropped frames, stalled
+// TCP writes, weak RSSI) and return once it has been clean for a while.
+// Adaptations are temporary: never saved, never reported over ONVIF.
+#define RATE_CTRL_ENABLED 1
+#define RATE_CTRL_WINDOW_MS 1000         // One decision per window
+#define RATE_CTRL_QUALITY_STEP 4         // esp_camera quality per step
+#define RATE_CTRL_MAX_QUALITY_DROP 20    // Worst: configured + 20 (capped)
+#define RATE_CTRL_MAX_INTERVAL_MS 1000   // Slowest: 1 fps
+#define RATE_CTRL_RECOVER_WINDOWS 3      // Clean windows before stepping up
+#define RATE_CTRL_WEAK_RSSI -75          // dBm; below it, keep more headroom
+
 // ┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓
 // ┃ SECTION 6: RECORDING & STORAGE [OPTIONAL]                              ┃
 // ┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛
@@ -172,6 +244,12 @@
 #define PTZ_PAN_MAX 90    // Pan servo maximum angle (degrees)
 #define PTZ_TILT_MIN -45  // Tilt servo minimum angle (degrees)
 #define PTZ_TILT_MAX 45   // Tilt servo maximum angle (degrees)
+#define PTZ_MAX_SPEED 90  // Top servo speed (degrees/s)
+#define PTZ_MAX_ACCEL 180 // Ramp up/down rate (degrees/s^2) - lower = smoother,
+                          // less current draw when a move starts
+#define PTZ_CONTROL_HZ 50 // Servo update rate while moving (matches 50Hz PWM)
+#define PTZ_PRESET_COUNT 8 // ONVIF presets stored in NVS
+#define PTZ_MOVE_TIMEOUT_MS 10000 // ContinuousMove without Timeout stops after this
 // Note: SERVO_PAN_PIN and SERVO_TILT_PIN defined in board_config.h
 
 // ┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓
@@ -226,6 +304,28 @@
 #define DEVICE_VERSION "1.3"
 #define DEVICE_HARDWARE_ID "ESP32CAM-J0X"
 
+// --- ONVIF Events (PullPoint) ---
+#define EVENT_QUEUE_SIZE 64              // Recent events kept for ONVIF/MQTT/cloud/web log
+#define EVENT_FRAME_SLOTS 4              // Motion snapshots in flight to Telegram/GDrive (PSRAM)
+#define EVENT_UPLOAD_QUEUE 3             // Snapshots the cloud outbox keeps pending (< EVENT_FRAME_SLOTS)
+#define EVENT_AUTH_COALESCE_MS 10000     // At most one auth-failure event per window
+#define EVENTS_MAX_PULLPOINTS 4          // Concurrent PullPoint subscriptions
+#define EVENTS_DEFAULT_TERMINATION_S 60  // When the NVR doesn't ask for one
+#define EVENTS_PULL_MAX_WAIT_MS 1000     // Max time a PullMessages is parked for events
+#define EVENTS_PULL_MAX_MESSAGES 8       // Messages per PullMessages response
+
+// --- HTTP engine: ONVIF and the port-80 web UI (non-blocking, keep-alive) ---
+#define HTTP_MAX_CONNECTIONS 6           // Pool for both ports (a browser opens up to 6); extra clients get 503
+#define HTTP_CONN_BUFFER_SIZE 4096       // Per-connection buffer = largest request
+#define HTTP_KEEPALIVE_TIMEOUT_MS 5000   // Idle keep-alive connections are closed
+#define HTTP_REQUEST_TIMEOUT_MS 3000     // A started request must complete within
+#define HTTP_WRITE_TIMEOUT_MS 2000       // Max wait on a full socket send buffer
+#define HTTP_MAX_REQUESTS_PER_CONN 100   // Then the connection is recycled
+
+// --- ONVIF WS-Discovery ---
+#define DISCOVERY_IP_CHECK_MS 1000       // IP change poll; a change sends Hello
+#define DISCOVERY_RECOVERY_MS 10000      // Socket re-open back-off after errors
+
 // --- OTA Updates ---
 // FIRMWARE_VERSION is defined at the top of this file (line 11)
 #define GITHUB_REPO_OWNER "John-Varghese-EH"
@@ -252,6 +352,26 @@
 #define MQTT_TOPIC_BASE "home/camera/esp32cam" // Base topic
 #define HA_DISCOVERY_PREFIX "homeassistant" // Home Assistant Discovery Prefix
 
+// --- Cloud HTTPS (Telegram, Google Drive; https_client.h) ---
+// A TLS handshake costs seconds and ~40KB of internal RAM. Connections are
+// kept open per host for a motion burst, and new handshakes are capped and
+// refused while memory is short.
+#define HTTPS_MAX_CONNECTIONS 2        // Open TLS connections (idle or in use)
+#define HTTPS_MAX_HANDSHAKES 1         // Handshakes in progress at once
+#define HTTPS_KEEPALIVE_MS 20000       // Idle connection kept this long
+#define HTTPS_MIN_BLOCK_FOR_TLS 24576  // Largest free block needed to start one
+#define HTTPS_TIMEOUT_MS 10000         // Connect / response timeout
+
+// --- Cloud outbox (motion snapshots; cloud_outbox.h) ---
+// Snapshots are journaled on the SD card and delivered once the uplink is
+// back, across reboots. Without a card each one is tried once.
+#define OUTBOX_DIR "/outbox"
+#define OUTBOX_MAX_PENDING 64          // Undelivered snapshots kept; oldest dropped past this
+#define OUTBOX_BATCH_MAX 4             // Photos per Telegram sendMediaGroup (1-10; sizes HTTPS_MULTIPART_*)
+#define OUTBOX_BACKOFF_MIN_MS 5000     // First retry after a failed delivery
+#define OUTBOX_BACKOFF_MAX_MS 600000   // Retry interval doubles up to this
+#define OUTBOX_COMPACT_BYTES 8192      // Journal rewritten past this size
+
 // ┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓
 // ┃ SECTION 11: ADVANCED SETTINGS                                          ┃
 // ┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛
@@ -279,6 +399,34 @@
 #define LOG_D(x)
 #endif
 
+// --- Heap monitor (heap_monitor.h) ---
+// Internal RAM is sampled every 2s (free bytes and largest free block).
+// Under pressure the device degrades one step at a time, each step adding
+// to the previous: shed the /stream viewer, cap the sensor resolution,
+// pause SD recording, and only then restart. A level is entered when its
+// free-heap or largest-block threshold has been crossed for
+// HEAP_MON_HOLD_SAMPLES samples in a row. It is left after
+// HEAP_MON_RECOVER_SAMPLES samples in a row with 25% headroom.
+#define HEAP_MON_HOLD_SAMPLES 2
+#define HEAP_MON_RECOVER_SAMPLES 15    // 30s
+#define HEAP_MON_WINDOW_S 600          // Rolling minimum over the last 10 min
+#define HEAP_SHED_VIEWER_FREE 36864
+#define HEAP_SHED_VIEWER_BLOCK 8192
+#define HEAP_LOW_RES_FREE 30720
+#define HEAP_LOW_RES_BLOCK 6144
+#define HEAP_LOW_RES_WIDTH 640         // Sensor cap (MJPEG builds)
+#define HEAP_PAUSE_SD_FREE 25600
+#define HEAP_PAUSE_SD_BLOCK 4096       // A SOAP response block
+#define HEAP_RESTART_FREE 20480
+#define HEAP_RESTART_BLOCK 2048        // An RTP packet buffer
+
+// --- Task accounting (task_manifest.h) ---
+// Task placement (core, priority, stack) is in the table in
+// task_manifest.cpp. Per-task CPU share is measured over
+// TASK_STATS_WINDOW_MS windows and served at /api/tasks.
+#define TASK_STATS_WINDOW_MS 5000
+#define TASK_STATS_MAX_TASKS 28 // Firmware + ESP-IDF tasks (WiFi, lwIP, timers, idle)
+
 // ┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓
 // ┃ SECTION 11: RUNTIME SETTINGS STRUCTURE                                 ┃
 // ┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛
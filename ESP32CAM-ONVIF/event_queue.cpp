@@ -0,0 +1,314 @@
+#include <Arduino.h>
+#include "event_queue.h"
+#include "config.h"
+#include <atomic>
+#include <esp_heap_caps.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef ESP_PLATFORM
+#include <mutex>
+#endif
+
+// Each slot carries a stamp: 0 while empty or being written, seq + 1 once
+// published. Readers copy optimistically and re-check the stamp afterwards
+// (seqlock), so producers never wait on readers.
+struct EventSlot {
+  std::atomic<uint32_t> stamp;
+  CamEvent ev;
+};
+
+static EventSlot s_ring[EVENT_QUEUE_SIZE];
+static std::atomic<uint32_t> s_head(0);
+
+// Snapshot slots. The lock only guards the bookkeeping below; copying a
+// JPEG in happens with the slot marked busy and the lock released.
+#define FRAME_WRITING 0xFF // refs while the publisher fills the slot
+#define FRAME_SLOT_BITS 3  // handle = generation << 3 | (slot + 1)
+
+struct FrameSlot {
+  uint8_t *data; // PSRAM, grown to the largest snapshot seen
+  size_t capacity;
+  size_t len;
+  uint16_t handle; // 0: empty
+  uint8_t refs;    // readers holding it, or FRAME_WRITING
+  uint32_t storedSeq;
+};
+
+static_assert(EVENT_FRAME_SLOTS < (1 << FRAME_SLOT_BITS), "handle slot bits");
+
+static FrameSlot s_frames[EVENT_FRAME_SLOTS];
+static uint16_t s_frameGen = 0;
+static uint32_t s_frameSeq = 0;
+
+#ifdef ESP_PLATFORM
+static portMUX_TYPE s_frameMux = portMUX_INITIALIZER_UNLOCKED;
+#define FRAMES_LOCK() portENTER_CRITICAL(&s_frameMux)
+#define FRAMES_UNLOCK() portEXIT_CRITICAL(&s_frameMux)
+#else
+static std::mutex s_frameMux;
+#define FRAMES_LOCK() s_frameMux.lock()
+#define FRAMES_UNLOCK() s_frameMux.unlock()
+#endif
+
+static uint16_t frame_store(const uint8_t *jpeg, size_t len) {
+  // Least recently stored slot no reader holds
+  int pick = -1;
+  FRAMES_LOCK();
+  for (int i = 0; i < EVENT_FRAME_SLOTS; i++) {
+    if (s_frames[i].refs)
+      continue;
+    if (pick < 0 || s_frames[i].storedSeq < s_frames[pick].storedSeq)
+      pick = i;
+  }
+  if (pick >= 0) {
+    s_frames[pick].refs = FRAME_WRITING;
+    s_frames[pick].handle = 0;
+  }
+  FRAMES_UNLOCK();
+  if (pick < 0)
+    return 0; // every slot is being read: this event goes without
+
+  FrameSlot &f = s_frames[pick];
+  if (f.capacity < len) {
+    heap_caps_free(f.data);
+    f.data = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    f.capacity = f.data ? len : 0;
+  }
+  uint16_t handle = 0;
+  if (f.data) {
+    memcpy(f.data, jpeg, len);
+    f.len = len;
+  }
+
+  FRAMES_LOCK();
+  if (f.data) {
+    s_frameGen = (s_frameGen + 1) & (0xFFFF >> FRAME_SLOT_BITS);
+    if (!s_frameGen)
+      s_frameGen = 1;
+    handle = (s_frameGen << FRAME_SLOT_BITS) | (pick + 1);
+    f.storedSeq = ++s_frameSeq;
+  }
+  f.handle = handle;
+  f.refs = 0;
+  FRAMES_UNLOCK();
+  return handle;
+}
+
+static FrameSlot *frame_slot(uint16_t frame) {
+  int i = (frame & ((1 << FRAME_SLOT_BITS) - 1)) - 1;
+  return frame && i >= 0 && i < EVENT_FRAME_SLOTS ? &s_frames[i] : nullptr;
+}
+
+bool event_frame_acquire(uint16_t frame, const uint8_t **jpeg, size_t *len) {
+  FrameSlot *f = frame_slot(frame);
+  if (!f)
+    return false;
+  bool ok = false;
+  FRAMES_LOCK();
+  if (f->handle == frame && f->refs < FRAME_WRITING - 1) {
+    f->refs++;
+    *jpeg = f->data;
+    *len = f->len;
+    ok = true;
+  }
+  FRAMES_UNLOCK();
+  return ok;
+}
+
+void event_frame_release(uint16_t frame) {
+  FrameSlot *f = frame_slot(frame);
+  if (!f)
+    return;
+  FRAMES_LOCK();
+  if (f->handle == frame && f->refs && f->refs != FRAME_WRITING)
+    f->refs--;
+  FRAMES_UNLOCK();
+}
+
+static void push_event(EventType type, bool state, const char *message,
+                       uint16_t frame) {
+  uint32_t seq = s_head.fetch_add(1, std::memory_order_relaxed);
+  EventSlot &slot = s_ring[seq % EVENT_QUEUE_SIZE];
+
+  slot.stamp.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.ev.seq = seq;
+  slot.ev.timestampMs = millis();
+  slot.ev.utc = time(nullptr);
+  slot.ev.type = type;
+  slot.ev.state = state;
+  slot.ev.frame = frame;
+  strncpy(slot.ev.message, message ? message : "", sizeof(slot.ev.message) - 1);
+  slot.ev.message[sizeof(slot.ev.message) - 1] = '\0';
+
+  slot.stamp.store(seq + 1, std::memory_order_release);
+}
+
+void event_queue_push(EventType type, bool state, const char *message) {
+  push_event(type, state, message, 0);
+}
+
+void event_queue_push_frame(EventType type, bool state, const char *message,
+                            const uint8_t *jpeg, size_t len) {
+  push_event(type, state, message, jpeg && len ? frame_store(jpeg, len) : 0);
+}
+
+void event_auth_failure(const char *service) {
+  static uint32_t s_lastMs = 0;
+  static uint32_t s_suppressed = 0;
+  static bool s_any = false;
+
+  uint32_t now = millis();
+  FRAMES_LOCK(); // tiny; shared with the frame bookkeeping
+  bool publish = !s_any || now - s_lastMs >= EVENT_AUTH_COALESCE_MS;
+  uint32_t suppressed = s_suppressed;
+  if (publish) {
+    s_any = true;
+    s_lastMs = now;
+    s_suppressed = 0;
+  } else {
+    s_suppressed++;
+  }
+  FRAMES_UNLOCK();
+  if (!publish)
+    return;
+
+  char msg[48];
+  if (suppressed)
+    snprintf(msg, sizeof(msg), "Auth failed: %s (+%u earlier)", service,
+             (unsigned)suppressed);
+  else
+    snprintf(msg, sizeof(msg), "Auth failed: %s", service);
+  push_event(EVENT_AUTH_FAIL, true, msg, 0);
+}
+
+uint32_t event_queue_head() { return s_head.load(std::memory_order_acquire); }
+
+uint32_t event_queue_oldest() {
+  uint32_t head = event_queue_head();
+  return head > EVENT_QUEUE_SIZE ? head - EVENT_QUEUE_SIZE : 0;
+}
+
+bool event_queue_next(uint32_t *cursor, CamEvent *out) {
+  for (;;) {
+    uint32_t c = *cursor;
+    uint32_t head = s_head.load(std::memory_order_acquire);
+    if (c >= head)
+      return false;
+    if (head - c > EVENT_QUEUE_SIZE) {
+      // Overwritten while we weren't looking - resume at the oldest event
+      *cursor = head - EVENT_QUEUE_SIZE;
+      continue;
+    }
+
+    EventSlot &slot = s_ring[c % EVENT_QUEUE_SIZE];
+    uint32_t stamp = slot.stamp.load(std::memory_order_acquire);
+    if (stamp != c + 1) {
+      if (stamp > c + 1)
+        continue; // lapped; the head check above moves the cursor
+      return false; // reserved but not published yet
+    }
+
+    memcpy(out, &slot.ev, sizeof(CamEvent));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.stamp.load(std::memory_order_relaxed) != c + 1)
+      continue; // overwritten during the copy
+
+    *cursor = c + 1;
+    return true;
+  }
+}
+
+void event_subscribe(EventSubscriber *sub, uint32_t typeMask,
+                     EventPolicy policy, bool withFrame, bool backlog) {
+  sub->cursor = backlog ? event_queue_oldest() : event_queue_head();
+  sub->typeMask = typeMask;
+  sub->policy = policy;
+  sub->withFrame = withFrame;
+  sub->delivered = 0;
+  sub->skipped = 0;
+}
+
+bool event_subscriber_next(EventSubscriber *sub, CamEvent *out) {
+  bool found = false;
+  for (;;) {
+    uint32_t expected = sub->cursor;
+    CamEvent ev;
+    if (!event_queue_next(&sub->cursor, &ev))
+      break;
+    sub->skipped += ev.seq - expected; // overwritten before we got there
+    if (!(sub->typeMask & EVENT_MASK(ev.type)) || (sub->withFrame && !ev.frame))
+      continue;
+    if (found)
+      sub->skipped++; // superseded by this one
+    *out = ev;
+    found = true;
+    if (sub->policy == EVENT_POLICY_ALL)
+      break;
+  }
+  if (found)
+    sub->delivered++;
+  return found;
+}
+
+static_assert(EVENT_UPLOAD_QUEUE < EVENT_FRAME_SLOTS,
+              "uploaders need a free slot for new snapshots");
+
+void event_frame_queue_fill(EventFrameQueue *q, EventSubscriber *sub) {
+  CamEvent ev;
+  while (event_subscriber_next(sub, &ev)) {
+    const uint8_t *jpeg;
+    size_t len;
+    if (!event_frame_acquire(ev.frame, &jpeg, &len)) {
+      q->dropped++; // reused while we were busy
+      continue;
+    }
+    if (q->count == EVENT_UPLOAD_QUEUE) {
+      event_frame_queue_pop(q);
+      q->dropped++;
+    }
+    EventFramePending &p = q->items[(q->head + q->count) % EVENT_UPLOAD_QUEUE];
+    p.ev = ev;
+    p.jpeg = jpeg;
+    p.len = len;
+    q->count++;
+  }
+}
+
+const EventFramePending *event_frame_queue_front(const EventFrameQueue *q) {
+  return q->count ? &q->items[q->head] : nullptr;
+}
+
+void event_frame_queue_pop(EventFrameQueue *q) {
+  if (!q->count)
+    return;
+  event_frame_release(q->items[q->head].ev.frame);
+  q->head = (q->head + 1) % EVENT_UPLOAD_QUEUE;
+  q->count--;
+}
+
+void event_frame_queue_clear(EventFrameQueue *q) {
+  while (q->count)
+    event_frame_queue_pop(q);
+}
+
+const char *event_type_str(EventType type) {
+  switch (type) {
+  case EVENT_BOOT:
+    return "boot";
+  case EVENT_MOTION:
+    return "motion";
+  case EVENT_ERROR:
+    return "error";
+  case EVENT_INFO:
+    return "info";
+  case EVENT_RECORDING:
+    return "recording";
+  case EVENT_WIFI:
+    return "wifi";
+  case EVENT_AUTH_FAIL:
+    return "auth_fail";
+  }
+  return "unknown";
+}
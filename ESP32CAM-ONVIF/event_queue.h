@@ -0,0 +1,128 @@
+#pragma once
+#include "config.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// ==============================================================================
+//   Event queue - bounded, lock-free ring of camera events (publish/subscribe)
+// ==============================================================================
+// Any task publishes: motion detection, the SD recorder, WiFi management,
+// the RTSP/ONVIF/web auth checks, boot and the heap monitor. Several
+// independent readers subscribe: ONVIF PullPoint subscriptions, MQTT,
+// the cloud outbox (Telegram, Google Drive) and /api/events. Readers never remove anything:
+// each keeps its own cursor (the sequence number of the next event it wants).
+// The ring simply overwrites the oldest entry when full; a reader that fell
+// behind skips ahead to the oldest event still available.
+//
+// Publishing never blocks, so a slow consumer (a cloud upload stuck in a
+// TLS handshake) can't hold up the task that raised the event. Each
+// consumer runs in its own task. It picks its back-pressure policy with its
+// EventSubscriber: EVENT_POLICY_ALL delivers every event, EVENT_POLICY_LATEST
+// only the newest one pending.
+//
+// An event may carry a JPEG snapshot. The snapshot is copied into one of
+// EVENT_FRAME_SLOTS PSRAM slots and the event holds a handle to it. A slot
+// is reused once no reader holds it, so a reader that comes too late gets
+// no frame - it never gets the wrong one. The cloud outbox pins the
+// snapshots it still has to journal or send in an EventFrameQueue, so a
+// burst of motion can't recycle them.
+// ==============================================================================
+
+enum EventType : uint8_t {
+  EVENT_BOOT = 0,
+  EVENT_MOTION, // state = motion active
+  EVENT_ERROR,
+  EVENT_INFO,
+  EVENT_RECORDING, // state = a segment is open (message: file)
+  EVENT_WIFI,      // state = connected
+  EVENT_AUTH_FAIL  // message: service and count, see event_auth_failure()
+};
+
+#define EVENT_MASK(type) (1u << (type))
+#define EVENT_MASK_ALL 0xFFFFFFFFu
+
+struct CamEvent {
+  uint32_t seq;
+  uint32_t timestampMs; // millis() at push
+  time_t utc;           // wall clock at push (0 before time sync)
+  EventType type;
+  bool state;
+  uint16_t frame; // snapshot handle for event_frame_acquire(), 0: none
+  char message[48];
+};
+
+void event_queue_push(EventType type, bool state, const char *message);
+
+// As event_queue_push(), with a copy of the JPEG attached when a frame slot
+// is free (otherwise the event goes out without one)
+void event_queue_push_frame(EventType type, bool state, const char *message,
+                            const uint8_t *jpeg, size_t len);
+
+// Auth failures come in bursts (a wrong password in an NVR retries every
+// second). The first failure in each EVENT_AUTH_COALESCE_MS is published;
+// the ones after it are counted into the next event.
+void event_auth_failure(const char *service);
+
+// Sequence number the next pushed event will get. Start a cursor here to
+// receive only new events, or at event_queue_oldest() for the backlog.
+uint32_t event_queue_head();
+uint32_t event_queue_oldest();
+
+// Copies the event at *cursor into out and advances the cursor.
+// Returns false when the reader has caught up.
+bool event_queue_next(uint32_t *cursor, CamEvent *out);
+
+const char *event_type_str(EventType type);
+
+// Pins the snapshot so it can't be reused while it's read. Fails when the
+// handle is 0 or the slot has since been reused. Release every success.
+bool event_frame_acquire(uint16_t frame, const uint8_t **jpeg, size_t *len);
+void event_frame_release(uint16_t frame);
+
+enum EventPolicy : uint8_t {
+  EVENT_POLICY_ALL,   // every matching event, in order
+  EVENT_POLICY_LATEST // only the newest pending match; older ones skipped
+};
+
+struct EventSubscriber {
+  uint32_t cursor;
+  uint32_t typeMask; // EVENT_MASK() of the types wanted
+  EventPolicy policy;
+  bool withFrame; // only events that carry a snapshot
+  uint32_t delivered;
+  uint32_t skipped; // superseded (LATEST) or overwritten before being read
+};
+
+// Starts at the next event, or at the oldest one kept with backlog
+void event_subscribe(EventSubscriber *sub, uint32_t typeMask,
+                     EventPolicy policy, bool withFrame = false,
+                     bool backlog = false);
+
+// Next event for this subscriber under its policy; false when there's none
+bool event_subscriber_next(EventSubscriber *sub, CamEvent *out);
+
+// Bounded queue of snapshot events waiting for a cloud upload. Filling it
+// takes every pending event from the subscriber (use EVENT_POLICY_ALL) and
+// pins its snapshot until popped. When full, the oldest entry is dropped to
+// make room. Dropped entries, and events whose snapshot was already reused
+// before the fill, are counted in dropped. One task owns each queue.
+struct EventFramePending {
+  CamEvent ev;
+  const uint8_t *jpeg;
+  size_t len;
+};
+
+struct EventFrameQueue {
+  EventFramePending items[EVENT_UPLOAD_QUEUE];
+  uint8_t head;
+  uint8_t count;
+  uint32_t dropped;
+};
+
+void event_frame_queue_fill(EventFrameQueue *q, EventSubscriber *sub);
+// Oldest pending entry, or nullptr when empty
+const EventFramePending *event_frame_queue_front(const EventFrameQueue *q);
+void event_frame_queue_pop(EventFrameQueue *q);
+// Releases every pinned snapshot (the owning task is exiting)
+void event_frame_queue_clear(EventFrameQueue *q);
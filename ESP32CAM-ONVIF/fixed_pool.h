@@ -0,0 +1,66 @@
+#pragma once
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+// ==============================================================================
+//   FixedPool - static storage for objects created per connection / request
+// ==============================================================================
+// Holds up to N objects of type T in a static array. create() constructs one
+// in a free slot (placement new) and destroy() runs its destructor and frees
+// the slot, so sessions and sockets coming and going never touch the heap
+// and can't fragment it. A full pool returns nullptr - the caller rejects the
+// client, as it would for any other resource limit.
+//
+// Not thread-safe: each pool belongs to one task (RTSP_Task for sessions and
+// their sockets). Plain C++ so it builds on the host as well.
+// ==============================================================================
+
+template <typename T, size_t N> class FixedPool {
+public:
+  FixedPool() : m_used(0) {
+    for (size_t i = 0; i < N; i++)
+      m_busy[i] = false;
+  }
+
+  template <typename... Args> T *create(Args &&...args) {
+    for (size_t i = 0; i < N; i++) {
+      if (m_busy[i])
+        continue;
+      m_busy[i] = true;
+      m_used++;
+      return new (slot(i)) T(std::forward<Args>(args)...);
+    }
+    return nullptr;
+  }
+
+  // Ignores nullptr and objects the pool doesn't own
+  void destroy(T *obj) {
+    size_t i = indexOf(obj);
+    if (i >= N || !m_busy[i])
+      return;
+    obj->~T();
+    m_busy[i] = false;
+    m_used--;
+  }
+
+  bool owns(const T *obj) const { return indexOf(obj) < N; }
+  size_t inUse() const { return m_used; }
+  static constexpr size_t capacity() { return N; }
+
+private:
+  T *slot(size_t i) { return reinterpret_cast<T *>(m_storage + i * sizeof(T)); }
+
+  size_t indexOf(const T *obj) const {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(obj);
+    if (!obj || p < m_storage || p >= m_storage + sizeof(m_storage))
+      return N;
+    size_t offset = p - m_storage;
+    return offset % sizeof(T) ? N : offset / sizeof(T);
+  }
+
+  alignas(T) uint8_t m_storage[N * sizeof(T)];
+  bool m_busy[N];
+  size_t m_used;
+};
@@ -0,0 +1,225 @@
+#include "frame_pipeline.h"
+#include "config.h"
+#include "CStreamer.h"
+#include "media_config.h"
+#include "platglue.h"
+#include "soap_writer.h"
+#include "task_manifest.h"
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+// Upper bound for maxFramesInFlight()
+#define PIPELINE_MAX_FRAMES 2
+
+static PLATQUEUE s_frames = nullptr; // captured frames, capture -> sender
+static PLATQUEUE s_slots = nullptr;  // one token per frame that may be captured
+
+// A stage marks itself busy *before* loading the streamer and detach clears
+// the streamer *before* checking the busy flags, so once detach has seen
+// both stages idle neither can still be using the old streamer.
+static std::atomic<CStreamer *> s_streamer{nullptr};
+static std::atomic<bool> s_captureBusy{false};
+static std::atomic<bool> s_senderBusy{false};
+
+static LatencyHistogram s_hist[STAGE_COUNT];
+static PipelineCounters s_counters;
+
+static const char *const STAGE_NAMES[STAGE_COUNT] = {"control", "capture",
+                                                     "queue", "send", "glass"};
+
+void frame_pipeline_record(PipelineStage stage, uint32_t us) {
+  // One writer per stage; readers may see a sample half-recorded, which is
+  // fine for statistics
+  latency_hist_add(s_hist[stage], us);
+}
+
+static void return_slot() {
+  uint8_t token = 1;
+  platqueuesend(s_slots, &token, 0);
+}
+
+static void capture_task(void *) {
+  uint32_t nextDue = 0;
+  for (;;) {
+    s_captureBusy = true;
+    CStreamer *streamer = s_streamer.load();
+    if (!streamer) {
+      s_captureBusy = false;
+      nextDue = platmillis();
+      platdelayms(10);
+      continue;
+    }
+
+    uint32_t now = platmillis();
+    int32_t wait = (int32_t)(nextDue - now);
+    if (wait > 0) {
+      s_captureBusy = false;
+      platdelayms(wait);
+      continue;
+    }
+
+    // Every frame buffer queued or on the wire: a frame still waiting for
+    // the sender is older than the one we can grab now, so replace it
+    uint8_t token;
+    if (!platqueuereceive(s_slots, &token, 0)) {
+      StreamFrame stale;
+      if (streamer->framesDroppable() &&
+          platqueuereceive(s_frames, &stale, 0)) {
+        streamer->releaseFrame(stale);
+        s_counters.dropped++;
+      } else if (!platqueuereceive(s_slots, &token, 20)) {
+        s_captureBusy = false;
+        continue;
+      }
+    }
+
+    // Keep the cadence; after a long stall restart it rather than burst
+    uint32_t interval = media_frame_interval_ms();
+    nextDue = (now - nextDue < interval) ? nextDue + interval : now + interval;
+
+    StreamFrame frame;
+    uint32_t start = platmicros();
+    if (streamer->captureFrame(frame)) {
+      frame.captureUs = platmicros();
+      frame_pipeline_record(STAGE_CAPTURE, frame.captureUs - start);
+      task_busy_add(TASK_CAPTURE, frame.captureUs - start);
+      s_counters.captured++;
+      platqueuesend(s_frames, &frame, 0); // slots bound it, never full
+    } else {
+      s_counters.captureFailed++;
+      return_slot();
+    }
+    s_captureBusy = false;
+  }
+}
+
+static void sender_task(void *) {
+  for (;;) {
+    s_senderBusy = true;
+    CStreamer *streamer = s_streamer.load();
+    if (!streamer) {
+      s_senderBusy = false;
+      platdelayms(10);
+      continue;
+    }
+
+    StreamFrame frame;
+    if (!platqueuereceive(s_frames, &frame, 20)) {
+      s_senderBusy = false;
+      continue;
+    }
+
+    // Behind schedule: only the newest frame is worth sending
+    StreamFrame newer;
+    while (streamer->framesDroppable() &&
+           platqueuereceive(s_frames, &newer, 0)) {
+      streamer->releaseFrame(frame);
+      return_slot();
+      s_counters.dropped++;
+      frame = newer;
+    }
+
+    uint32_t picked = platmicros();
+    frame_pipeline_record(STAGE_QUEUE, picked - frame.captureUs);
+    streamer->sendFrame(frame);
+    uint32_t done = platmicros();
+    frame_pipeline_record(STAGE_SEND, done - picked);
+    task_busy_add(TASK_SENDER, done - picked);
+    frame_pipeline_record(STAGE_GLASS, done - frame.captureUs);
+
+    streamer->releaseFrame(frame);
+    return_slot();
+    s_counters.sent++;
+    s_senderBusy = false;
+  }
+}
+
+void frame_pipeline_start() {
+  if (s_frames)
+    return;
+  s_frames = platqueuecreate(PIPELINE_MAX_FRAMES, sizeof(StreamFrame));
+  s_slots = platqueuecreate(PIPELINE_MAX_FRAMES, sizeof(uint8_t));
+
+  // Both off the WiFi core (task_manifest.cpp); the sender above capture so
+  // a frame on the wire isn't held up by grabbing the next one
+  const TaskPlacement &cap = task_placement(TASK_CAPTURE);
+  const TaskPlacement &snd = task_placement(TASK_SENDER);
+  plattaskcreate(capture_task, cap.name, cap.stackBytes, cap.priority, cap.core);
+  plattaskcreate(sender_task, snd.name, snd.stackBytes, snd.priority, snd.core);
+}
+
+void frame_pipeline_attach(CStreamer *streamer) {
+  if (!streamer || !s_frames || s_streamer.load())
+    return;
+  uint8_t frames = streamer->maxFramesInFlight();
+  if (frames < 1)
+    frames = 1;
+  if (frames > PIPELINE_MAX_FRAMES)
+    frames = PIPELINE_MAX_FRAMES;
+  for (uint8_t i = 0; i < frames; i++)
+    return_slot();
+  s_streamer = streamer;
+}
+
+void frame_pipeline_detach() {
+  CStreamer *streamer = s_streamer.exchange(nullptr);
+  if (!streamer)
+    return;
+  while (s_captureBusy || s_senderBusy)
+    platdelayms(1);
+
+  StreamFrame frame;
+  while (platqueuereceive(s_frames, &frame, 0))
+    streamer->releaseFrame(frame);
+  uint8_t token;
+  while (platqueuereceive(s_slots, &token, 0)) {
+  }
+}
+
+bool frame_pipeline_attached() { return s_streamer.load() != nullptr; }
+
+void frame_pipeline_stats(PipelineStage stage, LatencyHistogram *out) {
+  *out = s_hist[stage];
+}
+
+void frame_pipeline_counters(PipelineCounters *out) { *out = s_counters; }
+
+void frame_pipeline_reset_stats() {
+  memset(s_hist, 0, sizeof(s_hist));
+  memset(&s_counters, 0, sizeof(s_counters));
+}
+
+const char *frame_pipeline_stage_name(PipelineStage stage) {
+  return stage < STAGE_COUNT ? STAGE_NAMES[stage] : "unknown";
+}
+
+size_t frame_pipeline_stats_json(char *buf, size_t size) {
+  SoapBufferSink out = {buf, size, 0};
+  if (size)
+    buf[0] = '\0';
+  char block[128];
+  SoapWriter w(block, sizeof(block), soap_buffer_sink, &out);
+  w.printf_P("{\"bucket_us\":[");
+  for (int b = 0; b < LATENCY_HIST_BUCKETS - 1; b++)
+    w.printf_P(b ? ",%lu" : "%lu", LATENCY_HIST_BASE_US << b);
+  w.printf_P("],\"stages\":{");
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    LatencyHistogram h = s_hist[s];
+    w.printf_P("%s\"%s\":{\"count\":%u,\"avg_us\":%u,\"max_us\":%u,"
+               "\"buckets\":[",
+               s ? "," : "", STAGE_NAMES[s], (unsigned)h.count,
+               (unsigned)(h.count ? h.totalUs / h.count : 0),
+               (unsigned)h.maxUs);
+    for (int b = 0; b < LATENCY_HIST_BUCKETS; b++)
+      w.printf_P(b ? ",%u" : "%u", (unsigned)h.bucket[b]);
+    w.printf_P("]}");
+  }
+  PipelineCounters c = s_counters;
+  w.printf_P("},\"frames\":{\"captured\":%u,\"sent\":%u,\"dropped\":%u,"
+             "\"capture_failed\":%u}}",
+             (unsigned)c.captured, (unsigned)c.sent, (unsigned)c.dropped,
+             (unsigned)c.captureFailed);
+  w.flush();
+  return out.len;
+}
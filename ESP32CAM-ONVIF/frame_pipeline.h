@@ -0,0 +1,71 @@
+#pragma once
+#include "metrics.h"
+#include <stddef.h>
+#include <stdint.h>
+
+class CStreamer;
+
+// ==============================================================================
+//   RTSP frame pipeline - capture and send stages off the control task
+// ==============================================================================
+// RTSP_Task only accepts clients and handles requests. Frames flow through
+// two tasks of their own, connected by a bounded queue of frame handles
+// (StreamFrame, pointing at the camera / encoder buffer - nothing is copied):
+//
+//   RTSP_Capture  paces to the active stream's FrameRateLimit and grabs
+//                 (for H.264: also encodes) a frame
+//   RTSP_Sender   packetizes it to the client - UDP or interleaved TCP,
+//                 whichever the session negotiated - and hands it back
+//
+// At most streamer->maxFramesInFlight() frames exist at once (camera frame
+// buffers, encoder output), so the next frame is captured while the current
+// one is on the wire. When the sender falls behind, a frame still waiting in
+// the queue is replaced by a fresh capture: a slow socket costs frames, not
+// latency, and never holds up RTSP request handling. H.264 frames are never
+// skipped (each P-frame needs its predecessor); the encoder's own rate is
+// what keeps that stream in step.
+//
+// Each stage records its timings into a log2 LatencyHistogram (metrics.h).
+// Platform calls go through platglue, so the same code runs as threads on
+// the posix build for profiling.
+// ==============================================================================
+
+enum PipelineStage : uint8_t {
+  STAGE_CONTROL = 0, // RTSP request handling, per control loop pass
+  STAGE_CAPTURE,     // camera grab (+ H.264 encode)
+  STAGE_QUEUE,       // captured -> picked up by the sender
+  STAGE_SEND,        // packetizing and socket writes
+  STAGE_GLASS,       // captured -> last packet written
+  STAGE_COUNT
+};
+
+struct PipelineCounters {
+  uint32_t captured;
+  uint32_t sent;
+  uint32_t dropped;       // superseded by a newer frame before sending
+  uint32_t captureFailed; // no frame from the camera / encoder
+};
+
+// Creates the queues and the capture/sender tasks (idle until attached)
+void frame_pipeline_start();
+
+// Starts feeding frames of streamer to its client (after PLAY)
+void frame_pipeline_attach(CStreamer *streamer);
+
+// Stops the stages and returns every frame still in flight; when it returns
+// no stage touches the streamer any more (session teardown, encoder or
+// sensor reconfiguration)
+void frame_pipeline_detach();
+
+bool frame_pipeline_attached();
+
+void frame_pipeline_record(PipelineStage stage, uint32_t us);
+void frame_pipeline_stats(PipelineStage stage, LatencyHistogram *out);
+void frame_pipeline_counters(PipelineCounters *out);
+void frame_pipeline_reset_stats();
+
+const char *frame_pipeline_stage_name(PipelineStage stage);
+
+// {"stages":{"capture":{"count":..,"avg_us":..,"max_us":..,"buckets":[..]}
+//  ,...},"frames":{...}}; returns the length written
+size_t frame_pipeline_stats_json(char *buf, size_t size);
@@ -1,131 +1,85 @@
 #include "gdrive_manager.h"
 #include "config.h"
 #include "esp_camera.h"
-#include "mbedtls/base64.h" // ESP32 built-in; used if base64 encoding is needed
-#include <HTTPClient.h>
-#include <WiFiClientSecure.h>
+#include "https_client.h"
 
+bool gDriveMotionUploads() {
+  return appSettings.googleDriveEnabled && appSettings.googleDriveMotion &&
+         strlen(appSettings.googleDriveScriptUrl) > 0;
+}
 
-// Task Handle
-TaskHandle_t gDriveTaskHandle = NULL;
-
-// Buffer for async transfer
-static uint8_t *gDriveJpgBuf = NULL;
-static size_t gDriveJpgLen = 0;
-
-void gDriveUploadTask(void *pvParameters) {
-  if (gDriveJpgBuf == NULL || gDriveJpgLen == 0) {
-    Serial.println("[GDRIVE] Error: No valid image buffer.");
-    vTaskDelete(NULL);
-    return;
-  }
-
-  Serial.println("[GDRIVE] Starting upload task...");
-
-  // We encode the JPEG to base64, which uses more memory, but simplifies the
-  // Google Apps Script side. If memory is too constrained, we could use a
-  // custom URL-encoded binary stream or raw binary post. However, given PSRAM
-  // we can attempt Base64.
-
-  // Let's use raw binary upload to save memory, and the Apps script can read
-  // the post body. Actually, sending binary in standard POST is better done
-  // with multipart/form-data.
-
-  String boundary = "----ESP32CamBoundary123456789";
-  String head = "--" + boundary + "\r\n";
-  head += "Content-Disposition: form-data; name=\"file\"; "
-          "filename=\"motion.jpg\"\r\n";
-  head += "Content-Type: image/jpeg\r\n\r\n";
-
-  String tail = "\r\n--" + boundary + "--\r\n";
-
-  size_t contentLength = head.length() + gDriveJpgLen + tail.length();
-
-  HTTPClient http;
-  WiFiClientSecure client;
-  client.setInsecure();
-
-  Serial.printf("[GDRIVE] Connecting to %s\n",
-                appSettings.googleDriveScriptUrl);
-
-  if (http.begin(client, appSettings.googleDriveScriptUrl)) {
-    http.addHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-
-    // This relies on the ESP32 HTTPClient sendRequest with a pointer buffer.
-    // To save memory, we can manually construct the payload in a single buffer,
-    // or use the stream API. Given PSRAM, allocating another buffer for the
-    // full HTTP payload is possible but risky. Let's use the ESP32 HTTPClient's
-    // sendRequest that accepts a buffer, and we must construct the buffer.
-
-    uint8_t *payloadBuf = (uint8_t *)heap_caps_malloc(
-        contentLength, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (payloadBuf != NULL) {
-      size_t offset = 0;
-      memcpy(payloadBuf + offset, head.c_str(), head.length());
-      offset += head.length();
-      memcpy(payloadBuf + offset, gDriveJpgBuf, gDriveJpgLen);
-      offset += gDriveJpgLen;
-      memcpy(payloadBuf + offset, tail.c_str(), tail.length());
-
-      int httpCode = http.sendRequest("POST", payloadBuf, contentLength);
-      if (httpCode > 0) {
-        Serial.printf("[GDRIVE] Upload successful! HTTP Code: %d\n", httpCode);
-        String response = http.getString();
-        Serial.println(response);
-      } else {
-        Serial.printf("[GDRIVE] Upload failed! Error: %s\n",
-                      http.errorToString(httpCode).c_str());
-      }
-
-      free(payloadBuf);
-    } else {
-      Serial.println(
-          "[GDRIVE] Error: Failed to allocate payload buffer in PSRAM.");
-    }
-
-    http.end();
-  } else {
-    Serial.println("[GDRIVE] Error: Unable to connect.");
+#define GDRIVE_MAX_REDIRECTS 3
+
+// Apps Script answers the POST with a redirect to its output on another
+// host; the script has run by then. The output is fetched with GET (as for a
+// 303) only for the log, over the pool like the upload itself.
+static int gDriveFollow(const HttpsResponse &first) {
+  HttpsResponse resp = first;
+  for (int hop = 0; hop < GDRIVE_MAX_REDIRECTS && resp.status >= 300 &&
+                    resp.status < 400 && resp.location[0];
+       hop++) {
+    char host[64];
+    uint16_t port;
+    const char *path;
+    char location[sizeof(resp.location)];
+    strcpy(location, resp.location); // resp is reused for the reply
+    if (!https_split_url(location, host, sizeof(host), &port, &path))
+      break;
+    char body[128];
+    if (!https_request(host, port, "GET", path, nullptr, &resp, body,
+                       sizeof(body)))
+      break;
+    if (resp.status < 300)
+      Serial.printf("[GDRIVE] Script replied: %s\n", body);
   }
-
-  // Clean up
-  free(gDriveJpgBuf);
-  gDriveJpgBuf = NULL;
-  gDriveJpgLen = 0;
-
-  Serial.println("[GDRIVE] Upload task finished.");
-  gDriveTaskHandle = NULL;
-  vTaskDelete(NULL);
+  return resp.status;
 }
 
-void uploadToGDriveAsync(camera_fb_t *fb) {
-  if (!appSettings.googleDriveEnabled ||
-      strlen(appSettings.googleDriveScriptUrl) == 0) {
-    return;
+// Sends the body once its file part is added
+static int gDriveUpload(HttpsMultipart &body) {
+  Serial.println("[GDRIVE] Starting upload...");
+
+  char host[64];
+  uint16_t port;
+  const char *path;
+  if (!https_split_url(appSettings.googleDriveScriptUrl, host, sizeof(host),
+                       &port, &path)) {
+    Serial.println("[GDRIVE] Error: script URL must be https://host/path.");
+    return 0;
   }
-
-  if (gDriveTaskHandle != NULL) {
-    Serial.println("[GDRIVE] Upload already in progress. Skipping.");
-    return;
+  if (!https_multipart_end(&body)) {
+    Serial.println("[GDRIVE] Error: request body too large.");
+    return HTTPS_BODY_TOO_LARGE;
   }
 
-  // Allocate buffer in PSRAM
-  gDriveJpgBuf =
-      (uint8_t *)heap_caps_malloc(fb->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-  if (gDriveJpgBuf == NULL) {
-    Serial.println("[GDRIVE] Failed to allocate PSRAM for GDrive buffer.");
-    return;
+  Serial.printf("[GDRIVE] Connecting to %s\n", host);
+  HttpsResponse resp;
+  int status = https_request(host, port, "POST", path, &body, &resp);
+  if (status > 0 && status < 400) {
+    Serial.printf("[GDRIVE] Upload successful! HTTP Code: %d\n",
+                  gDriveFollow(resp));
+  } else {
+    Serial.printf("[GDRIVE] Upload failed! HTTP Code: %d\n", status);
   }
 
-  // Copy the image frame
-  memcpy(gDriveJpgBuf, fb->buf, fb->len);
-  gDriveJpgLen = fb->len;
+  Serial.println("[GDRIVE] Upload finished.");
+  return status;
+}
+
+// Binary multipart/form-data: no base64, the script reads the post body.
+// The JPEG is streamed from its event slot, never copied.
+int gDriveUploadJpeg(const uint8_t *jpeg, size_t len) {
+  HttpsMultipart body;
+  https_multipart_begin(&body);
+  https_multipart_file(&body, "file", "motion.jpg", "image/jpeg", jpeg, len);
+  return gDriveUpload(body);
+}
 
-  // Create the task
-  xTaskCreate(gDriveUploadTask, "GDriveUpload", 8192, NULL,
-              1, // low priority
-              &gDriveTaskHandle);
+int gDriveUploadFile(fs::FS &fs, const char *path, size_t len) {
+  HttpsMultipart body;
+  https_multipart_begin(&body);
+  https_multipart_file(&body, "file", "motion.jpg", "image/jpeg", fs, path, len);
+  return gDriveUpload(body);
 }
 
 void initGDrive() {
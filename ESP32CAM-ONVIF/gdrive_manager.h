@@ -1,7 +1,17 @@
 #pragma once
 
 #include <Arduino.h>
+#include <FS.h>
 #include "esp_camera.h"
 
 void initGDrive();
-void uploadToGDriveAsync(camera_fb_t* fb);
+
+// Motion uploads enabled, with a script URL
+bool gDriveMotionUploads();
+
+// Posts one JPEG to the Apps Script and returns the HTTP status (2xx/3xx:
+// stored; 0: no response; HTTPS_BODY_TOO_LARGE: not sent). Motion
+// snapshots reach this through the cloud outbox (cloud_outbox.h).
+int gDriveUploadJpeg(const uint8_t *jpeg, size_t len);
+// Same, with the JPEG streamed from its file on fs while it is sent
+int gDriveUploadFile(fs::FS &fs, const char *path, size_t len);
@@ -0,0 +1,206 @@
+#include "heap_monitor.h"
+#include "config.h"
+#include "event_queue.h"
+#include "media_config.h"
+#include "sd_recorder.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+#include <stdio.h>
+
+#define INTERNAL_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+// The rolling minimum is kept per bucket: HEAP_MON_WINDOW_S split in
+// WINDOW_BUCKETS slices, the oldest slice reused as time moves on
+#define WINDOW_BUCKETS 10
+#define BUCKET_MS (HEAP_MON_WINDOW_S * 1000UL / WINDOW_BUCKETS)
+
+struct HeapThreshold {
+  uint32_t minFree;
+  uint32_t minBlock;
+};
+
+// Indexed by HeapLevel: below either value, that level is called for
+static const HeapThreshold THRESHOLDS[HEAP_LEVEL_COUNT] = {
+    {0, 0},
+    {HEAP_SHED_VIEWER_FREE, HEAP_SHED_VIEWER_BLOCK},
+    {HEAP_LOW_RES_FREE, HEAP_LOW_RES_BLOCK},
+    {HEAP_PAUSE_SD_FREE, HEAP_PAUSE_SD_BLOCK},
+    {HEAP_RESTART_FREE, HEAP_RESTART_BLOCK},
+};
+
+static const char *const LEVEL_NAMES[HEAP_LEVEL_COUNT] = {
+    "ok", "shed_viewer", "low_res", "pause_sd", "restart"};
+
+struct WindowBucket {
+  uint32_t slice; // millis() / BUCKET_MS it covers
+  uint32_t minFree;
+  uint32_t minLargest;
+};
+
+struct CapsTracker {
+  HeapCapsStats stats;
+  WindowBucket window[WINDOW_BUCKETS];
+};
+
+static CapsTracker s_internal;
+static CapsTracker s_spiram;
+static volatile HeapLevel s_level = HEAP_OK;
+static HeapLevel s_worst = HEAP_OK;
+static uint32_t s_changes = 0;
+static uint32_t s_levelSinceMs = 0;
+static uint8_t s_worseSamples = 0;  // in a row calling for a higher level
+static uint8_t s_betterSamples = 0; // in a row with headroom below it
+
+static void sample_caps(CapsTracker &t, uint32_t caps, uint32_t now) {
+  HeapCapsStats &s = t.stats;
+  s.totalBytes = heap_caps_get_total_size(caps);
+  if (!s.totalBytes)
+    return;
+  s.freeBytes = heap_caps_get_free_size(caps);
+  s.largestBlock = heap_caps_get_largest_free_block(caps);
+  s.minFreeEver = heap_caps_get_minimum_free_size(caps);
+  s.fragPct = s.freeBytes ? 100 - (uint64_t)s.largestBlock * 100 / s.freeBytes
+                          : 0;
+
+  uint32_t slice = now / BUCKET_MS;
+  WindowBucket &b = t.window[slice % WINDOW_BUCKETS];
+  if (b.slice != slice || !b.minFree) {
+    b.slice = slice;
+    b.minFree = s.freeBytes;
+    b.minLargest = s.largestBlock;
+  } else {
+    if (s.freeBytes < b.minFree)
+      b.minFree = s.freeBytes;
+    if (s.largestBlock < b.minLargest)
+      b.minLargest = s.largestBlock;
+  }
+
+  s.windowMinFree = s.freeBytes;
+  s.windowMinLargest = s.largestBlock;
+  for (int i = 0; i < WINDOW_BUCKETS; i++) {
+    const WindowBucket &w = t.window[i];
+    if (!w.minFree || slice - w.slice >= WINDOW_BUCKETS)
+      continue; // unused, or older than the window
+    if (w.minFree < s.windowMinFree)
+      s.windowMinFree = w.minFree;
+    if (w.minLargest < s.windowMinLargest)
+      s.windowMinLargest = w.minLargest;
+  }
+}
+
+// Highest level whose thresholds the sample crosses
+static HeapLevel level_called_for(uint32_t freeBytes, uint32_t largest) {
+  for (int l = HEAP_LEVEL_COUNT - 1; l > HEAP_OK; l--)
+    if (freeBytes < THRESHOLDS[l].minFree || largest < THRESHOLDS[l].minBlock)
+      return (HeapLevel)l;
+  return HEAP_OK;
+}
+
+// Clear of the current level's thresholds by 25%
+static bool has_headroom(HeapLevel level, uint32_t freeBytes,
+                         uint32_t largest) {
+  const HeapThreshold &t = THRESHOLDS[level];
+  return freeBytes >= t.minFree + t.minFree / 4 &&
+         largest >= t.minBlock + t.minBlock / 4;
+}
+
+static void apply_level(HeapLevel from, HeapLevel to) {
+  media_set_resolution_cap(to >= HEAP_LOW_RES ? HEAP_LOW_RES_WIDTH : 0);
+  sd_recorder_set_paused(to >= HEAP_PAUSE_SD);
+
+  const HeapCapsStats &s = s_internal.stats;
+  char msg[48];
+  snprintf(msg, sizeof(msg), "Heap: %s (%uK free, %uK block)",
+           LEVEL_NAMES[to], (unsigned)(s.freeBytes / 1024),
+           (unsigned)(s.largestBlock / 1024));
+  Serial.printf("[WARN] Heap monitor: %s -> %s (free %u, largest %u, frag %u%%)\n",
+                LEVEL_NAMES[from], LEVEL_NAMES[to], (unsigned)s.freeBytes,
+                (unsigned)s.largestBlock, (unsigned)s.fragPct);
+  event_queue_push(to > from ? EVENT_ERROR : EVENT_INFO, to > HEAP_OK, msg);
+
+  if (to == HEAP_RESTART) {
+    Serial.println("[CRITICAL] Heap monitor: restarting for stability.");
+    delay(500); // let the log line and the event reach their consumers
+    esp_restart();
+  }
+}
+
+void heap_monitor_sample() {
+  uint32_t now = millis();
+  sample_caps(s_internal, INTERNAL_CAPS, now);
+  sample_caps(s_spiram, MALLOC_CAP_SPIRAM, now);
+
+  const HeapCapsStats &s = s_internal.stats;
+  HeapLevel level = s_level;
+  HeapLevel wanted = level_called_for(s.freeBytes, s.largestBlock);
+
+  s_worseSamples = wanted > level ? s_worseSamples + 1 : 0;
+  s_betterSamples = level > HEAP_OK && wanted < level &&
+                            has_headroom(level, s.freeBytes, s.largestBlock)
+                        ? s_betterSamples + 1
+                        : 0;
+
+  HeapLevel next = level;
+  if (s_worseSamples >= HEAP_MON_HOLD_SAMPLES)
+    next = (HeapLevel)(level + 1);
+  else if (s_betterSamples >= HEAP_MON_RECOVER_SAMPLES)
+    next = (HeapLevel)(level - 1);
+  if (next == level)
+    return;
+
+  s_worseSamples = s_betterSamples = 0;
+  s_level = next;
+  if (next > s_worst)
+    s_worst = next;
+  s_changes++;
+  s_levelSinceMs = now;
+  apply_level(level, next);
+}
+
+HeapLevel heap_monitor_level() { return s_level; }
+
+void heap_monitor_status(HeapStatus *out) {
+  out->internal = s_internal.stats;
+  out->spiram = s_spiram.stats;
+  out->level = s_level;
+  out->worstLevel = s_worst;
+  out->levelChanges = s_changes;
+  out->levelSinceMs = s_levelSinceMs;
+}
+
+const char *heap_level_str(HeapLevel level) {
+  return level < HEAP_LEVEL_COUNT ? LEVEL_NAMES[level] : "unknown";
+}
+
+static size_t caps_json(char *buf, size_t size, const char *name,
+                        const HeapCapsStats &s) {
+  int n = snprintf(buf, size,
+                   ",\"%s\":{\"total\":%u,\"free\":%u,\"largest\":%u,"
+                   "\"frag_pct\":%u,\"min_free\":%u,\"window_min_free\":%u,"
+                   "\"window_min_largest\":%u}",
+                   name, (unsigned)s.totalBytes, (unsigned)s.freeBytes,
+                   (unsigned)s.largestBlock, (unsigned)s.fragPct,
+                   (unsigned)s.minFreeEver, (unsigned)s.windowMinFree,
+                   (unsigned)s.windowMinLargest);
+  return n < 0 ? 0 : ((size_t)n < size ? n : size);
+}
+
+size_t heap_monitor_json(char *buf, size_t size) {
+  if (!size)
+    return 0;
+  int n = snprintf(buf, size,
+                   "{\"level\":\"%s\",\"worst\":\"%s\",\"changes\":%u,"
+                   "\"level_age_s\":%u",
+                   LEVEL_NAMES[s_level], LEVEL_NAMES[s_worst],
+                   (unsigned)s_changes,
+                   (unsigned)((millis() - s_levelSinceMs) / 1000));
+  size_t len = n < 0 ? 0 : ((size_t)n < size ? n : size);
+  len += caps_json(buf + len, size - len, "internal", s_internal.stats);
+  len += caps_json(buf + len, size - len, "spiram", s_spiram.stats);
+  if (len + 1 < size) {
+    buf[len++] = '}';
+    buf[len] = '\0';
+  }
+  return len < size ? len : size - 1;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ==============================================================================
+//   Heap monitor - fragmentation telemetry and graded low-memory mitigation
+// ==============================================================================
+// Free heap alone hides fragmentation: 40 KB free in 1 KB pieces can't hold
+// a 4 KB SOAP block or a 1.6 KB RTP buffer. Each sample records, for
+// internal RAM and for PSRAM, the free bytes, the largest free block, the
+// fragmentation (share of free memory outside the largest block) and the
+// minima over the last HEAP_MON_WINDOW_S.
+//
+// The internal RAM numbers drive a mitigation level (thresholds in
+// config.h). Each level keeps the ones below it in force:
+//   HEAP_SHED_VIEWER  the MJPEG /stream viewer is dropped, new ones refused
+//   HEAP_LOW_RES      sensor capped at HEAP_LOW_RES_WIDTH (MJPEG)
+//   HEAP_PAUSE_SD     SD recording paused, the open segment closed
+//   HEAP_RESTART      clean restart - recording is already closed
+// Levels go up one step per HEAP_MON_HOLD_SAMPLES bad samples, so each
+// step gets a chance to help, and down one step after
+// HEAP_MON_RECOVER_SAMPLES good ones. Changes are logged to the event queue.
+// ==============================================================================
+
+enum HeapLevel : uint8_t {
+  HEAP_OK = 0,
+  HEAP_SHED_VIEWER,
+  HEAP_LOW_RES,
+  HEAP_PAUSE_SD,
+  HEAP_RESTART,
+  HEAP_LEVEL_COUNT
+};
+
+struct HeapCapsStats {
+  uint32_t totalBytes; // 0: not present (no PSRAM)
+  uint32_t freeBytes;
+  uint32_t largestBlock;
+  uint8_t fragPct;           // 100 - largestBlock / freeBytes
+  uint32_t minFreeEver;      // allocator's low-water mark since boot
+  uint32_t windowMinFree;    // over the last HEAP_MON_WINDOW_S
+  uint32_t windowMinLargest; // ditto
+};
+
+struct HeapStatus {
+  HeapCapsStats internal;
+  HeapCapsStats spiram;
+  HeapLevel level;
+  HeapLevel worstLevel; // since boot
+  uint32_t levelChanges;
+  uint32_t levelSinceMs; // millis() of the last change
+};
+
+// Takes a sample and applies any level change; call periodically
+// (watchdog task, every 2s). Doesn't return at HEAP_RESTART.
+void heap_monitor_sample();
+
+// Read by the consumers that shed load themselves (/stream)
+HeapLevel heap_monitor_level();
+
+void heap_monitor_status(HeapStatus *out);
+const char *heap_level_str(HeapLevel level);
+
+// {"level":"ok","worst":..,"internal":{"free":..,"largest":..,...},
+//  "spiram":{...}}; returns the length written
+size_t heap_monitor_json(char *buf, size_t size);
@@ -0,0 +1,877 @@
+#include <Arduino.h>
+#include <FS.h>
+#include "config.h"
+#include "http_engine.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define HTTP_MAX_LISTENERS 2
+#define HTTP_MAX_ROUTES 64 // web UI and API, ONVIF services
+#define HTTP_MAX_WATCHES 2
+#define HTTP_EXTRA_HEADERS 320
+#define HTTP_FILE_CHUNK 2048
+
+struct HttpListener {
+  int fd;
+  uint16_t port;
+  HttpHandlerFn notFound;
+};
+
+struct HttpRoute {
+  uint16_t port;
+  HttpVerb verb;
+  const char *path;
+  HttpHandlerFn fn;
+  HttpBodyFn bodyFn; // streamed body, or nullptr to buffer it
+};
+
+static HttpListener s_listeners[HTTP_MAX_LISTENERS];
+static int s_listenerCount = 0;
+struct HttpWatch {
+  int fd;
+  HttpFdHandlerFn fn;
+  void *ctx;
+};
+
+static HttpRoute s_routes[HTTP_MAX_ROUTES];
+static int s_routeCount = 0;
+static HttpConn s_conns[HTTP_MAX_CONNECTIONS];
+static char *s_pool = nullptr;
+static HttpEngineStats s_stats;
+static HttpWatch s_watches[HTTP_MAX_WATCHES] = {{-1, nullptr, nullptr},
+                                               {-1, nullptr, nullptr}};
+// One handler runs at a time, so they share the extra header lines and the
+// file read buffer; each connection may have a file going out
+static char s_extra[HTTP_EXTRA_HEADERS];
+static size_t s_extraLen = 0;
+static uint8_t s_chunk[HTTP_FILE_CHUNK];
+static fs::File s_files[HTTP_MAX_CONNECTIONS];
+
+static bool write_all(HttpConn &conn, const void *data, size_t len);
+
+static const char *status_text(int code) {
+  switch (code) {
+  case 100:
+    return "Continue";
+  case 200:
+    return "OK";
+  case 204:
+    return "No Content";
+  case 207:
+    return "Multi-Status";
+  case 400:
+    return "Bad Request";
+  case 401:
+    return "Unauthorized";
+  case 403:
+    return "Forbidden";
+  case 404:
+    return "Not Found";
+  case 408:
+    return "Request Timeout";
+  case 411:
+    return "Length Required";
+  case 413:
+    return "Payload Too Large";
+  case 429:
+    return "Too Many Requests";
+  case 500:
+    return "Internal Server Error";
+  case 503:
+    return "Service Unavailable";
+  }
+  return "OK";
+}
+
+static void set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static bool pool_init() {
+  if (s_pool)
+    return true;
+  size_t total = (size_t)HTTP_MAX_CONNECTIONS * HTTP_CONN_BUFFER_SIZE;
+#ifdef ESP_PLATFORM
+  s_pool = (char *)heap_caps_malloc(total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!s_pool)
+    s_pool = (char *)heap_caps_malloc(total, MALLOC_CAP_8BIT);
+#else
+  s_pool = (char *)malloc(total);
+#endif
+  if (!s_pool) {
+    LOG_E("HTTP engine: connection pool allocation failed");
+    return false;
+  }
+  for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+    memset(&s_conns[i], 0, sizeof(HttpConn));
+    s_conns[i].fd = -1;
+    s_conns[i].buf = s_pool + (size_t)i * HTTP_CONN_BUFFER_SIZE;
+  }
+  return true;
+}
+
+bool http_engine_listen(uint16_t port) {
+  if (s_listenerCount >= HTTP_MAX_LISTENERS || !pool_init())
+    return false;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return false;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, HTTP_MAX_CONNECTIONS) != 0) {
+    close(fd);
+    LOG_E("HTTP engine: cannot listen on port " + String(port));
+    return false;
+  }
+  set_nonblocking(fd);
+
+  HttpListener &l = s_listeners[s_listenerCount++];
+  l.fd = fd;
+  l.port = port;
+  l.notFound = nullptr;
+  return true;
+}
+
+bool http_engine_on(uint16_t port, const char *path, HttpVerb verb,
+                    HttpHandlerFn fn) {
+  if (s_routeCount >= HTTP_MAX_ROUTES)
+    return false;
+  s_routes[s_routeCount++] = {port, verb, path, fn, nullptr};
+  return true;
+}
+
+bool http_engine_on_upload(uint16_t port, const char *path, HttpVerb verb,
+                           HttpBodyFn body, HttpHandlerFn fn) {
+  if (s_routeCount >= HTTP_MAX_ROUTES)
+    return false;
+  s_routes[s_routeCount++] = {port, verb, path, fn, body};
+  return true;
+}
+
+void http_engine_on_not_found(uint16_t port, HttpHandlerFn fn) {
+  for (int i = 0; i < s_listenerCount; i++) {
+    if (s_listeners[i].port == port)
+      s_listeners[i].notFound = fn;
+  }
+}
+
+void http_engine_stats(HttpEngineStats *out) {
+  s_stats.active = 0;
+  for (const HttpConn &c : s_conns) {
+    if (c.fd >= 0)
+      s_stats.active++;
+  }
+  *out = s_stats;
+}
+
+// ---------------------------------------------------------------------------
+// Connection lifecycle
+// ---------------------------------------------------------------------------
+
+static void conn_reset_request(HttpConn &c) {
+  c.verb = VERB_OTHER;
+  c.path = "";
+  c.query = "";
+  c.headers = "";
+  c.body = "";
+  c.bodyLen = 0;
+  c.headerLen = 0;
+  c.contentLength = 0;
+  c.keepAlive = false;
+  c.responded = false;
+  c.deferFn = nullptr;
+  c.deferCtx = nullptr;
+  c.chunked = false;
+  c.bodyLeft = 0;
+  c.sendLeft = 0;
+}
+
+static void conn_close(HttpConn &c) {
+  if (c.fd >= 0)
+    close(c.fd);
+  s_files[&c - s_conns].close();
+  c.fd = -1;
+  c.used = 0;
+  c.broken = false;
+  conn_reset_request(c);
+}
+
+// Short error reply for requests that never reach a handler
+static void conn_fail(HttpConn &c, int code) {
+  c.keepAlive = false;
+  http_send(c, code, "text/plain", status_text(code));
+  conn_close(c);
+}
+
+static void accept_clients(HttpListener &l) {
+  for (;;) {
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+    int fd = accept(l.fd, (struct sockaddr *)&peer, &len);
+    if (fd < 0)
+      return; // EAGAIN: backlog drained
+
+    HttpConn *slot = nullptr;
+    for (HttpConn &c : s_conns) {
+      if (c.fd < 0) {
+        slot = &c;
+        break;
+      }
+    }
+    if (!slot) {
+      // Pool exhausted: refuse quickly instead of letting the client hang
+      static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                 "Content-Length: 0\r\n"
+                                 "Connection: close\r\n\r\n";
+      send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL);
+      close(fd);
+      s_stats.rejected++;
+      continue;
+    }
+
+    set_nonblocking(fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    slot->fd = fd;
+    slot->remoteIp = peer.sin_addr.s_addr;
+    slot->localPort = l.port;
+    slot->used = 0;
+    slot->served = 0;
+    slot->broken = false;
+    slot->lastActiveMs = millis();
+    conn_reset_request(*slot);
+    s_stats.accepted++;
+  }
+}
+
+// Parses the header block in place (NUL-terminates path and query).
+// Returns 0 on success or an HTTP status code to fail with.
+static int parse_header(HttpConn &c, char *end, bool *expectContinue) {
+  char *p = c.buf;
+
+  char *sp = (char *)memchr(p, ' ', end - p);
+  if (!sp)
+    return 400;
+  size_t mlen = sp - p;
+  if (mlen == 3 && !memcmp(p, "GET", 3))
+    c.verb = VERB_GET;
+  else if (mlen == 4 && !memcmp(p, "POST", 4))
+    c.verb = VERB_POST;
+  else if (mlen == 3 && !memcmp(p, "PUT", 3))
+    c.verb = VERB_PUT;
+  else if (mlen == 6 && !memcmp(p, "DELETE", 6))
+    c.verb = VERB_DELETE;
+  else if (mlen == 7 && !memcmp(p, "OPTIONS", 7))
+    c.verb = VERB_OPTIONS;
+  else if (mlen == 8 && !memcmp(p, "PROPFIND", 8))
+    c.verb = VERB_PROPFIND;
+  else
+    c.verb = VERB_OTHER;
+
+  char *target = sp + 1;
+  char *sp2 = (char *)memchr(target, ' ', end - target);
+  if (!sp2)
+    return 400;
+  *sp2 = '\0';
+  c.path = target;
+  char *q = strchr(target, '?');
+  if (q) {
+    *q = '\0';
+    c.query = q + 1;
+  }
+
+  char *line = (char *)memchr(sp2 + 1, '\n', end - sp2);
+  if (!line)
+    return 400;
+  // HTTP/1.1 defaults to keep-alive, HTTP/1.0 to close
+  c.keepAlive = (line - sp2 > 8) && sp2[8] == '1';
+  line++;
+  c.headers = line;
+
+  *expectContinue = false;
+  while (line < end) {
+    char *eol = (char *)memchr(line, '\n', end - line + 2);
+    if (!eol)
+      break;
+    char *colon = (char *)memchr(line, ':', eol - line);
+    if (colon) {
+      size_t nlen = colon - line;
+      char *val = colon + 1;
+      while (*val == ' ' || *val == '\t')
+        val++;
+      if (nlen == 14 && !strncasecmp(line, "Content-Length", 14)) {
+        c.contentLength = strtoul(val, nullptr, 10);
+      } else if (nlen == 10 && !strncasecmp(line, "Connection", 10)) {
+        if (!strncasecmp(val, "close", 5))
+          c.keepAlive = false;
+        else if (!strncasecmp(val, "keep-alive", 10))
+          c.keepAlive = true;
+      } else if (nlen == 17 && !strncasecmp(line, "Transfer-Encoding", 17)) {
+        return 411; // chunked uploads are not supported
+      } else if (nlen == 6 && !strncasecmp(line, "Expect", 6)) {
+        *expectContinue = !strncasecmp(val, "100-continue", 12);
+      }
+    }
+    line = eol + 1;
+  }
+  return 0;
+}
+
+static const HttpRoute *find_route(const HttpConn &c) {
+  for (int i = 0; i < s_routeCount; i++) {
+    const HttpRoute &r = s_routes[i];
+    if (r.port == c.localPort && (r.verb == VERB_ANY || r.verb == c.verb) &&
+        strcmp(r.path, c.path) == 0)
+      return &r;
+  }
+  return nullptr;
+}
+
+static void dispatch(HttpConn &c) {
+  s_extraLen = 0;
+  const HttpRoute *r = find_route(c);
+  if (r) {
+    r->fn(c);
+    return;
+  }
+
+  HttpHandlerFn notFound = nullptr;
+  for (int i = 0; i < s_listenerCount; i++) {
+    if (s_listeners[i].port == c.localPort)
+      notFound = s_listeners[i].notFound;
+  }
+  if (notFound)
+    notFound(c);
+  else
+    http_send(c, 404, "text/plain", "Not Found");
+}
+
+// Ends the request just answered: closes the connection or shifts any
+// pipelined bytes down. True if more are buffered.
+static bool conn_complete(HttpConn &c) {
+  if (!c.responded)
+    http_send(c, 500, "text/plain", "No response");
+  if (c.chunked)
+    write_all(c, "0\r\n\r\n", 5); // last chunk
+  c.served++;
+
+  if (c.broken || !c.keepAlive) {
+    conn_close(c);
+    return false;
+  }
+
+  c.buf[c.requestLen] = c.requestNext;
+  c.used -= c.requestLen;
+  memmove(c.buf, c.buf + c.requestLen, c.used);
+  conn_reset_request(c);
+  c.lastActiveMs = millis();
+  return c.used > 0;
+}
+
+// Handles every complete request in the buffer (clients may pipeline)
+static void conn_process(HttpConn &c) {
+  while (c.fd >= 0 && !c.deferFn) {
+    if (c.headerLen == 0) {
+      char *end = nullptr;
+      for (size_t i = 3; i < c.used; i++) {
+        if (c.buf[i] == '\n' && c.buf[i - 1] == '\r' && c.buf[i - 2] == '\n' &&
+            c.buf[i - 3] == '\r') {
+          end = c.buf + i - 3;
+          break;
+        }
+      }
+      if (!end) {
+        if (c.used >= HTTP_CONN_BUFFER_SIZE - 1)
+          conn_fail(c, 413);
+        return;
+      }
+      bool expectContinue;
+      int err = parse_header(c, end, &expectContinue);
+      if (err) {
+        conn_fail(c, err);
+        return;
+      }
+      c.headerLen = end + 4 - c.buf;
+
+      const HttpRoute *r = find_route(c);
+      if (r && r->bodyFn)
+        c.bodyLeft = c.contentLength;
+      else if (c.contentLength >= HTTP_CONN_BUFFER_SIZE - c.headerLen) {
+        conn_fail(c, 413);
+        return;
+      }
+      // gSOAP-based clients wait for this before sending the body
+      if (expectContinue && c.contentLength > 0) {
+        static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        send(c.fd, cont, sizeof(cont) - 1, MSG_NOSIGNAL);
+      }
+    }
+
+    if (c.bodyLeft) {
+      // Streamed body: hand over what arrived and make room for more
+      size_t have = c.used - c.headerLen;
+      size_t take = have < c.bodyLeft ? have : c.bodyLeft;
+      if (take) {
+        find_route(c)->bodyFn(c, c.contentLength - c.bodyLeft,
+                              (const uint8_t *)c.buf + c.headerLen, take);
+        c.bodyLeft -= take;
+        c.used -= take;
+        memmove(c.buf + c.headerLen, c.buf + c.headerLen + take,
+                c.used - c.headerLen);
+      }
+      if (c.bodyLeft)
+        return;
+      c.contentLength = 0; // nothing of it left in the buffer
+    }
+
+    size_t total = c.headerLen + c.contentLength;
+    if (c.used < total)
+      return; // body still arriving
+
+    // Terminate the body; the byte it overwrites may start a pipelined request
+    c.requestLen = total;
+    c.requestNext = c.buf[total];
+    c.buf[total] = '\0';
+    c.body = c.buf + c.headerLen;
+    c.bodyLen = c.contentLength;
+
+    if (c.served + 1 >= HTTP_MAX_REQUESTS_PER_CONN)
+      c.keepAlive = false;
+    if (c.served > 0)
+      s_stats.reused++;
+    s_stats.requests++;
+
+    dispatch(c);
+    if (c.fd < 0)
+      return; // detached
+    if (c.deferFn && !c.responded)
+      return; // parked, answered from service_deferred()
+    c.deferFn = nullptr;
+    if (c.sendLeft && !c.broken)
+      return; // file going out, completed from conn_pump()
+    if (!conn_complete(c))
+      return;
+  }
+}
+
+// Sends file data while the socket takes it. Whatever a short send left
+// over is read again from the file next time.
+static void conn_pump(HttpConn &c) {
+  fs::File &f = s_files[&c - s_conns];
+  while (c.sendLeft && !c.broken) {
+    size_t want = c.sendLeft < sizeof(s_chunk) ? c.sendLeft : sizeof(s_chunk);
+    if (c.filePos != c.sendOff && !f.seek(c.sendOff))
+      c.broken = true;
+    size_t n = c.broken ? 0 : f.read(s_chunk, want);
+    c.filePos = c.sendOff + n;
+    if (n == 0) {
+      c.broken = true; // shorter than it said, or the card went away
+      break;
+    }
+    ssize_t sent = send(c.fd, s_chunk, n, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      c.broken = true;
+      break;
+    }
+    c.sendOff += sent;
+    c.sendLeft -= sent;
+    c.lastActiveMs = millis();
+    if ((size_t)sent < n)
+      return; // send buffer full: the rest once it drains
+  }
+  f.close();
+  c.sendLeft = 0;
+  if (conn_complete(c))
+    conn_process(c);
+}
+
+// Gives parked requests their chance to answer; the last one at the deadline
+static void service_deferred(uint32_t now) {
+  for (HttpConn &c : s_conns) {
+    if (c.fd < 0 || !c.deferFn)
+      continue;
+    bool timedOut = (int32_t)(now - c.deferDeadlineMs) >= 0;
+    s_extraLen = 0;
+    if (!c.deferFn(c, c.deferCtx, timedOut) && !timedOut)
+      continue;
+    c.deferFn = nullptr;
+    if (conn_complete(c))
+      conn_process(c);
+  }
+}
+
+// How long select() may sleep without missing a parked request's deadline
+static uint32_t deferred_wait(uint32_t now, uint32_t waitMs) {
+  for (const HttpConn &c : s_conns) {
+    if (c.fd < 0 || !c.deferFn)
+      continue;
+    int32_t left = (int32_t)(c.deferDeadlineMs - now);
+    if (left <= 0)
+      return 0;
+    if ((uint32_t)left < waitMs)
+      waitMs = left;
+  }
+  return waitMs;
+}
+
+static void conn_read(HttpConn &c) {
+  size_t room = HTTP_CONN_BUFFER_SIZE - 1 - c.used; // keep room for NUL
+  if (room == 0) {
+    conn_fail(c, 413);
+    return;
+  }
+  ssize_t n = recv(c.fd, c.buf + c.used, room, 0);
+  if (n == 0) {
+    conn_close(c); // peer closed
+    return;
+  }
+  if (n < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+      conn_close(c);
+    return;
+  }
+  c.used += n;
+  c.lastActiveMs = millis();
+  conn_process(c);
+}
+
+static void reap_idle(uint32_t now) {
+  for (HttpConn &c : s_conns) {
+    if (c.fd < 0 || c.deferFn)
+      continue; // parked requests run to their own deadline
+    // Half-received requests get less patience than idle keep-alive sockets;
+    // a file download only waits for the client to take the next piece
+    uint32_t limit = c.sendLeft ? HTTP_WRITE_TIMEOUT_MS
+                     : c.used   ? HTTP_REQUEST_TIMEOUT_MS
+                                : HTTP_KEEPALIVE_TIMEOUT_MS;
+    if (now - c.lastActiveMs > limit) {
+      s_stats.timeouts++;
+      conn_close(c);
+    }
+  }
+}
+
+bool http_engine_watch(int fd, HttpFdHandlerFn fn, void *ctx) {
+  for (HttpWatch &w : s_watches) {
+    if (w.fd < 0) {
+      w.fn = fn;
+      w.ctx = ctx;
+      w.fd = fd;
+      return true;
+    }
+  }
+  LOG_E("HTTP engine: no free watch slot for fd " + String(fd));
+  return false;
+}
+
+void http_engine_unwatch(int fd) {
+  for (HttpWatch &w : s_watches) {
+    if (w.fd == fd)
+      w.fd = -1;
+  }
+}
+
+uint32_t http_engine_poll(uint32_t waitMs) {
+  bool watching = false;
+  for (const HttpWatch &w : s_watches)
+    watching |= w.fd >= 0;
+  if (s_listenerCount == 0 && !watching) {
+    if (waitMs)
+      delay(waitMs);
+    return 0;
+  }
+  uint32_t start = micros();
+  uint32_t now = millis();
+  reap_idle(now);
+  service_deferred(now);
+  waitMs = deferred_wait(now, waitMs);
+
+  fd_set readable, writable;
+  FD_ZERO(&readable);
+  FD_ZERO(&writable);
+  int maxFd = -1;
+  for (int i = 0; i < s_listenerCount; i++) {
+    FD_SET(s_listeners[i].fd, &readable);
+    if (s_listeners[i].fd > maxFd)
+      maxFd = s_listeners[i].fd;
+  }
+  for (const HttpConn &c : s_conns) {
+    if (c.fd >= 0) {
+      FD_SET(c.fd, c.sendLeft ? &writable : &readable);
+      if (c.fd > maxFd)
+        maxFd = c.fd;
+    }
+  }
+  for (const HttpWatch &w : s_watches) {
+    if (w.fd >= 0) {
+      FD_SET(w.fd, &readable);
+      if (w.fd > maxFd)
+        maxFd = w.fd;
+    }
+  }
+
+  struct timeval tv;
+  tv.tv_sec = waitMs / 1000;
+  tv.tv_usec = (waitMs % 1000) * 1000;
+  uint32_t busy = micros() - start;
+  int ready = select(maxFd + 1, &readable, &writable, nullptr, &tv);
+  if (ready <= 0)
+    return busy;
+  start = micros();
+
+  for (int i = 0; i < s_listenerCount; i++) {
+    if (FD_ISSET(s_listeners[i].fd, &readable))
+      accept_clients(s_listeners[i]);
+  }
+  for (HttpConn &c : s_conns) {
+    // Freshly accepted sockets are not in this fd_set; they wait one round
+    if (c.fd < 0)
+      continue;
+    if (c.sendLeft && FD_ISSET(c.fd, &writable))
+      conn_pump(c);
+    else if (!c.sendLeft && FD_ISSET(c.fd, &readable))
+      conn_read(c);
+  }
+  for (HttpWatch &w : s_watches) {
+    // The callback may unwatch (and close) its own fd
+    int fd = w.fd;
+    if (fd >= 0 && FD_ISSET(fd, &readable))
+      w.fn(fd, w.ctx);
+  }
+  return busy + (micros() - start);
+}
+
+// ---------------------------------------------------------------------------
+// Request / response helpers
+// ---------------------------------------------------------------------------
+
+static int hex_val(char h) {
+  if (h >= '0' && h <= '9')
+    return h - '0';
+  if (h >= 'a' && h <= 'f')
+    return h - 'a' + 10;
+  if (h >= 'A' && h <= 'F')
+    return h - 'A' + 10;
+  return -1;
+}
+
+bool http_query_arg(const HttpConn &conn, const char *name, char *out,
+                    size_t size) {
+  size_t nlen = strlen(name);
+  const char *p = conn.query;
+  while (p && *p) {
+    const char *amp = strchr(p, '&');
+    const char *eq = strchr(p, '=');
+    if (eq && (!amp || eq < amp) && (size_t)(eq - p) == nlen &&
+        !memcmp(p, name, nlen)) {
+      const char *v = eq + 1;
+      const char *vend = amp ? amp : v + strlen(v);
+      size_t n = 0;
+      while (v < vend && n + 1 < size) {
+        if (*v == '%' && vend - v > 2 && hex_val(v[1]) >= 0 &&
+            hex_val(v[2]) >= 0) {
+          out[n++] = (char)(hex_val(v[1]) * 16 + hex_val(v[2]));
+          v += 3;
+        } else {
+          out[n++] = *v == '+' ? ' ' : *v;
+          v++;
+        }
+      }
+      out[n] = '\0';
+      return true;
+    }
+    p = amp ? amp + 1 : nullptr;
+  }
+  return false;
+}
+
+bool http_header(const HttpConn &conn, const char *name, char *out,
+                 size_t size) {
+  size_t nlen = strlen(name);
+  const char *end = conn.buf + conn.headerLen;
+  for (const char *line = conn.headers; line && line < end;) {
+    const char *eol = (const char *)memchr(line, '\n', end - line);
+    if (!eol)
+      break;
+    if ((size_t)(eol - line) > nlen && line[nlen] == ':' &&
+        !strncasecmp(line, name, nlen)) {
+      const char *v = line + nlen + 1;
+      while (*v == ' ' || *v == '\t')
+        v++;
+      size_t n = 0;
+      while (v < eol && *v != '\r' && n + 1 < size)
+        out[n++] = *v++;
+      out[n] = '\0';
+      return true;
+    }
+    line = eol + 1;
+  }
+  return false;
+}
+
+static bool write_all(HttpConn &conn, const void *data, size_t len) {
+  const char *p = (const char *)data;
+  while (len > 0 && !conn.broken) {
+    ssize_t n = send(conn.fd, p, len, MSG_NOSIGNAL);
+    if (n > 0) {
+      p += n;
+      len -= n;
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // Send buffer full: wait for the client to drain it, but not forever
+      fd_set writable;
+      FD_ZERO(&writable);
+      FD_SET(conn.fd, &writable);
+      struct timeval tv = {HTTP_WRITE_TIMEOUT_MS / 1000,
+                           (HTTP_WRITE_TIMEOUT_MS % 1000) * 1000};
+      if (select(conn.fd + 1, nullptr, &writable, nullptr, &tv) > 0)
+        continue;
+    }
+    conn.broken = true;
+  }
+  return !conn.broken;
+}
+
+bool http_write(HttpConn &conn, const void *data, size_t len) {
+  if (!conn.chunked)
+    return write_all(conn, data, len);
+  // An empty chunk would end the body; conn_complete() sends that one
+  if (len == 0)
+    return !conn.broken;
+  char size[12];
+  int n = snprintf(size, sizeof(size), "%x\r\n", (unsigned)len);
+  return write_all(conn, size, n) && write_all(conn, data, len) &&
+         write_all(conn, "\r\n", 2);
+}
+
+void http_add_header(HttpConn &conn, const char *name, const char *value) {
+  (void)conn;
+  int n = snprintf(s_extra + s_extraLen, sizeof(s_extra) - s_extraLen,
+                   "%s: %s\r\n", name, value);
+  if (n > 0 && s_extraLen + n < sizeof(s_extra))
+    s_extraLen += n;
+  else
+    s_extra[s_extraLen] = '\0';
+}
+
+static int format_header(HttpConn &conn, char *out, size_t size, int code,
+                         const char *type, size_t contentLength) {
+  char length[32];
+  if (contentLength == HTTP_LENGTH_UNKNOWN)
+    snprintf(length, sizeof(length), "Transfer-Encoding: chunked");
+  else
+    snprintf(length, sizeof(length), "Content-Length: %u",
+             (unsigned)contentLength);
+  conn.chunked = contentLength == HTTP_LENGTH_UNKNOWN;
+  int n = snprintf(out, size,
+                   "HTTP/1.1 %d %s\r\n"
+                   "Content-Type: %s\r\n"
+                   "%s\r\n"
+                   "%.*s"
+                   "Connection: %s\r\n\r\n",
+                   code, status_text(code), type, length, (int)s_extraLen,
+                   s_extra, conn.keepAlive ? "keep-alive" : "close");
+  s_extraLen = 0;
+  return n < (int)size ? n : (int)size - 1;
+}
+
+void http_begin_response(HttpConn &conn, int code, const char *type,
+                         size_t contentLength) {
+  char header[192 + HTTP_EXTRA_HEADERS];
+  int n = format_header(conn, header, sizeof(header), code, type,
+                        contentLength);
+  conn.responded = true;
+  write_all(conn, header, n);
+}
+
+void http_send(HttpConn &conn, int code, const char *type, const char *body,
+               size_t len) {
+  char header[192 + HTTP_EXTRA_HEADERS];
+  int n = format_header(conn, header, sizeof(header), code, type, len);
+  conn.responded = true;
+
+  // Header and body in one segment where possible
+  struct iovec iov[2] = {{header, (size_t)n}, {(void *)body, len}};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = len ? 2 : 1;
+  ssize_t sent = sendmsg(conn.fd, &msg, MSG_NOSIGNAL);
+  if (sent < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      conn.broken = true;
+      return;
+    }
+    sent = 0;
+  }
+  if ((size_t)sent < (size_t)n) {
+    if (!write_all(conn, header + sent, n - sent))
+      return;
+    sent = n;
+  }
+  size_t bodySent = sent - n;
+  if (bodySent < len)
+    write_all(conn, body + bodySent, len - bodySent);
+}
+
+void http_send(HttpConn &conn, int code, const char *type, const char *body) {
+  http_send(conn, code, type, body, body ? strlen(body) : 0);
+}
+
+void http_defer(HttpConn &conn, uint32_t timeoutMs, HttpDeferFn fn, void *ctx) {
+  conn.deferFn = fn;
+  conn.deferCtx = ctx;
+  conn.deferDeadlineMs = millis() + timeoutMs;
+}
+
+void http_send_file(HttpConn &conn, int code, const char *type, fs::File &file) {
+  size_t size = file.size();
+  http_begin_response(conn, code, type, size);
+  if (size == 0 || conn.broken) {
+    file.close();
+    return;
+  }
+  s_files[&conn - s_conns] = file; // a shared handle: closed by the engine
+  conn.sendOff = 0;
+  conn.sendLeft = size;
+  conn.filePos = 0;
+}
+
+int http_detach(HttpConn &conn) {
+  int fd = conn.fd;
+  int flags = fcntl(fd, F_GETFL, 0);
+  fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+  conn.fd = -1;
+  conn_close(conn);
+  return fd;
+}
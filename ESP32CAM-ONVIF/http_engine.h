@@ -0,0 +1,161 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ==============================================================================
+//   HTTP engine - event-driven HTTP/1.1 front end (select loop, keep-alive)
+// ==============================================================================
+// Plain BSD sockets (lwIP on the ESP32, POSIX on Linux) driven by a single
+// select() loop. Sockets are non-blocking: a slow or stalled client only holds
+// its own connection slot, never the loop. Connections come from a bounded
+// pool, each with one fixed request buffer allocated at start-up, and stay
+// open between requests (keep-alive) until idle for HTTP_KEEPALIVE_TIMEOUT_MS.
+//
+// Handlers run to completion, one at a time. Their responses are
+// written straight to the socket; a full send buffer is waited on for at
+// most HTTP_WRITE_TIMEOUT_MS before the connection is dropped. A handler that
+// has nothing to say yet (ONVIF PullMessages long-polls) parks the request
+// with http_defer() instead of waiting; the loop answers it later.
+//
+// Nothing large goes through a handler in one go. A file (SD download,
+// WebDAV GET) is sent by the loop a chunk at a time as the client drains
+// it (http_send_file). A request body larger than the buffer (firmware
+// upload) goes to its route's body callback piece by piece as it arrives
+// (http_engine_on_upload). A response that never ends (the MJPEG stream)
+// takes its connection to a task of its own (http_detach).
+// ==============================================================================
+
+enum HttpVerb : uint8_t {
+  VERB_ANY = 0, // route matching only
+  VERB_GET,
+  VERB_POST,
+  VERB_PUT,
+  VERB_DELETE,
+  VERB_OPTIONS,
+  VERB_PROPFIND, // WebDAV
+  VERB_OTHER
+};
+
+namespace fs {
+class File;
+}
+
+struct HttpConn;
+
+// Answers a parked request: runs on every http_engine_poll() round until it
+// returns true, and once more with timedOut set at the deadline, when it
+// must respond. Returning true without a response sends a 500.
+typedef bool (*HttpDeferFn)(HttpConn &conn, void *ctx, bool timedOut);
+
+struct HttpConn {
+  // --- Current request (valid inside the handler) ---
+  HttpVerb verb;
+  const char *path;  // "/onvif/device_service"
+  const char *query; // text after '?', "" if none
+  const char *headers; // header lines, up to the blank line (http_header())
+  const char *body;  // NUL-terminated, bodyLen bytes
+  size_t bodyLen;
+  uint32_t remoteIp; // network byte order, same as (uint32_t)IPAddress
+  uint16_t localPort;
+  bool keepAlive; // response announces keep-alive
+
+  // --- Engine state ---
+  int fd; // -1 = free slot
+  char *buf;
+  size_t used;
+  size_t headerLen; // 0 until the header block is complete
+  size_t contentLength;
+  uint32_t lastActiveMs;
+  uint16_t served;
+  bool responded;
+  bool broken;
+  HttpDeferFn deferFn; // set while the request is parked
+  void *deferCtx;
+  uint32_t deferDeadlineMs;
+  size_t requestLen; // header + body of the parked request
+  char requestNext;  // byte after it, overwritten by the body's NUL
+  bool chunked;      // response of unknown length, sent chunked
+  size_t bodyLeft;   // upload bytes still to come (body callback routes)
+  size_t sendOff;    // file being sent: bytes done and still to go
+  size_t sendLeft;
+  size_t filePos;    // where the file was read up to
+};
+
+typedef void (*HttpHandlerFn)(HttpConn &conn);
+
+// One piece of a streamed request body: offset bytes came before it, the
+// whole body is conn.contentLength. The request fields are valid.
+typedef void (*HttpBodyFn)(HttpConn &conn, size_t offset, const uint8_t *data,
+                           size_t len);
+
+struct HttpEngineStats {
+  uint32_t accepted;
+  uint32_t rejected; // pool full
+  uint32_t requests;
+  uint32_t reused; // requests served on an already open connection
+  uint32_t timeouts;
+  uint8_t active;
+};
+
+// Allocates the connection pool on first use and starts listening on `port`
+bool http_engine_listen(uint16_t port);
+
+// Exact path match; later routes never shadow earlier ones
+bool http_engine_on(uint16_t port, const char *path, HttpVerb verb,
+                    HttpHandlerFn fn);
+void http_engine_on_not_found(uint16_t port, HttpHandlerFn fn);
+// A route whose body may exceed HTTP_CONN_BUFFER_SIZE: it is handed to body
+// as it arrives instead of being buffered, then fn answers with bodyLen 0
+bool http_engine_on_upload(uint16_t port, const char *path, HttpVerb verb,
+                           HttpBodyFn body, HttpHandlerFn fn);
+
+// Extra sockets (e.g. the WS-Discovery UDP socket) woken by the same select()
+// call; fn runs on the polling task whenever fd is readable
+typedef void (*HttpFdHandlerFn)(int fd, void *ctx);
+bool http_engine_watch(int fd, HttpFdHandlerFn fn, void *ctx);
+void http_engine_unwatch(int fd);
+
+// Waits up to waitMs for socket activity, then services every ready socket.
+// Returns the microseconds spent on the work, the select() wait left out.
+uint32_t http_engine_poll(uint32_t waitMs);
+
+void http_engine_stats(HttpEngineStats *out);
+
+// --- Request helpers ---
+// Copies the URL-decoded value of query argument `name`; false if absent
+bool http_query_arg(const HttpConn &conn, const char *name, char *out,
+                    size_t size);
+// Copies the value of request header `name` (any case); false if absent
+bool http_header(const HttpConn &conn, const char *name, char *out,
+                 size_t size);
+
+// --- Response helpers (one response per request) ---
+// Extra header line for the response about to be sent (security headers,
+// WWW-Authenticate...). Lines that don't fit HTTP_EXTRA_HEADERS are dropped.
+void http_add_header(HttpConn &conn, const char *name, const char *value);
+
+void http_send(HttpConn &conn, int code, const char *type, const char *body,
+               size_t len);
+void http_send(HttpConn &conn, int code, const char *type, const char *body);
+
+// Instead of responding: park the request until fn answers it, for at most
+// timeoutMs. The request fields (path, body, ...) are not valid in fn; pass
+// what it needs in ctx. Requests pipelined behind it wait. If the client goes away
+// the request is dropped without calling fn.
+void http_defer(HttpConn &conn, uint32_t timeoutMs, HttpDeferFn fn, void *ctx);
+
+// Header only; follow with exactly contentLength bytes of http_write(). With
+// HTTP_LENGTH_UNKNOWN each write goes out as a chunk and the engine ends
+// the body when the handler returns.
+#define HTTP_LENGTH_UNKNOWN ((size_t)-1)
+void http_begin_response(HttpConn &conn, int code, const char *type,
+                         size_t contentLength);
+bool http_write(HttpConn &conn, const void *data, size_t len);
+
+// The whole file as the body. The loop sends it as the client takes it and
+// closes it afterwards; requests pipelined behind wait.
+void http_send_file(HttpConn &conn, int code, const char *type, fs::File &file);
+
+// Hands the connection over (no response from the engine, pipelined bytes
+// dropped): returns its socket, now blocking, for the caller to close
+int http_detach(HttpConn &conn);
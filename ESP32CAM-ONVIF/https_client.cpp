@@ -0,0 +1,509 @@
+#include "https_client.h"
+#include "config.h"
+#include "heap_monitor.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+struct HttpsSlot {
+  WiFiClientSecure client;
+  char host[64]; // empty: slot closed
+  uint16_t port;
+  bool busy; // acquired by a task
+  uint32_t idleSinceMs;
+};
+
+static HttpsSlot s_slots[HTTPS_MAX_CONNECTIONS];
+static HttpsStats s_stats;
+
+// Created on first use (thread-safe function-local statics)
+static SemaphoreHandle_t pool_mutex() {
+  static SemaphoreHandle_t m = xSemaphoreCreateMutex();
+  return m;
+}
+
+static SemaphoreHandle_t handshake_sem() {
+  static SemaphoreHandle_t s =
+      xSemaphoreCreateCounting(HTTPS_MAX_HANDSHAKES, HTTPS_MAX_HANDSHAKES);
+  return s;
+}
+
+static void pool_lock() { xSemaphoreTake(pool_mutex(), portMAX_DELAY); }
+static void pool_unlock() { xSemaphoreGive(pool_mutex()); }
+
+static void slot_close(HttpsSlot &s) {
+  if (s.host[0])
+    s.client.stop();
+  s.host[0] = '\0';
+}
+
+static bool heap_allows_handshake() {
+  if (heap_monitor_level() >= HEAP_SHED_VIEWER)
+    return false;
+  return heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) >=
+         HTTPS_MIN_BLOCK_FOR_TLS;
+}
+
+WiFiClientSecure *https_acquire(const char *host, uint16_t port,
+                                bool *reused) {
+  HttpsSlot *slot = nullptr;
+  bool reuse = false;
+  if (reused)
+    *reused = false;
+
+  pool_lock();
+  // An idle connection to this host that's still up
+  for (int i = 0; i < HTTPS_MAX_CONNECTIONS && !slot; i++) {
+    HttpsSlot &s = s_slots[i];
+    if (s.busy || !s.host[0] || s.port != port || strcmp(s.host, host))
+      continue;
+    if (s.client.connected()) {
+      slot = &s;
+      reuse = true;
+    } else {
+      slot_close(s); // the server closed it meanwhile
+    }
+  }
+  // Else a closed slot
+  for (int i = 0; i < HTTPS_MAX_CONNECTIONS && !slot; i++)
+    if (!s_slots[i].busy && !s_slots[i].host[0])
+      slot = &s_slots[i];
+  // Else the connection to another host that has been idle longest
+  if (!slot) {
+    for (int i = 0; i < HTTPS_MAX_CONNECTIONS; i++) {
+      HttpsSlot &s = s_slots[i];
+      if (!s.busy &&
+          (!slot || (int32_t)(s.idleSinceMs - slot->idleSinceMs) < 0))
+        slot = &s;
+    }
+    if (slot)
+      slot_close(*slot);
+  }
+  if (slot)
+    slot->busy = true;
+  if (!slot)
+    s_stats.refused++;
+  else if (reuse)
+    s_stats.reused++;
+  pool_unlock();
+
+  if (!slot) {
+    Serial.printf("[HTTPS] %s: all %d connections busy\n", host,
+                  HTTPS_MAX_CONNECTIONS);
+    return nullptr;
+  }
+  if (reuse) {
+    if (reused)
+      *reused = true;
+    return &slot->client;
+  }
+
+  // New handshake: one at a time, and only with room for its buffers
+  bool ok = false;
+  if (xSemaphoreTake(handshake_sem(), pdMS_TO_TICKS(HTTPS_TIMEOUT_MS)) == pdTRUE) {
+    if (heap_allows_handshake()) {
+      slot->client.setInsecure(); // Skip certificate validation to save RAM/time
+      ok = slot->client.connect(host, port);
+      if (!ok)
+        Serial.printf("[HTTPS] %s: connection failed\n", host);
+    } else {
+      Serial.printf("[HTTPS] %s: handshake refused, low memory\n", host);
+    }
+    xSemaphoreGive(handshake_sem());
+  } else {
+    Serial.printf("[HTTPS] %s: handshake slot busy\n", host);
+  }
+
+  pool_lock();
+  if (ok) {
+    strncpy(slot->host, host, sizeof(slot->host) - 1);
+    slot->host[sizeof(slot->host) - 1] = '\0';
+    slot->port = port;
+    s_stats.handshakes++;
+  } else {
+    slot->client.stop();
+    slot->host[0] = '\0';
+    slot->busy = false;
+    s_stats.failed++;
+  }
+  pool_unlock();
+  return ok ? &slot->client : nullptr;
+}
+
+void https_release(WiFiClientSecure *client, bool keepAlive) {
+  pool_lock();
+  for (int i = 0; i < HTTPS_MAX_CONNECTIONS; i++) {
+    HttpsSlot &s = s_slots[i];
+    if (&s.client != client)
+      continue;
+    if (!keepAlive || !s.client.connected())
+      slot_close(s);
+    s.idleSinceMs = millis();
+    s.busy = false;
+  }
+  pool_unlock();
+}
+
+static void close_idle(bool all) {
+  uint32_t now = millis();
+  pool_lock();
+  for (int i = 0; i < HTTPS_MAX_CONNECTIONS; i++) {
+    HttpsSlot &s = s_slots[i];
+    if (s.busy || !s.host[0])
+      continue;
+    if (all || now - s.idleSinceMs > HTTPS_KEEPALIVE_MS)
+      slot_close(s);
+  }
+  pool_unlock();
+}
+
+void https_maintain() {
+  close_idle(heap_monitor_level() >= HEAP_SHED_VIEWER);
+}
+
+void https_close_idle() { close_idle(true); }
+
+void https_stats(HttpsStats *out) {
+  pool_lock();
+  *out = s_stats;
+  out->open = 0;
+  for (int i = 0; i < HTTPS_MAX_CONNECTIONS; i++)
+    if (s_slots[i].host[0])
+      out->open++;
+  pool_unlock();
+}
+
+bool https_write(WiFiClientSecure *client, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (len) {
+    size_t n = client->write(p, len < 1024 ? len : 1024);
+    if (n == 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool https_print(WiFiClientSecure *client, const char *str) {
+  return https_write(client, str, strlen(str));
+}
+
+// false on timeout, or when the peer closed with nothing left to read
+static bool wait_available(WiFiClientSecure *c, uint32_t deadline) {
+  while (!c->available()) {
+    if (!c->connected() || (int32_t)(millis() - deadline) >= 0)
+      return false;
+    delay(5);
+  }
+  return true;
+}
+
+// -1 on timeout or close
+static int read_byte(WiFiClientSecure *c, uint32_t deadline) {
+  return wait_available(c, deadline) ? c->read() : -1;
+}
+
+// One line without CR/LF; longer lines are cut to fit. -1 on timeout.
+static int read_line(WiFiClientSecure *c, char *buf, size_t size,
+                     uint32_t deadline) {
+  size_t len = 0;
+  for (;;) {
+    int ch = read_byte(c, deadline);
+    if (ch < 0)
+      return -1;
+    if (ch == '\n')
+      break;
+    if (ch != '\r' && len + 1 < size)
+      buf[len++] = (char)ch;
+  }
+  buf[len] = '\0';
+  return (int)len;
+}
+
+// Reads n body bytes, keeping what fits into body
+static bool read_body(WiFiClientSecure *c, size_t n, char *body, size_t bodySize,
+                      size_t &kept, uint32_t deadline) {
+  uint8_t chunk[128];
+  while (n) {
+    if (!wait_available(c, deadline))
+      return false;
+    int got = c->read(chunk, n < sizeof(chunk) ? n : sizeof(chunk));
+    if (got <= 0)
+      return false;
+    if (body && kept + 1 < bodySize) {
+      size_t room = bodySize - 1 - kept;
+      size_t take = (size_t)got < room ? (size_t)got : room;
+      memcpy(body + kept, chunk, take);
+      kept += take;
+    }
+    n -= got;
+  }
+  return true;
+}
+
+static bool read_response(WiFiClientSecure *client, HttpsResponse *resp,
+                          char *body, size_t bodySize, uint32_t deadline) {
+  resp->status = 0;
+  resp->contentLength = -1;
+  resp->keepAlive = false;
+  resp->location[0] = '\0';
+  if (body && bodySize)
+    body[0] = '\0';
+
+  char line[320];
+  if (read_line(client, line, sizeof(line), deadline) < 0)
+    return false;
+  if (strncmp(line, "HTTP/1.", 7) || strlen(line) < 12)
+    return false;
+  resp->status = atoi(line + 9);
+  resp->keepAlive = line[7] == '1'; // HTTP/1.1 keeps the connection by default
+
+  bool chunked = false;
+  for (;;) {
+    int len = read_line(client, line, sizeof(line), deadline);
+    if (len < 0)
+      return false;
+    if (len == 0)
+      break;
+    char *value = strchr(line, ':');
+    if (!value)
+      continue;
+    *value++ = '\0';
+    while (*value == ' ')
+      value++;
+    if (!strcasecmp(line, "Content-Length"))
+      resp->contentLength = atol(value);
+    else if (!strcasecmp(line, "Connection"))
+      resp->keepAlive = !strcasecmp(value, "keep-alive") ||
+                        (resp->keepAlive && strcasecmp(value, "close"));
+    else if (!strcasecmp(line, "Transfer-Encoding"))
+      chunked = strcasestr(value, "chunked") != nullptr;
+    else if (!strcasecmp(line, "Location")) {
+      strncpy(resp->location, value, sizeof(resp->location) - 1);
+      resp->location[sizeof(resp->location) - 1] = '\0';
+    }
+  }
+
+  size_t kept = 0;
+  bool ok = true;
+  if (chunked) {
+    for (;;) {
+      if (read_line(client, line, sizeof(line), deadline) < 0) {
+        ok = false;
+        break;
+      }
+      size_t size = strtoul(line, nullptr, 16);
+      if (size == 0) {
+        // Trailer headers up to the blank line
+        while ((ok = read_line(client, line, sizeof(line), deadline) >= 0) &&
+               line[0])
+          ;
+        break;
+      }
+      if (!(ok = read_body(client, size, body, bodySize, kept, deadline)) ||
+          !(ok = read_line(client, line, sizeof(line), deadline) >= 0))
+        break;
+    }
+  } else if (resp->contentLength >= 0) {
+    ok = read_body(client, resp->contentLength, body, bodySize, kept, deadline);
+  } else {
+    // Delimited by close: read what arrives, the connection can't be reused
+    read_body(client, SIZE_MAX, body, bodySize, kept, deadline);
+    resp->keepAlive = false;
+  }
+  if (body && bodySize)
+    body[kept] = '\0';
+  if (!ok)
+    resp->keepAlive = false;
+  return resp->status > 0;
+}
+
+bool https_read_response(WiFiClientSecure *client, HttpsResponse *resp,
+                         char *body, size_t bodySize) {
+  return read_response(client, resp, body, bodySize,
+                       millis() + HTTPS_TIMEOUT_MS);
+}
+
+bool https_split_url(const char *url, char *host, size_t hostSize,
+                     uint16_t *port, const char **path) {
+  if (strncasecmp(url, "https://", 8))
+    return false;
+  const char *h = url + 8;
+  size_t n = strcspn(h, ":/?");
+  if (n == 0 || n >= hostSize)
+    return false;
+  memcpy(host, h, n);
+  host[n] = '\0';
+  *port = 443;
+  const char *rest = h + n;
+  if (*rest == ':') {
+    *port = (uint16_t)atoi(rest + 1);
+    rest += strcspn(rest, "/?");
+  }
+  *path = *rest ? rest : "/";
+  return *port != 0;
+}
+
+// Appends to the text, extending the last segment when it is text too
+static void mp_text(HttpsMultipart *mp, const char *fmt, ...) {
+  if (mp->overflow)
+    return;
+  size_t room = sizeof(mp->text) - mp->textLen;
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(mp->text + mp->textLen, room, fmt, ap);
+  va_end(ap);
+  if (n < 0 || (size_t)n >= room) {
+    mp->overflow = true;
+    return;
+  }
+  HttpsMultipart::Segment *last =
+      mp->segmentCount ? &mp->segments[mp->segmentCount - 1] : nullptr;
+  if (last && !last->data && !last->path) {
+    last->len += n;
+  } else if (mp->segmentCount < HTTPS_MULTIPART_SEGMENTS) {
+    mp->segments[mp->segmentCount++] = {nullptr, nullptr, nullptr, mp->textLen,
+                                        (size_t)n};
+  } else {
+    mp->overflow = true;
+    return;
+  }
+  mp->textLen += n;
+  mp->length += n;
+}
+
+#define BOUNDARY_PREFIX "----ESP32CAMBoundary"
+static_assert(sizeof(BOUNDARY_PREFIX) - 1 + 8 == HTTPS_MULTIPART_BOUNDARY_LEN,
+              "callers size their bodies by the boundary length");
+
+void https_multipart_begin(HttpsMultipart *mp) {
+  snprintf(mp->boundary, sizeof(mp->boundary), BOUNDARY_PREFIX "%08lx",
+           (unsigned long)millis());
+  mp->textLen = 0;
+  mp->segmentCount = 0;
+  mp->length = 0;
+  mp->overflow = false;
+}
+
+void https_multipart_field(HttpsMultipart *mp, const char *name,
+                           const char *value) {
+  mp_text(mp,
+          "--%s\r\nContent-Disposition: form-data; name=\"%s\"\r\n\r\n%s\r\n",
+          mp->boundary, name, value);
+}
+
+// Part header, the file's segment, then the CRLF ending the part
+static void mp_file(HttpsMultipart *mp, const char *name, const char *fileName,
+                    const char *contentType,
+                    const HttpsMultipart::Segment &file) {
+  mp_text(mp,
+          "--%s\r\nContent-Disposition: form-data; name=\"%s\"; "
+          "filename=\"%s\"\r\nContent-Type: %s\r\n\r\n",
+          mp->boundary, name, fileName, contentType);
+  if (mp->overflow)
+    return;
+  if (mp->segmentCount == HTTPS_MULTIPART_SEGMENTS) {
+    mp->overflow = true;
+    return;
+  }
+  mp->segments[mp->segmentCount++] = file;
+  mp->length += file.len;
+  mp_text(mp, "\r\n");
+}
+
+void https_multipart_file(HttpsMultipart *mp, const char *name,
+                          const char *fileName, const char *contentType,
+                          const uint8_t *data, size_t len) {
+  mp_file(mp, name, fileName, contentType, {data, nullptr, nullptr, 0, len});
+}
+
+void https_multipart_file(HttpsMultipart *mp, const char *name,
+                          const char *fileName, const char *contentType,
+                          fs::FS &fs, const char *path, size_t len) {
+  mp_file(mp, name, fileName, contentType, {nullptr, &fs, path, 0, len});
+}
+
+bool https_multipart_end(HttpsMultipart *mp) {
+  mp_text(mp, "--%s--\r\n", mp->boundary);
+  return !mp->overflow;
+}
+
+// Streams len bytes of the file through chunk. A file that is missing or
+// shorter than announced fails the request: the Content-Length is out.
+static bool write_file(WiFiClientSecure *client,
+                       const HttpsMultipart::Segment &s) {
+  File f = s.fs->open(s.path, FILE_READ);
+  if (!f) {
+    Serial.printf("[HTTPS] %s: cannot open\n", s.path);
+    return false;
+  }
+  uint8_t chunk[1024];
+  size_t left = s.len;
+  while (left) {
+    size_t n = f.read(chunk, left < sizeof(chunk) ? left : sizeof(chunk));
+    if (n == 0 || !https_write(client, chunk, n))
+      break;
+    left -= n;
+  }
+  f.close();
+  return left == 0;
+}
+
+bool https_multipart_write(WiFiClientSecure *client, const HttpsMultipart *mp) {
+  for (uint8_t i = 0; i < mp->segmentCount; i++) {
+    const HttpsMultipart::Segment &s = mp->segments[i];
+    bool ok = s.path   ? write_file(client, s)
+              : s.data ? https_write(client, s.data, s.len)
+                       : https_write(client, mp->text + s.off, s.len);
+    if (!ok)
+      return false;
+  }
+  return true;
+}
+
+int https_request(const char *host, uint16_t port, const char *method,
+                  const char *path, const HttpsMultipart *mp,
+                  HttpsResponse *resp, char *body, size_t bodySize) {
+  char headers[192];
+  int n = snprintf(headers, sizeof(headers),
+                   " HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n", host);
+  if (n < 0 || n >= (int)sizeof(headers))
+    return 0;
+  if (mp)
+    n += snprintf(headers + n, sizeof(headers) - n,
+                  "Content-Type: multipart/form-data; boundary=%s\r\n"
+                  "Content-Length: %u\r\n",
+                  mp->boundary, (unsigned)mp->length);
+  if (n + 3 > (int)sizeof(headers))
+    return 0;
+  strcpy(headers + n, "\r\n");
+
+  resp->status = 0;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reused;
+    WiFiClientSecure *client = https_acquire(host, port, &reused);
+    if (!client)
+      break;
+    bool sent = https_print(client, method) && https_print(client, " ") &&
+                https_print(client, path) && https_print(client, headers) &&
+                (!mp || https_multipart_write(client, mp));
+    uint32_t deadline = millis() + HTTPS_TIMEOUT_MS;
+    // Closed with not a byte of response: the server dropped the idle
+    // connection as the request arrived, without acting on it
+    bool dropped = sent && !wait_available(client, deadline) &&
+                   !client->connected();
+    bool ok = sent && !dropped &&
+              read_response(client, resp, body, bodySize, deadline);
+    https_release(client, ok && resp->keepAlive);
+    if (resp->status || !reused || (sent && !dropped))
+      break;
+  }
+  return resp->status;
+}
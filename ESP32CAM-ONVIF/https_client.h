@@ -0,0 +1,141 @@
+#pragma once
+#include "config.h"
+#include <FS.h>
+#include <WiFiClientSecure.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ==============================================================================
+//   HTTPS client manager - shared outbound TLS connections (Telegram, GDrive)
+// ==============================================================================
+// Every cloud request used to construct a WiFiClientSecure and pay a full
+// handshake: seconds of CPU and ~40KB of internal RAM. With one photo per
+// motion event, that was once per photo.
+//
+// Connections live in HTTPS_MAX_CONNECTIONS static slots, keyed by host and
+// port. After a request whose response allows keep-alive, the connection
+// goes back to the pool, and the next request to that host within
+// HTTPS_KEEPALIVE_MS reuses it without a handshake. New handshakes are
+// serialised (HTTPS_MAX_HANDSHAKES). They are refused when the largest free
+// block is below HTTPS_MIN_BLOCK_FOR_TLS or the heap monitor is shedding
+// load, so two uploads can't exhaust the heap between them.
+//
+// WiFiClientSecure offers no TLS session-ticket API. Resumption therefore
+// means reusing the open connection; a connection that was closed costs a
+// full handshake again.
+//
+// A slot belongs to the task that acquired it until released. The pool
+// itself is guarded and may be used from any task.
+// ==============================================================================
+
+struct HttpsResponse {
+  int status;            // 0 when no status line arrived
+  int32_t contentLength; // -1: not given (body read to close, no reuse)
+  bool keepAlive;        // the connection may carry another request
+  char location[256];    // Location header of a redirect, if any
+};
+
+// Connected client for host:port, or nullptr when the pool is full, the
+// handshake cap or heap guard refused, or the connection failed. *reused
+// tells whether it is a kept-alive connection rather than a new handshake.
+WiFiClientSecure *https_acquire(const char *host, uint16_t port,
+                                bool *reused = nullptr);
+
+// Returns the connection to the pool (kept open when keepAlive) or closes it
+void https_release(WiFiClientSecure *client, bool keepAlive);
+
+// Writes all of data; false on a short write (connection lost)
+bool https_write(WiFiClientSecure *client, const void *data, size_t len);
+bool https_print(WiFiClientSecure *client, const char *str);
+
+// Reads the status line, headers and body. The body is kept up to
+// bodySize - 1 bytes in body (NUL-terminated, may be nullptr); the rest is
+// discarded so the connection can be reused.
+bool https_read_response(WiFiClientSecure *client, HttpsResponse *resp,
+                         char *body = nullptr, size_t bodySize = 0);
+
+// multipart/form-data body sent straight from where its parts live. Part
+// headers and text fields are formatted into text; files are referenced,
+// not copied: a pinned event snapshot goes out as it sits in its slot, a
+// journaled one is read from its file on the card in small chunks as it is
+// sent. Content-Length is known once the body is ended, before anything is
+// sent.
+// Sized for the largest body sent, a Telegram sendMediaGroup of
+// OUTBOX_BATCH_MAX photos: per photo a text run (its part header and its
+// entry in the "media" field) then the photo, and one closing run.
+// telegram_manager.cpp checks the worst case fits.
+#define HTTPS_MULTIPART_FILES OUTBOX_BATCH_MAX
+#define HTTPS_MULTIPART_FILE_TEXT 256 // per photo
+#define HTTPS_MULTIPART_TEXT (256 + HTTPS_MULTIPART_FILES * HTTPS_MULTIPART_FILE_TEXT)
+#define HTTPS_MULTIPART_SEGMENTS (2 * HTTPS_MULTIPART_FILES + 1)
+#define HTTPS_MULTIPART_BOUNDARY_LEN 28 // "----ESP32CAMBoundary" + 8 hex digits
+
+// Returned instead of an HTTP status when the body overflowed: nothing was
+// sent, and the same request would never fit
+#define HTTPS_BODY_TOO_LARGE -1
+
+struct HttpsMultipart {
+  char boundary[40];
+  char text[HTTPS_MULTIPART_TEXT];
+  size_t textLen;
+  struct Segment {
+    const uint8_t *data; // file bytes in memory
+    fs::FS *fs;          // or file bytes read from fs at path
+    const char *path;
+    size_t off; // neither: text + off
+    size_t len;
+  } segments[HTTPS_MULTIPART_SEGMENTS];
+  uint8_t segmentCount;
+  size_t length; // Content-Length
+  bool overflow; // text or segments didn't fit: don't send
+};
+
+void https_multipart_begin(HttpsMultipart *mp);
+void https_multipart_field(HttpsMultipart *mp, const char *name,
+                           const char *value);
+void https_multipart_file(HttpsMultipart *mp, const char *name,
+                          const char *fileName, const char *contentType,
+                          const uint8_t *data, size_t len);
+// A file part read from path when sent (each time, should the request be
+// retried). path must stay valid until then, and the file len bytes long.
+void https_multipart_file(HttpsMultipart *mp, const char *name,
+                          const char *fileName, const char *contentType,
+                          fs::FS &fs, const char *path, size_t len);
+// Adds the closing boundary; false when the body overflowed
+bool https_multipart_end(HttpsMultipart *mp);
+bool https_multipart_write(WiFiClientSecure *client, const HttpsMultipart *mp);
+
+// One request on a pooled connection: "method path" with Host and
+// keep-alive headers, then the multipart body when mp is given. A kept-alive
+// connection the server dropped meanwhile only fails once used, so a request
+// on one that failed while being written, or was closed before any response
+// byte came back, is tried once more on a fresh connection. Nothing else is
+// retried: a request that timed out waiting for its response may still have
+// been acted on (an upload the script is slow to acknowledge). Returns the
+// HTTP status, 0 on failure.
+int https_request(const char *host, uint16_t port, const char *method,
+                  const char *path, const HttpsMultipart *mp,
+                  HttpsResponse *resp, char *body = nullptr,
+                  size_t bodySize = 0);
+
+// Splits "https://host[:port]/path" into host, port and a pointer to the
+// path within url ("/" when absent)
+bool https_split_url(const char *url, char *host, size_t hostSize,
+                     uint16_t *port, const char **path);
+
+// Closes connections idle longer than HTTPS_KEEPALIVE_MS, and every idle
+// one while the heap monitor is shedding load. Call periodically, from a
+// task with stack for it: closing sends a TLS close_notify through mbedtls
+// (the Cloud_Outbox task does it between passes).
+void https_maintain();
+// Closes every idle connection (the last user is going away)
+void https_close_idle();
+
+struct HttpsStats {
+  uint32_t handshakes;
+  uint32_t reused;
+  uint32_t refused; // pool full, handshake cap or heap guard
+  uint32_t failed;  // connect / handshake errors
+  uint8_t open;
+};
+void https_stats(HttpsStats *out);
@@ -0,0 +1,303 @@
+#include <Arduino.h>
+#include "media_config.h"
+#include "config.h"
+#include "esp_camera.h"
+#include "onvif_server.h"
+#include <Preferences.h>
+
+struct Resolution {
+  framesize_t frameSize;
+  uint16_t width;
+  uint16_t height;
+};
+
+// Sensor frame sizes offered to NVRs, largest first
+static const Resolution RESOLUTIONS[] = {
+    {FRAMESIZE_UXGA, 1600, 1200}, {FRAMESIZE_SXGA, 1280, 1024},
+    {FRAMESIZE_HD, 1280, 720},    {FRAMESIZE_XGA, 1024, 768},
+    {FRAMESIZE_SVGA, 800, 600},   {FRAMESIZE_VGA, 640, 480},
+    {FRAMESIZE_CIF, 400, 296},    {FRAMESIZE_QVGA, 320, 240},
+    {FRAMESIZE_QQVGA, 160, 120},
+};
+static const int RESOLUTION_COUNT = sizeof(RESOLUTIONS) / sizeof(RESOLUTIONS[0]);
+
+static const char *const ENCODER_TOKENS[] = {"VideoEncoderToken_Main",
+                                             "VideoEncoderToken_Sub"};
+static const char *const PROFILE_TOKENS[] = {"Profile_1", "Profile_2"};
+static const char *const STREAM_NAMES[] = {"MainStream", "SubStream"};
+static const char *const NVS_KEYS[] = {"main", "sub"};
+
+#ifdef VIDEO_CODEC_H264
+static const MediaEncoding BUILD_ENCODING = MEDIA_ENC_H264;
+#else
+static const MediaEncoding BUILD_ENCODING = MEDIA_ENC_JPEG;
+#endif
+
+static VideoEncoderConfig s_configs[MEDIA_STREAM_COUNT];
+static volatile MediaStreamId s_active = MEDIA_MAIN;
+static volatile uint32_t s_revision = 1;
+
+// Rate controller adaptation of the active stream (not saved)
+static uint8_t s_qualityDrop = 0;
+static volatile uint32_t s_minIntervalMs = 0;
+// Heap monitor's frame size cap (not saved), 0 = none
+static uint16_t s_maxWidth = 0;
+
+static uint16_t max_width() {
+#if defined(VIDEO_CODEC_H264) && !defined(H264_HW_ENCODER)
+  return H264_SW_MAX_WIDTH;
+#else
+  // Without PSRAM the frame buffer lives in internal RAM
+  return psramFound() ? 1600 : 640;
+#endif
+}
+
+static int first_resolution() {
+  for (int i = 0; i < RESOLUTION_COUNT; i++) {
+    if (RESOLUTIONS[i].width <= max_width())
+      return i;
+  }
+  return RESOLUTION_COUNT - 1;
+}
+
+// Largest supported frame size that fits in width x height
+static const Resolution &snap_resolution(uint16_t width, uint16_t height) {
+  for (int i = first_resolution(); i < RESOLUTION_COUNT; i++) {
+    if (RESOLUTIONS[i].width <= width && RESOLUTIONS[i].height <= height)
+      return RESOLUTIONS[i];
+  }
+  return RESOLUTIONS[RESOLUTION_COUNT - 1];
+}
+
+static uint32_t clamp_u32(uint32_t v, uint32_t lo, uint32_t hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static void sanitize(VideoEncoderConfig &c) {
+  const Resolution &r = snap_resolution(c.width, c.height);
+  c.width = r.width;
+  c.height = r.height;
+  c.quality = clamp_u32(c.quality, 1, 100);
+  c.fps = clamp_u32(c.fps, 1, MEDIA_MAX_FPS);
+  c.gop = clamp_u32(c.gop, 1, 255);
+  c.bitrateKbps = clamp_u32(c.bitrateKbps, 64, 16384);
+}
+
+static void load_defaults() {
+  VideoEncoderConfig &m = s_configs[MEDIA_MAIN];
+  m.encoding = BUILD_ENCODING;
+  m.quality = MEDIA_MAIN_QUALITY;
+#ifdef VIDEO_CODEC_H264
+#ifdef H264_HW_ENCODER
+  m.width = 1280;
+  m.height = 720;
+#else
+  m.width = 640;
+  m.height = 480;
+#endif
+  m.fps = H264_FPS;
+  m.gop = H264_GOP;
+  m.bitrateKbps = H264_BITRATE / 1000;
+#else
+  m.width = MEDIA_MAIN_WIDTH;
+  m.height = MEDIA_MAIN_HEIGHT;
+  m.fps = MEDIA_MAIN_FPS;
+  m.gop = MEDIA_MAIN_FPS;
+  m.bitrateKbps = MEDIA_MAIN_BITRATE_KBPS;
+#endif
+
+  VideoEncoderConfig &s = s_configs[MEDIA_SUB];
+  s.encoding = BUILD_ENCODING;
+  s.width = MEDIA_SUB_WIDTH;
+  s.height = MEDIA_SUB_HEIGHT;
+  s.quality = MEDIA_SUB_QUALITY;
+  s.fps = MEDIA_SUB_FPS;
+  s.gop = MEDIA_SUB_FPS * 2;
+  s.bitrateKbps = MEDIA_SUB_BITRATE_KBPS;
+}
+
+static void save(MediaStreamId id) {
+  Preferences prefs;
+  if (!prefs.begin("media", false))
+    return;
+  prefs.putBytes(NVS_KEYS[id], &s_configs[id], sizeof(VideoEncoderConfig));
+  prefs.end();
+}
+
+void media_config_init() {
+  load_defaults();
+
+  Preferences prefs;
+  if (prefs.begin("media", true)) {
+    for (int i = 0; i < MEDIA_STREAM_COUNT; i++) {
+      VideoEncoderConfig saved;
+      if (prefs.getBytesLength(NVS_KEYS[i]) == sizeof(saved) &&
+          prefs.getBytes(NVS_KEYS[i], &saved, sizeof(saved)) == sizeof(saved) &&
+          saved.encoding == BUILD_ENCODING)
+        s_configs[i] = saved;
+    }
+    prefs.end();
+  }
+  for (VideoEncoderConfig &c : s_configs)
+    sanitize(c);
+
+  s_active = MEDIA_MAIN;
+  media_config_apply_sensor();
+  Serial.printf("[INFO] Media: main %ux%u@%u, sub %ux%u@%u (%s)\n",
+                s_configs[MEDIA_MAIN].width, s_configs[MEDIA_MAIN].height,
+                s_configs[MEDIA_MAIN].fps, s_configs[MEDIA_SUB].width,
+                s_configs[MEDIA_SUB].height, s_configs[MEDIA_SUB].fps,
+                media_encoding_str(BUILD_ENCODING));
+}
+
+const VideoEncoderConfig &media_config_get(MediaStreamId id) {
+  return s_configs[id < MEDIA_STREAM_COUNT ? id : MEDIA_MAIN];
+}
+
+bool media_config_set(MediaStreamId id, const VideoEncoderConfig &cfg) {
+  if (id >= MEDIA_STREAM_COUNT || cfg.encoding != BUILD_ENCODING)
+    return false;
+
+  VideoEncoderConfig c = cfg;
+  sanitize(c);
+  s_configs[id] = c;
+  save(id);
+
+  s_revision = s_revision + 1;
+  onvif_bump_config_epoch();
+  Serial.printf("[INFO] Media: %s set to %ux%u q%u %ufps %ukbps\n",
+                STREAM_NAMES[id], c.width, c.height, c.quality, c.fps,
+                (unsigned)c.bitrateKbps);
+  return true;
+}
+
+const char *media_encoder_token(MediaStreamId id) {
+  return ENCODER_TOKENS[id < MEDIA_STREAM_COUNT ? id : MEDIA_MAIN];
+}
+
+const char *media_profile_token(MediaStreamId id) {
+  return PROFILE_TOKENS[id < MEDIA_STREAM_COUNT ? id : MEDIA_MAIN];
+}
+
+const char *media_stream_name(MediaStreamId id) {
+  return STREAM_NAMES[id < MEDIA_STREAM_COUNT ? id : MEDIA_MAIN];
+}
+
+bool media_stream_from_token(const char *token, MediaStreamId *out) {
+  for (int i = 0; i < MEDIA_STREAM_COUNT; i++) {
+    if (strcmp(token, ENCODER_TOKENS[i]) == 0 ||
+        strcmp(token, PROFILE_TOKENS[i]) == 0) {
+      *out = (MediaStreamId)i;
+      return true;
+    }
+  }
+  // Single-encoder token used by older firmware and cached by some NVRs
+  if (strcmp(token, "VideoEncoderToken") == 0) {
+    *out = MEDIA_MAIN;
+    return true;
+  }
+  return false;
+}
+
+const char *media_encoding_str(MediaEncoding enc) {
+  return enc == MEDIA_ENC_H264 ? "H264" : "JPEG";
+}
+
+void media_config_activate(MediaStreamId id) {
+  if (id >= MEDIA_STREAM_COUNT || id == s_active)
+    return;
+  s_active = id;
+  s_revision = s_revision + 1;
+}
+
+MediaStreamId media_config_active() { return s_active; }
+
+uint32_t media_config_revision() { return s_revision; }
+
+// esp_camera quality streamed: configured, plus the rate controller's drop
+static int applied_quality(const VideoEncoderConfig &c) {
+  int q = media_jpeg_quality(c.quality) + s_qualityDrop;
+  return q < 63 ? q : 63;
+}
+
+void media_config_apply_sensor() {
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s)
+    return;
+  const VideoEncoderConfig &c = s_configs[s_active];
+  framesize_t fs = snap_resolution(c.width, c.height).frameSize;
+#ifndef VIDEO_CODEC_H264 // the encoder is opened for the configured size
+  if (s_maxWidth && c.width > s_maxWidth)
+    fs = snap_resolution(s_maxWidth, 0xFFFF).frameSize;
+#endif
+  if (s->status.framesize != fs)
+    s->set_framesize(s, fs);
+  int q = applied_quality(c);
+  if (s->status.quality != q)
+    s->set_quality(s, q);
+}
+
+uint32_t media_configured_interval_ms() {
+  uint8_t fps = s_configs[s_active].fps;
+  return 1000 / (fps ? fps : 1);
+}
+
+uint32_t media_frame_interval_ms() {
+  uint32_t ms = media_configured_interval_ms();
+  return s_minIntervalMs > ms ? s_minIntervalMs : ms;
+}
+
+void media_set_adaptation(uint8_t jpegQualityDrop, uint32_t minIntervalMs) {
+  s_minIntervalMs = minIntervalMs;
+  if (jpegQualityDrop == s_qualityDrop)
+    return;
+  s_qualityDrop = jpegQualityDrop;
+  s_revision = s_revision + 1; // sensor re-applied by the RTSP task
+}
+
+void media_set_resolution_cap(uint16_t maxWidth) {
+  if (maxWidth == s_maxWidth)
+    return;
+  s_maxWidth = maxWidth;
+  s_revision = s_revision + 1;
+}
+
+int media_resolution_count() { return RESOLUTION_COUNT - first_resolution(); }
+
+void media_resolution_at(int i, uint16_t *width, uint16_t *height) {
+  const Resolution &r = RESOLUTIONS[first_resolution() + i];
+  *width = r.width;
+  *height = r.height;
+}
+
+int media_jpeg_quality(uint8_t onvifQuality) {
+  int q = clamp_u32(onvifQuality, 1, 100);
+  return MEDIA_JPEG_QUALITY_WORST -
+         (q - 1) * (MEDIA_JPEG_QUALITY_WORST - MEDIA_JPEG_QUALITY_BEST) / 99;
+}
+
+void media_config_adopt_sensor() {
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s)
+    return;
+
+  VideoEncoderConfig c = s_configs[s_active];
+  // Under a heap cap the sensor's frame size is no user choice either
+  for (int i = 0; i < RESOLUTION_COUNT && !s_maxWidth; i++) {
+    if (RESOLUTIONS[i].frameSize == s->status.framesize) {
+      c.width = RESOLUTIONS[i].width;
+      c.height = RESOLUTIONS[i].height;
+      break;
+    }
+  }
+  // Invert media_jpeg_quality(), unless the sensor still runs the rate
+  // controller's quality - that is no user choice to keep
+  if (s->status.quality != applied_quality(c)) {
+    int jq = clamp_u32(s->status.quality, MEDIA_JPEG_QUALITY_BEST,
+                       MEDIA_JPEG_QUALITY_WORST);
+    c.quality = 1 + (MEDIA_JPEG_QUALITY_WORST - jq) * 99 /
+                        (MEDIA_JPEG_QUALITY_WORST - MEDIA_JPEG_QUALITY_BEST);
+  }
+
+  media_config_set(s_active, c);
+}
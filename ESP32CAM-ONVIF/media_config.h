@@ -0,0 +1,85 @@
+#pragma once
+#include <stdint.h>
+
+// ==============================================================================
+//   Media configuration - ONVIF video encoder configurations (main / sub)
+// ==============================================================================
+// Single source of truth for what each stream delivers: the ONVIF Media and
+// Media2 responses, the RTSP DESCRIBE SDP and the RTSP frame pacing all read
+// from here, and SetVideoEncoderConfiguration writes here.
+//
+// There is one sensor, so only one stream is "active": the sensor is
+// configured for whichever stream an RTSP client described (/mjpeg/1 = main,
+// /mjpeg/2 = sub), and for the main stream otherwise. Several sessions may
+// play at once (a unicast one, or any number watching the multicast group),
+// all of the active stream: a DESCRIBE of the other stream is refused while
+// another session holds the streamer. Changes are picked up by the RTSP
+// task, which owns the sensor and encoder while streaming (see
+// media_config_revision()).
+// ==============================================================================
+
+enum MediaStreamId : uint8_t { MEDIA_MAIN = 0, MEDIA_SUB, MEDIA_STREAM_COUNT };
+
+enum MediaEncoding : uint8_t { MEDIA_ENC_JPEG = 0, MEDIA_ENC_H264 };
+
+struct VideoEncoderConfig {
+  MediaEncoding encoding;
+  uint16_t width;
+  uint16_t height;
+  uint8_t quality;      // ONVIF scale 1..100, higher = better
+  uint8_t fps;          // FrameRateLimit
+  uint16_t gop;         // H.264 GovLength (ignored for JPEG)
+  uint32_t bitrateKbps; // BitrateLimit
+};
+
+// Loads saved configurations (NVS) and configures the sensor for main
+void media_config_init();
+
+const VideoEncoderConfig &media_config_get(MediaStreamId id);
+
+// Clamps/snaps cfg to what the hardware supports, saves it and bumps the
+// ONVIF config epoch. Returns false if the encoding isn't available.
+bool media_config_set(MediaStreamId id, const VideoEncoderConfig &cfg);
+
+// "VideoEncoderToken_Main", "Profile_1", "MainStream"...
+const char *media_encoder_token(MediaStreamId id);
+const char *media_profile_token(MediaStreamId id);
+const char *media_stream_name(MediaStreamId id);
+// Accepts encoder or profile tokens; false if unknown
+bool media_stream_from_token(const char *token, MediaStreamId *out);
+const char *media_encoding_str(MediaEncoding enc);
+
+// Stream the sensor should currently serve (the described stream, else
+// main). Callers make sure no viewer of the other stream is playing.
+void media_config_activate(MediaStreamId id);
+MediaStreamId media_config_active();
+
+// Bumped on every set/activate; the RTSP task re-applies when it changes
+uint32_t media_config_revision();
+// Applies the active stream to the sensor (frame size, JPEG quality)
+void media_config_apply_sensor();
+// Capture pacing: the active stream's FrameRateLimit, slowed down by the
+// rate controller while adapted
+uint32_t media_frame_interval_ms();
+uint32_t media_configured_interval_ms();
+
+// Rate controller (rate_controller.h) back-off on top of the active stream:
+// esp_camera quality added and a floor for the frame interval. Temporary -
+// not saved, not reported over ONVIF; 0, 0 restores the configuration.
+void media_set_adaptation(uint8_t jpegQualityDrop, uint32_t minIntervalMs);
+
+// Heap monitor (heap_monitor.h) mitigation: the sensor runs at most this
+// wide, whatever the active stream asks for. Temporary like the above; 0
+// lifts it. MJPEG only - an H.264 encoder is opened for the configured size.
+void media_set_resolution_cap(uint16_t maxWidth);
+
+// Resolutions offered to NVRs, largest first
+int media_resolution_count();
+void media_resolution_at(int i, uint16_t *width, uint16_t *height);
+
+// ONVIF quality 1..100 <-> esp_camera JPEG quality (lower = better)
+int media_jpeg_quality(uint8_t onvifQuality);
+
+// The web UI changed the sensor directly: fold frame size and quality into
+// the active stream's configuration so ONVIF reports what is streamed
+void media_config_adopt_sensor();
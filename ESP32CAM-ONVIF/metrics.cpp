@@ -0,0 +1,170 @@
+#include "metrics.h"
+#include "frame_pipeline.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *const TIMER_NAMES[MT_COUNT] = {
+    "fb_acquire_rtsp", "fb_acquire_http", "fb_acquire_sd",
+    "fb_acquire_motion", "jpeg_parse",    "packetize",
+    "socket_send",     "h264_encode",     "soap",
+    "sd_write"};
+
+static const char *const CONSUMER_NAMES[MC_COUNT] = {"http_stream", "snapshot",
+                                                     "sd", "motion"};
+
+static const char *const EVENT_NAMES[MF_COUNT] = {"captured", "sent",
+                                                  "dropped"};
+
+void latency_hist_add(LatencyHistogram &h, uint32_t us) {
+  int b = 0;
+  while (b < LATENCY_HIST_BUCKETS - 1 && us >= (LATENCY_HIST_BASE_US << b))
+    b++;
+  h.bucket[b]++;
+  h.count++;
+  h.totalUs += us;
+  if (us > h.maxUs)
+    h.maxUs = us;
+}
+
+const char *metrics_timer_name(MetricTimer t) {
+  return t < MT_COUNT ? TIMER_NAMES[t] : "unknown";
+}
+
+#if METRICS_ENABLED
+
+static LatencyHistogram s_timers[MT_COUNT];
+static uint32_t s_frames[MC_COUNT][MF_COUNT];
+static uint32_t s_cyclesPerUs = 240;
+
+void metrics_init() {
+  uint32_t mhz = getCpuFrequencyMhz();
+  if (mhz)
+    s_cyclesPerUs = mhz;
+}
+
+void metrics_record_us(MetricTimer t, uint32_t us) {
+  if (t < MT_COUNT)
+    latency_hist_add(s_timers[t], us);
+}
+
+void metrics_record_cycles(MetricTimer t, uint32_t start) {
+  metrics_record_us(t, (metrics_cycles() - start) / s_cyclesPerUs);
+}
+
+void metrics_frame(MetricConsumer c, MetricFrameEvent e) {
+  if (c < MC_COUNT && e < MF_COUNT)
+    s_frames[c][e]++;
+}
+
+#endif
+
+static void prom_histogram(SoapWriter &w, const char *op,
+                           const LatencyHistogram &h) {
+  uint32_t cumulative = 0;
+  for (int b = 0; b < LATENCY_HIST_BUCKETS - 1; b++) {
+    cumulative += h.bucket[b];
+    w.printf_P("esp32cam_latency_seconds_bucket{op=\"%s\",le=\"%.6f\"} %u\n",
+               op, (LATENCY_HIST_BASE_US << b) / 1e6, (unsigned)cumulative);
+  }
+  w.printf_P("esp32cam_latency_seconds_bucket{op=\"%s\",le=\"+Inf\"} %u\n",
+             op, (unsigned)h.count);
+  w.printf_P("esp32cam_latency_seconds_sum{op=\"%s\"} %.6f\n", op,
+             h.totalUs / 1e6);
+  w.printf_P("esp32cam_latency_seconds_count{op=\"%s\"} %u\n", op,
+             (unsigned)h.count);
+}
+
+void metrics_write_prometheus(MetricsSink sink, void *ctx) {
+  static char block[512]; // single caller (web task); keeps it off its stack
+  SoapWriter w(block, sizeof(block), sink, ctx);
+
+  w.printf_P("# HELP esp32cam_latency_seconds Hot-path operation and "
+             "RTSP pipeline stage latency\n"
+             "# TYPE esp32cam_latency_seconds histogram\n");
+  char op[24];
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    LatencyHistogram h;
+    frame_pipeline_stats((PipelineStage)s, &h);
+    snprintf(op, sizeof(op), "rtsp_%s",
+             frame_pipeline_stage_name((PipelineStage)s));
+    prom_histogram(w, op, h);
+  }
+#if METRICS_ENABLED
+  for (int t = 0; t < MT_COUNT; t++) {
+    LatencyHistogram h = s_timers[t];
+    prom_histogram(w, TIMER_NAMES[t], h);
+  }
+#endif
+
+  PipelineCounters pc;
+  frame_pipeline_counters(&pc);
+  w.printf_P("# HELP esp32cam_frames_total Camera frames per consumer\n"
+             "# TYPE esp32cam_frames_total counter\n");
+  w.printf_P("esp32cam_frames_total{consumer=\"rtsp\",event=\"captured\"} %u\n"
+             "esp32cam_frames_total{consumer=\"rtsp\",event=\"sent\"} %u\n",
+             (unsigned)pc.captured, (unsigned)pc.sent);
+  w.printf_P("esp32cam_frames_total{consumer=\"rtsp\",event=\"dropped\"} %u\n"
+             "esp32cam_frames_total{consumer=\"rtsp\",event=\"failed\"} %u\n",
+             (unsigned)pc.dropped, (unsigned)pc.captureFailed);
+#if METRICS_ENABLED
+  for (int c = 0; c < MC_COUNT; c++)
+    for (int e = 0; e < MF_COUNT; e++)
+      w.printf_P("esp32cam_frames_total{consumer=\"%s\",event=\"%s\"} %u\n",
+                 CONSUMER_NAMES[c], EVENT_NAMES[e], (unsigned)s_frames[c][e]);
+
+  w.printf_P("# TYPE esp32cam_heap_free_bytes gauge\n"
+             "esp32cam_heap_free_bytes %u\n",
+             (unsigned)ESP.getFreeHeap());
+  w.printf_P("# TYPE esp32cam_heap_min_free_bytes gauge\n"
+             "esp32cam_heap_min_free_bytes %u\n",
+             (unsigned)ESP.getMinFreeHeap());
+  w.printf_P("# TYPE esp32cam_uptime_seconds counter\n"
+             "esp32cam_uptime_seconds %lu\n",
+             (unsigned long)(millis() / 1000));
+#endif
+  w.flush();
+}
+
+static void json_op(SoapWriter &w, bool first, const char *name,
+                    const LatencyHistogram &h) {
+  w.printf_P("%s\"%s\":[%u,%u,%u]", first ? "" : ",", name,
+             (unsigned)h.count, (unsigned)(h.count ? h.totalUs / h.count : 0),
+             (unsigned)h.maxUs);
+}
+
+size_t metrics_summary_json(char *buf, size_t size) {
+  SoapBufferSink out = {buf, size, 0};
+  if (size)
+    buf[0] = '\0';
+  char block[128];
+  SoapWriter w(block, sizeof(block), soap_buffer_sink, &out);
+  w.printf_P("{\"ops\":{");
+  char op[24];
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    LatencyHistogram h;
+    frame_pipeline_stats((PipelineStage)s, &h);
+    snprintf(op, sizeof(op), "rtsp_%s",
+             frame_pipeline_stage_name((PipelineStage)s));
+    json_op(w, s == 0, op, h);
+  }
+#if METRICS_ENABLED
+  for (int t = 0; t < MT_COUNT; t++) {
+    LatencyHistogram h = s_timers[t];
+    json_op(w, false, TIMER_NAMES[t], h);
+  }
+#endif
+  PipelineCounters pc;
+  frame_pipeline_counters(&pc);
+  w.printf_P("},\"frames\":{\"rtsp\":[%u,%u,%u]", (unsigned)pc.captured,
+             (unsigned)pc.sent, (unsigned)pc.dropped);
+#if METRICS_ENABLED
+  for (int c = 0; c < MC_COUNT; c++)
+    w.printf_P(",\"%s\":[%u,%u,%u]", CONSUMER_NAMES[c],
+               (unsigned)s_frames[c][MF_CAPTURED],
+               (unsigned)s_frames[c][MF_SENT],
+               (unsigned)s_frames[c][MF_DROPPED]);
+#endif
+  w.printf_P("}}");
+  w.flush();
+  return out.len;
+}
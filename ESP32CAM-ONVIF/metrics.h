@@ -0,0 +1,126 @@
+#pragma once
+#include "soap_writer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// ==============================================================================
+//   Hot-path instrumentation - latency histograms and frame counters
+// ==============================================================================
+// Everything lives in static memory: one log2 histogram per timed operation
+// and a frame counter per consumer of camera frames. Timers read the CPU
+// cycle counter (a register read), so they are cheap enough for per-packet
+// use; the tasks they run in are pinned, so start and stop read the same
+// core's counter. Readers may see a sample half-recorded, which is fine for
+// statistics.
+//
+// Exported as Prometheus text at /metrics (web port) and as a JSON summary
+// on the MQTT <base>/metrics topic with every status publish.
+//
+// METRICS_ENABLED=0 compiles every timer and counter away; it is the default
+// off the ESP32 (posix glue builds). LatencyHistogram itself is always
+// available - the RTSP pipeline and rate controller depend on it.
+// ==============================================================================
+
+#ifndef METRICS_ENABLED
+#ifdef ESP_PLATFORM
+#define METRICS_ENABLED 1
+#else
+#define METRICS_ENABLED 0
+#endif
+#endif
+
+// Bucket i counts samples below LATENCY_HIST_BASE_US << i (16us .. 262ms);
+// the last one is open-ended
+#define LATENCY_HIST_BUCKETS 16
+#define LATENCY_HIST_BASE_US 16UL
+
+struct LatencyHistogram {
+  uint32_t bucket[LATENCY_HIST_BUCKETS];
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t totalUs;
+};
+
+void latency_hist_add(LatencyHistogram &h, uint32_t us);
+
+enum MetricTimer : uint8_t {
+  // esp_camera_fb_get() wait, one per consumer so each histogram has a
+  // single writing task (latency_hist_add is not atomic)
+  MT_FB_RTSP = 0,    // RTSP capture task (MJPEG or H.264 streamer)
+  MT_FB_HTTP,        // web task: /stream and /snapshot
+  MT_FB_SD,          // SD recorder
+  MT_FB_MOTION,      // motion detection
+  MT_JPEG_PARSE,     // RTP/JPEG: locating quant tables and scan data
+  MT_PACKETIZE,      // building one RTP packet (JPEG or H.264)
+  MT_SOCKET_SEND,    // writing one RTP packet (TCP, UDP or multicast)
+  MT_H264_ENCODE,    // one frame through the H.264 encoder
+  MT_SOAP,           // one ONVIF request, parse to response sent or parked
+  MT_SD_WRITE,       // one frame to the SD card
+  MT_COUNT
+};
+
+// Consumers outside the RTSP pipeline (which keeps its own counters, see
+// frame_pipeline_counters())
+enum MetricConsumer : uint8_t {
+  MC_HTTP_STREAM = 0, // /stream MJPEG
+  MC_SNAPSHOT,
+  MC_SD,
+  MC_MOTION,
+  MC_COUNT
+};
+
+enum MetricFrameEvent : uint8_t {
+  MF_CAPTURED = 0,
+  MF_SENT,    // delivered: written to the client / card, analysed
+  MF_DROPPED, // captured but not delivered
+  MF_COUNT
+};
+
+// Streamed exports go through a SoapWriter; the sink gets its blocks
+typedef SoapSinkFn MetricsSink;
+
+#if METRICS_ENABLED
+
+#include <Arduino.h>
+
+inline uint32_t metrics_cycles() { return ESP.getCycleCount(); }
+
+void metrics_init();
+void metrics_record_us(MetricTimer t, uint32_t us);
+// Records the time since `start` (a metrics_cycles() value)
+void metrics_record_cycles(MetricTimer t, uint32_t start);
+void metrics_frame(MetricConsumer c, MetricFrameEvent e);
+
+// Times the enclosing scope
+class MetricScope {
+public:
+  explicit MetricScope(MetricTimer t) : m_timer(t), m_start(metrics_cycles()) {}
+  ~MetricScope() { metrics_record_cycles(m_timer, m_start); }
+
+private:
+  MetricTimer m_timer;
+  uint32_t m_start;
+};
+#define METRIC_SCOPE_CAT_(a, b) a##b
+#define METRIC_SCOPE_CAT(a, b) METRIC_SCOPE_CAT_(a, b)
+#define METRIC_SCOPE(t) MetricScope METRIC_SCOPE_CAT(metricScope_, __LINE__)(t)
+
+#else
+
+inline uint32_t metrics_cycles() { return 0; }
+inline void metrics_init() {}
+inline void metrics_record_us(MetricTimer, uint32_t) {}
+inline void metrics_record_cycles(MetricTimer, uint32_t) {}
+inline void metrics_frame(MetricConsumer, MetricFrameEvent) {}
+#define METRIC_SCOPE(t) ((void)0)
+
+#endif
+
+const char *metrics_timer_name(MetricTimer t);
+
+// Prometheus text exposition (0.0.4), written through sink in pieces
+void metrics_write_prometheus(MetricsSink sink, void *ctx);
+
+// {"ops":{"fb_acquire_rtsp":[count,avg_us,max_us],...},"frames":{...}};
+// returns the length written
+size_t metrics_summary_json(char *buf, size_t size);
@@ -3,10 +3,9 @@
 
 #include <Arduino.h>
 #include "motion_detection.h"
-#include "mqtt_manager.h"
-#include "telegram_manager.h"
-#include "gdrive_manager.h"
+#include "event_queue.h"
 #include "esp_camera.h"
+#include "metrics.h"
 
 // Frame-difference motion detection using average luminance
 // Lightweight: ~2ms per check at VGA, no PSRAM needed
@@ -50,11 +49,15 @@ void motion_detection_loop() {
     if (millis() - _last_check < MOTION_CHECK_INTERVAL_MS) return;
     _last_check = millis();
 
+    uint32_t t0 = metrics_cycles();
     camera_fb_t* fb = esp_camera_fb_get();
+    metrics_record_cycles(MT_FB_MOTION, t0);
     if (!fb) return;
+    metrics_frame(MC_MOTION, MF_CAPTURED);
 
     uint32_t avg_luma = calc_avg_luma_fast(fb->buf, fb->len);
     esp_camera_fb_return(fb);
+    metrics_frame(MC_MOTION, MF_SENT);
 
     if (!_has_baseline) {
         _prev_avg_luma = avg_luma;
@@ -68,29 +71,25 @@ void motion_detection_loop() {
     if (diff > MOTION_THRESHOLD) {
         if (!motion) {
             Serial.printf("[MOTION] Detected! delta=%ld\n", (long)diff);
-            mqtt_publish_motion(true);
+            // Consumed by ONVIF PullPoint subscribers, MQTT, /api/events and -
+            // with the snapshot, in its own task - the cloud outbox (Telegram, Drive)
+            char msg[32];
+            snprintf(msg, sizeof(msg), "Motion detected (delta=%ld)", (long)diff);
             
             bool needCapture = appSettings.telegramEnabled || (appSettings.googleDriveEnabled && appSettings.googleDriveMotion);
-            if (needCapture) {
-                camera_fb_t *snap = esp_camera_fb_get();
-                if (snap) {
-                    if (appSettings.telegramEnabled) {
-                        telegram_send_photo(snap);
-                    }
-                    if (appSettings.googleDriveEnabled && appSettings.googleDriveMotion) {
-                        uploadToGDriveAsync(snap);
-                    }
-                    esp_camera_fb_return(snap);
-                } else {
-                    Serial.println("[MOTION] Failed to capture frame for cloud upload.");
-                }
+            camera_fb_t *snap = needCapture ? esp_camera_fb_get() : NULL;
+            if (needCapture && !snap) {
+                Serial.println("[MOTION] Failed to capture frame for cloud upload.");
             }
+            event_queue_push_frame(EVENT_MOTION, true, msg,
+                                   snap ? snap->buf : NULL, snap ? snap->len : 0);
+            if (snap) esp_camera_fb_return(snap);
         }
         motion = true;
         _last_motion_time = millis();
     } else if (motion && (millis() - _last_motion_time > MOTION_COOLDOWN_MS)) {
         motion = false;
-        mqtt_publish_motion(false);
+        event_queue_push(EVENT_MOTION, false, "Motion cleared");
     }
 
     _prev_avg_luma = avg_luma;
@@ -5,6 +5,8 @@
 #include <ArduinoJson.h>
 #include "camera_control.h"
 #include "auto_flash.h"
+#include "event_queue.h"
+#include "metrics.h"
 
 WiFiClient espClient;
 PubSubClient mqttClient(espClient);
@@ -18,20 +20,29 @@ static String state_topic = "";
 static String cmd_topic = "";
 static String motion_topic = "";
 static String status_topic = "";
+static String event_topic = "";
 static bool mqtt_initialized = false;
+// Every event type, in order: a broker outage replays the backlog still in
+// the ring (EVENT_POLICY_ALL)
+static EventSubscriber event_sub;
 
-void mqtt_callback(char* topic, byte* payload, unsigned int length) {
-    String msg = "";
-    for (unsigned int i = 0; i < length; i++) {
-        msg += (char)payload[i];
-    }
-    Serial.printf("[MQTT] Message arrived on topic: %s. Message: %s\n", topic, msg.c_str());
+static void mqtt_publish_event(const CamEvent &ev);
 
-    if (String(topic) == cmd_topic) {
-        if (msg == "ON") {
+void mqtt_callback(char* topic, byte* payload, unsigned int length) {
+    // Commands are short words; longer payloads are truncated, not copied
+    // into a growing String
+    char msg[16];
+    size_t len = length < sizeof(msg) - 1 ? length : sizeof(msg) - 1;
+    memcpy(msg, payload, len);
+    msg[len] = '\0';
+    Serial.printf("[MQTT] Message arrived on topic: %s. Message: %.*s\n",
+                  topic, (int)length, (const char *)payload);
+
+    if (strcmp(topic, cmd_topic.c_str()) == 0 && length == len) {
+        if (strcmp(msg, "ON") == 0) {
             set_flash_led(true);
             mqttClient.publish(state_topic.c_str(), "ON", true);
-        } else if (msg == "OFF") {
+        } else if (strcmp(msg, "OFF") == 0) {
             set_flash_led(false);
             mqttClient.publish(state_topic.c_str(), "OFF", true);
         }
@@ -69,6 +80,7 @@ void init_mqtt() {
     cmd_topic = topic_base + "/flash/set";
     motion_topic = topic_base + "/motion";
     status_topic = topic_base + "/status";
+    event_topic = topic_base + "/event";
 
     String mac = WiFi.macAddress();
     mac.replace(":", "");
@@ -77,6 +89,7 @@ void init_mqtt() {
     mqttClient.setServer(appSettings.mqttBroker, appSettings.mqttPort);
     mqttClient.setCallback(mqtt_callback);
     mqttClient.setBufferSize(1024);
+    event_subscribe(&event_sub, EVENT_MASK_ALL, EVENT_POLICY_ALL);
     mqtt_initialized = true;
     Serial.printf("[MQTT] Initialized. Broker: %s:%d\n", appSettings.mqttBroker, appSettings.mqttPort);
 }
@@ -94,6 +107,16 @@ void handle_mqtt() {
     } else {
         mqttClient.loop();
 
+        // Forward events; backlog queued while offline is replayed in order.
+        // Motion also keeps its ON/OFF topic for Home Assistant.
+        CamEvent ev;
+        while (event_subscriber_next(&event_sub, &ev)) {
+            if (ev.type == EVENT_MOTION) {
+                mqtt_publish_motion(ev.state);
+            }
+            mqtt_publish_event(ev);
+        }
+
         unsigned long now = millis();
         if (now - last_status_publish > STATUS_INTERVAL) {
             last_status_publish = now;
@@ -156,6 +179,11 @@ void publish_status() {
     char buffer[256];
     serializeJson(doc, buffer);
     mqttClient.publish((topic_base + "/info").c_str(), buffer);
+
+    // Latency summary: op -> [count, avg_us, max_us], frames per consumer
+    static char metricsBuf[768];
+    size_t len = metrics_summary_json(metricsBuf, sizeof(metricsBuf));
+    mqttClient.publish((topic_base + "/metrics").c_str(), (const uint8_t *)metricsBuf, len, false);
 }
 
 void mqtt_publish_motion(bool motion_detected) {
@@ -164,6 +192,19 @@ void mqtt_publish_motion(bool motion_detected) {
     }
 }
 
+// {"seq":..,"type":"wifi","state":false,"utc":..,"message":".."} on <base>/event.
+// Messages are firmware-generated (file names, fixed text): no escaping.
+static void mqtt_publish_event(const CamEvent &ev) {
+    char payload[160];
+    int len = snprintf(payload, sizeof(payload),
+                       "{\"seq\":%u,\"type\":\"%s\",\"state\":%s,\"utc\":%ld,\"message\":\"%s\"}",
+                       (unsigned)ev.seq, event_type_str(ev.type), ev.state ? "true" : "false",
+                       (long)ev.utc, ev.message);
+    if (len > 0 && len < (int)sizeof(payload)) {
+        mqttClient.publish(event_topic.c_str(), (const uint8_t *)payload, len, false);
+    }
+}
+
 bool mqtt_is_connected() {
     return appSettings.mqttEnabled && mqtt_initialized && mqttClient.connected();
 }
@@ -0,0 +1,418 @@
+#include <Arduino.h>
+#include "config.h"
+#include "http_engine.h"
+#include "onvif_discovery.h"
+#include "onvif_server.h"
+#include <Preferences.h>
+#include <WiFi.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "esp_system.h"
+
+#define WSD_MULTICAST_ADDR "239.255.255.250"
+#define WSD_PORT 3702
+#define WSD_MAX_MESSAGE_ID 100
+
+#define WSD_NS "http://schemas.xmlsoap.org/ws/2005/04/discovery"
+#define WSD_TO_MULTICAST "urn:schemas-xmlsoap-org:ws:2005:04:discovery"
+#define WSD_TO_ANONYMOUS                                                       \
+  "http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous"
+
+const char TPL_WSD_ENVELOPE[] PROGMEM =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+    "<SOAP-ENV:Envelope "
+    "xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" "
+    "xmlns:wsa=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\" "
+    "xmlns:d=\"" WSD_NS "\" "
+    "xmlns:dn=\"http://www.onvif.org/ver10/network/wsdl\" "
+    "xmlns:tds=\"http://www.onvif.org/ver10/device/wsdl\">"
+    "<SOAP-ENV:Header>";
+
+const char TPL_WSD_HEADER[] PROGMEM =
+    "<wsa:MessageID>urn:uuid:%s</wsa:MessageID>"
+    "%s%s%s"
+    "<wsa:To>%s</wsa:To>"
+    "<wsa:Action>" WSD_NS "/%s</wsa:Action>"
+    "<d:AppSequence InstanceId=\"%u\" MessageNumber=\"%u\"/>"
+    "</SOAP-ENV:Header><SOAP-ENV:Body>";
+
+// Shared by ProbeMatch and Hello; rendered once per IP address
+const char TPL_WSD_ENDPOINT[] PROGMEM =
+    "<wsa:EndpointReference><wsa:Address>urn:uuid:%s</wsa:Address>"
+    "</wsa:EndpointReference>"
+    "<d:Types>dn:NetworkVideoTransmitter tds:Device</d:Types>"
+    "<d:Scopes>onvif://www.onvif.org/type/Network_Video_Transmitter "
+    "onvif://www.onvif.org/type/video_encoder "
+    "onvif://www.onvif.org/Profile/Streaming "
+    "onvif://www.onvif.org/location/Office "
+    "onvif://www.onvif.org/name/" DEVICE_MODEL
+    " onvif://www.onvif.org/hardware/" DEVICE_HARDWARE_ID "</d:Scopes>"
+    "<d:XAddrs>http://%s:%d/onvif/device_service</d:XAddrs>"
+    "<d:MetadataVersion>1</d:MetadataVersion>";
+
+static int s_sock = -1;
+static int s_errors = 0;
+static uint32_t s_retryAt = 0;
+static volatile bool s_rebindPending = false;
+
+static char s_uuid[40];      // stable endpoint UUID derived from the MAC
+static uint32_t s_instanceId = 1;
+static uint32_t s_messageNumber = 0;
+
+static uint32_t s_endpointIp = 0;
+static char s_endpoint[640];
+static size_t s_endpointLen = 0;
+static uint32_t s_lastIpCheck = 0;
+
+static char s_packet[1400];   // ONVIF task only
+static char s_byePacket[900]; // shutdown hook, may run on any task
+
+static void make_message_id(char *out, size_t size) {
+  uint32_t r[4];
+  for (int i = 0; i < 4; i++)
+    r[i] = esp_random();
+  // RFC 4122 version 4 (random)
+  r[1] = (r[1] & 0xFFFF0FFF) | 0x00004000;
+  r[2] = (r[2] & 0x3FFFFFFF) | 0x80000000;
+  snprintf(out, size, "%08x-%04x-%04x-%04x-%04x%08x", (unsigned)r[0],
+           (unsigned)(r[1] >> 16), (unsigned)(r[1] & 0xFFFF),
+           (unsigned)(r[2] >> 16), (unsigned)(r[2] & 0xFFFF), (unsigned)r[3]);
+}
+
+static void render_endpoint(uint32_t ip) {
+  IPAddress addr(ip);
+  char ipStr[16];
+  snprintf(ipStr, sizeof(ipStr), "%u.%u.%u.%u", addr[0], addr[1], addr[2],
+           addr[3]);
+  int n = snprintf(s_endpoint, sizeof(s_endpoint), TPL_WSD_ENDPOINT, s_uuid,
+                   ipStr, ONVIF_PORT);
+  s_endpointLen = n < (int)sizeof(s_endpoint) ? n : sizeof(s_endpoint) - 1;
+  s_endpointIp = ip;
+}
+
+static bool append(char *buf, size_t size, size_t *len, const char *s,
+                   size_t n) {
+  if (*len + n >= size)
+    return false;
+  memcpy(buf + *len, s, n);
+  *len += n;
+  buf[*len] = '\0';
+  return true;
+}
+
+// Envelope + header with a fresh MessageID; returns the length written
+static size_t begin_message(char *buf, size_t size, const char *action,
+                            const char *to, const char *relatesTo) {
+  char msgId[40];
+  make_message_id(msgId, sizeof(msgId));
+
+  size_t len = 0;
+  append(buf, size, &len, TPL_WSD_ENVELOPE, strlen(TPL_WSD_ENVELOPE));
+  int n = snprintf(buf + len, size - len, TPL_WSD_HEADER, msgId,
+                   relatesTo ? "<wsa:RelatesTo>" : "",
+                   relatesTo ? relatesTo : "",
+                   relatesTo ? "</wsa:RelatesTo>" : "", to, action,
+                   (unsigned)s_instanceId, (unsigned)++s_messageNumber);
+  if (n < 0 || (size_t)n >= size - len)
+    return 0;
+  return len + n;
+}
+
+static void send_to(int sock, const char *buf, size_t len, uint32_t ip,
+                    uint16_t port) {
+  struct sockaddr_in to;
+  memset(&to, 0, sizeof(to));
+  to.sin_family = AF_INET;
+  to.sin_port = htons(port);
+  to.sin_addr.s_addr = ip;
+  if (sendto(sock, buf, len, 0, (struct sockaddr *)&to, sizeof(to)) < 0)
+    LOG_D("WS-Discovery: sendto failed, errno " + String(errno));
+}
+
+static void send_hello() {
+  if (s_sock < 0 || s_endpointIp == 0)
+    return;
+  size_t len =
+      begin_message(s_packet, sizeof(s_packet), "Hello", WSD_TO_MULTICAST, nullptr);
+  static const char OPEN[] = "<d:Hello>";
+  static const char CLOSE[] =
+      "</d:Hello></SOAP-ENV:Body></SOAP-ENV:Envelope>";
+  if (!len || !append(s_packet, sizeof(s_packet), &len, OPEN, strlen(OPEN)) ||
+      !append(s_packet, sizeof(s_packet), &len, s_endpoint, s_endpointLen) ||
+      !append(s_packet, sizeof(s_packet), &len, CLOSE, strlen(CLOSE)))
+    return;
+  send_to(s_sock, s_packet, len, inet_addr(WSD_MULTICAST_ADDR), WSD_PORT);
+  Serial.println("[INFO] ONVIF WS-Discovery Hello sent.");
+}
+
+static void send_bye() {
+  if (s_sock < 0)
+    return;
+  size_t len = begin_message(s_byePacket, sizeof(s_byePacket), "Bye",
+                             WSD_TO_MULTICAST, nullptr);
+  char body[160];
+  int n = snprintf(body, sizeof(body),
+                   "<d:Bye><wsa:EndpointReference><wsa:Address>urn:uuid:%s"
+                   "</wsa:Address></wsa:EndpointReference></d:Bye>"
+                   "</SOAP-ENV:Body></SOAP-ENV:Envelope>",
+                   s_uuid);
+  if (!len || n <= 0 ||
+      !append(s_byePacket, sizeof(s_byePacket), &len, body, n))
+    return;
+  send_to(s_sock, s_byePacket, len, inet_addr(WSD_MULTICAST_ADDR), WSD_PORT);
+}
+
+// Value of the first <prefix:name>value</prefix:name> element; empty
+// elements yield length 0. Returns false if the element is absent.
+static bool find_value(const char *msg, const char *name, const char **val,
+                       size_t *len) {
+  size_t nlen = strlen(name);
+  const char *p = msg;
+  while ((p = strstr(p, name)) != nullptr) {
+    bool tagStart = p > msg && (p[-1] == '<' || p[-1] == ':');
+    char next = p[nlen];
+    if (!tagStart || (next != '>' && next != ' ' && next != '/')) {
+      p += nlen;
+      continue;
+    }
+    // Skip closing tags such as </d:Types>
+    const char *lt = p - 1;
+    while (lt > msg && *lt != '<')
+      lt--;
+    if (lt[1] == '/') {
+      p += nlen;
+      continue;
+    }
+    const char *gt = strchr(p, '>');
+    if (!gt)
+      return false;
+    if (gt[-1] == '/') {
+      *val = gt;
+      *len = 0;
+      return true;
+    }
+    const char *start = gt + 1;
+    while (*start == ' ' || *start == '\r' || *start == '\n' || *start == '\t')
+      start++;
+    const char *end = strchr(start, '<');
+    if (!end)
+      return false;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\r' ||
+                           end[-1] == '\n' || end[-1] == '\t'))
+      end--;
+    *val = start;
+    *len = end - start;
+    return true;
+  }
+  return false;
+}
+
+static bool probe_matches_us(const char *msg) {
+  const char *types;
+  size_t len;
+  if (!find_value(msg, "Types", &types, &len) || len == 0)
+    return true; // no Types = probe for everything
+  // Prefixes are whatever the client declared, compare local names only
+  char buf[128];
+  if (len >= sizeof(buf))
+    len = sizeof(buf) - 1;
+  memcpy(buf, types, len);
+  buf[len] = '\0';
+  return strstr(buf, "NetworkVideoTransmitter") || strstr(buf, "Device");
+}
+
+static void answer_probe(const char *msg, const struct sockaddr_in &from) {
+  // Only Probes; ProbeMatches from other devices can share the multicast group
+  if (strstr(msg, "ProbeMatch") || !strstr(msg, "Probe") ||
+      !probe_matches_us(msg))
+    return;
+
+  char relatesTo[WSD_MAX_MESSAGE_ID + 1];
+  const char *id;
+  size_t idLen;
+  if (find_value(msg, "MessageID", &id, &idLen) && idLen > 0 &&
+      idLen <= WSD_MAX_MESSAGE_ID) {
+    memcpy(relatesTo, id, idLen);
+    relatesTo[idLen] = '\0';
+  } else {
+    relatesTo[0] = '\0';
+  }
+
+  if (s_endpointIp == 0)
+    return; // no address yet; the loop renders the endpoint once we have one
+
+  size_t len = begin_message(s_packet, sizeof(s_packet), "ProbeMatches",
+                             WSD_TO_ANONYMOUS,
+                             relatesTo[0] ? relatesTo : nullptr);
+  static const char OPEN[] = "<d:ProbeMatches><d:ProbeMatch>";
+  static const char CLOSE[] = "</d:ProbeMatch></d:ProbeMatches>"
+                              "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
+  if (!len || !append(s_packet, sizeof(s_packet), &len, OPEN, strlen(OPEN)) ||
+      !append(s_packet, sizeof(s_packet), &len, s_endpoint, s_endpointLen) ||
+      !append(s_packet, sizeof(s_packet), &len, CLOSE, strlen(CLOSE))) {
+    LOG_E("WS-Discovery: ProbeMatch does not fit the packet buffer");
+    return;
+  }
+  send_to(s_sock, s_packet, len, from.sin_addr.s_addr, ntohs(from.sin_port));
+}
+
+static void close_socket() {
+  if (s_sock < 0)
+    return;
+  http_engine_unwatch(s_sock);
+  close(s_sock);
+  s_sock = -1;
+}
+
+static void on_readable(int fd, void *) {
+  // Drain everything queued; the socket is non-blocking
+  for (;;) {
+    char msg[1536];
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int n = recvfrom(fd, msg, sizeof(msg) - 1, 0, (struct sockaddr *)&from,
+                     &fromLen);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      if (++s_errors >= 10) {
+        LOG_E("ONVIF Discovery: Too many UDP errors, re-opening later.");
+        close_socket();
+        s_retryAt = millis() + DISCOVERY_RECOVERY_MS;
+      }
+      return;
+    }
+    s_errors = 0;
+    if (n == 0)
+      continue;
+    msg[n] = '\0';
+    if (onvif_is_enabled())
+      answer_probe(msg, from);
+  }
+}
+
+static bool open_socket() {
+  int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0)
+    return false;
+
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(WSD_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return false;
+  }
+
+  struct ip_mreq mreq;
+  mreq.imr_multiaddr.s_addr = inet_addr(WSD_MULTICAST_ADDR);
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+  if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+    close(fd);
+    return false;
+  }
+  uint8_t ttl = 1; // link-local by spec
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  uint8_t loop = 0;
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  if (!http_engine_watch(fd, on_readable, nullptr)) {
+    close(fd);
+    return false;
+  }
+  s_sock = fd;
+  s_errors = 0;
+  return true;
+}
+
+static void on_shutdown() {
+  // esp_restart() hook: say Bye and give lwIP a moment to put it on the air
+  send_bye();
+  delay(20);
+}
+
+void onvif_discovery_start() {
+  String mac = WiFi.macAddress();
+  mac.replace(":", "");
+  mac.toLowerCase();
+  snprintf(s_uuid, sizeof(s_uuid), "5e5c0a3e-0000-4000-8000-%s", mac.c_str());
+
+  // AppSequence InstanceId must grow across reboots; the boot counter does
+  Preferences prefs;
+  prefs.begin("system", true);
+  s_instanceId = prefs.getUInt("boot_count", 1);
+  prefs.end();
+
+  if (!open_socket()) {
+    LOG_E("ONVIF Discovery: Failed to initialize UDP multicast!");
+    s_retryAt = millis() + DISCOVERY_RECOVERY_MS;
+    return;
+  }
+  esp_register_shutdown_handler(on_shutdown);
+
+  uint32_t ip = (uint32_t)WiFi.localIP();
+  if (ip != 0) {
+    render_endpoint(ip);
+    send_hello();
+  }
+}
+
+void onvif_discovery_rebind() { s_rebindPending = true; }
+
+void onvif_discovery_stop() {
+  send_bye();
+  close_socket();
+}
+
+void onvif_discovery_loop() {
+  uint32_t now = millis();
+
+  if (s_rebindPending) {
+    // Group membership is tied to the old interface address
+    s_rebindPending = false;
+    close_socket();
+    if (open_socket())
+      Serial.println("[INFO] ONVIF WS-Discovery re-bound.");
+    else
+      Serial.println("[WARN] ONVIF WS-Discovery re-bind failed.");
+    s_endpointIp = 0; // forces Hello below
+  }
+
+  if (s_sock < 0) {
+    if ((int32_t)(now - s_retryAt) < 0)
+      return;
+    LOG_I("ONVIF Discovery: Attempting UDP recovery...");
+    if (!open_socket()) {
+      LOG_E("ONVIF Discovery: UDP recovery failed, will retry later.");
+      s_retryAt = now + DISCOVERY_RECOVERY_MS;
+      return;
+    }
+    LOG_I("ONVIF Discovery: UDP recovered.");
+    s_endpointIp = 0;
+  }
+
+  if (s_endpointIp != 0 && now - s_lastIpCheck < DISCOVERY_IP_CHECK_MS)
+    return;
+  s_lastIpCheck = now;
+
+  uint32_t ip = (uint32_t)WiFi.localIP();
+  if (ip == 0 || ip == s_endpointIp)
+    return;
+  // New address: cached SOAP responses embed the old one too
+  if (s_endpointIp != 0)
+    onvif_bump_config_epoch();
+  render_endpoint(ip);
+  send_hello();
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+// ==============================================================================
+//   ONVIF WS-Discovery - Probe/ProbeMatch, Hello and Bye on 239.255.255.250:3702
+// ==============================================================================
+// The UDP socket is watched by the HTTP engine's select() loop, so a Probe is
+// answered as soon as it arrives instead of on the next poll. The endpoint
+// part of the ProbeMatch (address, scopes, XAddrs) is rendered once per IP
+// address; each reply only fills in a fresh MessageID and the RelatesTo of
+// the Probe it answers.
+//
+// A Hello is multicast at start-up and whenever the IP changes (DHCP renew,
+// reconnect), so NVRs pick up the new address without waiting for their next
+// periodic Probe. A Bye goes out from an esp_restart() shutdown hook.
+// ==============================================================================
+
+// Opens the socket, registers it with the HTTP engine and announces Hello
+void onvif_discovery_start();
+
+// Run from the ONVIF task: IP change detection, rebinds, error recovery
+void onvif_discovery_loop();
+
+// Safe from any task; the socket is re-opened and Hello sent by the loop
+void onvif_discovery_rebind();
+
+// Multicasts Bye and closes the socket
+void onvif_discovery_stop();
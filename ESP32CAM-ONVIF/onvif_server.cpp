@@ -6,21 +6,25 @@
 #endif
 #include "camera_control.h"
 #include "config.h"
-#include "mbedtls/base64.h"
-#include "mbedtls/sha1.h"
+#include "event_queue.h"
+#include "http_engine.h"
+#include "media_config.h"
+#include "metrics.h"
+#include "ptz_control.h"
+#include "motion_detection.h"
+#include "onvif_discovery.h"
 #include "onvif_server.h"
 #include "rtsp_server.h"
-#include <WebServer.h>
-#include <WiFiUdp.h>
+#include "soap_parse.h"
+#include "soap_writer.h"
+#include "wsse_auth.h"
 #include <time.h>
 
-WebServer onvifServer(ONVIF_PORT);
-WiFiUDP onvifUDP;
 static bool _onvifEnabled = DEFAULT_ONVIF_ENABLED;
 
-// Shared SOAP response buffer - single-threaded, saves 2KB vs separate static buffers.
-static char *s_soapBuf = nullptr;
-const size_t SOAP_BUF_SIZE = 4096;
+// Shared SOAP output block - single-threaded. Responses are streamed through
+// it in 1KB pieces, so their size is no longer bounded by a render buffer.
+static char s_soapBlock[SOAP_WRITER_BLOCK_SIZE];
 
 bool onvif_is_enabled() { return _onvifEnabled; }
 void onvif_set_enabled(bool en) { _onvifEnabled = en; }
@@ -32,6 +36,16 @@ const char PART_BODY[] PROGMEM = "<SOAP-ENV:Body>";
 const char PART_END[] PROGMEM = "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
 
 // --- PROGMEM Templates ---
+// Stringifies config.h values into templates
+#define ONVIF_STR_(x) #x
+#define ONVIF_STR(x) ONVIF_STR_(x)
+
+#if RTSP_MULTICAST_ENABLED
+#define ONVIF_RTP_MULTICAST "true"
+#else
+#define ONVIF_RTP_MULTICAST "false"
+#endif
+
 // GetCapabilities Response - Uses tt: namespace for Capabilities content per
 // ONVIF spec
 const char TPL_CAPABILITIES[] PROGMEM =
@@ -42,38 +56,77 @@ const char TPL_CAPABILITIES[] PROGMEM =
     "<tds:Capabilities>"
     "<tt:Device>"
     "<tt:XAddr>http://%s:%d/onvif/device_service</tt:XAddr>"
-    "<tt:Network><tt:IPFilter>false</tt:IPFilter><tt:ZeroConfiguration>false</"
-    "tt:ZeroConfiguration><tt:IPVersion6>false</"
-    "tt:IPVersion6><tt:DynDNS>false</tt:DynDNS></tt:Network>"
-    "<tt:System><tt:DiscoveryResolve>false</"
-    "tt:DiscoveryResolve><tt:DiscoveryBye>false</"
-    "tt:DiscoveryBye><tt:RemoteDiscovery>false</"
-    "tt:RemoteDiscovery><tt:SystemBackup>false</"
-    "tt:SystemBackup><tt:FirmwareUpgrade>false</"
-    "tt:FirmwareUpgrade><tt:SupportedVersions><tt:Major>2</"
-    "tt:Major><tt:Minor>5</tt:Minor></tt:SupportedVersions></tt:System>"
-    "<tt:Security><tt:TLS1.0>false</tt:TLS1.0><tt:TLS1.1>false</"
-    "tt:TLS1.1><tt:TLS1.2>false</tt:TLS1.2><tt:OnboardKeyGeneration>false</"
-    "tt:OnboardKeyGeneration><tt:AccessPolicyConfig>false</"
-    "tt:AccessPolicyConfig><tt:DefaultAccessPolicy>false</"
-    "tt:DefaultAccessPolicy><tt:Dot1X>false</"
-    "tt:Dot1X><tt:RemoteUserHandling>false</"
-    "tt:RemoteUserHandling><tt:X.509Token>false</"
-    "tt:X.509Token><tt:SAMLToken>false</tt:SAMLToken><tt:KerberosToken>false</"
-    "tt:KerberosToken><tt:UsernameToken>true</"
-    "tt:UsernameToken><tt:HttpDigest>false</tt:HttpDigest><tt:RELToken>false</"
-    "tt:RELToken></tt:Security>"
+    "<tt:Network>"
+    "<tt:IPFilter>false</tt:IPFilter>"
+    "<tt:ZeroConfiguration>false</tt:ZeroConfiguration>"
+    "<tt:IPVersion6>false</tt:IPVersion6>"
+    "<tt:DynDNS>false</tt:DynDNS>"
+    "</tt:Network>"
+    "<tt:System>"
+    "<tt:DiscoveryResolve>false</tt:DiscoveryResolve>"
+    "<tt:DiscoveryBye>true</tt:DiscoveryBye>"
+    "<tt:RemoteDiscovery>false</tt:RemoteDiscovery>"
+    "<tt:SystemBackup>false</tt:SystemBackup>"
+    "<tt:FirmwareUpgrade>false</tt:FirmwareUpgrade>"
+    "<tt:SupportedVersions>"
+    "<tt:Major>2</tt:Major>"
+    "<tt:Minor>5</tt:Minor>"
+    "</tt:SupportedVersions>"
+    "</tt:System>"
     "</tt:Device>"
     "<tt:Media>"
     "<tt:XAddr>http://%s:%d/onvif/device_service</tt:XAddr>"
-    "<tt:StreamingCapabilities><tt:RTPMulticast>false</"
-    "tt:RTPMulticast><tt:RTP_TCP>true</tt:RTP_TCP><tt:RTP_RTSP_TCP>true</"
-    "tt:RTP_RTSP_TCP></tt:StreamingCapabilities>"
+    "<tt:StreamingCapabilities>"
+    "<tt:RTPMulticast>" ONVIF_RTP_MULTICAST "</tt:RTPMulticast>"
+    "<tt:RTP_TCP>true</tt:RTP_TCP>"
+    "<tt:RTP_RTSP_TCP>true</tt:RTP_RTSP_TCP>"
+    "</tt:StreamingCapabilities>"
     "</tt:Media>"
-    "<tt:Imaging><tt:XAddr>http://%s:%d/onvif/device_service</tt:XAddr></"
-    "tt:Imaging>"
+    "<tt:Events>"
+    "<tt:XAddr>http://%s:%d/onvif/events_service</tt:XAddr>"
+    "<tt:WSSubscriptionPolicySupport>false</tt:WSSubscriptionPolicySupport>"
+    "<tt:WSPullPointSupport>true</tt:WSPullPointSupport>"
+    "<tt:WSPausableSubscriptionManagerInterfaceSupport>false"
+    "</tt:WSPausableSubscriptionManagerInterfaceSupport>"
+    "</tt:Events>"
+#if PTZ_ENABLED
+    "<tt:PTZ><tt:XAddr>http://%s:%d/onvif/ptz_service</tt:XAddr></tt:PTZ>"
+#endif
     "</tds:Capabilities>"
     "</tds:GetCapabilitiesResponse>"
+    "</SOAP-ENV:Body>"
+    "</SOAP-ENV:Envelope>";
+
+// GetServices Response - Device, Media, Media2, Events and PTZ service entry
+// points
+const char TPL_SERVICES[] PROGMEM =
+    "xmlns:tds=\"http://www.onvif.org/ver10/device/wsdl\" "
+    "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
+    "<SOAP-ENV:Body>"
+    "<tds:GetServicesResponse>"
+    "<tds:Service><tds:Namespace>http://www.onvif.org/ver10/device/"
+    "wsdl</tds:Namespace><tds:XAddr>http://%s:%d/onvif/"
+    "device_service</tds:XAddr><tds:Version><tt:Major>2</"
+    "tt:Major><tt:Minor>5</tt:Minor></tds:Version></tds:Service>"
+    "<tds:Service><tds:Namespace>http://www.onvif.org/ver10/media/"
+    "wsdl</tds:Namespace><tds:XAddr>http://%s:%d/onvif/"
+    "device_service</tds:XAddr><tds:Version><tt:Major>2</"
+    "tt:Major><tt:Minor>5</tt:Minor></tds:Version></tds:Service>"
+    "<tds:Service><tds:Namespace>http://www.onvif.org/ver20/media/"
+    "wsdl</tds:Namespace><tds:XAddr>http://%s:%d/onvif/"
+    "media2_service</tds:XAddr><tds:Version><tt:Major>2</"
+    "tt:Major><tt:Minor>0</tt:Minor></tds:Version></tds:Service>"
+    "<tds:Service><tds:Namespace>http://www.onvif.org/ver10/events/"
+    "wsdl</tds:Namespace><tds:XAddr>http://%s:%d/onvif/"
+    "events_service</tds:XAddr><tds:Version><tt:Major>2</"
+    "tt:Major><tt:Minor>5</tt:Minor></tds:Version></tds:Service>"
+#if PTZ_ENABLED
+    "<tds:Service><tds:Namespace>http://www.onvif.org/ver20/ptz/"
+    "wsdl</tds:Namespace><tds:XAddr>http://%s:%d/onvif/"
+    "ptz_service</tds:XAddr><tds:Version><tt:Major>2</"
+    "tt:Major><tt:Minor>5</tt:Minor></tds:Version></tds:Service>"
+#endif
+    "</tds:GetServicesResponse>"
     "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
 
 const char TPL_DEV_INFO[] PROGMEM =
@@ -95,9 +148,9 @@ const char TPL_STREAM_URI[] PROGMEM =
     "<trt:GetStreamUriResponse>"
     "<trt:MediaUri>"
 #ifdef VIDEO_CODEC_H264
-    "<tt:Uri>rtsp://%s:%d/h264/1</tt:Uri>"
+    "<tt:Uri>rtsp://%s:%d/h264/%d</tt:Uri>"
 #else
-    "<tt:Uri>rtsp://%s:%d/mjpeg/1</tt:Uri>"
+    "<tt:Uri>rtsp://%s:%d/mjpeg/%d</tt:Uri>"
 #endif
     "<tt:InvalidAfterConnect>false</tt:InvalidAfterConnect>"
     "<tt:InvalidAfterReboot>false</tt:InvalidAfterReboot>"
@@ -172,241 +225,17 @@ const char PROGMEM TPL_NET_PROTOCOLS[] =
     "</tds:GetNetworkProtocolsResponse>"
     "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
 
-// Helper to base64 decode - FIXED: Added output buffer size parameter to
-// prevent overflow
-int base64_decode(const String &input, uint8_t *output, size_t outputSize) {
-  size_t olen = 0;
-  int ret = mbedtls_base64_decode(output, outputSize, &olen,
-                                  (const unsigned char *)input.c_str(),
-                                  input.length());
-  if (ret != 0) {
-    return -1; // Error
-  }
-  return (int)olen;
-}
-
-// Helper to base64 encode - FIXED: Added bounds check
-String base64_encode(const uint8_t *data, size_t length) {
-  // Base64 output is ~4/3 of input, plus null terminator
-  size_t maxOutput = ((length + 2) / 3) * 4 + 1;
-  if (maxOutput > 256)
-    maxOutput = 256; // Safety limit
-
-  unsigned char output[256];
-  size_t olen = 0;
-  int ret = mbedtls_base64_encode(output, sizeof(output), &olen, data, length);
-  if (ret != 0) {
-    return String("");
-  }
-  output[olen] = '\0';
-  return String((char *)output);
-}
-
-// WS-UsernameToken Verification
-// Helper function to find XML element value regardless of namespace prefix
-// Handles: <wsse:Username>, <Username>, <ns1:Username>, etc.
-// FIXED: Avoid creating String objects in loops to prevent heap fragmentation
-int findXmlElementStart(const String &xml, const char *elementName,
-                        int searchFrom) {
-  // Common namespace prefixes - use static const char* to avoid dynamic
-  // allocation
-  static const char *prefixes[] = {"wsse:", "wsu:", "", "ns1:", "ns2:", "sec:"};
-  static const int prefixCount = 6;
-
-  // Build search tag in stack buffer
-  char tag[64];
-  size_t elemLen = strlen(elementName);
-
-  for (int i = 0; i < prefixCount; i++) {
-    size_t prefixLen = strlen(prefixes[i]);
-    if (prefixLen + elemLen + 1 >= sizeof(tag))
-      continue; // Skip if too long
-
-    // Build "<prefix:element" pattern
-    tag[0] = '<';
-    strcpy(tag + 1, prefixes[i]);
-    strcpy(tag + 1 + prefixLen, elementName);
-
-    int searchPos = searchFrom;
-    while (true) {
-      int idx = xml.indexOf(tag, searchPos);
-      if (idx < 0)
-        break;
-
-      // Verify the character after the element name is a valid tag terminator
-      // (not a letter), to avoid matching e.g. <UsernameToken when seeking
-      // <Username
-      int afterElem = idx + 1 + (int)prefixLen + (int)elemLen;
-      char nextChar =
-          (afterElem < (int)xml.length()) ? xml[afterElem] : '\0';
-      if (nextChar == '>' || nextChar == ' ' || nextChar == '/' ||
-          nextChar == '\t' || nextChar == '\r' || nextChar == '\n') {
-        // Valid element found; find the closing > of the opening tag
-        int closeTag = xml.indexOf(">", idx);
-        if (closeTag >= 0 && closeTag + 1 <= (int)xml.length()) {
-          return closeTag + 1; // Return position after >
-        }
-      }
-      // Partial match (e.g. <UsernameToken); skip past it and keep searching
-      searchPos = idx + 1;
-    }
-  }
-  return -1;
-}
-
-int findXmlElementEnd(const String &xml, const char *elementName,
-                      int searchFrom) {
-  static const char *prefixes[] = {"wsse:", "wsu:", "", "ns1:", "ns2:", "sec:"};
-  static const int prefixCount = 6;
-
-  char tag[64];
-  size_t elemLen = strlen(elementName);
-
-  for (int i = 0; i < prefixCount; i++) {
-    size_t prefixLen = strlen(prefixes[i]);
-    if (prefixLen + elemLen + 3 >= sizeof(tag))
-      continue;
-
-    // Build "</prefix:element>" pattern
-    tag[0] = '<';
-    tag[1] = '/';
-    strcpy(tag + 2, prefixes[i]);
-    strcpy(tag + 2 + prefixLen, elementName);
-    strcat(tag, ">");
-
-    int idx = xml.indexOf(tag, searchFrom);
-    if (idx >= 0) {
-      return idx;
-    }
-  }
-  return -1;
-}
-
-String extractXmlElement(const String &xml, const char *elementName,
-                         int searchFrom) {
-  int start = findXmlElementStart(xml, elementName, searchFrom);
-  if (start < 0)
-    return String("");
-
-  int end = findXmlElementEnd(xml, elementName, start);
-  if (end < 0)
-    return String("");
-
-  String value = xml.substring(start, end);
-  value.trim();
-  return value;
-}
-
-bool verify_soap_header(String &soapReq) {
-  // 1. Check if Security Header exists (namespace-agnostic)
-  int secIdx = soapReq.indexOf("Security");
-  if (secIdx < 0) {
-    LOG_D("Auth: No Security header in request");
-    return false;
-  }
-
-  // Debug: Log positions for troubleshooting
-  if (DEBUG_LEVEL >= 3) {
-    int usernamePos = soapReq.indexOf("Username", secIdx);
-    int passwordPos = soapReq.indexOf("Password", secIdx);
-    Serial.printf(
-        "[DEBUG] Security header at %d, Username at %d, Password at %d\n",
-        secIdx, usernamePos, passwordPos);
-  }
-
-  // 2. Extract Username (handles wsse:Username, Username, etc.)
-  String username = extractXmlElement(soapReq, "Username", secIdx);
-  if (username.length() == 0) {
-    LOG_E("Auth: No Username element found");
-    return false;
-  }
-
-  if (username != WEB_USER) {
-    LOG_E("Auth: User mismatch. Expected: '" + String(WEB_USER) + "', Got: '" +
-          username + "'");
-    return false;
-  }
-
-  // 3. Extract Password (Digest) - handles wsse:Password, Password, etc.
-  String digestBase64 = extractXmlElement(soapReq, "Password", secIdx);
-  if (digestBase64.length() == 0) {
-    LOG_E("Auth: No Password element found");
-    return false;
-  }
-
-  // 4. Extract Nonce - handles wsse:Nonce, Nonce, etc.
-  String nonceBase64 = extractXmlElement(soapReq, "Nonce", secIdx);
-  if (nonceBase64.length() == 0) {
-    LOG_E("Auth: No Nonce element found");
-    return false;
-  }
-
-  // 5. Extract Created timestamp - handles wsu:Created, Created, etc.
-  String created = extractXmlElement(soapReq, "Created", secIdx);
-  if (created.length() == 0) {
-    LOG_E("Auth: No Created timestamp found");
-    return false;
-  }
-
-  // Debug output for troubleshooting (only in verbose mode)
-  if (DEBUG_LEVEL >= 3) {
-    Serial.println("[DEBUG] Auth components:");
-    Serial.println("  User: '" + username + "'");
-    Serial.println("  Nonce: '" + nonceBase64 + "'");
-    Serial.println("  Created: '" + created + "'");
-    Serial.println("  Password (config): '" + String(WEB_PASS) + "'");
-    Serial.println("  Digest (received): '" + digestBase64 + "'");
-  }
-
-  // 6. Verify Digest = Base64(SHA1(Base64Decode(Nonce) + Created + Password))
-  uint8_t nonce[64];
-  memset(nonce, 0, sizeof(nonce));
-  int nonceLen = base64_decode(nonceBase64, nonce, sizeof(nonce));
-
-  if (nonceLen <= 0) {
-    LOG_E("Auth: Failed to decode nonce");
-    return false;
-  }
-
-  // Safety check: Ensure concatenation won't overflow buffer
-  size_t requiredSize = nonceLen + created.length() + strlen(WEB_PASS);
-  if (requiredSize > 240) { // Leave margin for safety
-    LOG_E("Auth: Buffer overflow prevented - input too large");
-    return false;
-  }
-
-  // Concatenate: nonce + created + password
-  uint8_t buffer[256];
-  size_t offset = 0;
-  memcpy(buffer + offset, nonce, nonceLen);
-  offset += nonceLen;
-  memcpy(buffer + offset, created.c_str(), created.length());
-  offset += created.length();
-  memcpy(buffer + offset, WEB_PASS, strlen(WEB_PASS));
-  offset += strlen(WEB_PASS);
-
-  size_t totalLen = offset;
-
-  uint8_t sha1Result[20];
-  mbedtls_sha1(buffer, totalLen, sha1Result);
-
-  String calculatedDigest = base64_encode(sha1Result, 20);
-
-  if (DEBUG_LEVEL >= 3) {
-    Serial.println("  Digest (calculated): '" + calculatedDigest + "'");
-  }
-
-  // Verify digest match
-  if (calculatedDigest.equals(digestBase64)) {
-    LOG_D("Auth: Digest verification successful");
+// WS-UsernameToken verification (parsing, replay cache, digest in wsse_auth)
+bool verify_soap_header(HttpConn &conn, const char *soapReq) {
+  WsseResult r = wsse_verify(soapReq, WEB_USER, WEB_PASS,
+                             conn.remoteIp, millis(), time(nullptr));
+  if (r == WSSE_OK || r == WSSE_OK_CACHED) {
+    LOG_D(String("Auth: ") + wsse_result_str(r));
     return true;
   }
-
-  LOG_E("Auth: Digest verification failed");
-  if (DEBUG_LEVEL >= 2) {
-    Serial.println("  Expected: " + calculatedDigest);
-    Serial.println("  Got: " + digestBase64);
-  }
+  LOG_E(String("Auth: ") + wsse_result_str(r));
+  if (r != WSSE_NO_TOKEN)
+    event_auth_failure("onvif");
   return false;
 }
 
@@ -439,34 +268,19 @@ time_t timegm_impl(struct tm *tm) {
          tm->tm_sec;
 }
 
-void handle_SetSystemDateAndTime(String &req) {
-  int container = req.indexOf("UTCDateTime");
-  if (container < 0)
-    container = req.indexOf("DateTime"); // Fallback
-
-  if (container > 0) {
-    int year = 0, month = 0, day = 0, hour = 0, min = 0, sec = 0;
-
-    // Robust Tag Parsing (Handles optional namespaces)
-    // Helper lambda to find value between tags
-    auto getVal = [&](String tag) -> int {
-      int start = req.indexOf("<" + tag + ">", container); // check <tag>
-      if (start < 0)
-        start = req.indexOf(":" + tag + ">", container); // check :tag>
-      if (start > 0) {
-        int valStart = req.indexOf(">", start) + 1;
-        int valEnd = req.indexOf("<", valStart);
-        return req.substring(valStart, valEnd).toInt();
-      }
-      return 0;
-    };
+void handle_SetSystemDateAndTime(const char *req) {
+  const char *container = strstr(req, "UTCDateTime");
+  if (!container)
+    container = strstr(req, "DateTime"); // Fallback
 
-    year = getVal("Year");
-    month = getVal("Month");
-    day = getVal("Day");
-    hour = getVal("Hour");
-    min = getVal("Minute");
-    sec = getVal("Second");
+  if (container) {
+    // Tags with or without a namespace prefix
+    int year = soap_int_after(container, "Year");
+    int month = soap_int_after(container, "Month");
+    int day = soap_int_after(container, "Day");
+    int hour = soap_int_after(container, "Hour");
+    int min = soap_int_after(container, "Minute");
+    int sec = soap_int_after(container, "Second");
 
     if (year > 2000) {
       struct tm tm;
@@ -496,54 +310,85 @@ void handle_SetSystemDateAndTime(String &req) {
   }
 }
 
-void sendPROGMEM(WebServer &server, const char *content) {
-  server.send_P(200, "application/soap+xml", content);
+const char PROGMEM TPL_SOAP_FAULT[] =
+    "xmlns:ter=\"http://www.onvif.org/ver10/error\">"
+    "<SOAP-ENV:Body><SOAP-ENV:Fault>"
+    "<SOAP-ENV:Code><SOAP-ENV:Value>%s</SOAP-ENV:Value>"
+    "<SOAP-ENV:Subcode><SOAP-ENV:Value>%s</SOAP-ENV:Value></SOAP-ENV:Subcode>"
+    "</SOAP-ENV:Code>"
+    "<SOAP-ENV:Reason><SOAP-ENV:Text xml:lang=\"en\">%s</SOAP-ENV:Text></SOAP-ENV:Reason>"
+    "</SOAP-ENV:Fault></SOAP-ENV:Body></SOAP-ENV:Envelope>";
+
+// Renders a complete SOAP document into the writer. Called twice per response
+// (dry run for Content-Length, then for real), so it must be deterministic.
+typedef void (*SoapRenderFn)(SoapWriter &w, void *ctx);
+
+static void soap_sink_conn(void *ctx, const char *data, size_t len) {
+  http_write(*(HttpConn *)ctx, data, len);
+}
+
+static void send_soap_doc(HttpConn &conn, int code, SoapRenderFn render,
+                          void *ctx) {
+  SoapWriter dry(s_soapBlock, sizeof(s_soapBlock), nullptr, nullptr);
+  render(dry, ctx);
+
+  http_begin_response(conn, code, "application/soap+xml", dry.length());
+
+  SoapWriter out(s_soapBlock, sizeof(s_soapBlock), soap_sink_conn, &conn);
+  render(out, ctx);
+  out.flush();
+}
+
+// PART_HEADER + printf-style template, streamed with a precomputed
+// Content-Length
+static void send_soap_vP(HttpConn &conn, int code, const char *tpl,
+                         va_list ap) {
+  va_list count;
+  va_copy(count, ap);
+  SoapWriter dry(s_soapBlock, sizeof(s_soapBlock), nullptr, nullptr);
+  dry.write_P(PART_HEADER);
+  dry.vprintf_P(tpl, count);
+  va_end(count);
+
+  http_begin_response(conn, code, "application/soap+xml", dry.length());
+
+  SoapWriter out(s_soapBlock, sizeof(s_soapBlock), soap_sink_conn, &conn);
+  out.write_P(PART_HEADER);
+  out.vprintf_P(tpl, ap);
+  out.flush();
+}
+
+static void send_soap_P(HttpConn &conn, int code, const char *tpl, ...) {
+  va_list ap;
+  va_start(ap, tpl);
+  send_soap_vP(conn, code, tpl, ap);
+  va_end(ap);
 }
 
 // Helper to send SOAP Fault
-void send_soap_fault(WebServer &server, const char *code, const char *subcode,
+void send_soap_fault(HttpConn &conn, const char *code, const char *subcode,
                      const char *reason) {
-  String fault = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
-  fault += "<SOAP-ENV:Envelope "
-           "xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" "
-           "xmlns:ter=\"http://www.onvif.org/ver10/error\">";
-  fault += "<SOAP-ENV:Body><SOAP-ENV:Fault>";
-  fault +=
-      "<SOAP-ENV:Code><SOAP-ENV:Value>" + String(code) + "</SOAP-ENV:Value>";
-  fault += "<SOAP-ENV:Subcode><SOAP-ENV:Value>" + String(subcode) +
-           "</SOAP-ENV:Value></SOAP-ENV:Subcode>";
-  fault += "</SOAP-ENV:Code>";
-  fault += "<SOAP-ENV:Reason><SOAP-ENV:Text xml:lang=\"en\">" + String(reason) +
-           "</SOAP-ENV:Text></SOAP-ENV:Reason>";
-  fault += "</SOAP-ENV:Fault></SOAP-ENV:Body></SOAP-ENV:Envelope>";
-
-  server.send(500, "application/soap+xml", fault);
-}
-
-// Optimized heap-less send for dynamic content
-// Optimized send for dynamic content (Static Buffer = No Heap Frag)
-void sendDynamicPROGMEM(WebServer &server, const char *tpl, const char *ip,
+  send_soap_P(conn, 500, TPL_SOAP_FAULT, code, subcode, reason);
+}
+
+// Send for dynamic content - template takes (ip, port)
+void sendDynamicPROGMEM(HttpConn &conn, const char *tpl, const char *ip,
                         int port) {
-  if (!s_soapBuf) return;
-  // Reuse shared buffer (single-threaded, no OOM risk)
-  snprintf_P(s_soapBuf, SOAP_BUF_SIZE, PART_HEADER);
-  size_t len = strlen(s_soapBuf);
-  snprintf_P(s_soapBuf + len, SOAP_BUF_SIZE - len, tpl, ip, port);
-  server.send(200, "application/soap+xml", s_soapBuf);
+  send_soap_P(conn, 200, tpl, ip, port);
+}
+
+static void render_fixed(SoapWriter &w, void *tpl) {
+  w.write_P(PART_HEADER);
+  w.write_P((const char *)tpl); // copied verbatim, '%' is not a format here
 }
 
 // Overload for just sending fixed PROGMEM with header
-void sendFixedPROGMEM(WebServer &server, const char *tpl) {
-  if (!s_soapBuf) return;
-  // Reuse shared buffer (single-threaded)
-  snprintf_P(s_soapBuf, SOAP_BUF_SIZE, PART_HEADER);
-  strncat_P(s_soapBuf, tpl, SOAP_BUF_SIZE - strlen(s_soapBuf) - 1);
-  server.send(200, "application/soap+xml", s_soapBuf);
+void sendFixedPROGMEM(HttpConn &conn, const char *tpl) {
+  send_soap_doc(conn, 200, render_fixed, (void *)tpl);
 }
 
 // --- New Handlers ---
 
-// Mandatory for many NVRs to link Profile to Source
 // Mandatory for many NVRs to link Profile to Source
 // Now Dynamic to report actual Brightness/Contrast/Color
 const char PROGMEM TPL_VIDEO_SOURCES[] =
@@ -552,8 +397,8 @@ const char PROGMEM TPL_VIDEO_SOURCES[] =
     "<SOAP-ENV:Body>"
     "<trt:GetVideoSourcesResponse>"
     "<trt:VideoSources token=\"VideoSource_1\">"
-    "<tt:Framerate>20.0</tt:Framerate>"
-    "<tt:Resolution><tt:Width>640</tt:Width><tt:Height>480</tt:Height></"
+    "<tt:Framerate>%u.0</tt:Framerate>"
+    "<tt:Resolution><tt:Width>%u</tt:Width><tt:Height>%u</tt:Height></"
     "tt:Resolution>"
     "<tt:Imaging>"
     "<tt:BacklightCompensation><tt:Mode>OFF</tt:Mode></"
@@ -567,106 +412,334 @@ const char PROGMEM TPL_VIDEO_SOURCES[] =
     "</trt:GetVideoSourcesResponse>"
     "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
 
-// Tells NVR valid ranges (resolutions, quality, etc)
-const char PROGMEM TPL_VIDEO_OPTIONS[] =
+// ==============================================================================
+//   Media / Media2 - video encoder configurations
+// ==============================================================================
+// Profiles, encoder configurations and options are rendered from the
+// media_config model (main stream + substream), so what an NVR reads back is
+// what RTSP actually streams after a SetVideoEncoderConfiguration.
+
+// Both configurations report the RTSP multicast group; AutoStart stays false
+// (the group is only fed while an RTSP client has SETUP multicast)
+#if RTSP_MULTICAST_ENABLED
+#define ONVIF_MULTICAST                                                        \
+  "<tt:Multicast><tt:Address><tt:Type>IPv4</tt:Type><tt:IPv4Address>"          \
+  RTSP_MULTICAST_GROUP "</tt:IPv4Address></tt:Address><tt:Port>"              \
+  ONVIF_STR(RTSP_MULTICAST_PORT) "</tt:Port><tt:TTL>"                         \
+  ONVIF_STR(RTSP_MULTICAST_TTL) "</tt:TTL><tt:AutoStart>false</tt:AutoStart>" \
+  "</tt:Multicast>"
+#else
+#define ONVIF_MULTICAST                                                        \
+  "<tt:Multicast><tt:Address><tt:Type>IPv4</tt:Type><tt:IPv4Address>0.0.0.0</" \
+  "tt:IPv4Address></tt:Address><tt:Port>0</tt:Port><tt:TTL>1</"               \
+  "tt:TTL><tt:AutoStart>false</tt:AutoStart></tt:Multicast>"
+#endif
+
+const char PROGMEM TPL_MEDIA_NS[] =
     "xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\" "
     "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
-    "<SOAP-ENV:Body>"
-    "<trt:GetVideoEncoderConfigurationOptionsResponse>"
-    "<trt:Options>"
-    "<tt:QualityRange><tt:Min>0</tt:Min><tt:Max>63</tt:Max></tt:QualityRange>"
+    "<SOAP-ENV:Body>";
+
+const char PROGMEM TPL_MEDIA2_NS[] =
+    "xmlns:tr2=\"http://www.onvif.org/ver20/media/wsdl\" "
+    "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
+    "<SOAP-ENV:Body>";
+
+// tt:VideoEncoderConfiguration; element name, token, name, encoding, w, h,
+// quality, fps, bitrate
+const char PROGMEM TPL_ENCODER_CONFIG[] =
+    "<%s token=\"%s\">"
+    "<tt:Name>%s</tt:Name>"
+    "<tt:UseCount>1</tt:UseCount>"
+    "<tt:Encoding>%s</tt:Encoding>"
+    "<tt:Resolution><tt:Width>%u</tt:Width><tt:Height>%u</tt:Height>"
+    "</tt:Resolution>"
+    "<tt:Quality>%u</tt:Quality>"
+    "<tt:RateControl><tt:FrameRateLimit>%u</tt:FrameRateLimit>"
+    "<tt:EncodingInterval>1</tt:EncodingInterval>"
+    "<tt:BitrateLimit>%u</tt:BitrateLimit></tt:RateControl>";
+
+const char PROGMEM TPL_ENCODER_H264[] =
+    "<tt:H264><tt:GovLength>%u</tt:GovLength>"
+    "<tt:H264Profile>Baseline</tt:H264Profile></tt:H264>";
+
+const char PROGMEM TPL_ENCODER_CONFIG_END[] =
+    ONVIF_MULTICAST
+    "<tt:SessionTimeout>PT60S</tt:SessionTimeout>"
+    "</%s>";
+
+// tt:VideoEncoder2Configuration; element name, token, attributes, name,
+// encoding, w, h, fps, bitrate, quality
+const char PROGMEM TPL_ENCODER2_CONFIG[] =
+    "<%s token=\"%s\"%s>"
+    "<tt:Name>%s</tt:Name>"
+    "<tt:UseCount>1</tt:UseCount>"
+    "<tt:Encoding>%s</tt:Encoding>"
+    "<tt:Resolution><tt:Width>%u</tt:Width><tt:Height>%u</tt:Height>"
+    "</tt:Resolution>"
+    "<tt:RateControl ConstantBitRate=\"false\">"
+    "<tt:FrameRateLimit>%u</tt:FrameRateLimit>"
+    "<tt:BitrateLimit>%u</tt:BitrateLimit></tt:RateControl>"
+    ONVIF_MULTICAST
+    "<tt:Quality>%u</tt:Quality>"
+    "</%s>";
+
+const char PROGMEM TPL_PROFILE[] =
+    "<trt:Profiles token=\"%s\" fixed=\"true\">"
+    "<tt:Name>%s</tt:Name>"
+    "<tt:VideoSourceConfiguration token=\"VideoSourceToken\">"
+    "<tt:Name>VideoSource</tt:Name>"
+    "<tt:UseCount>2</tt:UseCount>"
+    "<tt:SourceToken>VideoSource_1</tt:SourceToken>"
+    "<tt:Bounds x=\"0\" y=\"0\" width=\"%u\" height=\"%u\"/>"
+    "</tt:VideoSourceConfiguration>";
+
+#if PTZ_ENABLED
+const char PROGMEM TPL_PROFILE_PTZ[] =
+    "<tt:PTZConfiguration token=\"PTZConfig_1\">"
+    "<tt:Name>PTZ</tt:Name>"
+    "<tt:UseCount>2</tt:UseCount>"
+    "<tt:NodeToken>PTZNode_1</tt:NodeToken>"
+    "<tt:DefaultAbsolutePantTiltPositionSpace>"
+    "http://www.onvif.org/ver10/tptz/PanTiltSpaces/PositionGenericSpace"
+    "</tt:DefaultAbsolutePantTiltPositionSpace>"
+    "<tt:DefaultContinuousPanTiltVelocitySpace>"
+    "http://www.onvif.org/ver10/tptz/PanTiltSpaces/VelocityGenericSpace"
+    "</tt:DefaultContinuousPanTiltVelocitySpace>"
+    "<tt:DefaultPTZTimeout>PT10S</tt:DefaultPTZTimeout>"
+    "</tt:PTZConfiguration>";
+#endif
+
+const char PROGMEM TPL_PROFILE2[] =
+    "<tr2:Profiles token=\"%s\" fixed=\"true\">"
+    "<tr2:Name>%s</tr2:Name>"
+    "<tr2:Configurations>"
+    "<tr2:VideoSource token=\"VideoSourceToken\">"
+    "<tt:Name>VideoSource</tt:Name>"
+    "<tt:UseCount>2</tt:UseCount>"
+    "<tt:SourceToken>VideoSource_1</tt:SourceToken>"
+    "<tt:Bounds x=\"0\" y=\"0\" width=\"%u\" height=\"%u\"/>"
+    "</tr2:VideoSource>";
+
+const char PROGMEM TPL_RESOLUTION_AVAILABLE[] =
+    "<tt:ResolutionsAvailable><tt:Width>%u</tt:Width><tt:Height>%u</tt:Height>"
+    "</tt:ResolutionsAvailable>";
+
+const char PROGMEM TPL_QUALITY_RANGE[] =
+    "<tt:QualityRange><tt:Min>1</tt:Min><tt:Max>100</tt:Max></tt:QualityRange>";
+
+const char PROGMEM TPL_VIDEO_OPTIONS_TAIL[] =
+#ifdef VIDEO_CODEC_H264
+    "<tt:GovLengthRange><tt:Min>1</tt:Min><tt:Max>255</tt:Max>"
+    "</tt:GovLengthRange>"
+#endif
+    "<tt:FrameRateRange><tt:Min>1</tt:Min><tt:Max>" ONVIF_STR(MEDIA_MAX_FPS)
+    "</tt:Max></tt:FrameRateRange>"
+    "<tt:EncodingIntervalRange><tt:Min>1</tt:Min><tt:Max>1</tt:Max>"
+    "</tt:EncodingIntervalRange>"
 #ifdef VIDEO_CODEC_H264
-    "<tt:H264>"
-    "<tt:ResolutionsAvailable><tt:Width>640</tt:Width><tt:Height>480</"
-    "tt:Height></tt:ResolutionsAvailable>"
-    "<tt:FrameRateRange><tt:Min>1</tt:Min><tt:Max>20</tt:Max></"
-    "tt:FrameRateRange>"
-    "<tt:EncodingIntervalRange><tt:Min>1</tt:Min><tt:Max>1</tt:Max></"
-    "tt:EncodingIntervalRange>"
     "<tt:H264ProfilesSupported>Baseline</tt:H264ProfilesSupported>"
     "</tt:H264>"
 #else
-    "<tt:JPEG><tt:ResolutionsAvailable><tt:Width>640</tt:Width><tt:Height>480</"
-    "tt:Height></tt:ResolutionsAvailable>"
-    "<tt:FrameRateRange><tt:Min>1</tt:Min><tt:Max>20</tt:Max></"
-    "tt:FrameRateRange>"
-    "<tt:EncodingIntervalRange><tt:Min>1</tt:Min><tt:Max>1</tt:Max></"
-    "tt:EncodingIntervalRange>"
     "</tt:JPEG>"
 #endif
     "</trt:Options>"
-    "</trt:GetVideoEncoderConfigurationOptionsResponse>"
-    "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
-
-const char PROGMEM TPL_VIDEO_ENCODER_CONFIG_MAIN[] =
-    "xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\" "
-    "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
+    "</trt:GetVideoEncoderConfigurationOptionsResponse>";
+
+const char PROGMEM TPL_MEDIA2_SERVICE_CAPS[] =
+    "<tr2:GetServiceCapabilitiesResponse>"
+    "<tr2:Capabilities SnapshotUri=\"true\" Rotation=\"false\" "
+    "VideoSourceMode=\"false\" OSD=\"false\">"
+    "<tr2:ProfileCapabilities MaximumNumberOfProfiles=\"2\" "
+    "ConfigurationsSupported=\"VideoSource VideoEncoder\"/>"
+    "<tr2:StreamingCapabilities RTSPStreaming=\"true\" RTPMulticast=\"" ONVIF_RTP_MULTICAST "\" "
+    "RTP_RTSP_TCP=\"true\" NonAggregateControl=\"false\"/>"
+    "</tr2:Capabilities>"
+    "</tr2:GetServiceCapabilitiesResponse>";
+
+const char PROGMEM TPL_STREAM_URI2[] =
+    "xmlns:tr2=\"http://www.onvif.org/ver20/media/wsdl\">"
     "<SOAP-ENV:Body>"
-    "<trt:GetVideoEncoderConfigurationResponse>"
-    "<trt:Configuration token=\"VideoEncoderToken_Main\">"
-    "<tt:Name>VideoEncoderConfig_Main</tt:Name>"
-    "<tt:UseCount>1</tt:UseCount>"
-#ifdef VIDEO_CODEC_H264
-    "<tt:Encoding>H264</tt:Encoding>"
-#else
-    "<tt:Encoding>JPEG</tt:Encoding>"
-#endif
-    "<tt:Resolution><tt:Width>640</tt:Width><tt:Height>480</tt:Height></"
-    "tt:Resolution>"
-    "<tt:Quality>10</tt:Quality>"
-    "<tt:RateControl><tt:FrameRateLimit>20</"
-    "tt:FrameRateLimit><tt:EncodingInterval>1</"
-    "tt:EncodingInterval><tt:BitrateLimit>4096</tt:BitrateLimit></"
-    "tt:RateControl>"
+    "<tr2:GetStreamUriResponse>"
 #ifdef VIDEO_CODEC_H264
-    "<tt:H264><tt:GovLength>30</tt:GovLength><tt:H264Profile>Baseline</"
-    "tt:H264Profile></tt:H264>"
+    "<tr2:Uri>rtsp://%s:%d/h264/%d</tr2:Uri>"
 #else
-    "<tt:JPEG><tt:Resolution><tt:Width>640</tt:Width><tt:Height>480</"
-    "tt:Height></tt:Resolution></tt:JPEG>"
+    "<tr2:Uri>rtsp://%s:%d/mjpeg/%d</tr2:Uri>"
 #endif
-    "<tt:Multicast><tt:Address><tt:Type>IPv4</tt:Type><tt:IPv4Address>0.0.0.0</"
-    "tt:IPv4Address></tt:Address><tt:Port>0</tt:Port><tt:TTL>1</"
-    "tt:TTL><tt:AutoStart>false</tt:AutoStart></tt:Multicast>"
-    "<tt:SessionTimeout>PT60S</tt:SessionTimeout>"
-    "</trt:Configuration>"
-    "</trt:GetVideoEncoderConfigurationResponse>"
+    "</tr2:GetStreamUriResponse>"
     "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
 
-const char PROGMEM TPL_VIDEO_ENCODER_CONFIG_SUB[] =
-    "xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\" "
-    "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
+const char PROGMEM TPL_SNAPSHOT_URI2[] =
+    "xmlns:tr2=\"http://www.onvif.org/ver20/media/wsdl\">"
     "<SOAP-ENV:Body>"
-    "<trt:GetVideoEncoderConfigurationResponse>"
-    "<trt:Configuration token=\"VideoEncoderToken_Sub\">"
-    "<tt:Name>VideoEncoderConfig_Sub</tt:Name>"
-    "<tt:UseCount>1</tt:UseCount>"
+    "<tr2:GetSnapshotUriResponse>"
+    "<tr2:Uri>http://%s:%d/snapshot</tr2:Uri>"
+    "</tr2:GetSnapshotUriResponse>"
+    "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
+
+// Which stream(s) a request is about: ConfigurationToken/ProfileToken, both
+// streams if the request names none
+struct MediaSelection {
+  MediaStreamId first;
+  MediaStreamId last;
+};
+
+static void render_encoder_config(SoapWriter &w, MediaStreamId id,
+                                  const char *elem) {
+  const VideoEncoderConfig &c = media_config_get(id);
+  w.printf_P(TPL_ENCODER_CONFIG, elem, media_encoder_token(id),
+             media_stream_name(id), media_encoding_str(c.encoding), c.width,
+             c.height, c.quality, c.fps, (unsigned)c.bitrateKbps);
+  if (c.encoding == MEDIA_ENC_H264)
+    w.printf_P(TPL_ENCODER_H264, c.gop);
+  w.printf_P(TPL_ENCODER_CONFIG_END, elem);
+}
+
+static void render_encoder2_config(SoapWriter &w, MediaStreamId id,
+                                   const char *elem) {
+  const VideoEncoderConfig &c = media_config_get(id);
+  char attrs[48] = "";
+  if (c.encoding == MEDIA_ENC_H264)
+    snprintf(attrs, sizeof(attrs), " GovLength=\"%u\" Profile=\"Baseline\"",
+             c.gop);
+  w.printf_P(TPL_ENCODER2_CONFIG, elem, media_encoder_token(id), attrs,
+             media_stream_name(id), media_encoding_str(c.encoding), c.width,
+             c.height, c.fps, (unsigned)c.bitrateKbps, c.quality, elem);
+}
+
+static void render_resolutions(SoapWriter &w) {
+  for (int i = 0; i < media_resolution_count(); i++) {
+    uint16_t width, height;
+    media_resolution_at(i, &width, &height);
+    w.printf_P(TPL_RESOLUTION_AVAILABLE, width, height);
+  }
+}
+
+static void render_profiles(SoapWriter &w, void *) {
+  const VideoEncoderConfig &main = media_config_get(MEDIA_MAIN);
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_MEDIA_NS);
+  w.write_P(PSTR("<trt:GetProfilesResponse>"));
+  for (int i = 0; i < MEDIA_STREAM_COUNT; i++) {
+    MediaStreamId id = (MediaStreamId)i;
+    w.printf_P(TPL_PROFILE, media_profile_token(id), media_stream_name(id),
+               main.width, main.height);
+    render_encoder_config(w, id, "tt:VideoEncoderConfiguration");
+#if PTZ_ENABLED
+    w.write_P(TPL_PROFILE_PTZ);
+#endif
+    w.write_P(PSTR("</trt:Profiles>"));
+  }
+  w.write_P(PSTR("</trt:GetProfilesResponse>"));
+  w.write_P(PART_END);
+}
+
+static void render_profiles2(SoapWriter &w, void *) {
+  const VideoEncoderConfig &main = media_config_get(MEDIA_MAIN);
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_MEDIA2_NS);
+  w.write_P(PSTR("<tr2:GetProfilesResponse>"));
+  for (int i = 0; i < MEDIA_STREAM_COUNT; i++) {
+    MediaStreamId id = (MediaStreamId)i;
+    w.printf_P(TPL_PROFILE2, media_profile_token(id), media_stream_name(id),
+               main.width, main.height);
+    render_encoder2_config(w, id, "tr2:VideoEncoder");
+    w.write_P(PSTR("</tr2:Configurations></tr2:Profiles>"));
+  }
+  w.write_P(PSTR("</tr2:GetProfilesResponse>"));
+  w.write_P(PART_END);
+}
+
+static void render_video_options(SoapWriter &w, void *) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_MEDIA_NS);
+  w.write_P(PSTR("<trt:GetVideoEncoderConfigurationOptionsResponse>"
+                 "<trt:Options>"));
+  w.write_P(TPL_QUALITY_RANGE);
 #ifdef VIDEO_CODEC_H264
-    "<tt:Encoding>H264</tt:Encoding>"
+  w.write_P(PSTR("<tt:H264>"));
 #else
-    "<tt:Encoding>JPEG</tt:Encoding>"
+  w.write_P(PSTR("<tt:JPEG>"));
 #endif
-    "<tt:Resolution><tt:Width>640</tt:Width><tt:Height>480</tt:Height></"
-    "tt:Resolution>"
-    "<tt:Quality>10</tt:Quality>"
-    "<tt:RateControl><tt:FrameRateLimit>20</"
-    "tt:FrameRateLimit><tt:EncodingInterval>1</"
-    "tt:EncodingInterval><tt:BitrateLimit>4096</tt:BitrateLimit></"
-    "tt:RateControl>"
+  render_resolutions(w);
+  w.write_P(TPL_VIDEO_OPTIONS_TAIL);
+  w.write_P(PART_END);
+}
+
+static void render_video_options2(SoapWriter &w, void *) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_MEDIA2_NS);
+  w.write_P(PSTR("<tr2:GetVideoEncoderConfigurationOptionsResponse>"));
+
+  // FrameRatesSupported: a few steps up to MEDIA_MAX_FPS
+  static const uint8_t STEPS[] = {20, 15, 10, 5, 1};
+  char rates[32];
+  int n = snprintf(rates, sizeof(rates), "%u", (unsigned)MEDIA_MAX_FPS);
+  for (uint8_t step : STEPS) {
+    if (step < MEDIA_MAX_FPS && n < (int)sizeof(rates))
+      n += snprintf(rates + n, sizeof(rates) - n, " %u", step);
+  }
+
 #ifdef VIDEO_CODEC_H264
-    "<tt:H264><tt:GovLength>30</tt:GovLength><tt:H264Profile>Baseline</"
-    "tt:H264Profile></tt:H264>"
+  w.printf_P(PSTR("<tr2:Options GovLengthRange=\"1 255\" "
+                  "FrameRatesSupported=\"%s\" ProfilesSupported=\"Baseline\" "
+                  "ConstantBitRateSupported=\"false\">"),
+             rates);
 #else
-    "<tt:JPEG><tt:Resolution><tt:Width>640</tt:Width><tt:Height>480</"
-    "tt:Height></tt:Resolution></tt:JPEG>"
+  w.printf_P(PSTR("<tr2:Options FrameRatesSupported=\"%s\" "
+                  "ConstantBitRateSupported=\"false\">"),
+             rates);
 #endif
-    "<tt:Multicast><tt:Address><tt:Type>IPv4</tt:Type><tt:IPv4Address>0.0.0.0</"
-    "tt:IPv4Address></tt:Address><tt:Port>0</tt:Port><tt:TTL>1</"
-    "tt:TTL><tt:AutoStart>false</tt:AutoStart></tt:Multicast>"
-    "<tt:SessionTimeout>PT60S</tt:SessionTimeout>"
-    "</trt:Configuration>"
-    "</trt:GetVideoEncoderConfigurationResponse>"
-    "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
+  w.printf_P(PSTR("<tt:Encoding>%s</tt:Encoding>"),
+             media_encoding_str(media_config_get(MEDIA_MAIN).encoding));
+  w.write_P(TPL_QUALITY_RANGE);
+  render_resolutions(w);
+  w.write_P(PSTR("<tt:BitrateRange><tt:Min>64</tt:Min><tt:Max>16384</tt:Max>"
+                 "</tt:BitrateRange></tr2:Options>"
+                 "</tr2:GetVideoEncoderConfigurationOptionsResponse>"));
+  w.write_P(PART_END);
+}
+
+// GetVideoEncoderConfiguration (one) / GetVideoEncoderConfigurations (list)
+static void render_encoder_configs(SoapWriter &w, void *ctx) {
+  const MediaSelection *sel = (const MediaSelection *)ctx;
+  bool single = sel->first == sel->last;
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_MEDIA_NS);
+  w.write_P(single ? PSTR("<trt:GetVideoEncoderConfigurationResponse>")
+                   : PSTR("<trt:GetVideoEncoderConfigurationsResponse>"));
+  for (int i = sel->first; i <= sel->last; i++)
+    render_encoder_config(w, (MediaStreamId)i,
+                          single ? "trt:Configuration" : "trt:Configurations");
+  w.write_P(single ? PSTR("</trt:GetVideoEncoderConfigurationResponse>")
+                   : PSTR("</trt:GetVideoEncoderConfigurationsResponse>"));
+  w.write_P(PART_END);
+}
+
+static void render_encoder_configs2(SoapWriter &w, void *ctx) {
+  const MediaSelection *sel = (const MediaSelection *)ctx;
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_MEDIA2_NS);
+  w.write_P(PSTR("<tr2:GetVideoEncoderConfigurationsResponse>"));
+  for (int i = sel->first; i <= sel->last; i++)
+    render_encoder2_config(w, (MediaStreamId)i, "tr2:Configurations");
+  w.write_P(PSTR("</tr2:GetVideoEncoderConfigurationsResponse>"));
+  w.write_P(PART_END);
+}
+
+static void render_media2_fixed(SoapWriter &w, void *tpl) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_MEDIA2_NS);
+  w.write_P((const char *)tpl);
+  w.write_P(PART_END);
+}
+
+static void render_media_fixed(SoapWriter &w, void *tpl) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_MEDIA_NS);
+  w.write_P((const char *)tpl);
+  w.write_P(PART_END);
+}
 
 const char PROGMEM TPL_HOSTNAME[] =
     "xmlns:tds=\"http://www.onvif.org/ver10/device/wsdl\" "
@@ -823,77 +896,153 @@ const char PROGMEM TPL_NETWORK_INTERFACES[] =
     "</tds:GetNetworkInterfacesResponse>"
     "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
 
-void handle_GetCapabilities() {
-  String ip = WiFi.localIP().toString();
+// ==============================================================================
+//   Response Cache
+// ==============================================================================
+// Discovery-time responses only change when the IP, settings or sensor config
+// change, but NVRs re-request them on every reconnect (several recorders at
+// once after a router reboot). Each one is rendered once per config epoch into
+// PSRAM and replayed together with its HTTP header in a single send.
+enum CachedResponseId {
+  CACHED_CAPABILITIES = 0,
+  CACHED_SERVICES,
+  CACHED_PROFILES,
+  CACHED_PROFILES2,
+  CACHED_VIDEO_SOURCES,
+  CACHED_NETWORK_INTERFACES,
+  CACHED_COUNT
+};
+
+struct CachedResponse {
+  uint32_t epoch; // 0 = never rendered
+  char *data;     // complete SOAP document
+  size_t len;
+  size_t cap;
+};
+
+static CachedResponse s_respCache[CACHED_COUNT];
+static volatile uint32_t s_configEpoch = 1;
+static uint32_t s_cachedIp = 0;
+
+void onvif_bump_config_epoch() {
+  uint32_t next = s_configEpoch + 1;
+  s_configEpoch = next ? next : 1; // 0 is reserved for empty cache slots
+}
 
-  LOG_D("Sending GetCapabilities response");
+uint32_t onvif_config_epoch() { return s_configEpoch; }
 
-  // Build complete response first for better reliability
-  char buffer[1500];
-  int len = snprintf(
-      buffer, sizeof(buffer),
-      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
-      "<SOAP-ENV:Envelope "
-      "xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" "
-      "xmlns:tds=\"http://www.onvif.org/ver10/device/wsdl\" "
-      "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
-      "<SOAP-ENV:Body>"
-      "<tds:GetCapabilitiesResponse>"
-      "<tds:Capabilities>"
-      "<tt:Device>"
-      "<tt:XAddr>http://%s:%d/onvif/device_service</tt:XAddr>"
-      "<tt:Network>"
-      "<tt:IPFilter>false</tt:IPFilter>"
-      "<tt:ZeroConfiguration>false</tt:ZeroConfiguration>"
-      "<tt:IPVersion6>false</tt:IPVersion6>"
-      "<tt:DynDNS>false</tt:DynDNS>"
-      "</tt:Network>"
-      "<tt:System>"
-      "<tt:DiscoveryResolve>false</tt:DiscoveryResolve>"
-      "<tt:DiscoveryBye>false</tt:DiscoveryBye>"
-      "<tt:RemoteDiscovery>false</tt:RemoteDiscovery>"
-      "<tt:SystemBackup>false</tt:SystemBackup>"
-      "<tt:FirmwareUpgrade>false</tt:FirmwareUpgrade>"
-      "<tt:SupportedVersions>"
-      "<tt:Major>2</tt:Major>"
-      "<tt:Minor>5</tt:Minor>"
-      "</tt:SupportedVersions>"
-      "</tt:System>"
-      "</tt:Device>"
-      "<tt:Media>"
-      "<tt:XAddr>http://%s:%d/onvif/device_service</tt:XAddr>"
-      "<tt:StreamingCapabilities>"
-      "<tt:RTPMulticast>false</tt:RTPMulticast>"
-      "<tt:RTP_TCP>true</tt:RTP_TCP>"
-      "<tt:RTP_RTSP_TCP>true</tt:RTP_RTSP_TCP>"
-      "</tt:StreamingCapabilities>"
-      "</tt:Media>"
-      "<tt:Events>"
-      "<tt:XAddr>http://%s:%d/onvif/device_service</tt:XAddr>"
-      "<tt:WSSubscriptionPolicySupport>false</tt:WSSubscriptionPolicySupport>"
-      "<tt:WSPullPointSupport>false</tt:WSPullPointSupport>"
-      "</tt:Events>"
-      "</tds:Capabilities>"
-      "</tds:GetCapabilitiesResponse>"
-      "</SOAP-ENV:Body>"
-      "</SOAP-ENV:Envelope>",
-      ip.c_str(), ONVIF_PORT, ip.c_str(), ONVIF_PORT, ip.c_str(), ONVIF_PORT);
-
-  if (len > 0 && len < sizeof(buffer)) {
-    onvifServer.send(200, "application/soap+xml", buffer);
-    LOG_D("GetCapabilities sent, size: " + String(len));
-  } else {
-    LOG_E("GetCapabilities buffer overflow!");
-    onvifServer.send(500, "text/plain", "Buffer overflow");
+// PART_HEADER + template with up to five IP/port pairs (XAddrs); unused
+// trailing arguments are simply ignored by printf
+static void render_with_ip(SoapWriter &w, const char *tpl) {
+  char ip[16];
+  WiFi.localIP().toString().toCharArray(ip, sizeof(ip));
+  w.write_P(PART_HEADER);
+  w.printf_P(tpl, ip, ONVIF_PORT, ip, ONVIF_PORT, ip, ONVIF_PORT, ip,
+             ONVIF_PORT, ip, ONVIF_PORT);
+}
+
+static void render_capabilities(SoapWriter &w, void *) {
+  render_with_ip(w, TPL_CAPABILITIES);
+}
+
+static void render_services(SoapWriter &w, void *) {
+  render_with_ip(w, TPL_SERVICES);
+}
+
+static void render_video_sources(SoapWriter &w, void *) {
+  // Inject current Sensor values
+  sensor_t *s = esp_camera_sensor_get();
+  // ESP32Cam standard is -2 to 2, ONVIF is 0..100. Map linearly:
+  // -2=0, -1=25, 0=50, 1=75, 2=100
+  int br = s ? (s->status.brightness + 2) * 25 : 50;
+  int cn = s ? (s->status.contrast + 2) * 25 : 50;
+  int sa = s ? (s->status.saturation + 2) * 25 : 50;
+
+  const VideoEncoderConfig &main = media_config_get(MEDIA_MAIN);
+  w.write_P(PART_HEADER);
+  w.printf_P(TPL_VIDEO_SOURCES, main.fps, main.width, main.height, br, sa, cn);
+}
+
+static void render_network_interfaces(SoapWriter &w, void *) {
+  // Pass MAC and IP to the template
+  char mac[18];
+  char ip[16];
+  WiFi.macAddress().toCharArray(mac, sizeof(mac));
+  WiFi.localIP().toString().toCharArray(ip, sizeof(ip));
+
+  w.write_P(PART_HEADER);
+  w.printf_P(TPL_NETWORK_INTERFACES, mac, ip);
+}
+
+struct CacheFill {
+  char *dst;
+  size_t room;
+};
+
+static void soap_sink_cache(void *ctx, const char *data, size_t len) {
+  CacheFill *fill = (CacheFill *)ctx;
+  if (len > fill->room)
+    len = fill->room;
+  memcpy(fill->dst, data, len);
+  fill->dst += len;
+  fill->room -= len;
+}
+
+static bool send_cached_response(HttpConn &conn, CachedResponseId id,
+                                 SoapRenderFn render) {
+  // DHCP can hand out a new lease without a WiFi reconnect event
+  uint32_t ip = (uint32_t)WiFi.localIP();
+  if (ip != s_cachedIp) {
+    s_cachedIp = ip;
+    onvif_bump_config_epoch();
+  }
+
+  CachedResponse &c = s_respCache[id];
+  uint32_t epoch = s_configEpoch;
+
+  if (c.epoch != epoch || !c.data) {
+    SoapWriter dry(s_soapBlock, sizeof(s_soapBlock), nullptr, nullptr);
+    render(dry, nullptr);
+    size_t need = dry.length();
+    if (c.cap < need) {
+      free(c.data);
+      c.data = (char *)heap_caps_malloc(need, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      if (!c.data)
+        c.data = (char *)heap_caps_malloc(need, MALLOC_CAP_8BIT);
+      c.cap = c.data ? need : 0;
+      if (!c.data) {
+        c.epoch = 0;
+        LOG_E("ONVIF cache: allocation failed");
+        return false;
+      }
+    }
+    CacheFill fill = {c.data, need};
+    SoapWriter out(s_soapBlock, sizeof(s_soapBlock), soap_sink_cache, &fill);
+    render(out, nullptr);
+    out.flush();
+
+    c.len = need;
+    c.epoch = epoch;
   }
+
+  http_send(conn, 200, "application/soap+xml", c.data, c.len);
+  return true;
 }
 
-void handle_GetStreamUri() {
-  sendDynamicPROGMEM(onvifServer, TPL_STREAM_URI,
-                     WiFi.localIP().toString().c_str(), RTSP_PORT);
+static void send_cached_or_fail(HttpConn &conn, CachedResponseId id,
+                                SoapRenderFn render) {
+  if (!send_cached_response(conn, id, render)) {
+    // Out of memory for the cache - stream it uncached instead
+    send_soap_doc(conn, 200, render, nullptr);
+  }
 }
 
-void handle_GetSystemDateAndTime() {
+void handle_GetCapabilities(HttpConn &conn) {
+  LOG_D("Sending GetCapabilities response");
+  send_cached_or_fail(conn, CACHED_CAPABILITIES, render_capabilities);
+}
+
+void handle_GetSystemDateAndTime(HttpConn &conn) {
   time_t now;
   struct tm timeinfo;
   time(&now);
@@ -915,33 +1064,158 @@ void handle_GetSystemDateAndTime() {
 
   const char* dst_str = (DAYLIGHT_OFFSET > 0) ? "true" : "false";
 
-  char *buffer = new char[1024];
-  if (buffer) {
-    snprintf_P(buffer, 1024, PART_HEADER);
-    size_t len = strlen(buffer);
-    // Note: tm_year is years since 1900, tm_mon is 0-11
-    snprintf_P(buffer + len, 1024 - len, TPL_TIME_FMT, 
-               dst_str, tz_str,
-               timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec,
-               timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
-
-    onvifServer.send(200, "application/soap+xml", buffer);
-    delete[] buffer;
+  // Note: tm_year is years since 1900, tm_mon is 0-11
+  send_soap_P(conn, 200, TPL_TIME_FMT, dst_str, tz_str,
+              timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec,
+              timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
+}
+
+// ProfileToken / ConfigurationToken of the request; both streams if it names
+// none. False (fault already sent) if the token is unknown.
+static bool media_selection(HttpConn &conn, const char *req, MediaSelection *sel) {
+  char token[40];
+  MediaStreamId id;
+  sel->first = MEDIA_MAIN;
+  sel->last = MEDIA_SUB;
+  if (!soap_text(req, "ProfileToken", token, sizeof(token)) &&
+      !soap_text(req, "ConfigurationToken", token, sizeof(token)))
+    return true;
+  if (!media_stream_from_token(token, &id)) {
+    send_soap_fault(conn, "env:Sender", "ter:InvalidArgVal/ter:NoConfig",
+                    "No such configuration");
+    return false;
+  }
+  sel->first = sel->last = id;
+  return true;
+}
+
+void handle_GetStreamUri(HttpConn &conn, const char *req, bool media2) {
+  MediaSelection sel;
+  if (!media_selection(conn, req, &sel))
+    return;
+  // /h264/1 (or /mjpeg/1) = main, /2 = sub; see CRtspSession DESCRIBE
+  int streamNo = sel.first == MEDIA_SUB ? 2 : 1;
+  send_soap_P(conn, 200, media2 ? TPL_STREAM_URI2 : TPL_STREAM_URI,
+              WiFi.localIP().toString().c_str(), RTSP_PORT, streamNo);
+}
+
+// SetVideoEncoderConfiguration - Media and Media2 share the element names,
+// Media2 carries GovLength as an attribute
+static void handle_set_video_encoder(HttpConn &conn, const char *req,
+                                     bool media2) {
+  char token[40] = "";
+  const char *at = strstr(req, "SetVideoEncoderConfiguration");
+  if (at && (at = strstr(at, "token=\"")) != nullptr) {
+    const char *p = at + 7;
+    size_t n = 0;
+    while (p[n] && p[n] != '"' && n + 1 < sizeof(token))
+      n++;
+    memcpy(token, p, n);
+    token[n] = '\0';
+  }
+  MediaStreamId id;
+  if (!media_stream_from_token(token, &id)) {
+    send_soap_fault(conn, "env:Sender", "ter:InvalidArgVal/ter:NoConfig",
+                    "No such configuration");
+    return;
+  }
+
+  VideoEncoderConfig cfg = media_config_get(id);
+  bool encodingOk = true;
+  char encoding[8];
+  if (soap_text(req, "Encoding", encoding, sizeof(encoding))) {
+    if (strcmp(encoding, "H264") == 0)
+      cfg.encoding = MEDIA_ENC_H264;
+    else if (strcmp(encoding, "JPEG") == 0)
+      cfg.encoding = MEDIA_ENC_JPEG;
+    else
+      encodingOk = false;
+  }
+
+  float v;
+  if ((v = soap_number(req, "Width")) > 0)
+    cfg.width = (uint16_t)v;
+  if ((v = soap_number(req, "Height")) > 0)
+    cfg.height = (uint16_t)v;
+  if ((v = soap_number(req, "Quality")) > 0)
+    cfg.quality = (uint8_t)constrain(lroundf(v), 1L, 100L);
+  if ((v = soap_number(req, "FrameRateLimit")) > 0)
+    cfg.fps = (uint8_t)constrain(lroundf(v), 1L, 255L);
+  if ((v = soap_number(req, "BitrateLimit")) > 0)
+    cfg.bitrateKbps = (uint32_t)v;
+  if ((v = soap_number(req, "GovLength")) > 0)
+    cfg.gop = (uint16_t)v;
+  const char *gov = strstr(req, "GovLength=\"");
+  if (gov && atoi(gov + 11) > 0)
+    cfg.gop = atoi(gov + 11);
+
+  if (!encodingOk || !media_config_set(id, cfg)) {
+    send_soap_fault(conn, "env:Sender", "ter:InvalidArgVal/ter:ConfigModify",
+                    "Encoding not supported by this firmware");
+    return;
+  }
+  if (media2)
+    send_soap_doc(conn, 200, render_media2_fixed,
+                  (void *)PSTR("<tr2:SetVideoEncoderConfigurationResponse/>"));
+  else
+    send_soap_doc(conn, 200, render_media_fixed,
+                  (void *)PSTR("<trt:SetVideoEncoderConfigurationResponse/>"));
+}
+
+// Media2 service (/onvif/media2_service)
+static void handle_media2(HttpConn &conn, const char *req, SoapAction action) {
+  MediaSelection sel;
+  if (action == SOAP_GET_PROFILES) {
+    send_cached_or_fail(conn, CACHED_PROFILES2, render_profiles2);
+  } else if (action == SOAP_GET_STREAM_URI) {
+    handle_GetStreamUri(conn, req, true);
+  } else if (action == SOAP_GET_SNAPSHOT_URI) {
+    sendDynamicPROGMEM(conn, TPL_SNAPSHOT_URI2,
+                       WiFi.localIP().toString().c_str(), WEB_PORT);
+  } else if (action == SOAP_GET_VIDEO_OPTIONS) {
+    send_soap_doc(conn, 200, render_video_options2, nullptr);
+  } else if (action == SOAP_GET_VIDEO_CONFIG) {
+    if (media_selection(conn, req, &sel))
+      send_soap_doc(conn, 200, render_encoder_configs2, &sel);
+  } else if (action == SOAP_SET_VIDEO_CONFIG) {
+    handle_set_video_encoder(conn, req, true);
+  } else if (action == SOAP_GET_MEDIA2_SERVICE_CAPS) {
+    send_soap_doc(conn, 200, render_media2_fixed,
+                  (void *)TPL_MEDIA2_SERVICE_CAPS);
   } else {
-    onvifServer.send(500, "text/plain", "OOM");
+    send_soap_fault(conn, "env:Receiver", "ter:ActionNotSupported",
+                    "Not supported by the Media2 service");
   }
 }
 
+// ONVIF 0..100 back to the sensor's -2..2 range (inverse of GetVideoSources)
+static int imaging_to_sensor(float v) {
+  int level = (int)lroundf(v / 25.0f) - 2;
+  return constrain(level, -2, 2);
+}
+
 // Simple parser for SetImagingSettings
 // We look for <tt:IrCutFilterMode>OFF</tt:IrCutFilterMode> to turn on 'Night
-// Mode' (Flash ON) and ON or AUTO for 'Day Mode' (Flash OFF)
-void handle_set_imaging_settings(String &req) {
+// Mode' (Flash ON) and ON or AUTO for 'Day Mode' (Flash OFF).
+// Brightness/ColorSaturation/Contrast are applied to the sensor.
+void handle_set_imaging_settings(const char *req) {
+  sensor_t *s = esp_camera_sensor_get();
+  if (s) {
+    float v;
+    if ((v = soap_number(req, "Brightness")) >= 0)
+      s->set_brightness(s, imaging_to_sensor(v));
+    if ((v = soap_number(req, "Contrast")) >= 0)
+      s->set_contrast(s, imaging_to_sensor(v));
+    if ((v = soap_number(req, "ColorSaturation")) >= 0)
+      s->set_saturation(s, imaging_to_sensor(v));
+  }
+
   if (!FLASH_LED_ENABLED)
     return;
 
   // Very basic string parsing as XML parsing is heavy
-  if (req.indexOf("IrCutFilterMode") > 0) {
-    if (req.indexOf(">OFF<") > 0) {
+  if (soap_has(req, "IrCutFilterMode")) {
+    if (soap_has(req, ">OFF<")) {
       // Night mode -> Flash ON
       set_flash_led(true);
       LOG_I("Night Mode: ON (Flash)");
@@ -953,39 +1227,615 @@ void handle_set_imaging_settings(String &req) {
   }
 }
 
-void handle_ptz(String &req) {
-#if PTZ_ENABLED
-  // AbsoluteMove
-  // <tptz:Vector PanTilt="x" y="0.5"/>
-  // Simplified parsing: find PanTilt space x=" and y="
-  // This is fragile but suffices for minimal SOAP
-
-  if (req.indexOf("AbsoluteMove") > 0) {
-    // Look for x="0.5" y="0.5" or similar
-    // Or PanTilt x="0.5" y="0.5"
-    // Actually ONVIF usually sends: <tt:PanTilt x="0.5" y="0.5" ... />
-
-    float x = 0.5f;
-    float y = 0.5f;
-
-    int xIdx = req.indexOf("x=\"");
-    if (xIdx > 0) {
-      int endQ = req.indexOf("\"", xIdx + 3);
-      String val = req.substring(xIdx + 3, endQ);
-      x = val.toFloat();
+// ==============================================================================
+//   Events Service (PullPoint)
+// ==============================================================================
+// Each subscription is just a subscriber on the shared event_queue (motion
+// only, every event in order: EVENT_POLICY_ALL). A PullMessages with nothing
+// to deliver is parked in the HTTP engine (http_defer) and answered as soon
+// as an event arrives, or empty after its Timeout, capped at
+// EVENTS_PULL_MAX_WAIT_MS; NVRs simply pull again. The ONVIF task keeps
+// serving other requests meanwhile.
+
+const char PROGMEM TPL_EVENTS_NS[] =
+    "xmlns:wsa=\"http://www.w3.org/2005/08/addressing\" "
+    "xmlns:wsnt=\"http://docs.oasis-open.org/wsn/b-2\" "
+    "xmlns:wstop=\"http://docs.oasis-open.org/wsn/t-1\" "
+    "xmlns:tev=\"http://www.onvif.org/ver10/events/wsdl\" "
+    "xmlns:tns1=\"http://www.onvif.org/ver10/topics\" "
+    "xmlns:tt=\"http://www.onvif.org/ver10/schema\" "
+    "xmlns:xs=\"http://www.w3.org/2001/XMLSchema\">"
+    "<SOAP-ENV:Body>";
+
+const char PROGMEM TPL_CREATE_PULLPOINT[] =
+    "<tev:CreatePullPointSubscriptionResponse>"
+    "<tev:SubscriptionReference>"
+    "<wsa:Address>http://%s:%d/onvif/events_service?sub=%u</wsa:Address>"
+    "</tev:SubscriptionReference>"
+    "<wsnt:CurrentTime>%s</wsnt:CurrentTime>"
+    "<wsnt:TerminationTime>%s</wsnt:TerminationTime>"
+    "</tev:CreatePullPointSubscriptionResponse>";
+
+const char PROGMEM TPL_PULL_MESSAGES_BEGIN[] =
+    "<tev:PullMessagesResponse>"
+    "<tev:CurrentTime>%s</tev:CurrentTime>"
+    "<tev:TerminationTime>%s</tev:TerminationTime>";
+
+const char PROGMEM TPL_PULL_MESSAGES_END[] = "</tev:PullMessagesResponse>";
+
+const char PROGMEM TPL_MOTION_NOTIFICATION[] =
+    "<wsnt:NotificationMessage>"
+    "<wsnt:Topic Dialect=\"http://www.onvif.org/ver10/tev/topicExpression/"
+    "ConcreteSet\">tns1:VideoSource/MotionAlarm</wsnt:Topic>"
+    "<wsnt:Message><tt:Message UtcTime=\"%s\" PropertyOperation=\"%s\">"
+    "<tt:Source><tt:SimpleItem Name=\"Source\" Value=\"VideoSource_1\"/>"
+    "</tt:Source>"
+    "<tt:Data><tt:SimpleItem Name=\"State\" Value=\"%s\"/></tt:Data>"
+    "</tt:Message></wsnt:Message>"
+    "</wsnt:NotificationMessage>";
+
+const char PROGMEM TPL_RENEW[] =
+    "<wsnt:RenewResponse>"
+    "<wsnt:TerminationTime>%s</wsnt:TerminationTime>"
+    "<wsnt:CurrentTime>%s</wsnt:CurrentTime>"
+    "</wsnt:RenewResponse>";
+
+const char PROGMEM TPL_UNSUBSCRIBE[] = "<wsnt:UnsubscribeResponse/>";
+
+const char PROGMEM TPL_EVENT_PROPERTIES[] =
+    "<tev:GetEventPropertiesResponse>"
+    "<tev:TopicNamespaceLocation>http://www.onvif.org/onvif/ver10/topics/"
+    "topicns.xml</tev:TopicNamespaceLocation>"
+    "<wsnt:FixedTopicSet>true</wsnt:FixedTopicSet>"
+    "<wstop:TopicSet><tns1:VideoSource>"
+    "<MotionAlarm wstop:topic=\"true\">"
+    "<tt:MessageDescription IsProperty=\"true\">"
+    "<tt:Source><tt:SimpleItemDescription Name=\"Source\" "
+    "Type=\"tt:ReferenceToken\"/></tt:Source>"
+    "<tt:Data><tt:SimpleItemDescription Name=\"State\" Type=\"xs:boolean\"/>"
+    "</tt:Data>"
+    "</tt:MessageDescription>"
+    "</MotionAlarm>"
+    "</tns1:VideoSource></wstop:TopicSet>"
+    "<wsnt:TopicExpressionDialect>http://www.onvif.org/ver10/tev/"
+    "topicExpression/ConcreteSet</wsnt:TopicExpressionDialect>"
+    "<wsnt:TopicExpressionDialect>http://docs.oasis-open.org/wsn/t-1/"
+    "TopicExpression/Concrete</wsnt:TopicExpressionDialect>"
+    "<tev:MessageContentFilterDialect>http://www.onvif.org/ver10/tev/"
+    "messageContentFilter/ItemFilter</tev:MessageContentFilterDialect>"
+    "<tev:MessageContentSchemaLocation>http://www.onvif.org/onvif/ver10/"
+    "schema/onvif.xsd</tev:MessageContentSchemaLocation>"
+    "</tev:GetEventPropertiesResponse>";
+
+const char PROGMEM TPL_EVENT_SERVICE_CAPS[] =
+    "<tev:GetServiceCapabilitiesResponse>"
+    "<tev:Capabilities WSSubscriptionPolicySupport=\"false\" "
+    "WSPullPointSupport=\"true\" "
+    "WSPausableSubscriptionManagerInterfaceSupport=\"false\" "
+    "MaxNotificationProducers=\"0\" MaxPullPoints=\"" ONVIF_STR(EVENTS_MAX_PULLPOINTS)
+    "\"/>"
+    "</tev:GetServiceCapabilitiesResponse>";
+
+struct PullPoint {
+  bool active;
+  bool initialSent; // "Initialized" motion state delivered
+  uint8_t pullLimit; // MessageLimit of the pending PullMessages
+  uint32_t id;
+  EventSubscriber sub; // motion events, next one to deliver
+  uint32_t ttlMs;
+  uint32_t expiresMs;
+};
+
+static PullPoint s_pullPoints[EVENTS_MAX_PULLPOINTS];
+static uint32_t s_nextPullPointId = 1;
+
+// Everything a pull-point response renders, captured up front so the dry run
+// and the real pass produce identical bytes. Static: too big for the stack.
+struct PullPointReply {
+  uint32_t id;
+  char now[24];
+  char termination[24];
+  bool initial;
+  bool motionNow;
+  int count;
+  CamEvent events[EVENTS_PULL_MAX_MESSAGES];
+};
+
+static PullPointReply s_pullReply;
+
+static void format_utc(time_t t, char *out, size_t size) {
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  strftime(out, size, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+static void pullpoint_reply_times(PullPoint &p, uint32_t nowMs) {
+  time_t now = time(nullptr);
+  format_utc(now, s_pullReply.now, sizeof(s_pullReply.now));
+  format_utc(now + (time_t)((p.expiresMs - nowMs) / 1000),
+             s_pullReply.termination, sizeof(s_pullReply.termination));
+  s_pullReply.id = p.id;
+}
+
+static void pullpoints_expire(uint32_t nowMs) {
+  for (PullPoint &p : s_pullPoints) {
+    if (p.active && (int32_t)(nowMs - p.expiresMs) >= 0) {
+      p.active = false;
+      LOG_D("Events: PullPoint " + String(p.id) + " expired");
+    }
+  }
+}
+
+static PullPoint *pullpoint_by_id(uint32_t id) {
+  if (id == 0)
+    return nullptr;
+  for (PullPoint &p : s_pullPoints) {
+    if (p.active && p.id == id)
+      return &p;
+  }
+  return nullptr;
+}
+
+// The subscription address is .../events_service?sub=<id>. Clients post to it
+// directly or echo it in the wsa:To header.
+static PullPoint *pullpoint_find(HttpConn &conn, const char *req) {
+  uint32_t id = 0;
+  char arg[12];
+  if (http_query_arg(conn, "sub", arg, sizeof(arg))) {
+    id = strtoul(arg, nullptr, 10);
+  } else {
+    const char *sub = strstr(req, "?sub=");
+    if (sub)
+      id = strtoul(sub + 5, nullptr, 10);
+  }
+  return pullpoint_by_id(id);
+}
+
+// xsd:duration subset sent by NVRs: "PT60S", "PT1M30S", "P1DT2H"
+static int32_t xsd_duration_ms(const char *s) {
+  if (*s++ != 'P')
+    return -1;
+  bool inTime = false;
+  double ms = 0;
+  while (*s && *s != '<') {
+    if (*s == 'T') {
+      inTime = true;
+      s++;
+      continue;
+    }
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s)
+      return -1;
+    switch (*end) {
+    case 'D':
+      ms += v * 86400000.0;
+      break;
+    case 'H':
+      ms += v * 3600000.0;
+      break;
+    case 'M':
+      if (!inTime)
+        return -1; // months are not supported
+      ms += v * 60000.0;
+      break;
+    case 'S':
+      ms += v * 1000.0;
+      break;
+    default:
+      return -1;
     }
+    s = end + 1;
+  }
+  return ms > 86400000.0 ? 86400000 : (int32_t)ms;
+}
+
+// Reads a duration or absolute dateTime element as milliseconds from now
+static int32_t event_time_ms(const char *req, const char *name, int32_t fallback) {
+  const char *val = soap_value(req, name);
+  if (!val)
+    return fallback;
+  while (*val == ' ' || *val == '\r' || *val == '\n' || *val == '\t')
+    val++;
+
+  if (*val == 'P') {
+    int32_t ms = xsd_duration_ms(val);
+    return ms >= 0 ? ms : fallback;
+  }
+
+  const char *end = strchr(val, '<');
+  time_t when;
+  if (end && wsse_parse_datetime(val, end - val, &when)) {
+    time_t now = time(nullptr);
+    if (when <= now)
+      return fallback;
+    return when - now > 86400 ? 86400000 : (int32_t)(when - now) * 1000;
+  }
+  return fallback;
+}
+
+static void render_events_fixed(SoapWriter &w, void *tpl) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_EVENTS_NS);
+  w.write_P((const char *)tpl);
+  w.write_P(PART_END);
+}
+
+static void render_create_pullpoint(SoapWriter &w, void *) {
+  char ip[16];
+  WiFi.localIP().toString().toCharArray(ip, sizeof(ip));
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_EVENTS_NS);
+  w.printf_P(TPL_CREATE_PULLPOINT, ip, ONVIF_PORT, (unsigned)s_pullReply.id,
+             s_pullReply.now, s_pullReply.termination);
+  w.write_P(PART_END);
+}
+
+static void render_pull_messages(SoapWriter &w, void *) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_EVENTS_NS);
+  w.printf_P(TPL_PULL_MESSAGES_BEGIN, s_pullReply.now,
+             s_pullReply.termination);
 
-    int yIdx = req.indexOf("y=\"");
-    if (yIdx > 0) {
-      int endQ = req.indexOf("\"", yIdx + 3);
-      String val = req.substring(yIdx + 3, endQ);
-      y = val.toFloat();
+  if (s_pullReply.initial) {
+    w.printf_P(TPL_MOTION_NOTIFICATION, s_pullReply.now, "Initialized",
+               s_pullReply.motionNow ? "true" : "false");
+  }
+  for (int i = 0; i < s_pullReply.count; i++) {
+    const CamEvent &ev = s_pullReply.events[i];
+    char utc[24];
+    if (ev.utc > 0)
+      format_utc(ev.utc, utc, sizeof(utc));
+    else
+      strcpy(utc, s_pullReply.now); // pushed before time sync
+    w.printf_P(TPL_MOTION_NOTIFICATION, utc, "Changed",
+               ev.state ? "true" : "false");
+  }
+
+  w.write_P(TPL_PULL_MESSAGES_END);
+  w.write_P(PART_END);
+}
+
+static void render_renew(SoapWriter &w, void *) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_EVENTS_NS);
+  w.printf_P(TPL_RENEW, s_pullReply.termination, s_pullReply.now);
+  w.write_P(PART_END);
+}
+
+static void send_unknown_subscription(HttpConn &conn) {
+  send_soap_fault(conn, "env:Sender", "ter:InvalidArgVal",
+                  "Unknown or expired subscription");
+}
+
+void handle_create_pullpoint(HttpConn &conn, const char *req) {
+  uint32_t now = millis();
+  pullpoints_expire(now);
+
+  PullPoint *p = nullptr;
+  for (PullPoint &slot : s_pullPoints) {
+    if (!slot.active) {
+      p = &slot;
+      break;
     }
+  }
+  if (!p) {
+    send_soap_fault(conn, "env:Receiver", "ter:CapabilityViolated",
+                    "Maximum number of PullPoints reached");
+    return;
+  }
+
+  p->active = true;
+  p->initialSent = false;
+  p->id = s_nextPullPointId++;
+  event_subscribe(&p->sub, EVENT_MASK(EVENT_MOTION), EVENT_POLICY_ALL);
+  p->ttlMs = event_time_ms(req, "InitialTerminationTime",
+                           EVENTS_DEFAULT_TERMINATION_S * 1000);
+  p->expiresMs = now + p->ttlMs;
+
+  Serial.printf("[INFO] Events: PullPoint %u created (%us)\n", (unsigned)p->id,
+                (unsigned)(p->ttlMs / 1000));
+  pullpoint_reply_times(*p, now);
+  send_soap_doc(conn, 200, render_create_pullpoint, nullptr);
+}
+
+// Fills s_pullReply from the subscriber; true if there is anything to send
+static bool pull_collect(PullPoint &p) {
+  s_pullReply.count = 0;
+  s_pullReply.initial = !p.initialSent;
+  s_pullReply.motionNow = motion_detected();
+  // Only motion is published as a topic; the subscriber filters the rest
+  while (s_pullReply.count < p.pullLimit &&
+         event_subscriber_next(&p.sub, &s_pullReply.events[s_pullReply.count]))
+    s_pullReply.count++;
+  return s_pullReply.count > 0 || s_pullReply.initial;
+}
+
+static void pull_reply(HttpConn &conn, PullPoint &p) {
+  p.initialSent = true;
+
+  // Most NVRs never call Renew and rely on pulling to keep the subscription
+  uint32_t now = millis();
+  p.expiresMs = now + p.ttlMs;
+
+  pullpoint_reply_times(p, now);
+  send_soap_doc(conn, 200, render_pull_messages, nullptr);
+}
+
+// A parked PullMessages: answered once events arrive or its Timeout is up
+static bool pull_resume(HttpConn &conn, void *ctx, bool timedOut) {
+  PullPoint *p = pullpoint_by_id((uint32_t)(uintptr_t)ctx);
+  if (!p) {
+    send_unknown_subscription(conn); // unsubscribed or expired meanwhile
+    return true;
+  }
+  if (!pull_collect(*p) && !timedOut)
+    return false;
+  pull_reply(conn, *p);
+  return true;
+}
+
+void handle_pull_messages(HttpConn &conn, const char *req) {
+  pullpoints_expire(millis());
+  PullPoint *p = pullpoint_find(conn, req);
+  if (!p) {
+    send_unknown_subscription(conn);
+    return;
+  }
+
+  int limit = EVENTS_PULL_MAX_MESSAGES;
+  const char *limitVal = soap_value(req, "MessageLimit");
+  if (limitVal) {
+    int requested = atoi(limitVal);
+    if (requested > 0 && requested < limit)
+      limit = requested;
+  }
+  p->pullLimit = (uint8_t)limit;
+  int32_t wait = event_time_ms(req, "Timeout", 0);
+  if (wait > EVENTS_PULL_MAX_WAIT_MS)
+    wait = EVENTS_PULL_MAX_WAIT_MS;
+
+  if (!pull_collect(*p) && wait > 0) {
+    http_defer(conn, wait, pull_resume, (void *)(uintptr_t)p->id);
+    return;
+  }
+  pull_reply(conn, *p);
+}
+
+void handle_renew(HttpConn &conn, const char *req) {
+  pullpoints_expire(millis());
+  PullPoint *p = pullpoint_find(conn, req);
+  if (!p) {
+    send_unknown_subscription(conn);
+    return;
+  }
+
+  uint32_t now = millis();
+  p->ttlMs = event_time_ms(req, "TerminationTime", p->ttlMs);
+  p->expiresMs = now + p->ttlMs;
 
-    // Pass ONVIF-native -1..1 values directly; ptz_set_absolute() performs the mapping.
-    ptz_set_absolute(x, y);
+  pullpoint_reply_times(*p, now);
+  send_soap_doc(conn, 200, render_renew, nullptr);
+}
+
+void handle_unsubscribe(HttpConn &conn, const char *req) {
+  PullPoint *p = pullpoint_find(conn, req);
+  if (!p) {
+    send_unknown_subscription(conn);
+    return;
+  }
+  p->active = false;
+  LOG_D("Events: PullPoint " + String(p->id) + " unsubscribed");
+  send_soap_doc(conn, 200, render_events_fixed,
+                (void *)TPL_UNSUBSCRIBE);
+}
+
+// ==============================================================================
+//   PTZ Service
+// ==============================================================================
+// Moves are posted to the PTZ task (ptz_control) and answered right away;
+// GetStatus reports where the servos currently are while a ramp is running.
+
+#if PTZ_ENABLED
+const char PROGMEM TPL_PTZ_NS[] =
+    "xmlns:tptz=\"http://www.onvif.org/ver20/ptz/wsdl\" "
+    "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
+    "<SOAP-ENV:Body>";
+
+#define ONVIF_PTZ_POSITION_SPACE                                               \
+  "http://www.onvif.org/ver10/tptz/PanTiltSpaces/PositionGenericSpace"
+
+#define ONVIF_PTZ_GENERIC_RANGE                                                \
+  "<tt:XRange><tt:Min>-1</tt:Min><tt:Max>1</tt:Max></tt:XRange>"               \
+  "<tt:YRange><tt:Min>-1</tt:Min><tt:Max>1</tt:Max></tt:YRange>"
+
+const char PROGMEM TPL_PTZ_NODES[] =
+    "<tptz:GetNodesResponse>"
+    "<tptz:PTZNode token=\"PTZNode_1\" FixedHomePosition=\"true\">"
+    "<tt:Name>PTZ</tt:Name>"
+    "<tt:SupportedPTZSpaces>"
+    "<tt:AbsolutePanTiltPositionSpace><tt:URI>" ONVIF_PTZ_POSITION_SPACE
+    "</tt:URI>" ONVIF_PTZ_GENERIC_RANGE "</tt:AbsolutePanTiltPositionSpace>"
+    "<tt:ContinuousPanTiltVelocitySpace><tt:URI>"
+    "http://www.onvif.org/ver10/tptz/PanTiltSpaces/VelocityGenericSpace"
+    "</tt:URI>" ONVIF_PTZ_GENERIC_RANGE "</tt:ContinuousPanTiltVelocitySpace>"
+    "<tt:PanTiltSpeedSpace><tt:URI>"
+    "http://www.onvif.org/ver10/tptz/PanTiltSpaces/GenericSpeedSpace</tt:URI>"
+    "<tt:XRange><tt:Min>0</tt:Min><tt:Max>1</tt:Max></tt:XRange>"
+    "</tt:PanTiltSpeedSpace>"
+    "</tt:SupportedPTZSpaces>"
+    "<tt:MaximumNumberOfPresets>" ONVIF_STR(PTZ_PRESET_COUNT)
+    "</tt:MaximumNumberOfPresets>"
+    "<tt:HomeSupported>true</tt:HomeSupported>"
+    "</tptz:PTZNode>"
+    "</tptz:GetNodesResponse>";
+
+// x, y, IDLE/MOVING, UTC time
+const char PROGMEM TPL_PTZ_STATUS[] =
+    "<tptz:GetStatusResponse><tptz:PTZStatus>"
+    "<tt:Position><tt:PanTilt x=\"%.3f\" y=\"%.3f\" "
+    "space=\"" ONVIF_PTZ_POSITION_SPACE "\"/></tt:Position>"
+    "<tt:MoveStatus><tt:PanTilt>%s</tt:PanTilt></tt:MoveStatus>"
+    "<tt:UtcTime>%s</tt:UtcTime>"
+    "</tptz:PTZStatus></tptz:GetStatusResponse>";
+
+// number, name, x, y
+const char PROGMEM TPL_PTZ_PRESET[] =
+    "<tptz:Preset token=\"Preset_%d\"><tt:Name>%s</tt:Name>"
+    "<tt:PTZPosition><tt:PanTilt x=\"%.3f\" y=\"%.3f\" "
+    "space=\"" ONVIF_PTZ_POSITION_SPACE "\"/></tt:PTZPosition>"
+    "</tptz:Preset>";
+
+static void render_ptz_fixed(SoapWriter &w, void *tpl) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_PTZ_NS);
+  w.write_P((const char *)tpl);
+  w.write_P(PART_END);
+}
+
+static void render_ptz_status(SoapWriter &w, void *) {
+  PtzStatus st;
+  ptz_get_status(&st);
+  char utc[24];
+  format_utc(time(nullptr), utc, sizeof(utc));
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_PTZ_NS);
+  w.printf_P(TPL_PTZ_STATUS, st.x, st.y, st.moving ? "MOVING" : "IDLE", utc);
+  w.write_P(PART_END);
+}
+
+static void render_ptz_presets(SoapWriter &w, void *) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_PTZ_NS);
+  w.write_P(PSTR("<tptz:GetPresetsResponse>"));
+  for (int i = 0; i < PTZ_PRESET_COUNT; i++) {
+    char name[24];
+    float x, y;
+    if (ptz_preset_get(i, name, sizeof(name), &x, &y))
+      w.printf_P(TPL_PTZ_PRESET, i + 1, name, x, y);
+  }
+  w.write_P(PSTR("</tptz:GetPresetsResponse>"));
+  w.write_P(PART_END);
+}
+
+static void render_set_preset(SoapWriter &w, void *ctx) {
+  w.write_P(PART_HEADER);
+  w.write_P(TPL_PTZ_NS);
+  w.printf_P(PSTR("<tptz:SetPresetResponse><tptz:PresetToken>Preset_%d"
+                  "</tptz:PresetToken></tptz:SetPresetResponse>"),
+             *(int *)ctx + 1);
+  w.write_P(PART_END);
+}
+
+// x="" / y="" of the PanTilt element inside `elem` (Position, Velocity,
+// Speed). Only the attributes present are written; false if no PanTilt.
+static bool soap_pantilt(const char *req, const char *elem, float *x, float *y) {
+  const char *at = strstr(req, elem);
+  if (!at || (at = strstr(at, "PanTilt")) == nullptr)
+    return false;
+  const char *end = strchr(at, '>');
+  const char *xi = strstr(at, "x=\"");
+  const char *yi = strstr(at, "y=\"");
+  if (xi && end && xi < end)
+    *x = atof(xi + 3);
+  if (yi && end && yi < end)
+    *y = atof(yi + 3);
+  return true;
+}
+
+// "Preset_3" -> 2; -1 if absent or not one of ours
+static int ptz_preset_index(const char *req) {
+  char token[24];
+  int n;
+  if (!soap_text(req, "PresetToken", token, sizeof(token)) ||
+      sscanf(token, "Preset_%d", &n) != 1 || n < 1 || n > PTZ_PRESET_COUNT)
+    return -1;
+  return n - 1;
+}
+
+static void send_no_preset(HttpConn &conn) {
+  send_soap_fault(conn, "env:Sender", "ter:InvalidArgVal/ter:NoToken",
+                  "No such preset");
+}
+#endif
+
+void handle_ptz(HttpConn &conn, const char *req) {
+#if PTZ_ENABLED
+  // Speed is 0..1 per axis; the planner moves both axes at one speed
+  float sx = 0.0f, sy = 0.0f;
+  soap_pantilt(req, "Speed", &sx, &sy);
+  float speed = fmaxf(fabsf(sx), fabsf(sy));
+
+  if (soap_has(req, "ContinuousMove")) {
+    float vx = 0.0f, vy = 0.0f;
+    soap_pantilt(req, "Velocity", &vx, &vy);
+    char timeout[24];
+    int32_t ms = 0;
+    if (soap_text(req, "Timeout", timeout, sizeof(timeout)))
+      ms = xsd_duration_ms(timeout);
+    ptz_continuous_move(vx, vy, ms > 0 ? ms : 0);
+    send_soap_doc(conn, 200, render_ptz_fixed,
+                  (void *)PSTR("<tptz:ContinuousMoveResponse/>"));
+  } else if (soap_has(req, "AbsoluteMove")) {
+    // An axis left out of Position keeps its current value
+    PtzStatus st;
+    ptz_get_status(&st);
+    float x = st.x, y = st.y;
+    soap_pantilt(req, "Position", &x, &y);
+    ptz_absolute_move(x, y, speed);
     Serial.printf("[INFO] PTZ AbsoluteMove: x=%.2f y=%.2f\n", x, y);
+    send_soap_doc(conn, 200, render_ptz_fixed,
+                  (void *)PSTR("<tptz:AbsoluteMoveResponse/>"));
+  } else if (soap_has(req, "GotoHomePosition")) {
+    ptz_absolute_move(0.0f, 0.0f, speed);
+    send_soap_doc(conn, 200, render_ptz_fixed,
+                  (void *)PSTR("<tptz:GotoHomePositionResponse/>"));
+  } else if (soap_has(req, "GotoPreset")) {
+    if (!ptz_preset_goto(ptz_preset_index(req), speed)) {
+      send_no_preset(conn);
+      return;
+    }
+    send_soap_doc(conn, 200, render_ptz_fixed,
+                  (void *)PSTR("<tptz:GotoPresetResponse/>"));
+  } else if (soap_has(req, "SetPreset")) {
+    // Overwrite the given token, or take the first free slot
+    int index = -1;
+    if (soap_has(req, "PresetToken") &&
+        (index = ptz_preset_index(req)) < 0) {
+      send_no_preset(conn);
+      return;
+    }
+    char name[24] = "";
+    soap_text(req, "PresetName", name, sizeof(name));
+    index = ptz_preset_set(index, name);
+    if (index < 0) {
+      send_soap_fault(conn, "env:Receiver", "ter:Action/ter:TooManyPresets",
+                      "All preset slots are in use");
+      return;
+    }
+    send_soap_doc(conn, 200, render_set_preset, &index);
+  } else if (soap_has(req, "RemovePreset")) {
+    if (!ptz_preset_remove(ptz_preset_index(req))) {
+      send_no_preset(conn);
+      return;
+    }
+    send_soap_doc(conn, 200, render_ptz_fixed,
+                  (void *)PSTR("<tptz:RemovePresetResponse/>"));
+  } else if (soap_has(req, "GetPresets")) {
+    send_soap_doc(conn, 200, render_ptz_presets, nullptr);
+  } else if (soap_has(req, "GetStatus")) {
+    send_soap_doc(conn, 200, render_ptz_status, nullptr);
+  } else if (soap_has(req, "GetNodes")) {
+    send_soap_doc(conn, 200, render_ptz_fixed, (void *)TPL_PTZ_NODES);
+  } else {
+    ptz_stop();
+    send_soap_doc(conn, 200, render_ptz_fixed,
+                  (void *)PSTR("<tptz:StopResponse/>"));
   }
+#else
+  send_soap_fault(conn, "env:Receiver",
+                  "ter:ActionNotSupported/ter:PTZNotSupported",
+                  "PTZ is not enabled on this camera");
 #endif
 }
 
@@ -994,89 +1844,24 @@ void handle_ptz(String &req) {
 // GetSystemDateAndTime, GetDeviceInformation should be PUBLIC (no auth
 // required) to allow discovery. Only protected actions like GetStreamUri,
 // GetProfiles need authentication.
-void handle_onvif_soap() {
-  String req = onvifServer.arg(0);
+void handle_onvif_soap(HttpConn &conn) {
+  if (!_onvifEnabled) {
+    http_send(conn, 503, "text/plain", "ONVIF disabled");
+    return;
+  }
+  METRIC_SCOPE(MT_SOAP);
+  const char *req = conn.body;
 
   // Detect action first for proper logging and auth decisions
-  String action = "Unknown";
-  if (req.indexOf("GetSystemDateAndTime") > 0)
-    action = "GetSystemDateAndTime";
-  else if (req.indexOf("SetSystemDateAndTime") > 0)
-    action = "SetSystemDateAndTime";
-  else if (req.indexOf("SetSynchronizationPoint") > 0)
-    action = "SetSynchronizationPoint";
-  else if (req.indexOf("GetCapabilities") > 0)
-    action = "GetCapabilities";
-  else if (req.indexOf("GetServices") > 0)
-    action = "GetServices";
-  else if (req.indexOf("GetDeviceInformation") > 0)
-    action = "GetDeviceInformation";
-  else if (req.indexOf("GetProfiles") > 0)
-    action = "GetProfiles";
-  else if (req.indexOf("GetStreamUri") > 0)
-    action = "GetStreamUri";
-  else if (req.indexOf("GetSnapshotUri") > 0)
-    action = "GetSnapshotUri";
-  else if (req.indexOf("GetVideoSources") > 0)
-    action = "GetVideoSources";
-  else if (req.indexOf("GetVideoEncoderConfigurationOptions") > 0)
-    action = "GetVideoOptions";
-  else if (req.indexOf("GetVideoEncoderConfiguration") > 0)
-    action = "GetVideoConfig";
-  else if (req.indexOf("GetAudioEncoderConfiguration") > 0)
-    action = "GetAudioConfig";
-  else if (req.indexOf("SetVideoEncoderConfiguration") > 0)
-    action = "SetVideoConfig";
-  else if (req.indexOf("GetNetworkInterfaces") > 0)
-    action = "GetNetworkInterfaces";
-  else if (req.indexOf("GetNetworkProtocols") > 0)
-    action = "GetNetworkProtocols";
-  else if (req.indexOf("GetScopes") > 0)
-    action = "GetScopes";
-  else if (req.indexOf("GetHostname") > 0)
-    action = "GetHostname";
-  else if (req.indexOf("GetDNS") > 0)
-    action = "GetDNS";
-  else if (req.indexOf("GetNTP") > 0)
-    action = "GetNTP";
-  else if (req.indexOf("GetOSDOptions") > 0)
-    action = "GetOSDOptions";
-  else if (req.indexOf("GetMoveOptions") > 0)
-    action = "GetMoveOptions";
-  else if (req.indexOf("GetVideoAnalyticsConfigurations") > 0)
-    action = "GetAnalyticsConfig";
-  else if (req.indexOf("GetOptions") > 0 && req.indexOf("VideoSourceToken") > 0)
-    action = "GetImagingOptions";
-  else if (req.indexOf("SetImagingSettings") > 0)
-    action = "SetImagingSettings";
-  else if (req.indexOf("AbsoluteMove") > 0 ||
-           req.indexOf("ContinuousMove") > 0 || req.indexOf("Stop") > 0)
-    action = "PTZ";
-
-  // PUBLIC actions (no auth required per ONVIF spec)
-  // These are needed for device discovery and initial handshake
-  // Hikvision calls many of these during initial camera probe
-  bool isPublicAction =
-      (action == "GetCapabilities" || action == "GetServices" ||
-       action == "GetSystemDateAndTime" || action == "GetDeviceInformation" ||
-       action == "GetScopes" || action == "GetHostname" ||
-       action == "GetNetworkInterfaces" || action == "GetNetworkProtocols" ||
-       action == "GetDNS" || action == "GetNTP" ||
-       action == "GetVideoOptions" || // Needed for codec negotiation
-       action == "GetAudioConfig"     // Usually empty, safe to expose
-      );
-
-  // PROTECTED actions (require authentication)
-  // These provide access to actual streams or modify settings
-  bool isProtectedAction =
-      (action == "GetStreamUri" || action == "GetProfiles" ||
-       action == "SetSystemDateAndTime" || action == "GetVideoSources" ||
-       action == "GetVideoConfig" || action == "GetSnapshotUri" ||
-       action == "SetVideoConfig" || action == "SetImagingSettings" ||
-       action == "PTZ");
+  SoapAction action = soap_action(req, conn.path);
+  const char *actionName = soap_action_name(action);
+
+  // PROTECTED actions give access to streams or modify settings; the public
+  // ones are needed for discovery (Hikvision calls many during its probe)
+  bool isProtectedAction = soap_action_protected(action);
 
   // Check if request contains Security header
-  bool hasSecurity = (req.indexOf("Security") > 0);
+  bool hasSecurity = soap_has(req, "Security");
 
   // Authentication logic:
   // 1. If Security header is present, we MUST verify it (even for public
@@ -1086,53 +1871,61 @@ void handle_onvif_soap() {
 
   if (hasSecurity) {
     // Request has auth header - verify it
-    if (!verify_soap_header(req)) {
-      LOG_E("Auth Failed for: " + action);
+    if (!verify_soap_header(conn, req)) {
+      LOG_E(String("Auth Failed for: ") + actionName);
       if (DEBUG_LEVEL >= 3) {
         // Verbose: show why auth failed
-        int secIdx = req.indexOf("Security");
-        int userIdx = req.indexOf("wsse:Username");
-        int passIdx = req.indexOf("wsse:Password");
+        const char *sec = strstr(req, "Security");
+        const char *user = strstr(req, "wsse:Username");
+        const char *pass = strstr(req, "wsse:Password");
+        int secIdx = sec ? (int)(sec - req) : -1;
+        int userIdx = user ? (int)(user - req) : -1;
+        int passIdx = pass ? (int)(pass - req) : -1;
         Serial.printf(
             "[DEBUG] Security header at %d, Username at %d, Password at %d\n",
             secIdx, userIdx, passIdx);
       }
-      send_soap_fault(onvifServer, "env:Sender", "ter:NotAuthorized",
+      send_soap_fault(conn, "env:Sender", "ter:NotAuthorized",
                       "Authentication failed");
       return;
     }
-    LOG_D("Auth OK for: " + action);
+    LOG_D(String("Auth OK for: ") + actionName);
   } else if (isProtectedAction) {
     // Protected action without auth - reject
-    LOG_E("Auth Required for: " + action + " (no credentials provided)");
-    send_soap_fault(onvifServer, "env:Sender", "ter:NotAuthorized",
+    LOG_E(String("Auth Required for: ") + actionName +
+          " (no credentials provided)");
+    send_soap_fault(conn, "env:Sender", "ter:NotAuthorized",
                     "Authentication required");
     return;
   }
   // Public action without auth - allow through
 
-  LOG_I("ONVIF: " + action);
+  // printf rather than LOG_I: this runs for every request and must not
+  // build a String
+  if (DEBUG_MODE && DEBUG_LEVEL >= 2)
+    Serial.printf("[INFO] ONVIF: %s\n", actionName);
 
   // Handle unknown actions with debug output
-  if (action == "Unknown") {
+  if (action == SOAP_UNKNOWN) {
     // Find the Body tag to show relevant info without header spam
-    int bodyIdx = req.indexOf("<SOAP-ENV:Body>");
-    if (bodyIdx == -1)
-      bodyIdx = req.indexOf("Body>");
+    const char *body = strstr(req, "<SOAP-ENV:Body>");
+    if (!body)
+      body = strstr(req, "Body>");
 
     Serial.println("[DEBUG] UNKNOWN ACTION BODY:");
-    if (bodyIdx > 0) {
-      Serial.println(req.substring(bodyIdx));
-    } else {
-      Serial.println(req);
-    }
+    Serial.println(body ? body : req);
+  }
+
+  if (strcmp(conn.path, "/onvif/media2_service") == 0) {
+    handle_media2(conn, req, action);
+    return;
   }
 
-  if (req.indexOf("GetCapabilities") > 0) {
-    handle_GetCapabilities();
-  } else if (req.indexOf("GetStreamUri") > 0) {
-    handle_GetStreamUri();
-  } else if (req.indexOf("GetSnapshotUri") > 0) {
+  if (soap_has(req, "GetCapabilities")) {
+    handle_GetCapabilities(conn);
+  } else if (soap_has(req, "GetStreamUri")) {
+    handle_GetStreamUri(conn, req, false);
+  } else if (soap_has(req, "GetSnapshotUri")) {
     // Send dynamic Snapshot URI pointing to /snapshot
     const char PROGMEM TPL_SNAPSHOT_URI[] =
         "xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\" "
@@ -1148,179 +1941,48 @@ void handle_onvif_soap() {
         "</trt:GetSnapshotUriResponse>"
         "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
 
-    sendDynamicPROGMEM(onvifServer, TPL_SNAPSHOT_URI,
+    sendDynamicPROGMEM(conn, TPL_SNAPSHOT_URI,
                        WiFi.localIP().toString().c_str(), WEB_PORT);
-  } else if (req.indexOf("GetDeviceInformation") > 0) {
+  } else if (soap_has(req, "GetDeviceInformation")) {
     // Dynamically insert MAC address as Serial Number for better NVR
     // compatibility
-    sendDynamicPROGMEM(onvifServer, TPL_DEV_INFO, WiFi.macAddress().c_str(), 0);
-  } else if (req.indexOf("GetSystemDateAndTime") > 0) {
-    handle_GetSystemDateAndTime();
-  } else if (req.indexOf("GetServices") > 0) {
-    onvifServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
-    onvifServer.send(200, "application/soap+xml", "");
-
-    char buffer[512];
-    String ip = WiFi.localIP().toString();
-
-    // Header + Device Service
-    snprintf_P(
-        buffer, sizeof(buffer),
-        PSTR("%s"
-             "xmlns:tds=\"http://www.onvif.org/ver10/device/wsdl\">"
-             "<SOAP-ENV:Body>"
-             "<tds:GetServicesResponse>"
-             "<tds:Service><tds:Namespace>http://www.onvif.org/ver10/device/"
-             "wsdl</tds:Namespace><tds:XAddr>http://%s:%d/onvif/"
-             "device_service</tds:XAddr><tds:Version><tt:Major>2</"
-             "tt:Major><tt:Minor>5</tt:Minor></tds:Version></tds:Service>"),
-        PART_HEADER, ip.c_str(), ONVIF_PORT);
-    onvifServer.sendContent(buffer);
-
-    // Media Service + Footer
-    snprintf_P(
-        buffer, sizeof(buffer),
-        PSTR("<tds:Service><tds:Namespace>http://www.onvif.org/ver10/media/"
-             "wsdl</tds:Namespace><tds:XAddr>http://%s:%d/onvif/"
-             "device_service</tds:XAddr><tds:Version><tt:Major>2</"
-             "tt:Major><tt:Minor>5</tt:Minor></tds:Version></tds:Service>"
-             "</tds:GetServicesResponse>"
-             "</SOAP-ENV:Body></SOAP-ENV:Envelope>"),
-        ip.c_str(), ONVIF_PORT);
-    onvifServer.sendContent(buffer);
-
-  } else if (req.indexOf("GetProfiles") > 0) {
+    sendDynamicPROGMEM(conn, TPL_DEV_INFO, WiFi.macAddress().c_str(), 0);
+  } else if (soap_has(req, "GetSystemDateAndTime")) {
+    handle_GetSystemDateAndTime(conn);
+  } else if (soap_has(req, "GetServices")) {
+    send_cached_or_fail(conn, CACHED_SERVICES, render_services);
+  } else if (soap_has(req, "GetProfiles")) {
     LOG_D("Sending GetProfiles response");
-
-    char buffer[1800];
-    int len;
-
-    // --- DYNAMIC PROFILE (Based on config.h) ---
-    len =
-        snprintf(buffer, sizeof(buffer),
-                 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
-                 "<SOAP-ENV:Envelope "
-                 "xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" "
-                 "xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\" "
-                 "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
-                 "<SOAP-ENV:Body>"
-                 "<trt:GetProfilesResponse>"
-                 "<trt:Profiles token=\"Profile_1\" fixed=\"true\">"
-                 "<tt:Name>MainStream</tt:Name>"
-                 "<tt:VideoSourceConfiguration token=\"VideoSourceToken\">"
-                 "<tt:Name>VideoSource</tt:Name>"
-                 "<tt:UseCount>1</tt:UseCount>"
-                 "<tt:SourceToken>VideoSource_1</tt:SourceToken>"
-                 "<tt:Bounds x=\"0\" y=\"0\" width=\"640\" height=\"480\"/>"
-                 "</tt:VideoSourceConfiguration>"
-                 "<tt:VideoEncoderConfiguration token=\"VideoEncoderToken\">"
-                 "<tt:Name>VideoEncoder</tt:Name>"
-                 "<tt:UseCount>1</tt:UseCount>"
-#ifdef VIDEO_CODEC_H264
-                 "<tt:Encoding>H264</tt:Encoding>"
-#else
-                 "<tt:Encoding>JPEG</tt:Encoding>"
-#endif
-                 "<tt:Resolution>"
-                 "<tt:Width>640</tt:Width>"
-                 "<tt:Height>480</tt:Height>"
-                 "</tt:Resolution>"
-                 "<tt:Quality>5</tt:Quality>"
-                 "<tt:RateControl>"
-                 "<tt:FrameRateLimit>20</tt:FrameRateLimit>"
-                 "<tt:EncodingInterval>1</tt:EncodingInterval>"
-#ifdef VIDEO_CODEC_H264
-                 "<tt:BitrateLimit>2048</tt:BitrateLimit>"
-                 "</tt:RateControl>"
-                 "<tt:H264>"
-                 "<tt:GovLength>30</tt:GovLength>"
-                 "<tt:H264Profile>Baseline</tt:H264Profile>"
-                 "</tt:H264>"
-#else
-                 "<tt:BitrateLimit>4096</tt:BitrateLimit>"
-                 "</tt:RateControl>"
-#endif
-                 "<tt:Multicast>"
-                 "<tt:Address><tt:Type>IPv4</tt:Type><tt:IPv4Address>0.0.0.0</"
-                 "tt:IPv4Address></tt:Address>"
-                 "<tt:Port>0</tt:Port>"
-                 "<tt:TTL>1</tt:TTL>"
-                 "<tt:AutoStart>false</tt:AutoStart>"
-                 "</tt:Multicast>"
-                 "<tt:SessionTimeout>PT60S</tt:SessionTimeout>"
-                 "</tt:VideoEncoderConfiguration>"
-                 "</trt:Profiles>"
-                 "</trt:GetProfilesResponse>"
-                 "</SOAP-ENV:Body>"
-                 "</SOAP-ENV:Envelope>");
-
-    if (len > 0 && len < sizeof(buffer)) {
-      onvifServer.send(200, "application/soap+xml", buffer);
-      LOG_D("GetProfiles sent, size: " + String(len));
-    } else {
-      LOG_E("GetProfiles buffer overflow!");
-      onvifServer.send(500, "text/plain", "Buffer overflow");
-    }
-
-  } else if (req.indexOf("GetVideoSources") > 0) {
-    // Inject current Sensor values
-    sensor_t *s = esp_camera_sensor_get();
-    // Map -2..2 to 0..100 or similar if needed, but ONVIF is often 0..100.
-    // ESP32Cam standard is -2 to 2. Let's map linearly: -2=0, -1=25, 0=50,
-    // 1=75, 2=100 Brightness
-    int br = (s->status.brightness + 2) * 25;
-    // Contrast
-    int cn = (s->status.contrast + 2) * 25;
-    // Saturation
-    int sa = (s->status.saturation + 2) * 25;
-
-    char *buffer = new char[2048];
-    if (buffer) {
-      snprintf_P(buffer, 2048, PART_HEADER);
-      size_t len = strlen(buffer);
-      snprintf_P(buffer + len, 2048 - len, TPL_VIDEO_SOURCES, br, sa, cn);
-      onvifServer.send(200, "application/soap+xml", buffer);
-      delete[] buffer;
-    } else {
-      onvifServer.send(500, "text/plain", "OOM");
+    send_cached_or_fail(conn, CACHED_PROFILES, render_profiles);
+  } else if (soap_has(req, "GetVideoSources")) {
+    send_cached_or_fail(conn, CACHED_VIDEO_SOURCES, render_video_sources);
+  } else if (soap_has(req, "GetVideoEncoderConfigurationOptions")) {
+    send_soap_doc(conn, 200, render_video_options, nullptr);
+  } else if (soap_has(req, "GetVideoEncoderConfiguration")) {
+    MediaSelection sel;
+    if (media_selection(conn, req, &sel)) {
+      // The singular form without a token means the main stream
+      if (!soap_has(req, "GetVideoEncoderConfigurations"))
+        sel.last = sel.first;
+      send_soap_doc(conn, 200, render_encoder_configs, &sel);
     }
-  } else if (req.indexOf("GetVideoEncoderConfigurationOptions") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_VIDEO_OPTIONS);
-  } else if (req.indexOf("GetVideoEncoderConfiguration") > 0) {
-    if (req.indexOf("VideoEncoderToken_Sub") > 0) {
-      sendFixedPROGMEM(onvifServer, TPL_VIDEO_ENCODER_CONFIG_SUB);
-    } else {
-      // Default to Main if unspecified or Main
-      sendFixedPROGMEM(onvifServer, TPL_VIDEO_ENCODER_CONFIG_MAIN);
-    }
-  } else if (req.indexOf("GetNetworkInterfaces") > 0) {
-    // Pass MAC and IP to the template
-    char *buffer = new char[2048];
-    if (buffer) {
-      snprintf_P(buffer, 2048, PART_HEADER);
-      size_t len = strlen(buffer);
-      snprintf_P(buffer + len, 2048 - len, TPL_NETWORK_INTERFACES,
-                 WiFi.macAddress().c_str(), WiFi.localIP().toString().c_str());
-      onvifServer.send(200, "application/soap+xml", buffer);
-      delete[] buffer;
-    } else {
-      onvifServer.send(500, "text/plain", "OOM");
-    }
-  } else if (req.indexOf("GetAudioEncoderConfigurationOptions") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_AUDIO_OPTIONS); // Return empty options
-  } else if (req.indexOf("GetAudioEncoderConfiguration") > 0) {
+  } else if (soap_has(req, "GetNetworkInterfaces")) {
+    send_cached_or_fail(conn, CACHED_NETWORK_INTERFACES, render_network_interfaces);
+  } else if (soap_has(req, "GetAudioEncoderConfigurationOptions")) {
+    sendFixedPROGMEM(conn, TPL_AUDIO_OPTIONS); // Return empty options
+  } else if (soap_has(req, "GetAudioEncoderConfiguration")) {
     // Return empty or fault? Empty list is safer for "Not Supported"
-    sendFixedPROGMEM(onvifServer, TPL_AUDIO_CONFIG);
-  } else if (req.indexOf("GetOSDOptions") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_OSD_OPTIONS);
-  } else if (req.indexOf("GetVideoAnalyticsConfigurations") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_ANALYTICS_CONFIG);
-  } else if (req.indexOf("GetVideoAnalyticsConfigurations") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_ANALYTICS_CONFIG);
-  } else if (req.indexOf("GetOptions") > 0 &&
-             req.indexOf("VideoSourceToken") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_IMAGING_OPTIONS);
-  } else if (req.indexOf("GetScopes") > 0) {
+    sendFixedPROGMEM(conn, TPL_AUDIO_CONFIG);
+  } else if (soap_has(req, "GetOSDOptions")) {
+    sendFixedPROGMEM(conn, TPL_OSD_OPTIONS);
+  } else if (soap_has(req, "GetVideoAnalyticsConfigurations")) {
+    sendFixedPROGMEM(conn, TPL_ANALYTICS_CONFIG);
+  } else if (soap_has(req, "GetVideoAnalyticsConfigurations")) {
+    sendFixedPROGMEM(conn, TPL_ANALYTICS_CONFIG);
+  } else if (soap_has(req, "GetOptions") &&
+             soap_has(req, "VideoSourceToken")) {
+    sendFixedPROGMEM(conn, TPL_IMAGING_OPTIONS);
+  } else if (soap_has(req, "GetScopes")) {
     const char PROGMEM TPL_SCOPES[] =
         "xmlns:tds=\"http://www.onvif.org/ver10/device/wsdl\" "
         "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
@@ -1340,175 +2002,88 @@ void handle_onvif_soap() {
         "tt:ScopeItem></tds:Scopes>"
         "</tds:GetScopesResponse>"
         "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
-    sendFixedPROGMEM(onvifServer, TPL_SCOPES);
-  } else if (req.indexOf("GetHostname") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_HOSTNAME);
-  } else if (req.indexOf("SetSystemDateAndTime") > 0) {
+    sendFixedPROGMEM(conn, TPL_SCOPES);
+  } else if (soap_has(req, "GetHostname")) {
+    sendFixedPROGMEM(conn, TPL_HOSTNAME);
+  } else if (soap_has(req, "SetSystemDateAndTime")) {
     handle_SetSystemDateAndTime(req);
-    sendFixedPROGMEM(onvifServer, TPL_SET_TIME_RES);
-  } else if (req.indexOf("SetImagingSettings") > 0 ||
-             req.indexOf("SetVideoEncoderConfiguration") > 0) {
-    // Acknowledge setting commands with OK (we ignore the actual values to
-    // enforce stability)
-    onvifServer.send(200, "application/soap+xml", "<ok/>");
-  } else if (req.indexOf("GetDNS") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_DNS);
-  } else if (req.indexOf("GetNTP") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_NTP);
-  } else if (req.indexOf("GetNetworkProtocols") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_NET_PROTOCOLS);
-  } else if (req.indexOf("GetMoveOptions") > 0) {
-    if (req.indexOf("VideoSourceToken") > 0) {
-      sendFixedPROGMEM(onvifServer, TPL_IMAGING_MOVE_OPTIONS);
+    sendFixedPROGMEM(conn, TPL_SET_TIME_RES);
+  } else if (soap_has(req, "SetImagingSettings")) {
+    handle_set_imaging_settings(req);
+    onvif_bump_config_epoch();
+    http_send(conn, 200, "application/soap+xml", "<ok/>");
+  } else if (soap_has(req, "SetVideoEncoderConfiguration")) {
+    handle_set_video_encoder(conn, req, false);
+  } else if (soap_has(req, "GetDNS")) {
+    sendFixedPROGMEM(conn, TPL_DNS);
+  } else if (soap_has(req, "GetNTP")) {
+    sendFixedPROGMEM(conn, TPL_NTP);
+  } else if (soap_has(req, "GetNetworkProtocols")) {
+    sendFixedPROGMEM(conn, TPL_NET_PROTOCOLS);
+  } else if (soap_has(req, "GetMoveOptions")) {
+    if (soap_has(req, "VideoSourceToken")) {
+      sendFixedPROGMEM(conn, TPL_IMAGING_MOVE_OPTIONS);
     } else {
-      sendFixedPROGMEM(onvifServer, TPL_MOVE_OPTIONS);
+      sendFixedPROGMEM(conn, TPL_MOVE_OPTIONS);
     }
-  } else if (req.indexOf("SetSynchronizationPoint") > 0) {
-    sendFixedPROGMEM(onvifServer, TPL_SET_SYNC_POINT);
-  } else if (req.indexOf("AbsoluteMove") > 0 ||
-             req.indexOf("ContinuousMove") > 0 || req.indexOf("Stop") > 0) {
-    handle_ptz(req);
-    onvifServer.send(200, "application/soap+xml", "<ok/>");
+  } else if (soap_has(req, "SetSynchronizationPoint")) {
+    sendFixedPROGMEM(conn, TPL_SET_SYNC_POINT);
+  } else if (action == SOAP_CREATE_PULL_POINT) {
+    handle_create_pullpoint(conn, req);
+  } else if (action == SOAP_PULL_MESSAGES) {
+    handle_pull_messages(conn, req);
+  } else if (action == SOAP_UNSUBSCRIBE) {
+    handle_unsubscribe(conn, req);
+  } else if (action == SOAP_RENEW) {
+    handle_renew(conn, req);
+  } else if (action == SOAP_GET_EVENT_PROPERTIES) {
+    send_soap_doc(conn, 200, render_events_fixed,
+                  (void *)TPL_EVENT_PROPERTIES);
+  } else if (action == SOAP_GET_EVENT_SERVICE_CAPS) {
+    send_soap_doc(conn, 200, render_events_fixed,
+                  (void *)TPL_EVENT_SERVICE_CAPS);
+  } else if (action == SOAP_PTZ) {
+    handle_ptz(conn, req);
   } else {
-    onvifServer.send(200, "application/soap+xml", "<ok/>");
+    http_send(conn, 200, "application/soap+xml", "<ok/>");
   }
 }
 
-void handle_onvif_discovery() {
-  // Rate limit discovery checks to prevent tight loop
-  static unsigned long lastDiscoveryCheck = 0;
-  static unsigned long lastRecoveryAttempt = 0;
-  static int consecutiveErrors = 0;
-  static bool udpDisabled = false;
-
-  unsigned long now = millis();
-
-  // Only check every 50ms minimum (20 checks/second max)
-  if (now - lastDiscoveryCheck < 50) {
-    return;
-  }
-  lastDiscoveryCheck = now;
-
-  // If we've had too many errors, back off and try to recover
-  if (udpDisabled) {
-    // Try to recover every 10 seconds
-    if (now - lastRecoveryAttempt < 10000) {
-      return;
-    }
-    lastRecoveryAttempt = now;
-
-    // Attempt to reinitialize UDP
-    LOG_I("ONVIF Discovery: Attempting UDP recovery...");
-    onvifUDP.stop();
-    delay(100);
-    if (onvifUDP.beginMulticast(IPAddress(239, 255, 255, 250), 3702)) {
-      LOG_I("ONVIF Discovery: UDP recovered.");
-      udpDisabled = false;
-      consecutiveErrors = 0;
-    } else {
-      LOG_E("ONVIF Discovery: UDP recovery failed, will retry later.");
-    }
-    return;
-  }
-
-  int packetSize = onvifUDP.parsePacket();
-
-  // Handle errors (parsePacket returns 0 for no packet, negative for error,
-  // positive for packet)
-  if (packetSize < 0) {
-    consecutiveErrors++;
-    if (consecutiveErrors >= 10) {
-      LOG_E("ONVIF Discovery: Too many UDP errors, disabling temporarily.");
-      udpDisabled = true;
-      lastDiscoveryCheck = now; // Reset for backoff timing
-    }
-    return;
-  }
-
-  // Reset error counter on success
-  consecutiveErrors = 0;
-
-  if (packetSize > 0) {
-    char packet[1024];
-    int len = onvifUDP.read(packet, sizeof(packet) - 1);
-    if (len > 0) {
-      packet[len] = 0;
-      // Optimization: Use strstr on buffer instead of allocating String object
-      if (strstr(packet, "Probe") != nullptr) {
-        String ip = WiFi.localIP().toString();
-
-        // WS-Discovery Probe Match Response
-        // Use stack buffer instead of String concatenation to prevent fragmentation
-        char resp[1200];
-        snprintf(resp, sizeof(resp), 
-            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
-            "<SOAP-ENV:Envelope "
-            "xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" "
-            "xmlns:SOAP-ENC=\"http://www.w3.org/2003/05/soap-encoding\" "
-            "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
-            "xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\">"
-            "<SOAP-ENV:Body>"
-            "<ProbeMatches "
-            "xmlns=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\">"
-            "<ProbeMatch>"
-            "<EndpointReference><Address>urn:uuid:esp32-cam-onvif-%s</Address></EndpointReference>"
-            "<Types>dn:NetworkVideoTransmitter</Types>"
-            "<Scopes>onvif://www.onvif.org/type/Network_Video_Transmitter "
-            "onvif://www.onvif.org/Profile/Streaming "
-            "onvif://www.onvif.org/location/Office "
-            "onvif://www.onvif.org/name/" DEVICE_MODEL
-            " onvif://www.onvif.org/hardware/" DEVICE_HARDWARE_ID "</Scopes>"
-            "<XAddrs>http://%s:%d/onvif/device_service</XAddrs>"
-            "<MetadataVersion>1</MetadataVersion>"
-            "</ProbeMatch>"
-            "</ProbeMatches>"
-            "</SOAP-ENV:Body>"
-            "</SOAP-ENV:Envelope>",
-            WiFi.macAddress().c_str(), ip.c_str(), ONVIF_PORT);
-
-        onvifUDP.beginPacket(onvifUDP.remoteIP(), onvifUDP.remotePort());
-        onvifUDP.write((const uint8_t *)resp, strlen(resp));
-        onvifUDP.endPacket();
-      }
-    }
-  } // End if(packetSize > 0)
-} // End function
-
 void onvif_reconnect() {
-  // Re-bind WS-Discovery multicast after WiFi reconnection so NVRs can
-  // rediscover the camera on its (potentially new) IP address.
-  onvifUDP.stop();
-  delay(50);
-  if (onvifUDP.beginMulticast(IPAddress(239, 255, 255, 250), 3702)) {
-    Serial.println("[INFO] ONVIF WS-Discovery re-broadcast OK.");
-  } else {
-    Serial.println("[WARN] ONVIF WS-Discovery re-broadcast failed.");
-  }
+  // Cached responses embed the old IP
+  onvif_bump_config_epoch();
+
+  // Re-join the WS-Discovery group on the (potentially new) address and
+  // announce it with a Hello; done on the ONVIF task, which owns the socket
+  onvif_discovery_rebind();
 }
 
 void onvif_server_start() {
-  if (!s_soapBuf) {
-    s_soapBuf = (char *)heap_caps_malloc(SOAP_BUF_SIZE, MALLOC_CAP_8BIT);
-    if (!s_soapBuf) {
-      Serial.println("[CRITICAL] Failed to allocate ONVIF SOAP buffer!");
-    }
-  }
-
-  onvifServer.on("/onvif/device_service", HTTP_POST, handle_onvif_soap);
-  onvifServer.on("/onvif/ptz_service", HTTP_POST,
-                 handle_onvif_soap); // Route PTZ to same handler for now
-  onvifServer.begin();
-
-  // Initialize UDP for WS-Discovery with error checking
-  if (!onvifUDP.beginMulticast(IPAddress(239, 255, 255, 250), 3702)) {
-    LOG_E("ONVIF Discovery: Failed to initialize UDP multicast!");
+  if (!http_engine_listen(ONVIF_PORT)) {
+    LOG_E("ONVIF: HTTP engine failed to start");
   }
+  http_engine_on(ONVIF_PORT, "/onvif/device_service", VERB_POST,
+                 handle_onvif_soap);
+  http_engine_on(ONVIF_PORT, "/onvif/ptz_service", VERB_POST,
+                 handle_onvif_soap);
+  http_engine_on(ONVIF_PORT, "/onvif/events_service", VERB_POST,
+                 handle_onvif_soap);
+  http_engine_on(ONVIF_PORT, "/onvif/media2_service", VERB_POST,
+                 handle_onvif_soap);
+
+  onvif_discovery_start();
   LOG_I("ONVIF server started.");
 }
 
-void onvif_server_loop() {
-  if (!_onvifEnabled)
-    return;
-  onvifServer.handleClient();
-  handle_onvif_discovery();
+uint32_t onvif_server_loop(uint32_t waitMs) {
+  // Sleeps in select() instead of a fixed delay, so a request is answered as
+  // soon as it arrives. The engine also serves port 80, so it runs with ONVIF
+  // switched off; SOAP and discovery check the switch themselves.
+  uint32_t busy = http_engine_poll(waitMs);
+  if (_onvifEnabled) {
+    uint32_t start = micros();
+    onvif_discovery_loop();
+    busy += micros() - start;
+  }
+  return busy;
 }
\ No newline at end of file
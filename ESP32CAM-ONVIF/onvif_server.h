@@ -1,11 +1,19 @@
 #pragma once
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WiFiUdp.h>
-#include <WebServer.h>
 
 void onvif_server_start();
-void onvif_server_loop();
+// Services the HTTP engine (ONVIF SOAP and the port-80 web server) and
+// WS-Discovery, all in one select() loop. Blocks up to waitMs waiting for
+// network activity (use it as the task's sleep). With ONVIF disabled, SOAP
+// requests get 503 and probes go unanswered; port 80 is served regardless.
+// Returns the microseconds of work, for task_busy_add().
+uint32_t onvif_server_loop(uint32_t waitMs = 0);
 bool onvif_is_enabled();
 void onvif_set_enabled(bool en);
 void onvif_reconnect();
+
+// Config epoch: cached ONVIF responses are re-rendered after every bump.
+// Call whenever IP, settings or sensor configuration change.
+void onvif_bump_config_epoch();
+uint32_t onvif_config_epoch();
@@ -5,11 +5,18 @@
 #include <WiFiUdp.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "fixed_pool.h"
 
 typedef WiFiClient *SOCKET;
 typedef WiFiUDP *UDPSOCKET;
@@ -18,10 +25,31 @@ typedef uint16_t IPPORT;
 
 #define NULLSOCKET NULL
 
+// Accepted RTSP connections and the streamer's RTP/RTCP pair live in fixed
+// pools, so clients coming and going don't fragment the heap. Only
+// RTSP_Task opens and closes them.
+#define PLAT_MAX_SOCKETS     4 // >= RTSP_MAX_CLIENTS
+#define PLAT_MAX_UDP_SOCKETS 2 // one streamer's RTP + RTCP
+
+inline FixedPool<WiFiClient, PLAT_MAX_SOCKETS> &platsocketpool() {
+    static FixedPool<WiFiClient, PLAT_MAX_SOCKETS> pool;
+    return pool;
+}
+
+inline FixedPool<WiFiUDP, PLAT_MAX_UDP_SOCKETS> &platudppool() {
+    static FixedPool<WiFiUDP, PLAT_MAX_UDP_SOCKETS> pool;
+    return pool;
+}
+
+// Takes over an accepted connection; NULL if every socket slot is in use
+inline SOCKET socketadopt(const WiFiClient &client) {
+    return platsocketpool().create(client);
+}
+
 inline void closesocket(SOCKET s) {
     if (s) {
         s->stop();
-        delete s;
+        platsocketpool().destroy(s);
     }
 }
 
@@ -36,16 +64,17 @@ inline void socketpeeraddr(SOCKET s, IPADDRESS *addr, IPPORT *port) {
 inline void udpsocketclose(UDPSOCKET s) {
     if (s) {
         s->stop();
-        delete s;
+        platudppool().destroy(s);
     }
 }
 
 inline UDPSOCKET udpsocketcreate(unsigned short portNum)
 {
-    UDPSOCKET s = new WiFiUDP();
+    UDPSOCKET s = platudppool().create();
+    if (!s) return NULL;
     if (!s->begin(portNum)) {
         printf("Can't bind UDP port %d\n", portNum);
-        delete s;
+        platudppool().destroy(s);
         return NULL;
     }
     return s;
@@ -70,6 +99,45 @@ inline ssize_t udpsocketsend(UDPSOCKET sockfd, const void *buf, size_t len,
     return len;
 }
 
+// Non-blocking UDP receive; returns bytes read, 0 if nothing pending
+inline int udpsocketrecv(UDPSOCKET sockfd, void *buf, size_t len)
+{
+    if (!sockfd || sockfd->parsePacket() <= 0) return 0;
+    return sockfd->read((uint8_t *)buf, len);
+}
+
+// Send-only multicast socket: plain (lwIP) BSD socket, since WiFiUDP can't
+// set the TTL. Returns -1 on failure.
+typedef int MCASTSOCKET;
+#define NULLMCASTSOCKET -1
+
+inline MCASTSOCKET mcastsocketcreate(uint8_t ttl)
+{
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) return NULLMCASTSOCKET;
+    if (setsockopt(s, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0)
+        printf("Can't set multicast TTL\n");
+    return s;
+}
+
+inline void mcastsocketclose(MCASTSOCKET s)
+{
+    if (s >= 0) close(s);
+}
+
+// group in network byte order (inet_addr)
+inline ssize_t mcastsocketsend(MCASTSOCKET s, const void *buf, size_t len,
+                               uint32_t group, uint16_t port)
+{
+    if (s < 0) return 0;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = group;
+    addr.sin_port        = htons(port);
+    return sendto(s, buf, len, 0, (sockaddr *)&addr, sizeof(addr));
+}
+
 /**
    Read from a socket with a timeout.
    Return 0=socket was closed by client, -1=timeout, >0 number of bytes read
@@ -90,6 +158,47 @@ inline int socketread(SOCKET sock, char *buf, size_t buflen, int timeoutmsec)
         return -1;  // Timeout
     }
 
+    // Never wait for more than is already there
+    if ((size_t)numAvail < buflen) buflen = numAvail;
     int numRead = sock->readBytes(buf, buflen);
     return numRead;
 }
+
+// --- Tasks, queues and locks for the RTSP frame pipeline ---
+
+typedef QueueHandle_t PLATQUEUE;
+typedef SemaphoreHandle_t PLATMUTEX;
+
+inline PLATQUEUE platqueuecreate(unsigned depth, size_t itemSize)
+{
+    return xQueueCreate(depth, itemSize);
+}
+
+// Copies item in; false if the queue stayed full for timeoutMs
+inline bool platqueuesend(PLATQUEUE q, const void *item, uint32_t timeoutMs)
+{
+    return xQueueSend(q, item, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+// Copies the oldest item out; false if none arrived within timeoutMs
+inline bool platqueuereceive(PLATQUEUE q, void *item, uint32_t timeoutMs)
+{
+    return xQueueReceive(q, item, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+inline PLATMUTEX platmutexcreate() { return xSemaphoreCreateMutex(); }
+inline void platmutexlock(PLATMUTEX m) { xSemaphoreTake(m, portMAX_DELAY); }
+inline void platmutexunlock(PLATMUTEX m) { xSemaphoreGive(m); }
+inline void platmutexdelete(PLATMUTEX m) { vSemaphoreDelete(m); }
+
+inline bool plattaskcreate(void (*fn)(void *), const char *name, uint32_t stackBytes,
+                           unsigned priority, int core)
+{
+    return xTaskCreatePinnedToCore(fn, name, stackBytes, NULL, priority, NULL, core) == pdPASS;
+}
+
+inline uint32_t platmicros() { return micros(); }
+// Monotonic microseconds since boot - same clock as camera_fb_t::timestamp
+inline uint64_t platmicros64() { return (uint64_t)esp_timer_get_time(); }
+inline uint32_t platmillis() { return millis(); }
+inline void platdelayms(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms ? ms : 1)); }
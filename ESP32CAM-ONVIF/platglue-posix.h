@@ -9,6 +9,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 typedef int SOCKET;
 typedef int UDPSOCKET;
@@ -18,7 +20,7 @@ typedef uint16_t IPPORT; // on linux use network byte order
 #define NULLSOCKET 0
 
 inline void closesocket(SOCKET s) {
-    close(s);
+    if (s) close(s);
 }
 
 #define getRandom() rand()
@@ -41,7 +43,7 @@ inline void socketpeeraddr(SOCKET s, IPADDRESS *addr, IPPORT *port) {
 }
 
 inline void udpsocketclose(UDPSOCKET s) {
-    close(s);
+    if (s) close(s);
 }
 
 inline UDPSOCKET udpsocketcreate(unsigned short portNum)
@@ -65,8 +67,8 @@ inline UDPSOCKET udpsocketcreate(unsigned short portNum)
 // TCP sending
 inline ssize_t socketsend(SOCKET sockfd, const void *buf, size_t len)
 {
-    // printf("TCP send\n");
-    return send(sockfd, buf, len, 0);
+    // A client that went away must not kill the process with SIGPIPE
+    return send(sockfd, buf, len, MSG_NOSIGNAL);
 }
 
 inline ssize_t udpsocketsend(UDPSOCKET sockfd, const void *buf, size_t len,
@@ -82,6 +84,45 @@ inline ssize_t udpsocketsend(UDPSOCKET sockfd, const void *buf, size_t len,
     return sendto(sockfd, buf, len, 0, (sockaddr *) &addr, sizeof(addr));
 }
 
+// Non-blocking UDP receive; returns bytes read, 0 if nothing pending
+inline int udpsocketrecv(UDPSOCKET sockfd, void *buf, size_t len)
+{
+    ssize_t res = recv(sockfd, buf, len, MSG_DONTWAIT);
+    return res > 0 ? (int)res : 0;
+}
+
+// Send-only multicast socket: IP_MULTICAST_TTL set once. Returns -1 on
+// failure.
+typedef int MCASTSOCKET;
+#define NULLMCASTSOCKET -1
+
+inline MCASTSOCKET mcastsocketcreate(uint8_t ttl)
+{
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) return NULLMCASTSOCKET;
+    if (setsockopt(s, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0)
+        printf("Can't set multicast TTL\n");
+    return s;
+}
+
+inline void mcastsocketclose(MCASTSOCKET s)
+{
+    if (s >= 0) close(s);
+}
+
+// group in network byte order (inet_addr)
+inline ssize_t mcastsocketsend(MCASTSOCKET s, const void *buf, size_t len,
+                               uint32_t group, uint16_t port)
+{
+    if (s < 0) return 0;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = group;
+    addr.sin_port        = htons(port);
+    return sendto(s, buf, len, 0, (sockaddr *)&addr, sizeof(addr));
+}
+
 /**
    Read from a socket with a timeout.
 
@@ -89,13 +130,18 @@ inline ssize_t udpsocketsend(UDPSOCKET sockfd, const void *buf, size_t len,
  */
 inline int socketread(SOCKET sock, char *buf, size_t buflen, int timeoutmsec)
 {
-    // Use a timeout on our socket read to instead serve frames
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = timeoutmsec * 1000; // send a new frame ever
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    // Use a timeout on our socket read to instead serve frames; 0 polls
+    // (a zero SO_RCVTIMEO would block forever)
+    int flags = 0;
+    if (timeoutmsec > 0) {
+        struct timeval tv;
+        tv.tv_sec = timeoutmsec / 1000;
+        tv.tv_usec = (timeoutmsec % 1000) * 1000;
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    }
+    else flags = MSG_DONTWAIT;
 
-    int res = recv(sock,buf,buflen,0);
+    int res = recv(sock,buf,buflen,flags);
     if(res > 0) {
         return res;
     }
@@ -109,3 +155,127 @@ inline int socketread(SOCKET sock, char *buf, size_t buflen, int timeoutmsec)
             return 0; // unknown error, just claim client dropped it
     };
 }
+
+// --- Tasks, queues and locks for the RTSP frame pipeline ---
+
+struct PlatQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned depth, count, head;
+    size_t itemSize;
+    unsigned char *items;
+};
+typedef PlatQueue *PLATQUEUE;
+typedef pthread_mutex_t *PLATMUTEX;
+
+inline uint32_t platmillis()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
+
+inline uint32_t platmicros()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+inline uint64_t platmicros64()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+inline void platdelayms(uint32_t ms)
+{
+    timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+inline PLATQUEUE platqueuecreate(unsigned depth, size_t itemSize)
+{
+    PlatQueue *q = new PlatQueue();
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    q->depth = depth;
+    q->count = q->head = 0;
+    q->itemSize = itemSize;
+    q->items = new unsigned char[depth * itemSize];
+    return q;
+}
+
+// Deadline for pthread_cond_timedwait (CLOCK_REALTIME)
+inline timespec platdeadline(uint32_t timeoutMs)
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec  += timeoutMs / 1000;
+    ts.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+    return ts;
+}
+
+inline bool platqueuesend(PLATQUEUE q, const void *item, uint32_t timeoutMs)
+{
+    timespec deadline = platdeadline(timeoutMs);
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->depth) {
+        if (pthread_cond_timedwait(&q->changed, &q->lock, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&q->lock);
+            return false;
+        }
+    }
+    memcpy(q->items + ((q->head + q->count) % q->depth) * q->itemSize, item, q->itemSize);
+    q->count++;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    return true;
+}
+
+inline bool platqueuereceive(PLATQUEUE q, void *item, uint32_t timeoutMs)
+{
+    timespec deadline = platdeadline(timeoutMs);
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) {
+        if (pthread_cond_timedwait(&q->changed, &q->lock, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&q->lock);
+            return false;
+        }
+    }
+    memcpy(item, q->items + q->head * q->itemSize, q->itemSize);
+    q->head = (q->head + 1) % q->depth;
+    q->count--;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    return true;
+}
+
+inline PLATMUTEX platmutexcreate()
+{
+    pthread_mutex_t *m = new pthread_mutex_t;
+    pthread_mutex_init(m, NULL);
+    return m;
+}
+inline void platmutexlock(PLATMUTEX m) { pthread_mutex_lock(m); }
+inline void platmutexunlock(PLATMUTEX m) { pthread_mutex_unlock(m); }
+inline void platmutexdelete(PLATMUTEX m) { pthread_mutex_destroy(m); delete m; }
+
+inline void *plattaskentry(void *fn)
+{
+    ((void (*)(void *))fn)(NULL);
+    return NULL;
+}
+
+// Priority and core are FreeRTOS notions; on Linux every stage is a thread
+inline bool plattaskcreate(void (*fn)(void *), const char *name, uint32_t stackBytes,
+                           unsigned priority, int core)
+{
+    (void)name; (void)stackBytes; (void)priority; (void)core;
+    pthread_t t;
+    if (pthread_create(&t, NULL, plattaskentry, (void *)fn) != 0) return false;
+    pthread_detach(t);
+    return true;
+}
@@ -0,0 +1,269 @@
+#include <Arduino.h>
+#include "ptz_control.h"
+#include "config.h"
+#include "board_config.h"
+
+#if PTZ_ENABLED
+#include "ptz_planner.h"
+#include "task_manifest.h"
+#include <ESP32Servo.h>
+#include <Preferences.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+// Pulse range the servos are attached with (0..180 degrees)
+#define SERVO_MIN_US 500
+#define SERVO_MAX_US 2400
+
+enum PtzCommandType : uint8_t { PTZ_CMD_GOTO, PTZ_CMD_VELOCITY, PTZ_CMD_STOP };
+
+struct PtzCommand {
+  PtzCommandType type;
+  float pan;  // degrees (goto) or -1..1 (velocity)
+  float tilt;
+  float speed; // goto only, 0..1
+  uint32_t timeoutMs;
+};
+
+struct PtzPreset {
+  float pan; // degrees
+  float tilt;
+  uint8_t used;
+  char name[23];
+};
+
+static Servo servoPan;
+static Servo servoTilt;
+
+static const PtzAxisLimits PAN_LIMITS = {PTZ_PAN_MIN, PTZ_PAN_MAX,
+                                         PTZ_MAX_SPEED, PTZ_MAX_ACCEL};
+static const PtzAxisLimits TILT_LIMITS = {PTZ_TILT_MIN, PTZ_TILT_MAX,
+                                          PTZ_MAX_SPEED, PTZ_MAX_ACCEL};
+
+static QueueHandle_t s_ptzQueue = nullptr;
+static PtzPreset s_presets[PTZ_PRESET_COUNT];
+
+// Published by the PTZ task
+static volatile float s_panDeg = 0.0f;
+static volatile float s_tiltDeg = 0.0f;
+static volatile bool s_moving = false;
+
+// Generic space -1..1 <-> degrees over the configured range
+static float to_degrees(float v, const PtzAxisLimits &lim) {
+  v = constrain(v, -1.0f, 1.0f);
+  return lim.min + (v + 1.0f) * 0.5f * (lim.max - lim.min);
+}
+
+static float to_generic(float deg, const PtzAxisLimits &lim) {
+  return (deg - lim.min) * 2.0f / (lim.max - lim.min) - 1.0f;
+}
+
+static int to_pulse(float deg) {
+  float servoDeg = constrain(deg + 90.0f, 0.0f, 180.0f);
+  return SERVO_MIN_US + (int)lroundf(servoDeg * (SERVO_MAX_US - SERVO_MIN_US) /
+                                     180.0f);
+}
+
+static void apply_command(const PtzCommand &cmd, PtzAxisState &pan,
+                          PtzAxisState &tilt, uint32_t &deadline) {
+  switch (cmd.type) {
+  case PTZ_CMD_GOTO:
+    ptz_axis_goto(pan, PAN_LIMITS, cmd.pan, cmd.speed);
+    ptz_axis_goto(tilt, TILT_LIMITS, cmd.tilt, cmd.speed);
+    deadline = 0;
+    break;
+  case PTZ_CMD_VELOCITY:
+    ptz_axis_velocity(pan, PAN_LIMITS, cmd.pan);
+    ptz_axis_velocity(tilt, TILT_LIMITS, cmd.tilt);
+    deadline = millis() + (cmd.timeoutMs ? cmd.timeoutMs : PTZ_MOVE_TIMEOUT_MS);
+    if (!deadline)
+      deadline = 1;
+    break;
+  case PTZ_CMD_STOP:
+    ptz_axis_stop(pan);
+    ptz_axis_stop(tilt);
+    deadline = 0;
+    break;
+  }
+}
+
+static void ptz_task(void *) {
+  PtzAxisState pan, tilt;
+  ptz_axis_reset(pan, 0.0f);
+  ptz_axis_reset(tilt, 0.0f);
+
+  const TickType_t period = pdMS_TO_TICKS(1000 / PTZ_CONTROL_HZ);
+  uint32_t deadline = 0; // ContinuousMove timeout, 0 = none
+  uint32_t lastUs = micros();
+  int lastPanUs = -1, lastTiltUs = -1;
+  bool moving = false;
+
+  for (;;) {
+    // Sleep until the next command while idle, tick at the control rate
+    // while moving
+    PtzCommand cmd;
+    if (xQueueReceive(s_ptzQueue, &cmd, moving ? period : portMAX_DELAY) ==
+        pdTRUE) {
+      do {
+        apply_command(cmd, pan, tilt, deadline);
+      } while (xQueueReceive(s_ptzQueue, &cmd, 0) == pdTRUE);
+      if (!moving)
+        lastUs = micros(); // don't integrate the idle time
+    }
+
+    if (deadline && (int32_t)(millis() - deadline) >= 0) {
+      ptz_axis_stop(pan);
+      ptz_axis_stop(tilt);
+      deadline = 0;
+    }
+
+    uint32_t nowUs = micros();
+    float dt = (nowUs - lastUs) / 1000000.0f;
+    lastUs = nowUs;
+    if (dt > 0.1f)
+      dt = 0.1f;
+
+    bool panMoving = ptz_axis_step(pan, PAN_LIMITS, dt);
+    bool tiltMoving = ptz_axis_step(tilt, TILT_LIMITS, dt);
+    moving = panMoving || tiltMoving;
+
+    // Only touch the PWM when the pulse actually changes
+    int panUs = to_pulse(pan.pos);
+    int tiltUs = to_pulse(tilt.pos);
+    if (panUs != lastPanUs) {
+      servoPan.writeMicroseconds(panUs);
+      lastPanUs = panUs;
+    }
+    if (tiltUs != lastTiltUs) {
+      servoTilt.writeMicroseconds(tiltUs);
+      lastTiltUs = tiltUs;
+    }
+
+    s_panDeg = pan.pos;
+    s_tiltDeg = tilt.pos;
+    s_moving = moving;
+  }
+}
+
+static void post(const PtzCommand &cmd) {
+  if (!s_ptzQueue)
+    return;
+  // A newer command supersedes whatever is still queued
+  if (xQueueSend(s_ptzQueue, &cmd, 0) != pdTRUE) {
+    xQueueReset(s_ptzQueue);
+    xQueueSend(s_ptzQueue, &cmd, 0);
+  }
+}
+
+static void load_presets() {
+  memset(s_presets, 0, sizeof(s_presets));
+  Preferences prefs;
+  if (!prefs.begin("ptz", true))
+    return;
+  if (prefs.getBytesLength("presets") == sizeof(s_presets))
+    prefs.getBytes("presets", s_presets, sizeof(s_presets));
+  prefs.end();
+}
+
+static void save_presets() {
+  Preferences prefs;
+  if (!prefs.begin("ptz", false))
+    return;
+  prefs.putBytes("presets", s_presets, sizeof(s_presets));
+  prefs.end();
+}
+
+void ptz_init() {
+  servoPan.setPeriodHertz(50);
+  servoPan.attach(SERVO_PAN_PIN, SERVO_MIN_US, SERVO_MAX_US);
+  servoTilt.setPeriodHertz(50);
+  servoTilt.attach(SERVO_TILT_PIN, SERVO_MIN_US, SERVO_MAX_US);
+
+  // Center alignment; the task ramps from here
+  servoPan.writeMicroseconds(to_pulse(0.0f));
+  servoTilt.writeMicroseconds(to_pulse(0.0f));
+
+  load_presets();
+
+  s_ptzQueue = xQueueCreate(4, sizeof(PtzCommand));
+  task_spawn(TASK_PTZ, ptz_task);
+  Serial.println("[INFO] PTZ Servos initialized.");
+}
+
+void ptz_absolute_move(float x, float y, float speed) {
+  ptz_goto_degrees(to_degrees(x, PAN_LIMITS), to_degrees(y, TILT_LIMITS),
+                   speed);
+}
+
+void ptz_goto_degrees(float panDeg, float tiltDeg, float speed) {
+  PtzCommand cmd = {PTZ_CMD_GOTO, panDeg, tiltDeg, speed, 0};
+  post(cmd);
+}
+
+void ptz_continuous_move(float vx, float vy, uint32_t timeoutMs) {
+  PtzCommand cmd = {PTZ_CMD_VELOCITY, vx, vy, 0.0f, timeoutMs};
+  post(cmd);
+}
+
+void ptz_stop() {
+  PtzCommand cmd = {PTZ_CMD_STOP, 0.0f, 0.0f, 0.0f, 0};
+  post(cmd);
+}
+
+void ptz_get_status(PtzStatus *out) {
+  out->panDeg = s_panDeg;
+  out->tiltDeg = s_tiltDeg;
+  out->x = to_generic(out->panDeg, PAN_LIMITS);
+  out->y = to_generic(out->tiltDeg, TILT_LIMITS);
+  out->moving = s_moving;
+}
+
+int ptz_preset_set(int index, const char *name) {
+  if (index < 0) {
+    for (int i = 0; i < PTZ_PRESET_COUNT && index < 0; i++) {
+      if (!s_presets[i].used)
+        index = i;
+    }
+  }
+  if (index < 0 || index >= PTZ_PRESET_COUNT)
+    return -1;
+
+  PtzPreset &p = s_presets[index];
+  p.pan = s_panDeg;
+  p.tilt = s_tiltDeg;
+  p.used = 1;
+  if (name && *name)
+    snprintf(p.name, sizeof(p.name), "%s", name);
+  else
+    snprintf(p.name, sizeof(p.name), "Preset %d", index + 1);
+  save_presets();
+  Serial.printf("[INFO] PTZ preset %d '%s' = %.1f, %.1f\n", index + 1, p.name,
+                p.pan, p.tilt);
+  return index;
+}
+
+bool ptz_preset_goto(int index, float speed) {
+  if (index < 0 || index >= PTZ_PRESET_COUNT || !s_presets[index].used)
+    return false;
+  ptz_goto_degrees(s_presets[index].pan, s_presets[index].tilt, speed);
+  return true;
+}
+
+bool ptz_preset_remove(int index) {
+  if (index < 0 || index >= PTZ_PRESET_COUNT || !s_presets[index].used)
+    return false;
+  memset(&s_presets[index], 0, sizeof(PtzPreset));
+  save_presets();
+  return true;
+}
+
+bool ptz_preset_get(int index, char *name, size_t nameSize, float *x,
+                    float *y) {
+  if (index < 0 || index >= PTZ_PRESET_COUNT || !s_presets[index].used)
+    return false;
+  snprintf(name, nameSize, "%s", s_presets[index].name);
+  *x = to_generic(s_presets[index].pan, PAN_LIMITS);
+  *y = to_generic(s_presets[index].tilt, TILT_LIMITS);
+  return true;
+}
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ==============================================================================
+//   PTZ control - servo task, ContinuousMove, presets
+// ==============================================================================
+// All servo writes happen on one task running at PTZ_CONTROL_HZ; callers
+// (ONVIF, web UI) only post commands to its queue and return immediately.
+// Motion follows the acceleration-limited profiles of ptz_planner, so the
+// servos ramp instead of jumping to the target.
+//
+// ONVIF coordinates are the generic spaces: positions -1..1 across the
+// PTZ_PAN_MIN..PTZ_PAN_MAX / PTZ_TILT_MIN..PTZ_TILT_MAX range, velocities and
+// speeds -1..1 / 0..1 of PTZ_MAX_SPEED. Presets are kept in NVS.
+// ==============================================================================
+
+struct PtzStatus {
+  float x;        // generic space, -1..1
+  float y;
+  float panDeg;   // degrees from centre
+  float tiltDeg;
+  bool moving;
+};
+
+// Attaches the servos, loads presets and starts the PTZ task
+void ptz_init();
+
+// speed 0..1 of PTZ_MAX_SPEED (0 = full speed)
+void ptz_absolute_move(float x, float y, float speed);
+void ptz_goto_degrees(float panDeg, float tiltDeg, float speed);
+// Velocities -1..1; stops by itself after timeoutMs (0 = PTZ_MOVE_TIMEOUT_MS)
+void ptz_continuous_move(float vx, float vy, uint32_t timeoutMs);
+void ptz_stop();
+
+void ptz_get_status(PtzStatus *out);
+
+// Presets are numbered 0..PTZ_PRESET_COUNT-1. ptz_preset_set() stores the
+// current position under `index` (-1 = first free slot) and returns the slot
+// used, or -1 if all are taken.
+int ptz_preset_set(int index, const char *name);
+bool ptz_preset_goto(int index, float speed);
+bool ptz_preset_remove(int index);
+// False if the slot is empty
+bool ptz_preset_get(int index, char *name, size_t nameSize, float *x,
+                    float *y);
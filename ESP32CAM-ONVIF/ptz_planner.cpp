@@ -0,0 +1,109 @@
+#include "ptz_planner.h"
+#include <math.h>
+
+// Below these the axis counts as settled
+static const float POS_EPSILON = 0.05f; // degrees
+static const float VEL_EPSILON = 0.5f;  // degrees/s
+
+static float clampf(float v, float lo, float hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Fastest speed from which the axis still stops exactly after dist, when
+// each step of dt may only lose accel * dt. The continuous sqrt(2*a*d)
+// ignores the step and ends with a velocity jump on landing. Here the
+// speeds run v, v - dv, ..., v - k*dv over the remaining k + 1 steps:
+// (k + 1) * v - dv * k(k+1)/2 = dist / dt, with the last speed in (0, dv].
+static float stop_speed(float dist, float accel, float dt) {
+  if (dist <= 0.0f)
+    return 0.0f;
+  float dv = accel * dt;
+  float n = (sqrtf(1.0f + 8.0f * dist / (dv * dt)) - 1.0f) * 0.5f;
+  float k = fmaxf(ceilf(n) - 1.0f, 0.0f);
+  return (dist / dt + dv * k * (k + 1.0f) * 0.5f) / (k + 1.0f);
+}
+
+void ptz_axis_reset(PtzAxisState &a, float pos) {
+  a.pos = pos;
+  a.vel = 0.0f;
+  a.target = pos;
+  a.speed = 0.0f;
+  a.velocityMode = false;
+}
+
+void ptz_axis_goto(PtzAxisState &a, const PtzAxisLimits &lim, float target,
+                   float speed) {
+  a.target = clampf(target, lim.min, lim.max);
+  a.speed = clampf(speed, 0.0f, 1.0f) * lim.maxSpeed;
+  if (a.speed <= 0.0f)
+    a.speed = lim.maxSpeed;
+  a.velocityMode = false;
+}
+
+void ptz_axis_velocity(PtzAxisState &a, const PtzAxisLimits &lim,
+                       float velocity) {
+  a.speed = clampf(velocity, -1.0f, 1.0f) * lim.maxSpeed;
+  a.velocityMode = true;
+}
+
+void ptz_axis_stop(PtzAxisState &a) {
+  a.speed = 0.0f;
+  a.velocityMode = true;
+}
+
+bool ptz_axis_moving(const PtzAxisState &a) {
+  if (fabsf(a.vel) > VEL_EPSILON)
+    return true;
+  if (a.velocityMode)
+    return a.speed != 0.0f;
+  return fabsf(a.target - a.pos) > POS_EPSILON;
+}
+
+bool ptz_axis_step(PtzAxisState &a, const PtzAxisLimits &lim, float dt) {
+  if (dt <= 0.0f)
+    return ptz_axis_moving(a);
+
+  // Velocity the axis would like to have right now
+  float desired;
+  if (a.velocityMode) {
+    desired = a.speed;
+    // Brake in time to stop at the end stops
+    float room = desired > 0.0f ? lim.max - a.pos : a.pos - lim.min;
+    if (desired != 0.0f && room <= POS_EPSILON) {
+      // Parked against the end stop: the move is over
+      a.pos = desired > 0.0f ? lim.max : lim.min;
+      a.speed = desired = 0.0f;
+    }
+    float reach = stop_speed(room, lim.maxAccel, dt);
+    desired = clampf(desired, -reach, reach);
+  } else {
+    float err = a.target - a.pos;
+    // Fastest speed from which we can still stop at the target
+    float brake = stop_speed(fabsf(err), lim.maxAccel, dt);
+    float cruise = fminf(a.speed, brake);
+    desired = err > 0.0f ? cruise : -cruise;
+  }
+
+  // Acceleration limit
+  float dv = lim.maxAccel * dt;
+  a.vel = clampf(desired, a.vel - dv, a.vel + dv);
+
+  float next = a.pos + a.vel * dt;
+  if (!a.velocityMode) {
+    // Don't overshoot on the final step; snap once slow and close
+    float before = a.target - a.pos;
+    float after = a.target - next;
+    if ((before > 0.0f) != (after > 0.0f) ||
+        (fabsf(after) < POS_EPSILON && fabsf(a.vel) <= dv)) {
+      next = a.target;
+      a.vel = 0.0f;
+    }
+  }
+  a.pos = clampf(next, lim.min, lim.max);
+  if ((a.pos == lim.min && a.vel < 0.0f) || (a.pos == lim.max && a.vel > 0.0f))
+    a.vel = 0.0f;
+  if (a.velocityMode && a.speed == 0.0f && fabsf(a.vel) <= dv)
+    a.vel = 0.0f;
+
+  return ptz_axis_moving(a);
+}
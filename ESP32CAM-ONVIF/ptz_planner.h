@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+
+// ==============================================================================
+//   PTZ trajectory planner - acceleration-limited motion for one servo axis
+// ==============================================================================
+// Pure math, no Arduino or FreeRTOS dependencies, so it builds and can be
+// exercised on a host. The PTZ task (ptz_control.cpp) calls ptz_axis_step()
+// at a fixed control rate and writes the resulting position to the servo.
+//
+// Positions are in degrees from centre, speeds in degrees/s. Each axis either
+// tracks a target position (AbsoluteMove, presets) with a trapezoidal
+// velocity profile, or a commanded velocity (ContinuousMove). Both respect
+// the acceleration limit, so the servo never jumps: no image shake and no
+// stall-current spike on the 5V rail.
+// ==============================================================================
+
+struct PtzAxisLimits {
+  float min;      // degrees
+  float max;      // degrees
+  float maxSpeed; // degrees/s
+  float maxAccel; // degrees/s^2
+};
+
+struct PtzAxisState {
+  float pos;    // current position, degrees
+  float vel;    // current velocity, degrees/s
+  float target; // position mode: where to stop
+  float speed;  // position mode: cruise speed; velocity mode: signed velocity
+  bool velocityMode;
+};
+
+// Starts at `pos` with zero velocity
+void ptz_axis_reset(PtzAxisState &a, float pos);
+
+// Move to `target` (clamped to limits) at up to `speed` (0..1 of maxSpeed)
+void ptz_axis_goto(PtzAxisState &a, const PtzAxisLimits &lim, float target,
+                   float speed);
+
+// Move with `velocity` (-1..1 of maxSpeed) until stopped or a limit is reached
+void ptz_axis_velocity(PtzAxisState &a, const PtzAxisLimits &lim,
+                       float velocity);
+
+// Decelerates to a standstill (at maxAccel) wherever the axis is
+void ptz_axis_stop(PtzAxisState &a);
+
+// Advances the axis by dt seconds; returns true while it is still moving
+bool ptz_axis_step(PtzAxisState &a, const PtzAxisLimits &lim, float dt);
+
+bool ptz_axis_moving(const PtzAxisState &a);
@@ -0,0 +1,106 @@
+#include "rate_controller.h"
+
+void rate_control_reset(RateControlState &st, uint32_t baseIntervalMs) {
+  st.qualityDrop = 0;
+  st.intervalMs = baseIntervalMs;
+  st.cleanWindows = 0;
+  st.reason = RATE_STEADY;
+  st.steps = 0;
+}
+
+static bool step_down(RateControlState &st, const RateControlLimits &lim,
+                      bool both) {
+  bool changed = false;
+  if (st.qualityDrop < lim.maxQualityDrop) {
+    uint32_t q = st.qualityDrop + lim.qualityStep;
+    st.qualityDrop = q < lim.maxQualityDrop ? q : lim.maxQualityDrop;
+    changed = true;
+    if (!both)
+      return true;
+  }
+  if (st.intervalMs < lim.maxIntervalMs) {
+    // +25% per step: 20 fps -> 16 -> 13 -> 10 -> 8 ...
+    uint32_t next = st.intervalMs + st.intervalMs / 4 + 1;
+    st.intervalMs = next < lim.maxIntervalMs ? next : lim.maxIntervalMs;
+    changed = true;
+  }
+  return changed;
+}
+
+static bool step_up(RateControlState &st, const RateControlLimits &lim,
+                    uint32_t baseIntervalMs) {
+  if (st.intervalMs > baseIntervalMs) {
+    uint32_t next = st.intervalMs - st.intervalMs / 5;
+    st.intervalMs = next > baseIntervalMs ? next : baseIntervalMs;
+    return true;
+  }
+  if (st.qualityDrop > 0) {
+    st.qualityDrop = st.qualityDrop > lim.qualityStep
+                         ? st.qualityDrop - lim.qualityStep
+                         : 0;
+    return true;
+  }
+  return false;
+}
+
+bool rate_control_update(RateControlState &st, const RateControlLimits &lim,
+                         uint32_t baseIntervalMs, const RateWindow &w) {
+  // The configured rate may have changed (ONVIF, stream switch)
+  if (st.intervalMs < baseIntervalMs)
+    st.intervalMs = baseIntervalMs;
+  if (w.frames == 0 && w.dropped == 0 && w.stalls == 0)
+    return false;
+
+  uint64_t avgUs = w.frames ? w.sendUsTotal / w.frames : 0;
+  uint64_t budgetUs = (uint64_t)st.intervalMs * 1000;
+  bool weak = w.rssi != 0 && w.rssi < lim.weakRssi;
+  uint64_t slowUs = weak ? budgetUs / 2 : budgetUs * 3 / 4;
+  uint64_t cleanUs = weak ? budgetUs / 3 : budgetUs / 2;
+
+  RateReason congestion = RATE_STEADY;
+  if (w.stalls)
+    congestion = RATE_STALLS;
+  else if (w.dropped * 8 > w.frames) // more than ~1 in 9 superseded
+    congestion = RATE_DROPS;
+  else if (avgUs > slowUs)
+    congestion = RATE_SLOW_SEND;
+
+  bool changed = false;
+  if (congestion != RATE_STEADY) {
+    st.cleanWindows = 0;
+    changed = step_down(st, lim, congestion == RATE_STALLS);
+    st.reason = congestion;
+  } else if (w.dropped == 0 && avgUs <= cleanUs) {
+    if (++st.cleanWindows >= lim.recoverWindows) {
+      st.cleanWindows = 0;
+      changed = step_up(st, lim, baseIntervalMs);
+    }
+    bool adapted = st.qualityDrop || st.intervalMs > baseIntervalMs;
+    st.reason = adapted ? RATE_RECOVERING : RATE_STEADY;
+  } else {
+    st.cleanWindows = 0;
+    if (st.qualityDrop || st.intervalMs > baseIntervalMs)
+      st.reason = RATE_HOLD;
+  }
+  if (changed)
+    st.steps++;
+  return changed;
+}
+
+const char *rate_control_reason_str(RateReason r) {
+  switch (r) {
+  case RATE_STEADY:
+    return "steady";
+  case RATE_SLOW_SEND:
+    return "slow send";
+  case RATE_DROPS:
+    return "dropped frames";
+  case RATE_STALLS:
+    return "stalled writes";
+  case RATE_HOLD:
+    return "hold";
+  case RATE_RECOVERING:
+    return "recovering";
+  }
+  return "unknown";
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+
+// ==============================================================================
+//   Adaptive rate controller - JPEG quality and frame interval vs. the link
+// ==============================================================================
+// Pure logic, no Arduino or FreeRTOS dependencies, so it builds and can be
+// run on a host against a simulated link. The RTSP task feeds it one
+// RateWindow per RATE_CTRL_WINDOW_MS from the pipeline counters and applies
+// the result through media_set_adaptation().
+//
+// Each window is congested, clean or in between:
+//   congested  a TCP write stalled, frames were superseded before sending,
+//              or sending a frame took more than 3/4 of the frame interval
+//              (1/2 with weak RSSI, where retries come in bursts)
+//   clean      no drops or stalls, sends within 1/2 of the interval (1/3)
+// A congested window steps quality down first and then the frame rate
+// (a stall steps both). Only RATE_CTRL_RECOVER_WINDOWS clean windows in a
+// row step back up, frame rate first. The band in between holds, so the
+// controller doesn't oscillate around the link's capacity.
+// ==============================================================================
+
+struct RateControlLimits {
+  uint8_t qualityStep;    // esp_camera quality units per step
+  uint8_t maxQualityDrop; // added to the configured quality at most
+  uint32_t maxIntervalMs; // slowest frame interval
+  uint8_t recoverWindows; // clean windows before stepping up
+  int8_t weakRssi;        // dBm
+};
+
+// What the sender saw during one window
+struct RateWindow {
+  uint32_t frames;      // frames sent
+  uint32_t dropped;     // superseded by a newer frame before sending
+  uint32_t stalls;      // failed or too slow TCP writes
+  uint64_t sendUsTotal; // summed per-frame send time
+  int8_t rssi;          // dBm, 0 = unknown
+};
+
+enum RateReason : uint8_t {
+  RATE_STEADY = 0, // at the configured quality and frame rate
+  RATE_SLOW_SEND,
+  RATE_DROPS,
+  RATE_STALLS,
+  RATE_HOLD,      // adapted, link not clean enough to step up yet
+  RATE_RECOVERING
+};
+
+struct RateControlState {
+  uint8_t qualityDrop;  // esp_camera quality added (higher = worse)
+  uint32_t intervalMs;  // frame interval in force
+  uint8_t cleanWindows; // consecutive clean windows
+  RateReason reason;    // last decision
+  uint32_t steps;       // adjustments made since reset
+};
+
+void rate_control_reset(RateControlState &st, uint32_t baseIntervalMs);
+
+// Evaluates one window against the configured interval; returns true if
+// qualityDrop or intervalMs changed. Windows without frames are ignored.
+bool rate_control_update(RateControlState &st, const RateControlLimits &lim,
+                         uint32_t baseIntervalMs, const RateWindow &w);
+
+const char *rate_control_reason_str(RateReason r);
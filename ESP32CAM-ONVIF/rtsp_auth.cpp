@@ -0,0 +1,241 @@
+#include "rtsp_auth.h"
+#include "config.h"
+#include "mbedtls/md5.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#ifdef ESP_PLATFORM
+#include "esp_system.h"
+#endif
+
+static const uint32_t NONCE_TTL_MS = RTSP_AUTH_NONCE_TTL_S * 1000UL;
+
+static char s_user[33];
+static char s_realm[49];
+static char s_ha1[33]; // hex MD5(user:realm:pass)
+
+// Slice of the Authorization header
+struct Span {
+  const char *p;
+  size_t len;
+};
+
+struct DigestParams {
+  Span username, realm, nonce, uri, response, qop, nc, cnonce;
+};
+
+static void to_hex(const uint8_t *in, size_t n, char *out) {
+  static const char HEX[] = "0123456789abcdef";
+  for (size_t i = 0; i < n; i++) {
+    out[i * 2] = HEX[in[i] >> 4];
+    out[i * 2 + 1] = HEX[in[i] & 0x0f];
+  }
+  out[n * 2] = '\0';
+}
+
+// hex MD5 of the parts joined with ':'; false if they don't fit
+static bool md5_hex(const Span *parts, int count, char out[33]) {
+  uint8_t buffer[384];
+  size_t off = 0;
+  for (int i = 0; i < count; i++) {
+    if (off + parts[i].len + 1 > sizeof(buffer))
+      return false;
+    if (i)
+      buffer[off++] = ':';
+    memcpy(buffer + off, parts[i].p, parts[i].len);
+    off += parts[i].len;
+  }
+  uint8_t digest[16];
+  mbedtls_md5(buffer, off, digest);
+  to_hex(digest, sizeof(digest), out);
+  return true;
+}
+
+static Span span_of(const char *s) { return Span{s, strlen(s)}; }
+
+static bool span_equal(const Span &s, const char *z) {
+  return s.p && s.len == strlen(z) && memcmp(s.p, z, s.len) == 0;
+}
+
+void rtsp_auth_init(const char *user, const char *pass, const char *realm) {
+  snprintf(s_user, sizeof(s_user), "%s", user);
+  snprintf(s_realm, sizeof(s_realm), "%s", realm);
+  Span parts[3] = {span_of(s_user), span_of(s_realm), span_of(pass)};
+  if (!md5_hex(parts, 3, s_ha1))
+    s_ha1[0] = '\0';
+}
+
+void rtsp_auth_reset(RtspAuthState &st) {
+  st.nonce[0] = '\0';
+  st.issuedMs = 0;
+}
+
+static bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+// username="admin", nonce="...", uri="rtsp://...", response="...", nc=00000001
+static bool parse_params(const char *p, DigestParams &d) {
+  memset(&d, 0, sizeof(d));
+  while (*p) {
+    while (*p == ',' || is_space(*p))
+      p++;
+    const char *name = p;
+    while (*p && *p != '=' && *p != ',' && !is_space(*p))
+      p++;
+    size_t nameLen = p - name;
+    while (is_space(*p))
+      p++;
+    if (*p != '=') {
+      if (!nameLen)
+        break;
+      continue; // bare token, ignore
+    }
+    p++;
+    while (is_space(*p))
+      p++;
+
+    Span v;
+    if (*p == '"') {
+      v.p = ++p;
+      while (*p && *p != '"')
+        p++;
+      if (!*p)
+        return false; // unterminated quote
+      v.len = p - v.p;
+      p++;
+    } else {
+      v.p = p;
+      while (*p && *p != ',' && !is_space(*p))
+        p++;
+      v.len = p - v.p;
+    }
+
+    Span *slot = nullptr;
+    if (nameLen == 8 && strncasecmp(name, "username", 8) == 0)
+      slot = &d.username;
+    else if (nameLen == 5 && strncasecmp(name, "realm", 5) == 0)
+      slot = &d.realm;
+    else if (nameLen == 5 && strncasecmp(name, "nonce", 5) == 0)
+      slot = &d.nonce;
+    else if (nameLen == 3 && strncasecmp(name, "uri", 3) == 0)
+      slot = &d.uri;
+    else if (nameLen == 8 && strncasecmp(name, "response", 8) == 0)
+      slot = &d.response;
+    else if (nameLen == 3 && strncasecmp(name, "qop", 3) == 0)
+      slot = &d.qop;
+    else if (nameLen == 2 && strncasecmp(name, "nc", 2) == 0)
+      slot = &d.nc;
+    else if (nameLen == 6 && strncasecmp(name, "cnonce", 6) == 0)
+      slot = &d.cnonce;
+    if (slot)
+      *slot = v;
+  }
+  return true;
+}
+
+static bool response_equal(const Span &client, const char *expected) {
+  if (client.len != 32)
+    return false;
+  // Constant time, hex case-insensitive
+  uint8_t diff = 0;
+  for (int i = 0; i < 32; i++) {
+    char c = client.p[i];
+    if (c >= 'A' && c <= 'F')
+      c += 'a' - 'A';
+    diff |= c ^ expected[i];
+  }
+  return diff == 0;
+}
+
+RtspAuthResult rtsp_auth_check(RtspAuthState &st, const char *method,
+                               const char *authorization, uint32_t nowMs) {
+  if (!authorization || strncasecmp(authorization, "Digest", 6) != 0 ||
+      !is_space(authorization[6]))
+    return RTSP_AUTH_MISSING;
+
+  DigestParams d;
+  if (!parse_params(authorization + 7, d) || !d.username.p || !d.nonce.p ||
+      !d.uri.p || !d.response.p)
+    return RTSP_AUTH_MALFORMED;
+
+  if (!span_equal(d.username, s_user) ||
+      (d.realm.p && !span_equal(d.realm, s_realm)))
+    return RTSP_AUTH_BAD_USER;
+  if (!s_ha1[0])
+    return RTSP_AUTH_BAD_DIGEST;
+
+  // HA2 over the uri the client hashed; clients differ in whether they send
+  // the absolute URL or the Content-Base relative one, and the method in
+  // HA2 already keeps a response from being replayed for another request.
+  char ha2[33];
+  Span a2[2] = {span_of(method), d.uri};
+  if (!md5_hex(a2, 2, ha2))
+    return RTSP_AUTH_MALFORMED;
+
+  char expected[33];
+  bool ok;
+  if (d.qop.p) {
+    if (!d.nc.p || !d.cnonce.p)
+      return RTSP_AUTH_MALFORMED;
+    Span parts[6] = {span_of(s_ha1), d.nonce, d.nc, d.cnonce, d.qop,
+                     span_of(ha2)};
+    ok = md5_hex(parts, 6, expected);
+  } else {
+    Span parts[3] = {span_of(s_ha1), d.nonce, span_of(ha2)};
+    ok = md5_hex(parts, 3, expected);
+  }
+  if (!ok)
+    return RTSP_AUTH_MALFORMED;
+  if (!response_equal(d.response, expected))
+    return RTSP_AUTH_BAD_DIGEST;
+
+  // Credentials are right; the nonce must still be the one we issued to
+  // this connection. Otherwise (expired, or left over from an earlier
+  // connection) the client retries with a fresh one without re-prompting.
+  if (!st.nonce[0] || !span_equal(d.nonce, st.nonce) ||
+      (uint32_t)(nowMs - st.issuedMs) >= NONCE_TTL_MS)
+    return RTSP_AUTH_STALE;
+  return RTSP_AUTH_OK;
+}
+
+static uint32_t random32() {
+#ifdef ESP_PLATFORM
+  return esp_random();
+#else
+  return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+#endif
+}
+
+void rtsp_auth_challenge(RtspAuthState &st, bool stale, uint32_t nowMs,
+                         char *out, size_t size) {
+  if (stale || !st.nonce[0] ||
+      (uint32_t)(nowMs - st.issuedMs) >= NONCE_TTL_MS) {
+    uint8_t raw[16];
+    for (int i = 0; i < 16; i += 4) {
+      uint32_t r = random32();
+      memcpy(raw + i, &r, 4);
+    }
+    to_hex(raw, sizeof(raw), st.nonce);
+    st.issuedMs = nowMs;
+  }
+  snprintf(out, size, "Digest realm=\"%s\", nonce=\"%s\", algorithm=MD5%s",
+           s_realm, st.nonce, stale ? ", stale=TRUE" : "");
+}
+
+const char *rtsp_auth_result_str(RtspAuthResult r) {
+  switch (r) {
+  case RTSP_AUTH_OK:
+    return "ok";
+  case RTSP_AUTH_MISSING:
+    return "no Digest credentials";
+  case RTSP_AUTH_MALFORMED:
+    return "malformed Authorization";
+  case RTSP_AUTH_BAD_USER:
+    return "user/realm mismatch";
+  case RTSP_AUTH_STALE:
+    return "stale nonce";
+  case RTSP_AUTH_BAD_DIGEST:
+    return "digest mismatch";
+  }
+  return "unknown";
+}
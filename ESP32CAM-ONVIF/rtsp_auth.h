@@ -0,0 +1,50 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ==============================================================================
+//   RTSP Digest authentication (RFC 2617, MD5)
+// ==============================================================================
+// response = MD5(HA1 ":" nonce [":" nc ":" cnonce ":" qop] ":" HA2)
+//   HA1 = MD5(user ":" realm ":" pass)   - fixed per credentials, hashed once
+//   HA2 = MD5(method ":" uri)
+//
+// Each RTSP connection keeps one RtspAuthState. The 401 challenge issues a
+// nonce for that connection, and the client reuses it for DESCRIBE, SETUP
+// and PLAY until RTSP_AUTH_NONCE_TTL_S runs out. A correct response with an
+// expired nonce is answered with a fresh nonce and stale=true, so the client
+// retries silently instead of prompting for credentials again.
+//
+// No platform dependencies beyond mbedtls, so transcripts of ffmpeg/VLC
+// sessions can be replayed against it on a host.
+// ==============================================================================
+
+enum RtspAuthResult {
+  RTSP_AUTH_OK = 0,
+  RTSP_AUTH_MISSING,   // No Authorization header, or not Digest
+  RTSP_AUTH_MALFORMED, // Missing username/nonce/uri/response
+  RTSP_AUTH_BAD_USER,
+  RTSP_AUTH_STALE,     // Right credentials, expired or foreign nonce
+  RTSP_AUTH_BAD_DIGEST
+};
+
+struct RtspAuthState {
+  char nonce[33]; // 128-bit, hex; empty until the first challenge
+  uint32_t issuedMs;
+};
+
+// Sets the credentials and realm; hashes HA1 once for all connections
+void rtsp_auth_init(const char *user, const char *pass, const char *realm);
+
+void rtsp_auth_reset(RtspAuthState &st);
+
+// authorization: value of the Authorization header (may be nullptr)
+RtspAuthResult rtsp_auth_check(RtspAuthState &st, const char *method,
+                               const char *authorization, uint32_t nowMs);
+
+// Issues a fresh nonce if there is none (or stale) and writes the
+// WWW-Authenticate header value into out
+void rtsp_auth_challenge(RtspAuthState &st, bool stale, uint32_t nowMs,
+                         char *out, size_t size);
+
+const char *rtsp_auth_result_str(RtspAuthResult r);
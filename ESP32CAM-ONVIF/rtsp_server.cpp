@@ -2,13 +2,31 @@
 #include "config.h"
 #include "board_config.h"
 #include "status_led.h"
+#include "media_config.h"
+#include "rtsp_auth.h"
+#include "frame_pipeline.h"
+#include "rate_controller.h"
+#include "fixed_pool.h"
 
 // Minimum free heap required to accept a new RTSP client.
 // Below this, the ESP32 risks OOM crashes during frame encoding.
 #define MIN_HEAP_FOR_CLIENT  32000
 
+// One client streams unicast at a time; with multicast several clients
+// may watch the group (see RTSP_MULTICAST_ENABLED)
+#if RTSP_MULTICAST_ENABLED
+    #define RTSP_MAX_SESSIONS RTSP_MAX_CLIENTS
+#else
+    #define RTSP_MAX_SESSIONS 1
+#endif
+
+static_assert(RTSP_MAX_SESSIONS <= PLAT_MAX_SOCKETS, "raise PLAT_MAX_SOCKETS");
+
 WiFiServer rtspServer(RTSP_PORT);
-CRtspSession *session = nullptr;
+static CRtspSession *sessions[RTSP_MAX_SESSIONS];
+// Sessions (and their sockets, see platglue-esp32.h) are pooled: a client
+// connecting and leaving allocates nothing
+static FixedPool<CRtspSession, RTSP_MAX_SESSIONS> s_sessionPool;
 
 // Conditionally define the streamer type.
 #ifdef VIDEO_CODEC_H264
@@ -34,24 +52,126 @@ const char* getCodecName() {
     #endif
 }
 
-static void getH264Resolution(uint16_t &width, uint16_t &height) {
-    #ifdef H264_HW_ENCODER
-        width  = 1280;
-        height = 720;
-    #else
-        width  = 640;
-        height = 480;
+static RateControlState s_rate;
+
+const RateControlState &rtsp_rate_state() { return s_rate; }
+
+#if RATE_CTRL_ENABLED
+static const RateControlLimits RATE_LIMITS = {
+    RATE_CTRL_QUALITY_STEP, RATE_CTRL_MAX_QUALITY_DROP,
+    RATE_CTRL_MAX_INTERVAL_MS, RATE_CTRL_RECOVER_WINDOWS, RATE_CTRL_WEAK_RSSI};
+
+// Feeds the rate controller one window of sender statistics at a time while
+// frames flow; back to the configured quality/frame rate when nobody plays
+static void rateControlTick(bool playing) {
+    static bool active = false;
+    static uint32_t windowStart;
+    static PipelineCounters last;
+    static LatencyHistogram lastSend;
+    static uint32_t lastStalls;
+
+    uint32_t now = millis();
+    PipelineCounters c;
+    LatencyHistogram send;
+    frame_pipeline_counters(&c);
+    frame_pipeline_stats(STAGE_SEND, &send);
+    uint32_t stalls = streamer ? streamer->sendStalls() : 0;
+
+    if (!playing) {
+        if (active) {
+            active = false;
+            rate_control_reset(s_rate, media_configured_interval_ms());
+            media_set_adaptation(0, 0);
+        }
+        return;
+    }
+
+    // Window boundary; stats reset via /api/pipeline restart the window
+    bool restart = !active || c.sent < last.sent || send.count < lastSend.count ||
+                   stalls < lastStalls;
+    if (!restart && now - windowStart < RATE_CTRL_WINDOW_MS) return;
+
+    if (!restart) {
+        RateWindow w;
+        w.frames = c.sent - last.sent;
+        w.dropped = c.dropped - last.dropped;
+        w.stalls = stalls - lastStalls;
+        w.sendUsTotal = send.totalUs - lastSend.totalUs;
+        w.rssi = WiFi.RSSI();
+        if (rate_control_update(s_rate, RATE_LIMITS, media_configured_interval_ms(), w)) {
+            media_set_adaptation(s_rate.qualityDrop, s_rate.intervalMs);
+            Serial.printf("[INFO] Rate control: quality +%u, %ums/frame (%s, %d dBm)\n",
+                          s_rate.qualityDrop, (unsigned)s_rate.intervalMs,
+                          rate_control_reason_str(s_rate.reason), w.rssi);
+        }
+    } else if (!active) {
+        active = true;
+        rate_control_reset(s_rate, media_configured_interval_ms());
+    }
+    windowStart = now;
+    last = c;
+    lastSend = send;
+    lastStalls = stalls;
+}
+#endif
+
+static int sessionCount() {
+    int n = 0;
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++)
+        if (sessions[i]) n++;
+    return n;
+}
+
+#ifdef VIDEO_CODEC_H264
+// Encoder settings for the active stream
+static bool initH264(H264Streamer *h264) {
+    const VideoEncoderConfig &c = media_config_get(media_config_active());
+    return h264->init(c.width, c.height, c.fps, c.bitrateKbps * 1000UL,
+                      (uint8_t)c.gop);
+}
+#endif
+
+// Picks up media configuration changes (ONVIF Set*, stream switch). The
+// capture/sender stages are paused meanwhile so the sensor and encoder are
+// never reconfigured mid-frame.
+static void applyMediaConfig() {
+    static uint32_t appliedRevision = 0;
+    uint32_t rev = media_config_revision();
+    if (rev == appliedRevision) return;
+    appliedRevision = rev;
+
+    bool resume = frame_pipeline_attached();
+    frame_pipeline_detach();
+
+    media_config_apply_sensor();
+
+    #ifdef VIDEO_CODEC_H264
+        if (s_h264Active && streamer) {
+            H264Streamer *h264 = static_cast<H264Streamer*>(streamer);
+            const VideoEncoderConfig &c = media_config_get(media_config_active());
+            const h264_encoder_config_t &cur = h264->config();
+            if (cur.fps != c.fps || cur.gop != c.gop ||
+                cur.bitrate != c.bitrateKbps * 1000UL ||
+                cur.width != c.width || cur.height != c.height) {
+                // esp_h264 has no runtime rate-control API; re-open the encoder
+                if (initH264(h264)) {
+                    h264->requestIDR();
+                } else {
+                    Serial.println("[ERROR] H.264 reconfigure failed.");
+                }
+            }
+        }
     #endif
+
+    if (resume) frame_pipeline_attach(streamer);
 }
 
 void rtsp_server_start() {
     #ifdef VIDEO_CODEC_H264
         Serial.println("[INFO] Creating H.264 streamer...");
         H264Streamer *h264 = new H264Streamer();
-        uint16_t width, height;
-        getH264Resolution(width, height);
 
-        if (!h264->init(width, height)) {
+        if (!initH264(h264)) {
             Serial.println("[ERROR] H.264 encoder init failed! Falling back to MJPEG.");
             delete h264;
             streamer = new MyStreamer();
@@ -68,6 +188,12 @@ void rtsp_server_start() {
         Serial.println("[INFO] RTSP server started at " + getRTSPUrl());
     #endif
 
+    #if RTSP_AUTH_ENABLED
+        rtsp_auth_init(WEB_USER, WEB_PASS, RTSP_AUTH_REALM);
+    #endif
+
+    rate_control_reset(s_rate, media_configured_interval_ms());
+    frame_pipeline_start();
     rtspServer.begin();
 
     #ifdef BOARD_NAME
@@ -76,12 +202,18 @@ void rtsp_server_start() {
 }
 
 void rtsp_server_loop() {
+    applyMediaConfig();
+
     // Accept new clients (drains TCP backlog even if we reject)
     WiFiClient client = rtspServer.available();
     if (client) {
-        // Guard 1: Only one RTSP session at a time
-        if (session) {
-            Serial.println("[WARN] RTSP Client rejected: session already active");
+        int slot = -1;
+        for (int i = 0; i < RTSP_MAX_SESSIONS && slot < 0; i++)
+            if (!sessions[i]) slot = i;
+
+        // Guard 1: Bounded number of RTSP sessions
+        if (slot < 0) {
+            Serial.println("[WARN] RTSP Client rejected: all sessions in use");
             client.stop();
         }
         // Guard 2: Reject if heap is dangerously low
@@ -90,18 +222,16 @@ void rtsp_server_loop() {
             client.stop();
         }
         else {
-            // Allocate WiFiClient on heap so it survives this scope
-            WiFiClient *clientPtr = new WiFiClient(client);
+            // Pooled copy of the WiFiClient so it outlives this scope
+            SOCKET clientPtr = socketadopt(client);
 
             // Ensure streamer exists
             if (!streamer) {
                 Serial.println("[ERROR] Streamer is NULL! Re-initializing...");
                 #ifdef VIDEO_CODEC_H264
                     if (s_h264Active) {
-                        uint16_t width, height;
-                        getH264Resolution(width, height);
                         H264Streamer *h264 = new H264Streamer();
-                        if (!h264->init(width, height)) {
+                        if (!initH264(h264)) {
                             Serial.println("[ERROR] H.264 reinit failed. Using MJPEG.");
                             delete h264;
                             streamer = new MyStreamer();
@@ -117,9 +247,9 @@ void rtsp_server_loop() {
                 #endif
             }
 
-            if (streamer) {
-                streamer->setClientSocket(clientPtr);
-                session = new CRtspSession(clientPtr, streamer);
+            if (streamer && clientPtr) {
+                // The session claims the streamer's transport at SETUP
+                sessions[slot] = s_sessionPool.create(clientPtr, streamer);
                 Serial.printf("[INFO] RTSP Client Connected (%s, heap: %u)\n",
                               getCodecName(), ESP.getFreeHeap());
 
@@ -129,39 +259,51 @@ void rtsp_server_loop() {
                     }
                 #endif
             } else {
-                Serial.println("[FATAL] Streamer init failed. Closing client.");
-                clientPtr->stop();
-                delete clientPtr;
+                Serial.println(streamer ? "[WARN] RTSP Client rejected: no free socket"
+                                        : "[FATAL] Streamer init failed. Closing client.");
+                closesocket(clientPtr);
+                client.stop();
             }
         }
     }
 
-    // Service existing session
-    if (session) {
-        session->handleRequests(0);  // Non-blocking
-
-        // Frame rate limiting
-        static uint32_t lastFrameTime = 0;
-        uint32_t now = millis();
-
-        #ifdef VIDEO_CODEC_H264
-            uint32_t frameInterval = 1000 / H264_FPS;
-        #else
-            uint32_t frameInterval = 50;  // ~20 FPS
+    // Service existing sessions; frames are captured and sent by the
+    // pipeline tasks (frame_pipeline.h), this task only handles requests
+    if (sessionCount() == 0) {
+        #if RATE_CTRL_ENABLED
+            rateControlTick(false);
         #endif
+        return;
+    }
+    uint32_t start = micros();
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++)
+        if (sessions[i]) sessions[i]->handleRequests(0);  // Non-blocking
+    frame_pipeline_record(STAGE_CONTROL, micros() - start);
 
-        if (now - lastFrameTime > frameInterval) {
-            if (!session->m_stopped) {
-                session->broadcastCurrentFrame(now);
-            }
-            lastFrameTime = now;
-        }
+    int playing = 0;
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++)
+        if (sessions[i] && sessions[i]->m_streaming && !sessions[i]->m_stopped) playing++;
 
-        // Teardown on disconnect
-        if (session->m_stopped) {
-            Serial.printf("[INFO] RTSP client disconnected (heap: %u)\n", ESP.getFreeHeap());
-            delete session;
-            session = nullptr;
-        }
+    // Teardown on disconnect. The pipeline stops before the streamer's
+    // transport is released, i.e. before the session that held it goes.
+    bool removed = false;
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+        if (!sessions[i] || !sessions[i]->m_stopped) continue;
+        if (playing == 0) frame_pipeline_detach();
+        Serial.printf("[INFO] RTSP client disconnected (heap: %u)\n", ESP.getFreeHeap());
+        s_sessionPool.destroy(sessions[i]);
+        sessions[i] = nullptr;
+        removed = true;
     }
+
+    if (playing && !frame_pipeline_attached())
+        frame_pipeline_attach(streamer);
+
+    #if RATE_CTRL_ENABLED
+        rateControlTick(playing > 0);
+    #endif
+
+    // Back to the main stream for snapshots, recording and the web UI
+    if (removed && sessionCount() == 0)
+        media_config_activate(MEDIA_MAIN);
 }
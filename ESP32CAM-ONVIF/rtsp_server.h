@@ -4,6 +4,7 @@
 #include "config.h"
 #include "board_config.h"
 #include "CRtspSession.h"
+#include "rate_controller.h"
 
 // Include both streamers — the H.264 path may fall back to MyStreamer
 #ifdef VIDEO_CODEC_H264
@@ -23,3 +24,6 @@ void rtsp_server_start();
 void rtsp_server_loop();
 
 const char* getCodecName();
+
+// Current rate controller decision (quality drop, frame interval, reason)
+const RateControlState &rtsp_rate_state();
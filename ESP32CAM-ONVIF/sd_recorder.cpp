@@ -2,6 +2,9 @@
 #include "FS.h"
 #include "SD_MMC.h"
 #include "esp_camera.h" // Added for camera functions
+#include "metrics.h"
+#include "event_queue.h"
+#include "task_manifest.h"
 
 #include "config.h"
 #include "wifi_manager.h"
@@ -55,8 +58,8 @@ void sd_write_task(void *pvParameters);
       sd_queue = xQueueCreate(2, sizeof(camera_fb_t *)); // Max 2 frames in queue
   }
   if (sd_task_handle == NULL) {
-      // Create SD writer task on Core 1
-      xTaskCreatePinnedToCore(sd_write_task, "SD_Write_Task", 4096, NULL, 1, &sd_task_handle, 1);
+      // SD writer task, placed by the task manifest
+      task_spawn(TASK_SD_WRITE, sd_write_task, &sd_task_handle);
   }
 }
 
@@ -66,6 +69,7 @@ unsigned long _currentSegmentStart = 0;
 File _recordFile;
 bool _isRecording = false;
 bool _manualRecording = false; // Flag for manual web trigger
+static volatile bool _paused = false; // heap monitor: no frames, segment closed
 int _segmentCounter = 0;
 int _framesSinceFlush = 0;  // Track frames for periodic flush
 
@@ -116,8 +120,10 @@ void start_new_segment() {
         Serial.println("[INFO] Started recording segment: " + filename);
         _currentSegmentStart = millis();
         _isRecording = true;
+        event_queue_push(EVENT_RECORDING, true, filename.c_str());
     } else {
         Serial.println("[ERROR] Failed to open recording file");
+        if (_isRecording) event_queue_push(EVENT_RECORDING, false, "Failed to open segment");
         _isRecording = false;
     }
 }
@@ -127,6 +133,7 @@ void sd_recorder_stop_segment() {
         _recordFile.close();
         Serial.println("[INFO] Stopped recording segment.");
     }
+    if (_isRecording) event_queue_push(EVENT_RECORDING, false, "Recording stopped");
     _isRecording = false;
 }
 
@@ -134,13 +141,17 @@ void sd_write_task(void *pvParameters) {
     camera_fb_t *fb = NULL;
     while (1) {
         if (xQueueReceive(sd_queue, &fb, portMAX_DELAY) == pdTRUE) {
-            bool shouldRecord = appSettings.continuousRecordingEnabled || _manualRecording;
+            bool shouldRecord = (appSettings.continuousRecordingEnabled || _manualRecording) && !_paused;
             
-            if (!shouldRecord || !_sdMountSuccess) {
+            // fb == NULL: sd_recorder_loop asks us to close the segment
+            if (!shouldRecord || !_sdMountSuccess || !fb) {
                 if (_isRecording) {
                     sd_recorder_stop_segment();
                 }
-                esp_camera_fb_return(fb);
+                if (fb) {
+                    esp_camera_fb_return(fb);
+                    metrics_frame(MC_SD, MF_DROPPED);
+                }
                 continue;
             }
 
@@ -151,19 +162,25 @@ void sd_write_task(void *pvParameters) {
                 start_new_segment();
             }
 
+            bool written = false;
             if (_isRecording && _recordFile) {
+                uint32_t t0 = metrics_cycles();
                 if (_recordFile.write(fb->buf, fb->len) != fb->len) {
                     Serial.println("[ERROR] Write failed. Disk full?");
                     _recordFile.close();
                     _isRecording = false;
+                    event_queue_push(EVENT_RECORDING, false, "Write failed (disk full?)");
                 } else {
                     _framesSinceFlush++;
                     if (_framesSinceFlush >= 10) {
                         _recordFile.flush();
                         _framesSinceFlush = 0;
                     }
+                    written = true;
                 }
+                metrics_record_cycles(MT_SD_WRITE, t0);
             }
+            metrics_frame(MC_SD, written ? MF_SENT : MF_DROPPED);
             
             esp_camera_fb_return(fb);
         }
@@ -185,7 +202,17 @@ void sd_recorder_stop_manual() {
 }
 
 bool sd_recorder_is_recording() {
-    return _manualRecording || (appSettings.continuousRecordingEnabled && _sdMountSuccess);
+    return !_paused && (_manualRecording || (appSettings.continuousRecordingEnabled && _sdMountSuccess));
+}
+
+void sd_recorder_set_paused(bool paused) {
+    if (paused == _paused) return;
+    _paused = paused;
+    Serial.printf("[INFO] SD recording %s\n", paused ? "paused (low memory)" : "resumed");
+}
+
+bool sd_recorder_is_paused() {
+    return _paused;
 }
 
 bool sd_recorder_is_mounted() {
@@ -201,18 +228,32 @@ void sd_recorder_loop() {
     
     if (!shouldRecord) return;
 
+    if (_paused) {
+        // The writer owns the file: have it close the segment and free its
+        // buffers (repeats harmlessly until it has)
+        if (_isRecording) {
+            camera_fb_t *none = NULL;
+            xQueueSend(sd_queue, &none, 0);
+        }
+        return;
+    }
+
     unsigned long now = millis();
     
     // 3. Record Frame (2 FPS for background recording — saves CPU vs 5 FPS)
     // We queue the frame here, the actual writing happens in sd_write_task without blocking loop()
     if (now - _lastRecordFrame > 500) { // 500ms = 2 FPS
+        uint32_t t0 = metrics_cycles();
         camera_fb_t * fb = esp_camera_fb_get();
+        metrics_record_cycles(MT_FB_SD, t0);
         if (!fb) return;
+        metrics_frame(MC_SD, MF_CAPTURED);
         
         // Push to queue, do not block. If full, SD is lagging, drop frame.
         if (xQueueSend(sd_queue, &fb, 0) != pdTRUE) {
             // Serial.println("[WARN] SD Queue full, dropping frame to avoid freeze");
             esp_camera_fb_return(fb);
+            metrics_frame(MC_SD, MF_DROPPED);
         }
         
         _lastRecordFrame = now;
@@ -11,4 +11,9 @@ void manage_storage();
 void sd_recorder_start_manual();
 void sd_recorder_stop_manual();
 bool sd_recorder_is_recording();
+
+// Heap monitor mitigation: stop taking frames and close the open segment;
+// the recording mode itself is kept and resumes with set_paused(false)
+void sd_recorder_set_paused(bool paused);
+bool sd_recorder_is_paused();
 bool sd_recorder_is_mounted();
@@ -0,0 +1,186 @@
+#include "soap_parse.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *const ACTION_NAMES[SOAP_ACTION_COUNT] = {
+    "Unknown",
+    "GetSystemDateAndTime",
+    "SetSystemDateAndTime",
+    "SetSynchronizationPoint",
+    "GetCapabilities",
+    "GetServices",
+    "GetDeviceInformation",
+    "GetProfiles",
+    "GetStreamUri",
+    "GetSnapshotUri",
+    "GetVideoSources",
+    "GetVideoOptions",
+    "GetVideoConfig",
+    "GetAudioConfig",
+    "SetVideoConfig",
+    "GetNetworkInterfaces",
+    "GetNetworkProtocols",
+    "GetScopes",
+    "GetHostname",
+    "GetDNS",
+    "GetNTP",
+    "GetOSDOptions",
+    "GetMoveOptions",
+    "GetAnalyticsConfig",
+    "GetImagingOptions",
+    "SetImagingSettings",
+    "CreatePullPoint",
+    "PullMessages",
+    "Unsubscribe",
+    "Renew",
+    "GetEventProperties",
+    "GetEventServiceCaps",
+    "GetMedia2ServiceCaps",
+    "PTZ"};
+
+const char *soap_action_name(SoapAction a) {
+  return a < SOAP_ACTION_COUNT ? ACTION_NAMES[a] : ACTION_NAMES[SOAP_UNKNOWN];
+}
+
+SoapAction soap_action(const char *body, const char *path) {
+  // Order matters where one operation name contains another
+  // (GetVideoEncoderConfigurationOptions / GetVideoEncoderConfiguration)
+  if (soap_has(body, "GetSystemDateAndTime"))
+    return SOAP_GET_SYSTEM_DATE_AND_TIME;
+  if (soap_has(body, "SetSystemDateAndTime"))
+    return SOAP_SET_SYSTEM_DATE_AND_TIME;
+  if (soap_has(body, "SetSynchronizationPoint"))
+    return SOAP_SET_SYNCHRONIZATION_POINT;
+  if (soap_has(body, "GetCapabilities"))
+    return SOAP_GET_CAPABILITIES;
+  if (soap_has(body, "GetServices"))
+    return SOAP_GET_SERVICES;
+  if (soap_has(body, "GetDeviceInformation"))
+    return SOAP_GET_DEVICE_INFORMATION;
+  if (soap_has(body, "GetProfiles"))
+    return SOAP_GET_PROFILES;
+  if (soap_has(body, "GetStreamUri"))
+    return SOAP_GET_STREAM_URI;
+  if (soap_has(body, "GetSnapshotUri"))
+    return SOAP_GET_SNAPSHOT_URI;
+  if (soap_has(body, "GetVideoSources"))
+    return SOAP_GET_VIDEO_SOURCES;
+  if (soap_has(body, "GetVideoEncoderConfigurationOptions"))
+    return SOAP_GET_VIDEO_OPTIONS;
+  if (soap_has(body, "GetVideoEncoderConfiguration"))
+    return SOAP_GET_VIDEO_CONFIG;
+  if (soap_has(body, "GetAudioEncoderConfiguration"))
+    return SOAP_GET_AUDIO_CONFIG;
+  if (soap_has(body, "SetVideoEncoderConfiguration"))
+    return SOAP_SET_VIDEO_CONFIG;
+  if (soap_has(body, "GetNetworkInterfaces"))
+    return SOAP_GET_NETWORK_INTERFACES;
+  if (soap_has(body, "GetNetworkProtocols"))
+    return SOAP_GET_NETWORK_PROTOCOLS;
+  if (soap_has(body, "GetScopes"))
+    return SOAP_GET_SCOPES;
+  if (soap_has(body, "GetHostname"))
+    return SOAP_GET_HOSTNAME;
+  if (soap_has(body, "GetDNS"))
+    return SOAP_GET_DNS;
+  if (soap_has(body, "GetNTP"))
+    return SOAP_GET_NTP;
+  if (soap_has(body, "GetOSDOptions"))
+    return SOAP_GET_OSD_OPTIONS;
+  if (soap_has(body, "GetMoveOptions"))
+    return SOAP_GET_MOVE_OPTIONS;
+  if (soap_has(body, "GetVideoAnalyticsConfigurations"))
+    return SOAP_GET_ANALYTICS_CONFIG;
+  if (soap_has(body, "GetOptions") && soap_has(body, "VideoSourceToken"))
+    return SOAP_GET_IMAGING_OPTIONS;
+  if (soap_has(body, "SetImagingSettings"))
+    return SOAP_SET_IMAGING_SETTINGS;
+  if (soap_has(body, "CreatePullPointSubscription"))
+    return SOAP_CREATE_PULL_POINT;
+  if (soap_has(body, "PullMessages"))
+    return SOAP_PULL_MESSAGES;
+  if (soap_has(body, "Unsubscribe"))
+    return SOAP_UNSUBSCRIBE;
+  if (soap_has(body, "Renew"))
+    return SOAP_RENEW;
+  if (soap_has(body, "GetEventProperties"))
+    return SOAP_GET_EVENT_PROPERTIES;
+  if (soap_has(body, "GetServiceCapabilities") &&
+      strcmp(path, "/onvif/events_service") == 0)
+    return SOAP_GET_EVENT_SERVICE_CAPS;
+  if (soap_has(body, "GetServiceCapabilities") &&
+      strcmp(path, "/onvif/media2_service") == 0)
+    return SOAP_GET_MEDIA2_SERVICE_CAPS;
+  if (soap_has(body, "AbsoluteMove") || soap_has(body, "ContinuousMove") ||
+      soap_has(body, "Preset") || soap_has(body, "GotoHomePosition") ||
+      soap_has(body, "GetNodes") || soap_has(body, "Stop") ||
+      (soap_has(body, "GetStatus") && strcmp(path, "/onvif/ptz_service") == 0))
+    return SOAP_PTZ;
+  return SOAP_UNKNOWN;
+}
+
+bool soap_action_protected(SoapAction a) {
+  switch (a) {
+  case SOAP_GET_STREAM_URI:
+  case SOAP_GET_PROFILES:
+  case SOAP_SET_SYSTEM_DATE_AND_TIME:
+  case SOAP_GET_VIDEO_SOURCES:
+  case SOAP_GET_VIDEO_CONFIG:
+  case SOAP_GET_SNAPSHOT_URI:
+  case SOAP_SET_VIDEO_CONFIG:
+  case SOAP_SET_IMAGING_SETTINGS:
+  case SOAP_PTZ:
+  case SOAP_CREATE_PULL_POINT:
+  case SOAP_PULL_MESSAGES:
+  case SOAP_RENEW:
+  case SOAP_UNSUBSCRIBE:
+  case SOAP_GET_EVENT_PROPERTIES:
+    return true;
+  default:
+    return false;
+  }
+}
+
+const char *soap_value(const char *body, const char *name) {
+  char tag[40];
+  int n = snprintf(tag, sizeof(tag), "%s>", name);
+  if (n <= 0 || (size_t)n >= sizeof(tag))
+    return nullptr;
+  const char *at = strstr(body, tag);
+  return at ? at + n : nullptr;
+}
+
+float soap_number(const char *body, const char *name) {
+  const char *val = soap_value(body, name);
+  return val ? atof(val) : -1.0f;
+}
+
+bool soap_text(const char *body, const char *name, char *out, size_t size) {
+  const char *p = soap_value(body, name);
+  if (!p || size == 0)
+    return false;
+  while (isspace((unsigned char)*p))
+    p++;
+  size_t n = 0;
+  while (p[n] && p[n] != '<' && n + 1 < size)
+    n++;
+  while (n && isspace((unsigned char)p[n - 1]))
+    n--;
+  memcpy(out, p, n);
+  out[n] = '\0';
+  return n > 0;
+}
+
+int soap_int_after(const char *from, const char *name) {
+  char tag[40];
+  snprintf(tag, sizeof(tag), "<%s>", name);
+  const char *at = strstr(from, tag);
+  if (!at) {
+    tag[0] = ':'; // namespaced: <tt:Year>
+    at = strstr(from, tag);
+  }
+  if (!at)
+    return 0;
+  return atoi(strchr(at, '>') + 1);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ==============================================================================
+//   soap_parse - reads ONVIF requests in place
+// ==============================================================================
+// The SOAP body stays in the HTTP engine's receive buffer (NUL-terminated).
+// These helpers search it with plain pointers and copy out only the values
+// asked for, so handling a request makes no heap allocation. Elements are
+// matched by local name whatever namespace prefix the client picked
+// ("tt:Width>", "ns2:Width>"). Plain C++ so it builds on the host as well.
+// ==============================================================================
+
+enum SoapAction : uint8_t {
+  SOAP_UNKNOWN = 0,
+  SOAP_GET_SYSTEM_DATE_AND_TIME,
+  SOAP_SET_SYSTEM_DATE_AND_TIME,
+  SOAP_SET_SYNCHRONIZATION_POINT,
+  SOAP_GET_CAPABILITIES,
+  SOAP_GET_SERVICES,
+  SOAP_GET_DEVICE_INFORMATION,
+  SOAP_GET_PROFILES,
+  SOAP_GET_STREAM_URI,
+  SOAP_GET_SNAPSHOT_URI,
+  SOAP_GET_VIDEO_SOURCES,
+  SOAP_GET_VIDEO_OPTIONS,
+  SOAP_GET_VIDEO_CONFIG,
+  SOAP_GET_AUDIO_CONFIG,
+  SOAP_SET_VIDEO_CONFIG,
+  SOAP_GET_NETWORK_INTERFACES,
+  SOAP_GET_NETWORK_PROTOCOLS,
+  SOAP_GET_SCOPES,
+  SOAP_GET_HOSTNAME,
+  SOAP_GET_DNS,
+  SOAP_GET_NTP,
+  SOAP_GET_OSD_OPTIONS,
+  SOAP_GET_MOVE_OPTIONS,
+  SOAP_GET_ANALYTICS_CONFIG,
+  SOAP_GET_IMAGING_OPTIONS,
+  SOAP_SET_IMAGING_SETTINGS,
+  SOAP_CREATE_PULL_POINT,
+  SOAP_PULL_MESSAGES,
+  SOAP_UNSUBSCRIBE,
+  SOAP_RENEW,
+  SOAP_GET_EVENT_PROPERTIES,
+  SOAP_GET_EVENT_SERVICE_CAPS,
+  SOAP_GET_MEDIA2_SERVICE_CAPS,
+  SOAP_PTZ, // any PTZ service operation, handle_ptz() tells them apart
+  SOAP_ACTION_COUNT
+};
+
+// The operation a request asks for. path (the service URL) separates
+// operations several services share, like GetServiceCapabilities.
+SoapAction soap_action(const char *body, const char *path);
+const char *soap_action_name(SoapAction a);
+
+// Refused without WS-Security. The rest (GetCapabilities, GetServices,
+// GetSystemDateAndTime, ...) are answered without it so NVRs can discover
+// the device, but a Security header that is present is always checked.
+bool soap_action_protected(SoapAction a);
+
+inline bool soap_has(const char *body, const char *needle) {
+  return strstr(body, needle) != nullptr;
+}
+
+// Text right after the first "name>" (an opening tag), nullptr if absent
+const char *soap_value(const char *body, const char *name);
+// Numeric value of <prefix:name>value</prefix:name>, -1 if absent
+float soap_number(const char *body, const char *name);
+// Copies the trimmed text of <prefix:name>text</prefix:name>; false if
+// absent or empty. Longer text is cut to size - 1.
+bool soap_text(const char *body, const char *name, char *out, size_t size);
+// Integer value of the first <name> or <prefix:name> element at or after
+// from; 0 if absent
+int soap_int_after(const char *from, const char *name);
+
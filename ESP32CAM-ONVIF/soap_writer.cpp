@@ -0,0 +1,278 @@
+#include "soap_writer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef pgm_read_byte
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+#endif
+
+SoapWriter::SoapWriter(char *block, size_t blockSize, SoapSinkFn sink,
+                       void *ctx)
+    : m_block(block), m_blockSize(blockSize), m_used(0), m_total(0),
+      m_sink(sink), m_ctx(ctx) {}
+
+void SoapWriter::write(const char *data, size_t len) {
+  m_total += len;
+  if (!m_sink)
+    return; // dry run
+
+  while (len > 0) {
+    size_t chunk = m_blockSize - m_used;
+    if (chunk > len)
+      chunk = len;
+    memcpy(m_block + m_used, data, chunk);
+    m_used += chunk;
+    data += chunk;
+    len -= chunk;
+    if (m_used == m_blockSize)
+      flush();
+  }
+}
+
+void SoapWriter::putc(char c) { write(&c, 1); }
+
+void SoapWriter::pad(char c, int count) {
+  while (count-- > 0)
+    putc(c);
+}
+
+void SoapWriter::write_P(const char *pgm) {
+  // Copy in runs so PROGMEM is walked once without a strlen_P pass
+  char run[64];
+  size_t n = 0;
+  char c;
+  while ((c = (char)pgm_read_byte(pgm++)) != '\0') {
+    run[n++] = c;
+    if (n == sizeof(run)) {
+      write(run, n);
+      n = 0;
+    }
+  }
+  if (n)
+    write(run, n);
+}
+
+void SoapWriter::printf_P(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  vprintf_P(fmt, ap);
+  va_end(ap);
+}
+
+void SoapWriter::vprintf_P(const char *fmt, va_list ap) {
+  char run[64];
+  size_t runLen = 0;
+  const char *p = fmt;
+
+  for (;;) {
+    char c = (char)pgm_read_byte(p);
+
+    // Literal text between conversions
+    if (c != '%' && c != '\0') {
+      run[runLen++] = c;
+      p++;
+      if (runLen == sizeof(run)) {
+        write(run, runLen);
+        runLen = 0;
+      }
+      continue;
+    }
+    if (runLen) {
+      write(run, runLen);
+      runLen = 0;
+    }
+    if (c == '\0')
+      return;
+    p++; // skip '%'
+
+    // Rebuild a single-conversion spec for snprintf, resolving '*'
+    char spec[32];
+    size_t n = 0;
+    bool left = false;
+    int width = 0;
+    int prec = -1;
+    spec[n++] = '%';
+
+    while ((c = (char)pgm_read_byte(p)) == '-' || c == '+' || c == ' ' ||
+           c == '#' || c == '0') {
+      if (c == '-')
+        left = true;
+      if (n < 8)
+        spec[n++] = c;
+      p++;
+    }
+
+    if (c == '*') {
+      width = va_arg(ap, int);
+      if (width < 0) {
+        left = true;
+        width = -width;
+        spec[n++] = '-';
+      }
+      n += snprintf(spec + n, sizeof(spec) - n, "%d", width);
+      c = (char)pgm_read_byte(++p);
+    } else {
+      while (c >= '0' && c <= '9') {
+        width = width * 10 + (c - '0');
+        if (n < 16)
+          spec[n++] = c;
+        c = (char)pgm_read_byte(++p);
+      }
+    }
+
+    if (c == '.') {
+      spec[n++] = '.';
+      c = (char)pgm_read_byte(++p);
+      if (c == '*') {
+        prec = va_arg(ap, int);
+        if (prec < 0)
+          n--; // negative precision means "omitted": drop the '.'
+        else
+          n += snprintf(spec + n, sizeof(spec) - n, "%d", prec);
+        c = (char)pgm_read_byte(++p);
+      } else {
+        prec = 0;
+        while (c >= '0' && c <= '9') {
+          prec = prec * 10 + (c - '0');
+          if (n < 24)
+            spec[n++] = c;
+          c = (char)pgm_read_byte(++p);
+        }
+      }
+    }
+
+    // Length modifiers: h hh l ll z j t L
+    int longs = 0;
+    bool isSize = false;
+    bool isLongDouble = false;
+    while (c == 'h' || c == 'l' || c == 'z' || c == 'j' || c == 't' ||
+           c == 'L') {
+      if (c == 'l')
+        longs++;
+      else if (c == 'z' || c == 'j' || c == 't')
+        isSize = true;
+      else if (c == 'L')
+        isLongDouble = true;
+      if (n < sizeof(spec) - 2)
+        spec[n++] = c;
+      c = (char)pgm_read_byte(++p);
+    }
+    if (c == '\0')
+      return; // truncated spec, nothing sensible to print
+    p++;
+    spec[n++] = c;
+    spec[n] = '\0';
+
+    char tmp[64];
+    int len = -1;
+
+    switch (c) {
+    case '%':
+      putc('%');
+      break;
+
+    case 's': {
+      const char *str = va_arg(ap, const char *);
+      if (!str)
+        str = "(null)";
+      size_t slen = strlen(str);
+      if (prec >= 0 && (size_t)prec < slen)
+        slen = prec;
+      int fill = width > (int)slen ? width - (int)slen : 0;
+      if (!left)
+        pad(' ', fill);
+      write(str, slen);
+      if (left)
+        pad(' ', fill);
+      break;
+    }
+
+    case 'c': {
+      char ch = (char)va_arg(ap, int);
+      int fill = width > 1 ? width - 1 : 0;
+      if (!left)
+        pad(' ', fill);
+      putc(ch);
+      if (left)
+        pad(' ', fill);
+      break;
+    }
+
+    case 'd':
+    case 'i':
+      if (longs >= 2)
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, long long));
+      else if (longs == 1)
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, long));
+      else if (isSize)
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, ptrdiff_t));
+      else
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, int));
+      break;
+
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+      if (longs >= 2)
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, unsigned long long));
+      else if (longs == 1)
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, unsigned long));
+      else if (isSize)
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, size_t));
+      else
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, unsigned int));
+      break;
+
+    case 'p':
+      len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, void *));
+      break;
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      if (isLongDouble)
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, long double));
+      else
+        len = snprintf(tmp, sizeof(tmp), spec, va_arg(ap, double));
+      break;
+
+    case 'n':
+      (void)va_arg(ap, int *); // never write through template pointers
+      break;
+
+    default:
+      // Unknown conversion: emit it verbatim like most libcs do
+      write(spec, n);
+      break;
+    }
+
+    if (len > 0)
+      write(tmp, (size_t)len < sizeof(tmp) ? (size_t)len : sizeof(tmp) - 1);
+  }
+}
+
+void soap_buffer_sink(void *ctx, const char *data, size_t len) {
+  SoapBufferSink *out = (SoapBufferSink *)ctx;
+  if (out->size == 0)
+    return;
+  size_t room = out->size - 1 - out->len;
+  if (len > room)
+    len = room;
+  memcpy(out->buf + out->len, data, len);
+  out->len += len;
+  out->buf[out->len] = '\0';
+}
+
+void SoapWriter::flush() {
+  if (m_sink && m_used) {
+    m_sink(m_ctx, m_block, m_used);
+  }
+  m_used = 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdarg.h>
+#include <stddef.h>
+
+// ==============================================================================
+//   SoapWriter - block-buffered output stream for ONVIF documents
+// ==============================================================================
+// Formats PROGMEM template segments into a small reusable block and hands each
+// full block to a sink, so a response of any size needs only the block in RAM.
+// Without a sink the writer only counts bytes: render a document once in that
+// mode to get its Content-Length, then render it again into the real sink.
+//
+// printf_P() accepts the printf subset used by the templates (flags, width,
+// precision, h/l/ll/z modifiers, d i u x X o c s p f e g %%) and produces the
+// same bytes snprintf_P would. Plain C++ so it builds on the host as well.
+// ==============================================================================
+
+#define SOAP_WRITER_BLOCK_SIZE 1024
+
+// Receives each filled block (and the final partial one on flush)
+typedef void (*SoapSinkFn)(void *ctx, const char *data, size_t len);
+
+class SoapWriter {
+public:
+  // sink == nullptr -> dry run, only length() is meaningful
+  SoapWriter(char *block, size_t blockSize, SoapSinkFn sink, void *ctx);
+
+  void write(const char *data, size_t len);
+  void write_P(const char *pgm);
+  void printf_P(const char *fmt, ...);
+  void vprintf_P(const char *fmt, va_list ap);
+
+  // Push out the partially filled block
+  void flush();
+
+  // Total bytes produced so far (flushed or not)
+  size_t length() const { return m_total; }
+
+private:
+  void putc(char c);
+  void pad(char c, int count);
+
+  char *m_block;
+  size_t m_blockSize;
+  size_t m_used;
+  size_t m_total;
+  SoapSinkFn m_sink;
+  void *m_ctx;
+};
+
+// Sink for short documents rendered into a fixed buffer (JSON summaries):
+// keeps buf NUL-terminated and drops what doesn't fit; len is what was kept
+struct SoapBufferSink {
+  char *buf;
+  size_t size;
+  size_t len;
+};
+void soap_buffer_sink(void *ctx, const char *data, size_t len);
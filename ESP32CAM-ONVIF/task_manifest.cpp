@@ -0,0 +1,309 @@
+#include "task_manifest.h"
+#include "config.h"
+#include "platglue.h"
+#include "soap_writer.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef VIDEO_CODEC_H264
+#define CAPTURE_STACK 8192 // software H.264 encode runs in the capture task
+#else
+#define CAPTURE_STACK 4096
+#endif
+
+// Indexed by TaskId
+static const TaskPlacement MANIFEST[TASK_COUNT] = {
+    //  name               core            prio stack  period
+    {"RTSP_Task", TASK_WIFI_CORE, 4, 6144, 5},
+    {"RTSP_Capture", TASK_APP_CORE, 4, CAPTURE_STACK, 0},
+    {"RTSP_Sender", TASK_APP_CORE, 5, 4096, 0},
+    {"ONVIF_HTTP_Task", TASK_APP_CORE, 3, 6144, 20},
+    {"WiFi_Mgmt_Task", TASK_APP_CORE, 6, 4096, 100},
+    {"WDT_Task", TASK_APP_CORE, 7, 2048, 2000},
+    {"Low_Prio_Task", TASK_APP_CORE, 2, 4096, 100},
+    {"SD_Write_Task", TASK_APP_CORE, 1, 4096, 0},
+    {"MQTT_Task", TASK_APP_CORE, 2, 4096, 50},
+    {"PTZ_Task", TASK_APP_CORE, 3, 3072, 1000 / PTZ_CONTROL_HZ},
+    {"Cloud_Outbox", TASK_APP_CORE, 1, 10240, 0},
+    {"MJPEG_Stream", TASK_APP_CORE, 2, 4096, 100},
+};
+
+static uint64_t s_busyUs[TASK_COUNT];
+
+static TaskId s_coopOwner = TASK_COUNT;
+static CoopSubtask *s_coop = nullptr;
+static size_t s_coopCount = 0;
+
+const TaskPlacement &task_placement(TaskId id) { return MANIFEST[id]; }
+
+void task_busy_add(TaskId id, uint32_t us) { s_busyUs[id] += us; }
+
+uint32_t task_coop_run(TaskId owner, CoopSubtask *subs, size_t count) {
+  s_coopOwner = owner;
+  s_coop = subs;
+  s_coopCount = count;
+
+  uint32_t now = platmillis();
+  for (size_t i = 0; i < count; i++) {
+    CoopSubtask &t = subs[i];
+    if (t.runs && (int32_t)(t.nextDueMs - now) > 0)
+      continue;
+    uint32_t due = t.runs ? t.nextDueMs : now;
+
+    uint32_t start = platmicros();
+    t.run();
+    uint32_t us = platmicros() - start;
+    now = platmillis();
+
+    t.runs++;
+    t.busyUs += us;
+    s_busyUs[owner] += us;
+    if (us > t.maxRunUs)
+      t.maxRunUs = us;
+    uint32_t late = now - due;
+    if (late > t.maxLateMs)
+      t.maxLateMs = late;
+    if (late > t.deadlineMs)
+      t.misses++;
+
+    // Keep the cadence, but after a stall start over rather than catch up
+    t.nextDueMs = (now - due < t.periodMs) ? due + t.periodMs : now + t.periodMs;
+  }
+
+  uint32_t wait = UINT32_MAX;
+  for (size_t i = 0; i < count; i++) {
+    int32_t left = (int32_t)(subs[i].nextDueMs - now);
+    uint32_t w = left > 0 ? left : 0;
+    if (w < wait)
+      wait = w;
+  }
+  return count ? wait : 0;
+}
+
+#ifdef ESP_PLATFORM
+
+bool task_spawn(TaskId id, TaskFunction_t fn, TaskHandle_t *handle,
+                void *arg) {
+  const TaskPlacement &p = MANIFEST[id];
+  return xTaskCreatePinnedToCore(fn, p.name, p.stackBytes, arg, p.priority,
+                                 handle, p.core) == pdPASS;
+}
+
+#define CPU_UNKNOWN 0xFFFF
+
+#if configGENERATE_RUN_TIME_STATS
+#define STATS_SOURCE "freertos"
+#else
+#define STATS_SOURCE "self"
+#endif
+
+// One row per task seen in the last window. The watchdog task rewrites the
+// rows while the web task may read them; a torn row is harmless here.
+struct TaskRow {
+  char name[configMAX_TASK_NAME_LEN];
+  TaskHandle_t handle;
+  uint32_t counter;   // run-time counter (or busy us) at the last sample
+  uint16_t cpuTenths; // share of one core over the window, 0.1%
+  uint16_t stackFree; // bytes never used
+  uint8_t priority;
+  int8_t core; // -1: unpinned or unknown
+};
+
+// Counter of each task at the previous sample, by handle
+struct TaskPrev {
+  TaskHandle_t handle;
+  uint32_t counter;
+};
+
+static TaskStatus_t s_status[TASK_STATS_MAX_TASKS];
+static TaskRow s_rows[TASK_STATS_MAX_TASKS];
+#if configGENERATE_RUN_TIME_STATS
+static TaskPrev s_prev[TASK_STATS_MAX_TASKS];
+#endif
+static uint8_t s_rowCount = 0;
+static uint16_t s_coreLoad[portNUM_PROCESSORS]; // 0.1%, CPU_UNKNOWN if n/a
+#if !configGENERATE_RUN_TIME_STATS
+static uint64_t s_prevBusyUs[TASK_COUNT];
+#endif
+static uint32_t s_windowStartUs = 0;
+static uint32_t s_windowUs = 0;
+
+static int manifest_index(const char *name) {
+  for (int i = 0; i < TASK_COUNT; i++)
+    if (!strcmp(MANIFEST[i].name, name))
+      return i;
+  return -1;
+}
+
+static uint16_t share_tenths(uint64_t part, uint64_t whole) {
+  if (!whole)
+    return CPU_UNKNOWN;
+  uint64_t t = part * 1000 / whole;
+  return t > 1000 ? 1000 : (uint16_t)t;
+}
+
+void task_stats_sample() {
+  uint32_t nowUs = micros();
+  if (s_windowStartUs && nowUs - s_windowStartUs < TASK_STATS_WINDOW_MS * 1000UL)
+    return;
+
+  uint32_t total = 0;
+  UBaseType_t n = uxTaskGetSystemState(s_status, TASK_STATS_MAX_TASKS, &total);
+  uint32_t wallUs = nowUs - s_windowStartUs;
+  bool first = !s_windowStartUs;
+
+#if configGENERATE_RUN_TIME_STATS
+  // Run-time counters tick with the stats clock, not micros(): measure the
+  // window in the same unit
+  static uint32_t s_prevTotal = 0;
+  uint32_t window = total - s_prevTotal;
+  s_prevTotal = total;
+  uint64_t idle[portNUM_PROCESSORS] = {};
+  bool idleSeen = false;
+
+  // The rows are rewritten below, and uxTaskGetSystemState() may list the
+  // tasks in a different order each time: look the previous counters up in
+  // a copy
+  uint8_t prevCount = s_rowCount < TASK_STATS_MAX_TASKS ? s_rowCount
+                                                        : TASK_STATS_MAX_TASKS;
+  for (uint8_t r = 0; r < prevCount; r++) {
+    s_prev[r].handle = s_rows[r].handle;
+    s_prev[r].counter = s_rows[r].counter;
+  }
+#else
+  // Busy time reported by manifest tasks over the window
+  uint64_t busy[TASK_COUNT];
+  for (int i = 0; i < TASK_COUNT; i++) {
+    busy[i] = s_busyUs[i] - s_prevBusyUs[i];
+    s_prevBusyUs[i] = s_busyUs[i];
+  }
+#endif
+
+  for (UBaseType_t i = 0; i < n; i++) {
+    const TaskStatus_t &st = s_status[i];
+    TaskRow row;
+    strncpy(row.name, st.pcTaskName, sizeof(row.name) - 1);
+    row.name[sizeof(row.name) - 1] = '\0';
+    row.handle = st.xHandle;
+    row.priority = st.uxCurrentPriority;
+    row.stackFree = st.usStackHighWaterMark * sizeof(StackType_t);
+#if configTASKLIST_INCLUDE_COREID
+    row.core = st.xCoreID < portNUM_PROCESSORS ? st.xCoreID : -1;
+#else
+    row.core = -1;
+#endif
+    row.cpuTenths = CPU_UNKNOWN;
+
+#if configGENERATE_RUN_TIME_STATS
+    row.counter = st.ulRunTimeCounter;
+    for (uint8_t r = 0; r < prevCount && !first; r++) {
+      if (s_prev[r].handle != st.xHandle)
+        continue;
+      uint32_t delta = row.counter - s_prev[r].counter;
+      row.cpuTenths = share_tenths(delta, window);
+      if (!strncmp(row.name, "IDLE", 4) && row.core >= 0) {
+        idle[row.core] += delta;
+        idleSeen = true;
+      }
+      break;
+    }
+#else
+    int m = manifest_index(row.name);
+    row.counter = 0;
+    if (m >= 0 && !first && busy[m])
+      row.cpuTenths = share_tenths(busy[m], wallUs);
+#endif
+    if (i < TASK_STATS_MAX_TASKS)
+      s_rows[i] = row;
+  }
+  s_rowCount = n;
+
+  for (int c = 0; c < portNUM_PROCESSORS; c++) {
+    s_coreLoad[c] = CPU_UNKNOWN;
+#if configGENERATE_RUN_TIME_STATS
+    if (idleSeen && window)
+      s_coreLoad[c] = 1000 - share_tenths(idle[c], window);
+#else
+    // Lower bound: only what the manifest tasks on this core reported
+    uint64_t sum = 0;
+    for (int m = 0; m < TASK_COUNT; m++)
+      if (MANIFEST[m].core == c)
+        sum += busy[m];
+    if (!first)
+      s_coreLoad[c] = share_tenths(sum, wallUs);
+#endif
+  }
+
+  s_windowUs = first ? 0 : wallUs;
+  s_windowStartUs = nowUs ? nowUs : 1;
+}
+
+// "12.3" or null
+static void out_pct(SoapWriter &w, const char *key, uint16_t tenths) {
+  if (tenths == CPU_UNKNOWN)
+    w.printf_P(",\"%s\":null", key);
+  else
+    w.printf_P(",\"%s\":%u.%u", key, tenths / 10, tenths % 10);
+}
+
+void task_stats_write_json(MetricsSink sink, void *ctx) {
+  static char block[512]; // single caller (web task); keeps it off its stack
+  SoapWriter w(block, sizeof(block), sink, ctx);
+
+  w.printf_P("{\"source\":\"" STATS_SOURCE "\",\"window_ms\":%u,\"cores\":[",
+             (unsigned)(s_windowUs / 1000));
+  for (int c = 0; c < portNUM_PROCESSORS; c++) {
+    w.printf_P("%s{\"core\":%d", c ? "," : "", c);
+    out_pct(w, "load_pct", s_coreLoad[c]);
+    w.printf_P("}");
+  }
+
+  // Every task the scheduler knows, with the manifest's placement where it
+  // has an entry, then manifest tasks that aren't running
+  bool listed[TASK_COUNT] = {};
+  w.printf_P("],\"tasks\":[");
+  uint8_t rows = s_rowCount < TASK_STATS_MAX_TASKS ? s_rowCount
+                                                   : TASK_STATS_MAX_TASKS;
+  for (uint8_t r = 0; r < rows; r++) {
+    TaskRow row = s_rows[r];
+    row.name[sizeof(row.name) - 1] = '\0';
+    int m = manifest_index(row.name);
+    w.printf_P("%s{\"name\":\"%s\",\"running\":true,\"prio\":%u,"
+               "\"core\":%d,\"stack_free\":%u",
+               r ? "," : "", row.name, row.priority,
+               m >= 0 ? MANIFEST[m].core : row.core, row.stackFree);
+    out_pct(w, "cpu_pct", row.cpuTenths);
+    if (m >= 0) {
+      listed[m] = true;
+      w.printf_P(",\"stack\":%u,\"period_ms\":%u",
+                 MANIFEST[m].stackBytes, MANIFEST[m].periodMs);
+    }
+    w.printf_P("}");
+  }
+  for (int m = 0; m < TASK_COUNT; m++) {
+    if (listed[m])
+      continue;
+    const TaskPlacement &p = MANIFEST[m];
+    w.printf_P("%s{\"name\":\"%s\",\"running\":false,\"prio\":%u,"
+               "\"core\":%d,\"stack\":%u,\"period_ms\":%u}",
+               rows ? "," : "", p.name, p.priority, p.core, p.stackBytes,
+               p.periodMs);
+    rows++;
+  }
+
+  w.printf_P("],\"subtasks\":[");
+  for (size_t i = 0; i < s_coopCount; i++) {
+    const CoopSubtask &t = s_coop[i];
+    w.printf_P("%s{\"task\":\"%s\",\"name\":\"%s\",\"period_ms\":%u,"
+               "\"deadline_ms\":%u,\"runs\":%u,\"misses\":%u",
+               i ? "," : "", MANIFEST[s_coopOwner].name, t.name, t.periodMs,
+               t.deadlineMs, (unsigned)t.runs, (unsigned)t.misses);
+    w.printf_P(",\"max_run_us\":%u,\"max_late_ms\":%u,\"avg_run_us\":%u}",
+               (unsigned)t.maxRunUs, (unsigned)t.maxLateMs,
+               (unsigned)(t.runs ? t.busyUs / t.runs : 0));
+  }
+  w.printf_P("]}");
+  w.flush();
+}
+
+#endif // ESP_PLATFORM
@@ -0,0 +1,106 @@
+#pragma once
+#include "metrics.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// ==============================================================================
+//   Task manifest - placement of every firmware task, and where the CPU goes
+// ==============================================================================
+// One table (task_manifest.cpp) gives each long-running task its name, core,
+// priority, stack and nominal period. Task creation goes through it. To move
+// or re-prioritise a task, edit the table instead of the call sites.
+//
+// Core 0 also runs the WiFi driver and lwIP, so only RTSP_Task stays there:
+// it does short request handling next to the network stack. Frame capture,
+// RTP sending, analytics (motion, in Low_Prio_Task) and everything else run
+// on TASK_APP_CORE.
+//
+// CPU accounting: task_stats_sample() compares the FreeRTOS run-time counters
+// of every task over TASK_STATS_WINDOW_MS. That needs
+// CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS in the SDK configuration. Without
+// it, the figures come from the busy time that manifest tasks report with
+// task_busy_add(). ONVIF_HTTP books its requests but not its select() wait.
+// Tasks that block inside their work (SD_Write, MQTT, the cloud uploaders,
+// the MJPEG viewer) can't report busy time and show no figure. Both sources
+// are served as JSON at /api/tasks.
+//
+// Low_Prio_Task runs cooperative subtasks (CoopSubtask). Each subtask has
+// its own period and deadline, and its own runtime and miss counters.
+// ==============================================================================
+
+#if defined(CONFIG_FREERTOS_UNICORE)
+#define TASK_APP_CORE 0
+#else
+#define TASK_APP_CORE 1
+#endif
+#define TASK_WIFI_CORE 0
+
+enum TaskId : uint8_t {
+  TASK_RTSP = 0,   // RTSP control: accept, requests, pipeline attach
+  TASK_CAPTURE,    // frame pipeline capture (+ H.264 encode)
+  TASK_SENDER,     // frame pipeline RTP packetizing and sending
+  TASK_ONVIF_HTTP, // HTTP engine: web UI, API, WebDAV, ONVIF SOAP, discovery
+  TASK_WIFI,       // connectivity checks
+  TASK_WDT,        // watchdog, heap monitor, task stats
+  TASK_LOW_PRIO,   // cooperative subtasks: motion, SD, console, flash, LED
+  TASK_SD_WRITE,   // SD card writer
+  TASK_MQTT,       // spawned on demand
+  TASK_PTZ,        // servo ramping
+  TASK_OUTBOX,     // motion snapshots to Telegram / Drive (event consumer)
+  TASK_MJPEG,      // the /stream viewer, spawned per connection
+  TASK_COUNT
+};
+
+struct TaskPlacement {
+  const char *name;
+  int8_t core;
+  uint8_t priority;
+  uint16_t stackBytes;
+  uint16_t periodMs; // nominal loop period; 0: paced by queue or stream
+};
+
+const TaskPlacement &task_placement(TaskId id);
+
+// Self-reported busy time for accounting without run-time stats. Only the
+// task itself may call it (single writer).
+void task_busy_add(TaskId id, uint32_t us);
+
+// A cooperative subtask is due every periodMs. It misses its deadline when
+// it finishes more than deadlineMs after falling due. That happens when it
+// runs too long itself, or when the subtasks before it delayed its start.
+struct CoopSubtask {
+  const char *name;
+  void (*run)();
+  uint16_t periodMs;
+  uint16_t deadlineMs;
+  // Kept by task_coop_run()
+  uint32_t nextDueMs;
+  uint32_t runs;
+  uint32_t misses;
+  uint32_t maxRunUs;
+  uint32_t maxLateMs; // due -> finished, worst seen
+  uint64_t busyUs;
+};
+
+// Runs the due subtasks in table order and returns the ms until the next one
+// falls due. Their run time is booked to owner, and the table is reported in
+// /api/tasks.
+uint32_t task_coop_run(TaskId owner, CoopSubtask *subs, size_t count);
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// xTaskCreatePinnedToCore() with the manifest's placement
+bool task_spawn(TaskId id, TaskFunction_t fn, TaskHandle_t *handle = nullptr,
+                void *arg = nullptr);
+
+// Closes the current accounting window once TASK_STATS_WINDOW_MS has passed.
+// Call periodically from one task (watchdog).
+void task_stats_sample();
+
+// Writes the last window as JSON: the source of the figures, per-core load,
+// every task (with manifest placement where it has one, and CPU share as a
+// percentage of one core), and the cooperative subtasks
+void task_stats_write_json(MetricsSink sink, void *ctx);
+#endif
@@ -1,129 +1,169 @@
 #include "telegram_manager.h"
-#include <WiFiClientSecure.h>
-#include <HTTPClient.h>
+#include "https_client.h"
 
 static const char* TELEGRAM_API_HOST = "api.telegram.org";
 static const int TELEGRAM_API_PORT = 443;
 
-bool telegram_send_message(const char* message) {
+// Multipart text of a sendMediaGroup as telegram_send_media() formats it
+#define PART_TEXT(head) (2 + HTTPS_MULTIPART_BOUNDARY_LEN + sizeof("\r\nContent-Disposition: form-data; name=" head "\r\n\r\n\r\n") - 1)
+#define GROUP_FIXED_TEXT \
+    (PART_TEXT("\"chat_id\"") + sizeof(appSettings.telegramChatId) - 1 + \
+     PART_TEXT("\"media\"") + 2 + /* [] */ \
+     2 + HTTPS_MULTIPART_BOUNDARY_LEN + 4) /* closing boundary */
+#define GROUP_PHOTO_TEXT \
+    (PART_TEXT("\"p9\"; filename=\"p9.jpg\"\r\nContent-Type: image/jpeg") + \
+     sizeof(",{\"type\":\"photo\",\"media\":\"attach://p9\",\"caption\":\"\"}") - 1 + \
+     TELEGRAM_CAPTION_MAX - 1)
+static_assert(GROUP_PHOTO_TEXT <= HTTPS_MULTIPART_FILE_TEXT &&
+              GROUP_FIXED_TEXT + OUTBOX_BATCH_MAX * GROUP_PHOTO_TEXT <= HTTPS_MULTIPART_TEXT,
+              "HTTPS_MULTIPART_TEXT must hold a sendMediaGroup of OUTBOX_BATCH_MAX photos");
+static_assert(HTTPS_MULTIPART_SEGMENTS >= 2 * OUTBOX_BATCH_MAX + 1,
+              "HTTPS_MULTIPART_SEGMENTS must hold a sendMediaGroup of OUTBOX_BATCH_MAX photos");
+
+bool telegram_is_configured() {
+    return appSettings.telegramEnabled && strlen(appSettings.telegramBotToken) > 0 &&
+           strlen(appSettings.telegramChatId) > 0;
+}
+
+static bool telegram_configured() {
     if (!appSettings.telegramEnabled) return false;
-    if (strlen(appSettings.telegramBotToken) == 0 || strlen(appSettings.telegramChatId) == 0) {
+    if (!telegram_is_configured()) {
         Serial.println("[TELEGRAM] Token or Chat ID not configured.");
         return false;
     }
+    return true;
+}
 
-    WiFiClientSecure client;
-    client.setInsecure(); // Skip certificate validation to save RAM/time
-    HTTPClient http;
+static void url_encode(String &out, const char* s) {
+    static const char hex[] = "0123456789ABCDEF";
+    for (; *s; s++) {
+        uint8_t c = (uint8_t)*s;
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out += (char)c;
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+}
 
-    String url = String("https://") + TELEGRAM_API_HOST + "/bot" + appSettings.telegramBotToken + "/sendMessage";
-    url += "?chat_id=" + String(appSettings.telegramChatId);
-    url += "&text=" + String(message);
+bool telegram_send_message(const char* message) {
+    if (!telegram_configured()) return false;
+
+    String path = "/bot" + String(appSettings.telegramBotToken) + "/sendMessage?chat_id=";
+    url_encode(path, appSettings.telegramChatId);
+    path += "&text=";
+    url_encode(path, message);
 
     Serial.println("[TELEGRAM] Sending message...");
-    if (http.begin(client, url)) {
-        int httpCode = http.GET();
-        if (httpCode == HTTP_CODE_OK) {
-            Serial.println("[TELEGRAM] Message sent successfully.");
-            http.end();
-            return true;
-        } else {
-            Serial.printf("[TELEGRAM] Failed, error: %s\n", http.errorToString(httpCode).c_str());
-        }
-        http.end();
-    } else {
-        Serial.println("[TELEGRAM] Unable to connect");
+    HttpsResponse resp;
+    int status = https_request(TELEGRAM_API_HOST, TELEGRAM_API_PORT, "GET", path.c_str(), nullptr, &resp);
+    if (status == 200) {
+        Serial.println("[TELEGRAM] Message sent successfully.");
+        return true;
     }
+    Serial.printf("[TELEGRAM] Failed, HTTP status: %d\n", status);
     return false;
 }
 
 bool telegram_send_photo(camera_fb_t* fb) {
-    if (!appSettings.telegramEnabled) return false;
-    if (strlen(appSettings.telegramBotToken) == 0 || strlen(appSettings.telegramChatId) == 0) {
-        Serial.println("[TELEGRAM] Token or Chat ID not configured.");
+    if (!fb) {
+        Serial.println("[TELEGRAM] Invalid frame buffer.");
         return false;
     }
+    return telegram_send_jpeg(fb->buf, fb->len);
+}
 
-    if (!fb || fb->len == 0) {
+bool telegram_send_jpeg(const uint8_t* jpeg, size_t len) {
+    if (!jpeg || len == 0) {
         Serial.println("[TELEGRAM] Invalid frame buffer.");
         return false;
     }
+    return telegram_send_media(&jpeg, &len, nullptr, 1) == 200;
+}
 
-    WiFiClientSecure client;
-    client.setInsecure(); // Skip certificate validation
-    
-    if (!client.connect(TELEGRAM_API_HOST, TELEGRAM_API_PORT)) {
-        Serial.println("[TELEGRAM] Connection failed!");
-        return false;
+// Appends s as a JSON string body (without the quotes)
+static void json_escape(String &out, const char* s) {
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') out += '\\';
+        if ((uint8_t)*s >= 0x20) out += *s;
     }
+}
 
-    Serial.println("[TELEGRAM] Connected to server, preparing to send photo...");
-
-    String boundary = "----ESP32CAMBoundary" + String(millis());
-    String url = "/bot" + String(appSettings.telegramBotToken) + "/sendPhoto";
-
-    String head = "--" + boundary + "\r\n";
-    head += "Content-Disposition: form-data; name=\"chat_id\"\r\n\r\n";
-    head += String(appSettings.telegramChatId) + "\r\n";
-    head += "--" + boundary + "\r\n";
-    head += "Content-Disposition: form-data; name=\"photo\"; filename=\"snapshot.jpg\"\r\n";
-    head += "Content-Type: image/jpeg\r\n\r\n";
-
-    String tail = "\r\n--" + boundary + "--\r\n";
-
-    uint32_t contentLength = head.length() + fb->len + tail.length();
-
-    // Send HTTP POST headers
-    client.println("POST " + url + " HTTP/1.1");
-    client.println("Host: " + String(TELEGRAM_API_HOST));
-    client.println("Content-Length: " + String(contentLength));
-    client.println("Content-Type: multipart/form-data; boundary=" + boundary);
-    client.println();
-
-    // Send body head
-    client.print(head);
-
-    // Send image data in chunks to avoid memory issues
-    uint8_t *fbBuf = fb->buf;
-    size_t fbLen = fb->len;
-    for (size_t n = 0; n < fbLen; n += 1024) {
-        if (n + 1024 < fbLen) {
-            client.write(fbBuf, 1024);
-            fbBuf += 1024;
-        } else if (fbLen % 1024 > 0) {
-            size_t remainder = fbLen % 1024;
-            client.write(fbBuf, remainder);
-        }
+// The photos of one request: in memory, or files on fs read as they are sent
+struct TelegramPhotos {
+    const uint8_t* const* jpegs;
+    fs::FS* fs;
+    const char* const* paths;
+    const size_t* lens;
+};
+
+static void add_photo(HttpsMultipart* body, const TelegramPhotos& photos, size_t i, const char* part, const char* file) {
+    if (photos.jpegs) {
+        https_multipart_file(body, part, file, "image/jpeg", photos.jpegs[i], photos.lens[i]);
+    } else {
+        https_multipart_file(body, part, file, "image/jpeg", *photos.fs, photos.paths[i], photos.lens[i]);
     }
+}
 
-    // Send body tail
-    client.print(tail);
-
-    // Wait for response
-    int timeoutTimer = 10000;
-    long startTimer = millis();
-    bool state = false;
-    while ((startTimer + timeoutTimer) > millis()) {
-        Serial.print(".");
-        delay(100);      
-        while (client.available()) {
-            char c = client.read();
-            if (c == '\n') {
-                if (state) {
-                    Serial.println();
-                    Serial.println("[TELEGRAM] Photo sent successfully!");
-                    client.stop();
-                    return true;
-                }
-                state = true;
-            } else if (c != '\r') {
-                state = false;
+static int send_photos(const TelegramPhotos& photos, const char* const* captions, size_t count) {
+    if (!telegram_configured()) return 0;
+    if (count == 0 || count > TELEGRAM_MEDIA_GROUP_MAX) return 0;
+
+    // Streamed from where the photos sit: only part headers are formatted
+    HttpsMultipart body;
+    https_multipart_begin(&body);
+    https_multipart_field(&body, "chat_id", appSettings.telegramChatId);
+    String media;
+    if (count == 1) {
+        if (captions && captions[0]) https_multipart_field(&body, "caption", captions[0]);
+        add_photo(&body, photos, 0, "photo", "snapshot.jpg");
+    } else {
+        // sendMediaGroup: the photos are attached as parts p0..pN
+        media = "[";
+        for (size_t i = 0; i < count; i++) {
+            media += i ? ",{" : "{";
+            media += "\"type\":\"photo\",\"media\":\"attach://p" + String((unsigned)i) + "\"";
+            if (captions && captions[i]) {
+                media += ",\"caption\":\"";
+                json_escape(media, captions[i]);
+                media += "\"";
             }
+            media += "}";
         }
+        media += "]";
+        https_multipart_field(&body, "media", media.c_str());
+        for (size_t i = 0; i < count; i++) {
+            char part[8];
+            char file[12];
+            snprintf(part, sizeof(part), "p%u", (unsigned)i);
+            snprintf(file, sizeof(file), "p%u.jpg", (unsigned)i);
+            add_photo(&body, photos, i, part, file);
+        }
+    }
+    if (!https_multipart_end(&body)) {
+        Serial.println("[TELEGRAM] Request body too large.");
+        return HTTPS_BODY_TOO_LARGE;
     }
 
-    Serial.println();
-    Serial.println("[TELEGRAM] Time out waiting for response.");
-    client.stop();
-    return false;
+    String path = "/bot" + String(appSettings.telegramBotToken) + (count == 1 ? "/sendPhoto" : "/sendMediaGroup");
+
+    Serial.printf("[TELEGRAM] Sending %u photo(s)...\n", (unsigned)count);
+    HttpsResponse resp;
+    int status = https_request(TELEGRAM_API_HOST, TELEGRAM_API_PORT, "POST", path.c_str(), &body, &resp);
+    if (status == 200) {
+        Serial.println("[TELEGRAM] Photo sent successfully!");
+    } else {
+        Serial.printf("[TELEGRAM] Photo failed, HTTP status: %d\n", status);
+    }
+    return status;
+}
+
+int telegram_send_media(const uint8_t* const* jpegs, const size_t* lens, const char* const* captions, size_t count) {
+    return send_photos({jpegs, nullptr, nullptr, lens}, captions, count);
+}
+
+int telegram_send_files(fs::FS& fs, const char* const* paths, const size_t* lens, const char* const* captions, size_t count) {
+    return send_photos({nullptr, &fs, paths, lens}, captions, count);
 }
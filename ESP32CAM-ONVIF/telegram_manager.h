@@ -2,10 +2,29 @@
 
 #include "config.h"
 #include "esp_camera.h"
+#include <FS.h>
 
 // Send a captured frame as a photo to the configured Telegram chat
 // Returns true on success, false on failure
 bool telegram_send_photo(camera_fb_t* fb);
+bool telegram_send_jpeg(const uint8_t* jpeg, size_t len);
+
+// Telegram accepts 2-10 photos per sendMediaGroup
+#define TELEGRAM_MEDIA_GROUP_MAX 10
+// Caption length (with its NUL) a media group's body is sized for
+#define TELEGRAM_CAPTION_MAX 32
+
+// Sends count photos (sendPhoto for one, sendMediaGroup for several), each
+// with an optional caption (captions may be nullptr). Returns the HTTP
+// status: 200 on success, 0 when not configured or without a response,
+// HTTPS_BODY_TOO_LARGE when the request didn't fit (fewer photos might).
+// Motion photos reach this through the cloud outbox (cloud_outbox.h).
+int telegram_send_media(const uint8_t* const* jpegs, const size_t* lens, const char* const* captions, size_t count);
+// Same, with the photos streamed from files on fs while they are sent
+int telegram_send_files(fs::FS& fs, const char* const* paths, const size_t* lens, const char* const* captions, size_t count);
+
+// Enabled, with a bot token and chat ID
+bool telegram_is_configured();
 
 // Send a text message to the configured Telegram chat
 bool telegram_send_message(const char* message);
@@ -1,12 +1,21 @@
 #include "web_config.h"
-#include <WebServer.h>
 #include <WiFi.h>
 #include "index_html.h" // Inline HTML
 #include "rtsp_server.h"
 #include "onvif_server.h"
 #include "motion_detection.h"
+#include "event_queue.h"
 #include "auto_flash.h"
 #include "camera_control.h"
+#include "media_config.h"
+#include "frame_pipeline.h"
+#include "metrics.h"
+#include "heap_monitor.h"
+#include "task_manifest.h"
+#include "https_client.h"
+#include "cloud_outbox.h"
+#include "soap_writer.h"
+#include "http_engine.h"
 #include <FS.h>
 #include <SPIFFS.h>
 #include <SD_MMC.h>
@@ -18,6 +27,9 @@
 #include <HTTPClient.h>
 #include <WiFiClientSecure.h>
 #include <esp_task_wdt.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "mbedtls/base64.h"
 #include "sd_recorder.h"
 #include "mqtt_manager.h"
 #include "webdav_server.h"
@@ -28,17 +40,50 @@
 
 // PTZ Servo support (if enabled)
 #if PTZ_ENABLED
-  #include <ESP32Servo.h>
-  extern Servo servoPan;
-  extern Servo servoTilt;
+  #include "ptz_control.h"
 #endif
 
-WebServer webConfigServer(WEB_PORT);
+// Port 80 is served by the HTTP engine, next to ONVIF, from onvif_http_task.
+// Handlers run one at a time on that task.
 
 // Shared JSON response buffer (single-threaded, reused across API handlers)
 // Eliminates heap fragmentation from String concatenation
 static char s_jsonBuf[1024];
 
+// Lists of unknown length (SD files, recordings, events) are streamed
+// chunked through s_jsonBuf a block at a time instead of growing a String.
+// ctx is the HttpConn being answered.
+static void jsonSink(void *ctx, const char *data, size_t len) {
+    http_write(*(HttpConn *)ctx, data, len);
+}
+
+static void beginJsonStream(HttpConn &c) {
+    http_begin_response(c, 200, "application/json", HTTP_LENGTH_UNKNOWN);
+}
+
+// Quoted JSON string; file names and event messages may contain anything
+static void writeJsonString(SoapWriter &w, const char *str) {
+    w.write("\"", 1);
+    for (const char *p = str; *p; p++) {
+        char c = *p;
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', c};
+            w.write(esc, 2);
+        } else if ((uint8_t)c < 0x20) {
+            w.printf_P(PSTR("\\u%04x"), (unsigned)c);
+        } else {
+            w.write(p, 1);
+        }
+    }
+    w.write("\"", 1);
+}
+
+static bool isRecordingFile(const char *name) {
+    const char *ext = strrchr(name, '.');
+    return ext && (strcmp(ext, ".avi") == 0 || strcmp(ext, ".mp4") == 0 ||
+                   strcmp(ext, ".mjpeg") == 0);
+}
+
 // === SECURITY: Rate limiting ===
 #define MAX_AUTH_FAILURES 5
 #define AUTH_LOCKOUT_MS   60000  // 60 second lockout
@@ -53,56 +98,355 @@ static uint32_t s_minFreeHeap = UINT32_MAX;
 
 
 // Add security headers to prevent XSS, clickjacking, MIME sniffing
-static void addSecurityHeaders() {
-    webConfigServer.sendHeader("X-Content-Type-Options", "nosniff");
-    webConfigServer.sendHeader("X-Frame-Options", "SAMEORIGIN");
-    webConfigServer.sendHeader("X-XSS-Protection", "1; mode=block");
-    webConfigServer.sendHeader("Cache-Control", "no-store");
+static void addSecurityHeaders(HttpConn &c) {
+    http_add_header(c, "X-Content-Type-Options", "nosniff");
+    http_add_header(c, "X-Frame-Options", "SAMEORIGIN");
+    http_add_header(c, "X-XSS-Protection", "1; mode=block");
+    http_add_header(c, "Cache-Control", "no-store");
+}
+
+// HTTP Basic credentials of the request match WEB_USER / WEB_PASS
+static bool hasCredentials(HttpConn &c) {
+    char auth[128];
+    if (!http_header(c, "Authorization", auth, sizeof(auth)) ||
+        strncasecmp(auth, "Basic ", 6) != 0) {
+        return false;
+    }
+    unsigned char decoded[96];
+    size_t len = 0;
+    if (mbedtls_base64_decode(decoded, sizeof(decoded) - 1, &len,
+                              (const unsigned char *)auth + 6, strlen(auth + 6)) != 0) {
+        return false;
+    }
+    decoded[len] = '\0';
+    char expected[96];
+    snprintf(expected, sizeof(expected), "%s:%s", WEB_USER, WEB_PASS);
+    return strcmp((const char *)decoded, expected) == 0;
 }
 
-bool isAuthenticated(WebServer &server) {
+static bool authLockedOut() {
+    return s_authFailures >= MAX_AUTH_FAILURES && millis() - s_lockoutStart < AUTH_LOCKOUT_MS;
+}
+
+static void requestAuthentication(HttpConn &c) {
+    http_add_header(c, "WWW-Authenticate", "Basic realm=\"Login Required\"");
+    http_send(c, 401, "text/plain", "Unauthorized");
+}
+
+static bool isAuthenticated(HttpConn &c) {
     // Rate limiting: lockout after repeated failures
     if (s_authFailures >= MAX_AUTH_FAILURES) {
-        if (millis() - s_lockoutStart < AUTH_LOCKOUT_MS) {
-            server.send(429, "text/plain", "Too many attempts. Try again later.");
+        if (authLockedOut()) {
+            http_send(c, 429, "text/plain", "Too many attempts. Try again later.");
             return false;
         }
         s_authFailures = 0;  // Reset after lockout period
     }
-    if (!server.authenticate(WEB_USER, WEB_PASS)) {
+    if (!hasCredentials(c)) {
         s_authFailures++;
         if (s_authFailures >= MAX_AUTH_FAILURES) {
             s_lockoutStart = millis();
             Serial.println(F("[SECURITY] Auth lockout triggered"));
+            // Browsers fail once before asking for credentials: only a
+            // lockout is worth an event
+            event_auth_failure("web (lockout)");
         }
-        server.requestAuthentication();
+        requestAuthentication(c);
         return false;
     }
     s_authFailures = 0;  // Reset on success
-    addSecurityHeaders();
+    addSecurityHeaders(c);
     return true;
 }
 
+// === OTA Backend State & Preparation ===
+static volatile int ota_progress = -1;
+static String ota_status_msg = "";
+
+static void prepare_for_ota() {
+    Serial.println("[OTA] Preparing for OTA: Stopping services to free memory...");
+    sd_recorder_stop_manual();
+    // Stop camera to free massive framebuffers back to PSRAM/Heap
+    esp_camera_deinit();
+    delay(500);
+}
+
+// === GitHub Background OTA Task ===
+static void otaGithubTask(void *pvParameters) {
+    String url = String((char *)pvParameters);
+    free(pvParameters);
+    
+    ota_progress = 0;
+    ota_status_msg = "Connecting to GitHub...";
+    
+    WiFiClientSecure client;
+    client.setInsecure();
+    HTTPClient https;
+    https.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    https.setTimeout(30000); 
+    
+    if (https.begin(client, url)) {
+        int httpCode = https.GET();
+        if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_MOVED_PERMANENTLY) {
+            int contentLength = https.getSize();
+            if (contentLength <= 0) {
+                ota_status_msg = "Invalid content length";
+                ota_progress = -2;
+                https.end();
+                vTaskDelete(NULL);
+                return;
+            }
+            
+            if (Update.begin(contentLength, U_FLASH)) {
+                ota_status_msg = "Downloading firmware...";
+                WiFiClient *stream = https.getStreamPtr();
+                
+                uint8_t buff[1024];
+                size_t written = 0;
+                unsigned long lastDataTime = millis();
+                
+                while (https.connected() && written < contentLength) {
+                    size_t available = stream->available();
+                    if (available) {
+                        int c = stream->readBytes(buff, ((available > sizeof(buff)) ? sizeof(buff) : available));
+                        Update.write(buff, c);
+                        written += c;
+                        
+                        ota_progress = (written * 100) / contentLength;
+                        lastDataTime = millis();
+                        
+                        esp_task_wdt_reset();
+                        yield();
+                    } else {
+                        if (millis() - lastDataTime > 15000) {
+                            ota_status_msg = "Download timeout";
+                            ota_progress = -2;
+                            break;
+                        }
+                        delay(10);
+                    }
+                }
+                
+                if (written == contentLength) {
+                    if (Update.end(true)) {
+                        ota_progress = 100;
+                        ota_status_msg = "Update Complete. Rebooting...";
+                        delay(1000);
+                        ESP.restart();
+                    } else {
+                        ota_status_msg = "Update failed on end()";
+                        ota_progress = -2;
+                    }
+                } else {
+                    ota_status_msg = "Download incomplete";
+                    ota_progress = -2;
+                    Update.abort();
+                }
+            } else {
+                ota_status_msg = "Not enough space for OTA";
+                ota_progress = -2;
+            }
+        } else {
+            ota_status_msg = "Failed to download (HTTP " + String(httpCode) + ")";
+            ota_progress = -2;
+        }
+        https.end();
+    } else {
+        ota_status_msg = "Unable to connect to GitHub";
+        ota_progress = -2;
+    }
+    
+    vTaskDelete(NULL);
+}
+
+// === Browser upload ===
+// app.js posts the image as multipart/form-data: it lies between the part
+// header and the closing "\r\n--boundary". A body that isn't multipart is
+// taken as the raw image. Bytes that may be the start of the delimiter are
+// held back until the next piece settles it.
+static struct {
+    bool active;       // authorized, Update begun
+    bool done;         // closing delimiter seen, or the raw body complete
+    bool inData;       // past the part header
+    uint8_t headMatch; // "\r\n\r\n" bytes of the part header matched so far
+    char delim[80];    // "\r\n--" boundary
+    size_t delimLen;
+    uint8_t pending[1024 + 80];
+    size_t pendingLen;
+    size_t written;
+} s_ota;
+
+static void otaWrite(const uint8_t *data, size_t len) {
+    if (len && Update.write((uint8_t *)data, len) != len) {
+        Update.printError(Serial);
+    }
+    s_ota.written += len;
+}
+
+static void otaUploadBody(HttpConn &c, size_t offset, const uint8_t *data, size_t len) {
+    if (offset == 0) {
+        if (s_ota.active) Update.abort(); // an earlier upload that never finished
+        s_ota.active = !authLockedOut() && hasCredentials(c);
+        s_ota.done = false;
+        s_ota.written = 0;
+        s_ota.pendingLen = 0;
+        s_ota.headMatch = 0;
+        char type[128];
+        const char *b = http_header(c, "Content-Type", type, sizeof(type)) ? strstr(type, "boundary=") : nullptr;
+        if (b) {
+            b += 9;
+            size_t n = strcspn(b, "\";");
+            if (*b == '"') n = strcspn(++b, "\"");
+            s_ota.delimLen = snprintf(s_ota.delim, sizeof(s_ota.delim), "\r\n--%.*s", (int)n, b);
+            if (s_ota.delimLen >= sizeof(s_ota.delim)) s_ota.active = false;
+        } else {
+            s_ota.delimLen = 0;
+        }
+        s_ota.inData = s_ota.delimLen == 0;
+        if (!s_ota.active) return;
+        Serial.println("[OTA] Update upload started");
+        prepare_for_ota();
+        if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH)) {
+            Update.printError(Serial);
+        }
+    }
+    if (!s_ota.active || s_ota.done) return;
+
+    while (len && !s_ota.inData) {
+        static const char END[] = "\r\n\r\n";
+        s_ota.headMatch = *data == END[s_ota.headMatch] ? s_ota.headMatch + 1 : (*data == '\r');
+        s_ota.inData = s_ota.headMatch == 4;
+        data++;
+        len--;
+    }
+
+    if (s_ota.delimLen == 0) {
+        otaWrite(data, len);
+        s_ota.done = offset + len >= c.contentLength;
+        return;
+    }
+
+    while (len && !s_ota.done) {
+        size_t take = sizeof(s_ota.pending) - s_ota.pendingLen;
+        if (take > len) take = len;
+        memcpy(s_ota.pending + s_ota.pendingLen, data, take);
+        s_ota.pendingLen += take;
+        data += take;
+        len -= take;
+
+        uint8_t *end = (uint8_t *)memmem(s_ota.pending, s_ota.pendingLen, s_ota.delim, s_ota.delimLen);
+        if (end) {
+            otaWrite(s_ota.pending, end - s_ota.pending);
+            s_ota.done = true;
+            break;
+        }
+        size_t keep = s_ota.pendingLen < s_ota.delimLen - 1 ? s_ota.pendingLen : s_ota.delimLen - 1;
+        otaWrite(s_ota.pending, s_ota.pendingLen - keep);
+        memmove(s_ota.pending, s_ota.pending + s_ota.pendingLen - keep, keep);
+        s_ota.pendingLen = keep;
+    }
+}
+
+// One /stream viewer, on the socket taken over from the HTTP engine
+static void mjpegStreamTask(void *arg) {
+    int fd = (int)(intptr_t)arg;
+
+    // Low timeout for writes (2s) so a stalled viewer can't hold a frame buffer
+    struct timeval tv = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // Security: restrict CORS to same-origin (no wildcard)
+    static const char header[] = "HTTP/1.1 200 OK\r\n"
+                                 "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+                                 "X-Content-Type-Options: nosniff\r\n"
+                                 "\r\n";
+    bool ok = send(fd, header, sizeof(header) - 1, 0) == (int)sizeof(header) - 1;
+    Serial.println("[INFO] MJPEG Stream started");
+
+    int64_t last_frame = 0;
+    const int frame_interval = 100; // 100ms = ~10 FPS
+
+    while (ok) {
+        if (heap_monitor_level() >= HEAP_SHED_VIEWER) {
+            Serial.println("[WARN] MJPEG Stream shed: low memory");
+            break;
+        }
+
+        int64_t now = esp_timer_get_time() / 1000;
+        if (now - last_frame < frame_interval) {
+            delay(frame_interval - (now - last_frame));
+            continue;
+        }
+        last_frame = now;
+
+        uint32_t t0 = metrics_cycles();
+        camera_fb_t *fb = esp_camera_fb_get();
+        metrics_record_cycles(MT_FB_HTTP, t0);
+        if (!fb) {
+            Serial.println("[WARN] Frame buffer failed");
+            delay(100);
+            continue;
+        }
+
+        metrics_frame(MC_HTTP_STREAM, MF_CAPTURED);
+        size_t dataLen = fb->len; // Cache before releasing!
+        char part[96];
+        int hlen = snprintf(part, sizeof(part),
+                            "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
+                            (unsigned)dataLen);
+        size_t wlen = 0;
+        if (send(fd, part, hlen, 0) == hlen) {
+            while (wlen < dataLen) {
+                int n = send(fd, fb->buf + wlen, dataLen - wlen, 0);
+                if (n <= 0) break;
+                wlen += n;
+            }
+        }
+        esp_camera_fb_return(fb); // Release immediately
+        ok = wlen == dataLen && send(fd, "\r\n", 2, 0) == 2;
+        metrics_frame(MC_HTTP_STREAM, ok ? MF_SENT : MF_DROPPED);
+
+        if (!ok) {
+            Serial.printf("[WARN] Stream write failed (Sent %u of %u bytes). Client disconnected?\n",
+                          (unsigned)wlen, (unsigned)dataLen);
+        }
+    }
+
+    close(fd);
+    Serial.println("[INFO] MJPEG Stream stopped");
+    s_streamActive = false;
+    vTaskDelete(NULL);
+}
+
 void web_config_start() {
     // SPIFFS no longer required for index.html, but still needed for SD/Config persistence if used
     if (!SPIFFS.begin(true)) {
         Serial.println("[WARN] SPIFFS Mount Failed - Configs might not save");
     }
 
+    if (!http_engine_listen(WEB_PORT)) {
+        Serial.println("[WARN] Web config server: port busy");
+        return;
+    }
+
     // Serving Embedded HTML
-    webConfigServer.on("/", HTTP_GET, []() {
-        if (!webConfigServer.authenticate(WEB_USER, WEB_PASS)) {
-           return webConfigServer.requestAuthentication();
+    http_engine_on(WEB_PORT, "/", VERB_GET, [](HttpConn &c) {
+        if (!hasCredentials(c)) {
+           return requestAuthentication(c);
         }
-        webConfigServer.sendHeader("Content-Encoding", "gzip");
-        webConfigServer.send_P(200, "text/html", (const char*)index_html_gz, index_html_gz_len);
+        http_add_header(c, "Content-Encoding", "gzip");
+        http_send(c, 200, "text/html", (const char*)index_html_gz, index_html_gz_len);
     });
 
     // --- API ENDPOINTS ---
-    webConfigServer.on("/api/status", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/status", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         uint32_t freeHeap = ESP.getFreeHeap();
         uint32_t maxBlock = ESP.getMaxAllocHeap();
+        static char heapJson[512];
+        heap_monitor_json(heapJson, sizeof(heapJson));
+        HttpsStats https;
+        https_stats(&https);
         snprintf(s_jsonBuf, sizeof(s_jsonBuf),
             "{\"status\":\"Online\","
             "\"rtsp\":\"%s\","
@@ -117,7 +461,12 @@ void web_config_start() {
             "\"psram_free\":%u,"
             "\"uptime\":%lu,"
             "\"rssi\":%d,"
-            "\"autoflash\":%s}",
+            "\"autoflash\":%s,"
+            "\"rate\":{\"quality_drop\":%u,\"interval_ms\":%u,"
+            "\"steps\":%u,\"reason\":\"%s\"},"
+            "\"https\":{\"open\":%u,\"handshakes\":%u,\"reused\":%u,"
+            "\"refused\":%u,\"failed\":%u},"
+            "\"heap_monitor\":%s}",
             getRTSPUrl().c_str(),
             WiFi.localIP().toString().c_str(), ONVIF_PORT,
             onvif_is_enabled() ? "true" : "false",
@@ -130,17 +479,59 @@ void web_config_start() {
             ESP.getFreePsram(),
             millis() / 1000,
             WiFi.RSSI(),
-            auto_flash_is_enabled() ? "true" : "false");
-        webConfigServer.send(200, "application/json", s_jsonBuf);
+            auto_flash_is_enabled() ? "true" : "false",
+            rtsp_rate_state().qualityDrop,
+            (unsigned)rtsp_rate_state().intervalMs,
+            (unsigned)rtsp_rate_state().steps,
+            rate_control_reason_str(rtsp_rate_state().reason),
+            https.open, (unsigned)https.handshakes, (unsigned)https.reused,
+            (unsigned)https.refused, (unsigned)https.failed,
+            heapJson);
+        http_send(c, 200, "application/json", s_jsonBuf);
+    });
+
+    // --- RTSP pipeline stage timings (histograms in microseconds) ---
+    http_engine_on(WEB_PORT, "/api/pipeline", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        static char pipelineBuf[1536];
+        frame_pipeline_stats_json(pipelineBuf, sizeof(pipelineBuf));
+        http_send(c, 200, "application/json", pipelineBuf);
+    });
+
+    http_engine_on(WEB_PORT, "/api/pipeline", VERB_DELETE, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        frame_pipeline_reset_stats();
+        http_send(c, 200, "application/json", "{\"ok\":1}");
+    });
+
+    // --- Prometheus scrape endpoint (latency histograms, frame counters) ---
+    http_engine_on(WEB_PORT, "/metrics", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        http_begin_response(c, 200, "text/plain; version=0.0.4", HTTP_LENGTH_UNKNOWN);
+        metrics_write_prometheus(jsonSink, &c);
+    });
+
+    // --- Task placement and CPU share per task / cooperative subtask ---
+    http_engine_on(WEB_PORT, "/api/tasks", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        beginJsonStream(c);
+        task_stats_write_json(jsonSink, &c);
+    });
+
+    // --- Cloud outbox: snapshots waiting for Telegram / Drive ---
+    http_engine_on(WEB_PORT, "/api/outbox", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        cloud_outbox_json(s_jsonBuf, sizeof(s_jsonBuf));
+        http_send(c, 200, "application/json", s_jsonBuf);
     });
 
     // --- Change Camera Settings ---
-    webConfigServer.on("/api/config", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/config", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<256> doc;
-        DeserializationError err = deserializeJson(doc, webConfigServer.arg("plain"));
+        DeserializationError err = deserializeJson(doc, c.body, c.bodyLen);
         if (err) {
-            webConfigServer.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+            http_send(c, 400, "application/json", "{\"error\":\"Invalid JSON\"}");
             return;
         }
         sensor_t * s = esp_camera_sensor_get();
@@ -178,68 +569,72 @@ void web_config_start() {
         if (doc.containsKey("hmirror"))     s->set_hmirror(s, doc["hmirror"]);
         if (doc.containsKey("vflip"))       s->set_vflip(s, doc["vflip"]);
         if (doc.containsKey("dcw"))         s->set_dcw(s, doc["dcw"]);
-        webConfigServer.send(200, "application/json", "{\"ok\":1}");
+        media_config_adopt_sensor();
+        onvif_bump_config_epoch();
+        http_send(c, 200, "application/json", "{\"ok\":1}");
     });
 
     // --- SD Card File List ---
-    webConfigServer.on("/api/sd/list", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
-        String json = "[";
+    http_engine_on(WEB_PORT, "/api/sd/list", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        beginJsonStream(c);
+        SoapWriter w(s_jsonBuf, sizeof(s_jsonBuf), jsonSink, &c);
+        w.write("[", 1);
         File root = SD_MMC.open("/");
         File file = root.openNextFile();
         bool first = true;
         while(file){
-            if (!first) json += ",";
-            json += "\"" + String(file.name()) + "\"";
+            if (!first) w.write(",", 1);
+            writeJsonString(w, file.name());
             file = root.openNextFile();
             first = false;
         }
-        json += "]";
-        webConfigServer.send(200, "application/json", json);
+        w.write("]", 1);
+        w.flush();
     });
 
     // --- SD Card Download ---
     // CSS and JS are now inline in index.html, no need to serve files
     // But keep stream logic etc.
-    webConfigServer.on("/api/sd/download", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
-        if (!webConfigServer.hasArg("file")) {
-            webConfigServer.send(400, "text/plain", "Missing file param");
+    http_engine_on(WEB_PORT, "/api/sd/download", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        char name[96];
+        if (!http_query_arg(c, "file", name, sizeof(name))) {
+            http_send(c, 400, "text/plain", "Missing file param");
             return;
         }
-        String filename = "/" + webConfigServer.arg("file");
+        String filename = "/" + String(name);
         File file = SD_MMC.open(filename, "r");
         if (!file) {
-            webConfigServer.send(404, "text/plain", "File not found");
+            http_send(c, 404, "text/plain", "File not found");
             return;
         }
-        webConfigServer.streamFile(file, "application/octet-stream");
-        file.close();
+        http_send_file(c, 200, "application/octet-stream", file);
     });
 
     // --- SD Card Delete ---
-    webConfigServer.on("/api/sd/delete", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/sd/delete", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<128> doc;
-        DeserializationError err = deserializeJson(doc, webConfigServer.arg("plain"));
+        DeserializationError err = deserializeJson(doc, c.body, c.bodyLen);
         if (err || !doc.containsKey("file")) {
-            webConfigServer.send(400, "application/json", "{\"error\":\"Invalid request\"}");
+            http_send(c, 400, "application/json", "{\"error\":\"Invalid request\"}");
             return;
         }
         String filename = "/" + doc["file"].as<String>();
         if (SD_MMC.remove(filename)) {
-            webConfigServer.send(200, "application/json", "{\"ok\":1}");
+            http_send(c, 200, "application/json", "{\"ok\":1}");
         } else {
-            webConfigServer.send(404, "application/json", "{\"error\":\"Delete failed\"}");
+            http_send(c, 404, "application/json", "{\"error\":\"Delete failed\"}");
         }
     });
 
     // --- SD Recording Trigger ---
-    webConfigServer.on("/api/record", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/record", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         StaticJsonDocument<128> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         String action = doc["action"];
         
         if (action == "start") {
@@ -248,69 +643,69 @@ void web_config_start() {
             sd_recorder_stop_manual();
         }
         
-        webConfigServer.send(200, "application/json", "{\"ok\":1}");
+        http_send(c, 200, "application/json", "{\"ok\":1}");
     });
 
     // --- Flash Control ---
-    webConfigServer.on("/api/flash", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/flash", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<64> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         bool state = doc["state"];
         
         // If manual control is used, disable auto flash temporarily (or user should toggle it off first)
         // But for simplicity, we just set the LED.
         set_flash_led(state);
-        webConfigServer.send(200, "application/json", "{}");
+        http_send(c, 200, "application/json", "{}");
     });
     
-    webConfigServer.on("/api/autoflash", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/autoflash", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<64> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         bool enabled = doc["enabled"];
         auto_flash_set_enabled(enabled);
-        webConfigServer.send(200, "application/json", "{}");
+        http_send(c, 200, "application/json", "{}");
     });
     
     // --- ONVIF Enable/Disable ---
-    webConfigServer.on("/api/onvif/toggle", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/onvif/toggle", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<64> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         bool enabled = doc["enabled"];
         onvif_set_enabled(enabled);
-        webConfigServer.send(200, "application/json", "{}");
+        http_send(c, 200, "application/json", "{}");
     });
 
     // --- Reboot (GET - legacy) ---
-    webConfigServer.on("/reboot", []() {
-        if (!isAuthenticated(webConfigServer)) return;
-        webConfigServer.send(200, "application/json", "{\"ok\":1, \"msg\":\"Rebooting...\"}");
+    http_engine_on(WEB_PORT, "/reboot", VERB_ANY, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        http_send(c, 200, "application/json", "{\"ok\":1, \"msg\":\"Rebooting...\"}");
         delay(500);
         ESP.restart();
     });
 
     // --- Reboot (POST - proper REST API) ---
-    webConfigServer.on("/api/reboot", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
-        webConfigServer.send(200, "application/json", "{\"ok\":1, \"msg\":\"Rebooting...\"}");
+    http_engine_on(WEB_PORT, "/api/reboot", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        http_send(c, 200, "application/json", "{\"ok\":1, \"msg\":\"Rebooting...\"}");
         delay(500);
         ESP.restart();
     });
 
     // --- Factory Reset (stub) ---
-    webConfigServer.on("/api/factory_reset", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/factory_reset", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         // Reset settings logic here
-        webConfigServer.send(200, "application/json", "{\"ok\":1}");
+        http_send(c, 200, "application/json", "{\"ok\":1}");
         ESP.restart();
     });
 
 
 
-    webConfigServer.on("/api/system/info", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/system/info", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         sensor_t * s = esp_camera_sensor_get();
         framesize_t res = s->status.framesize;
@@ -361,20 +756,20 @@ void web_config_start() {
             flash_size, sketch_size, flash_size - sketch_size,
             psram_size, psram_free);
         
-        webConfigServer.send(200, "application/json", infoBuf);
+        http_send(c, 200, "application/json", infoBuf);
     });
     
     // --- Camera Quality Presets ---
-    webConfigServer.on("/api/camera/presets", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/camera/presets", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         String json = "{\"presets\":[\"Low\",\"Medium\",\"High\",\"Ultra\"]}";
-        webConfigServer.send(200, "application/json", json);
+        http_send(c, 200, "application/json", json.c_str());
     });
     
-    webConfigServer.on("/api/camera/preset", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/camera/preset", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<64> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         String preset = doc["preset"];
         
         sensor_t * s = esp_camera_sensor_get();
@@ -400,13 +795,15 @@ void web_config_start() {
             s->set_brightness(s, 0);
             s->set_contrast(s, 0);
         }
+        media_config_adopt_sensor();
+        onvif_bump_config_epoch();
         
-        webConfigServer.send(200, "application/json", "{\"ok\":1}");
+        http_send(c, 200, "application/json", "{\"ok\":1}");
     });
     
     // --- SD Card Information ---
-    webConfigServer.on("/api/sd/info", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/sd/info", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         uint64_t cardSize = SD_MMC.cardSize();
         uint64_t cardUsed = SD_MMC.usedBytes();
@@ -428,39 +825,34 @@ void web_config_start() {
         json += "\"file_count\":" + String(fileCount);
         json += "}";
         
-        webConfigServer.send(200, "application/json", json);
+        http_send(c, 200, "application/json", json.c_str());
     });
     
     // --- PTZ Control (if enabled) ---
     #if PTZ_ENABLED
-    webConfigServer.on("/api/ptz/control", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/ptz/control", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<128> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         
         if (doc.containsKey("action") && doc["action"] == "home") {
-            servoPan.write(90);   // Center
-            servoTilt.write(90);  // Center
+            ptz_goto_degrees(0, 0, 1.0f);  // Center
         } else {
-            if (doc.containsKey("pan")) {
-                int angle = doc["pan"];
-                angle = constrain(angle + 90, PTZ_PAN_MIN + 90, PTZ_PAN_MAX + 90);
-                servoPan.write(angle);
-            }
-            if (doc.containsKey("tilt")) {
-                int angle = doc["tilt"];
-                angle = constrain(angle + 90, PTZ_TILT_MIN + 90, PTZ_TILT_MAX + 90);
-                servoTilt.write(angle);
-            }
+            // Angles from centre; an axis not given stays where it is
+            PtzStatus st;
+            ptz_get_status(&st);
+            float pan = doc.containsKey("pan") ? doc["pan"].as<float>() : st.panDeg;
+            float tilt = doc.containsKey("tilt") ? doc["tilt"].as<float>() : st.tiltDeg;
+            ptz_goto_degrees(pan, tilt, 1.0f);
         }
         
-        webConfigServer.send(200, "application/json", "{\"ok\":1}");
+        http_send(c, 200, "application/json", "{\"ok\":1}");
     });
     #endif
     
     // --- Settings Export ---
-    webConfigServer.on("/api/settings/export", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/settings/export", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         sensor_t * s = esp_camera_sensor_get();
         
@@ -496,19 +888,19 @@ void web_config_start() {
         
         json += "}";
         
-        webConfigServer.sendHeader("Content-Disposition", "attachment; filename=esp32cam-config.json");
-        webConfigServer.send(200, "application/json", json);
+        http_add_header(c, "Content-Disposition", "attachment; filename=esp32cam-config.json");
+        http_send(c, 200, "application/json", json.c_str());
     });
     
     // --- Settings Import ---
-    webConfigServer.on("/api/settings/import", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/settings/import", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         StaticJsonDocument<1024> doc;
-        DeserializationError err = deserializeJson(doc, webConfigServer.arg("plain"));
+        DeserializationError err = deserializeJson(doc, c.body, c.bodyLen);
         
         if (err) {
-            webConfigServer.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+            http_send(c, 400, "application/json", "{\"error\":\"Invalid JSON\"}");
             return;
         }
         
@@ -551,25 +943,27 @@ void web_config_start() {
             saveSettings();
         }
         #endif
+        media_config_adopt_sensor();
+        onvif_bump_config_epoch();
         
-        webConfigServer.send(200, "application/json", "{\"ok\":1}");
+        http_send(c, 200, "application/json", "{\"ok\":1}");
     });
 
     // ==================== CAMERA PROFILES ====================
     // --- List Profiles ---
-    webConfigServer.on("/api/profiles", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/profiles", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         String json = "{\"profiles\":[\"Default\",\"Daytime\",\"Night\",\"Indoor\",\"Outdoor\"]}";
-        webConfigServer.send(200, "application/json", json);
+        http_send(c, 200, "application/json", json.c_str());
     });
     
     // --- Save Profile ---
-    webConfigServer.on("/api/profiles/save", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/profiles/save", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         StaticJsonDocument<512> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         String profileName = doc["name"];
         
         sensor_t * s = esp_camera_sensor_get();
@@ -595,24 +989,24 @@ void web_config_start() {
         if (file) {
             file.print(profileJson);
             file.close();
-            webConfigServer.send(200, "application/json", "{\"ok\":1}");
+            http_send(c, 200, "application/json", "{\"ok\":1}");
         } else {
-            webConfigServer.send(500, "application/json", "{\"error\":\"Failed to save\"}");
+            http_send(c, 500, "application/json", "{\"error\":\"Failed to save\"}");
         }
     });
     
     // --- Load Profile ---
-    webConfigServer.on("/api/profiles/load", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/profiles/load", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         StaticJsonDocument<128> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         String profileName = doc["name"];
         
         // Load from SPIFFS
         File file = SPIFFS.open("/profiles/" + profileName + ".json", "r");
         if (!file) {
-            webConfigServer.send(404, "application/json", "{\"error\":\"Profile not found\"}");
+            http_send(c, 404, "application/json", "{\"error\":\"Profile not found\"}");
             return;
         }
         
@@ -637,123 +1031,108 @@ void web_config_start() {
         if (profile.containsKey("agc")) s->set_gain_ctrl(s, profile["agc"]);
         if (profile.containsKey("hmirror")) s->set_hmirror(s, profile["hmirror"]);
         if (profile.containsKey("vflip")) s->set_vflip(s, profile["vflip"]);
+        media_config_adopt_sensor();
+        onvif_bump_config_epoch();
         
-        webConfigServer.send(200, "application/json", "{\"ok\":1,\"profile\":" + profileJson + "}");
+        http_send(c, 200, "application/json", ("{\"ok\":1,\"profile\":" + profileJson + "}").c_str());
     });
     
     // --- Delete Profile ---
-    webConfigServer.on("/api/profiles/delete", HTTP_DELETE, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/profiles/delete", VERB_DELETE, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         StaticJsonDocument<128> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         String profileName = doc["name"];
         
         if (SPIFFS.remove("/profiles/" + profileName + ".json")) {
-            webConfigServer.send(200, "application/json", "{\"ok\":1}");
+            http_send(c, 200, "application/json", "{\"ok\":1}");
         } else {
-            webConfigServer.send(404, "application/json", "{\"error\":\"Profile not found\"}");
+            http_send(c, 404, "application/json", "{\"error\":\"Profile not found\"}");
         }
     });
 
     // ==================== EVENT LOG ====================
-    #define MAX_EVENTS 50
-    struct LogEvent {
-        unsigned long timestamp;
-        char type[12];       // "boot", "motion", "error", etc. (was heap-allocated String)
-        char message[64];    // Fixed buffer, no heap fragmentation (was heap-allocated String)
-    };
-    static LogEvent eventLog[MAX_EVENTS];
-    static int eventCount = 0;
-    static int eventIndex = 0;
-    
-    // Helper to add event
-    auto addEvent = [](const char* type, const char* message) {
-        eventLog[eventIndex].timestamp = millis();
-        strncpy(eventLog[eventIndex].type, type, sizeof(eventLog[eventIndex].type) - 1);
-        eventLog[eventIndex].type[sizeof(eventLog[eventIndex].type) - 1] = '\0';
-        strncpy(eventLog[eventIndex].message, message, sizeof(eventLog[eventIndex].message) - 1);
-        eventLog[eventIndex].message[sizeof(eventLog[eventIndex].message) - 1] = '\0';
-        eventIndex = (eventIndex + 1) % MAX_EVENTS;
-        if (eventCount < MAX_EVENTS) eventCount++;
-    };
-    
+    // Backed by the shared event_queue ring (also feeds ONVIF and MQTT).
+    // Clearing only moves this log's start; other consumers are unaffected.
+    static uint32_t eventLogStart = 0;
+
     // --- Get Events ---
-    webConfigServer.on("/api/events", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/events", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
-        String json = "{\"events\":[";
+        beginJsonStream(c);
+        SoapWriter w(s_jsonBuf, sizeof(s_jsonBuf), jsonSink, &c);
+        w.write_P(PSTR("{\"events\":["));
         
-        int start = (eventIndex - eventCount + MAX_EVENTS) % MAX_EVENTS;
-        for (int i = 0; i < eventCount; i++) {
-            int idx = (start + i) % MAX_EVENTS;
-            if (i > 0) json += ",";
-            json += "{";
-            json += "\"timestamp\":" + String(eventLog[idx].timestamp) + ",";
-            json += "\"type\":\"" + String(eventLog[idx].type) + "\",";
-            json += "\"message\":\"" + String(eventLog[idx].message) + "\"";
-            json += "}";
+        uint32_t cursor = eventLogStart;
+        CamEvent ev;
+        bool first = true;
+        while (event_queue_next(&cursor, &ev)) {
+            w.printf_P(PSTR("%s{\"timestamp\":%lu,\"type\":\"%s\",\"message\":"),
+                       first ? "" : ",", (unsigned long)ev.timestampMs,
+                       event_type_str(ev.type));
+            writeJsonString(w, ev.message);
+            w.write("}", 1);
+            first = false;
         }
         
-        json += "]}";
-        webConfigServer.send(200, "application/json", json);
+        w.write_P(PSTR("]}"));
+        w.flush();
     });
     
     // --- Clear Events ---
-    webConfigServer.on("/api/events", HTTP_DELETE, []() {
-        if (!isAuthenticated(webConfigServer)) return;
-        eventCount = 0;
-        eventIndex = 0;
-        webConfigServer.send(200, "application/json", "{\"ok\":1}");
+    http_engine_on(WEB_PORT, "/api/events", VERB_DELETE, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        eventLogStart = event_queue_head();
+        http_send(c, 200, "application/json", "{\"ok\":1}");
     });
     
     // Log system boot event
-    addEvent("boot", "System started");
+    event_queue_push(EVENT_BOOT, false, "System started");
 
     // ==================== VIDEO RECORDINGS ====================
     // --- List Recordings ---
-    webConfigServer.on("/api/recordings", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/recordings", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
-        String json = "{\"recordings\":[";
+        beginJsonStream(c);
+        SoapWriter w(s_jsonBuf, sizeof(s_jsonBuf), jsonSink, &c);
+        w.write_P(PSTR("{\"recordings\":["));
         File root = SD_MMC.open("/");
         File file = root.openNextFile();
         bool first = true;
         
         while(file) {
-            if (!file.isDirectory()) {
-                String fname = String(file.name());
-                if (fname.endsWith(".avi") || fname.endsWith(".mp4") || fname.endsWith(".mjpeg")) {
-                    if (!first) json += ",";
-                    json += "{";
-                    json += "\"name\":\"" + fname + "\",";
-                    json += "\"size\":" + String(file.size()) + ",";
-                    json += "\"time\":" + String(file.getLastWrite());
-                    json += "}";
-                    first = false;
-                }
+            if (!file.isDirectory() && isRecordingFile(file.name())) {
+                w.printf_P(PSTR("%s{\"name\":"), first ? "" : ",");
+                writeJsonString(w, file.name());
+                w.printf_P(PSTR(",\"size\":%u,\"time\":%ld}"),
+                           (unsigned)file.size(), (long)file.getLastWrite());
+                first = false;
             }
             file = root.openNextFile();
         }
         
-        json += "]}";
-        webConfigServer.send(200, "application/json", json);
+        w.write_P(PSTR("]}"));
+        w.flush();
     });
     
     // --- Stream Recording ---
-    webConfigServer.on("/api/recordings/stream", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/recordings/stream", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
-        if (!webConfigServer.hasArg("file")) {
-            webConfigServer.send(400, "text/plain", "Missing file param");
+        char name[96];
+        if (!http_query_arg(c, "file", name, sizeof(name))) {
+            http_send(c, 400, "text/plain", "Missing file param");
             return;
         }
         
-        String filename = "/" + webConfigServer.arg("file");
+        String filename = "/" + String(name);
         File file = SD_MMC.open(filename, "r");
         
         if (!file) {
-            webConfigServer.send(404, "text/plain", "File not found");
+            http_send(c, 404, "text/plain", "File not found");
             return;
         }
         
@@ -761,55 +1140,50 @@ void web_config_start() {
         if (filename.endsWith(".mp4")) contentType = "video/mp4";
         else if (filename.endsWith(".mjpeg")) contentType = "video/x-motion-jpeg";
         
-        webConfigServer.streamFile(file, contentType);
-        file.close();
+        http_send_file(c, 200, contentType.c_str(), file);
     });
     
     // --- Delete Recording ---
-    webConfigServer.on("/api/recordings/delete", HTTP_DELETE, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/recordings/delete", VERB_DELETE, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         StaticJsonDocument<128> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         String filename = "/" + doc["file"].as<String>();
         
         if (SD_MMC.remove(filename)) {
-            webConfigServer.send(200, "application/json", "{\"ok\":1}");
+            http_send(c, 200, "application/json", "{\"ok\":1}");
         } else {
-            webConfigServer.send(404, "application/json", "{\"error\":\"Delete failed\"}");
+            http_send(c, 404, "application/json", "{\"error\":\"Delete failed\"}");
         }
     });
 
     // ==================== NETWORK DIAGNOSTICS ====================
     // --- Ping Test ---
-    webConfigServer.on("/api/network/ping", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/network/ping", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         snprintf(s_jsonBuf, sizeof(s_jsonBuf),
             "{\"timestamp\":%lu,\"rssi\":%d,\"ip\":\"%s\"}",
             millis(), WiFi.RSSI(), WiFi.localIP().toString().c_str());
-        webConfigServer.send(200, "application/json", s_jsonBuf);
+        http_send(c, 200, "application/json", s_jsonBuf);
     });
     
     // --- Bandwidth Test ---
-    webConfigServer.on("/api/network/bandwidth-test", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
-        
-        size_t dataSize = webConfigServer.arg("plain").length();
-        unsigned long timestamp = millis();
-        
-        String json = "{";
-        json += "\"bytes_received\":" + String(dataSize) + ",";
-        json += "\"timestamp\":" + String(timestamp);
-        json += "}";
+    http_engine_on(WEB_PORT, "/api/network/bandwidth-test", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
-        webConfigServer.send(200, "application/json", json);
+        size_t dataSize = c.bodyLen;
+        snprintf(s_jsonBuf, sizeof(s_jsonBuf),
+            "{\"bytes_received\":%u,\"timestamp\":%lu}",
+            (unsigned)dataSize, millis());
+        http_send(c, 200, "application/json", s_jsonBuf);
     });
 
     // --- Time Sync API ---
-    webConfigServer.on("/api/time", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/time", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<64> doc;
-        deserializeJson(doc, webConfigServer.arg("plain"));
+        deserializeJson(doc, c.body, c.bodyLen);
         long epoch = doc["epoch"];
         if(epoch > 0) {
             struct timeval tv;
@@ -817,25 +1191,25 @@ void web_config_start() {
             tv.tv_usec = 0;
             settimeofday(&tv, NULL); 
             Serial.println("[INFO] Time set via Web");
-            webConfigServer.send(200, "application/json", "{\"ok\":1}");
+            http_send(c, 200, "application/json", "{\"ok\":1}");
         } else {
-             webConfigServer.send(400, "application/json", "{\"error\":\"Invalid time\"}");
+             http_send(c, 400, "application/json", "{\"error\":\"Invalid time\"}");
         }
     });
     // --- WiFi API Endpoints ---
-    webConfigServer.on("/api/wifi/status", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/wifi/status", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         snprintf(s_jsonBuf, sizeof(s_jsonBuf),
             "{\"connected\":%s,\"ssid\":\"%s\",\"ip\":\"%s\",\"mode\":\"%s\"}",
             WiFi.status() == WL_CONNECTED ? "true" : "false",
             wifiManager.getSSID().c_str(),
             wifiManager.getLocalIP().toString().c_str(),
             wifiManager.isInAPMode() ? "AP" : "STA");
-        webConfigServer.send(200, "application/json", s_jsonBuf);
+        http_send(c, 200, "application/json", s_jsonBuf);
     });
     
-    webConfigServer.on("/api/wifi/scan", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/wifi/scan", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         int networksFound = wifiManager.scanNetworks();
         WiFiNetwork* networks = wifiManager.getScannedNetworks();
@@ -851,17 +1225,17 @@ void web_config_start() {
         }
         json += "]}";
         
-        webConfigServer.send(200, "application/json", json);
+        http_send(c, 200, "application/json", json.c_str());
     });
     
-    webConfigServer.on("/api/wifi/connect", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/wifi/connect", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         StaticJsonDocument<256> doc;
-        DeserializationError err = deserializeJson(doc, webConfigServer.arg("plain"));
+        DeserializationError err = deserializeJson(doc, c.body, c.bodyLen);
         
         if (err || !doc.containsKey("ssid") || !doc.containsKey("password")) {
-            webConfigServer.send(400, "application/json", "{\"success\":false,\"message\":\"Invalid request\"}");
+            http_send(c, 400, "application/json", "{\"success\":false,\"message\":\"Invalid request\"}");
             return;
         }
         
@@ -874,121 +1248,66 @@ void web_config_start() {
             bool connected = wifiManager.connectToNetwork(ssid, password);
             
             if (connected) {
-                webConfigServer.send(200, "application/json", "{\"success\":true,\"message\":\"Connected\"}");
+                http_send(c, 200, "application/json", "{\"success\":true,\"message\":\"Connected\"}");
                 
                 // Optional: schedule a restart after a short delay to ensure response is sent
                 delay(1000);
                 ESP.restart();
             } else {
-                webConfigServer.send(200, "application/json", "{\"success\":false,\"message\":\"Failed to connect\"}");
+                http_send(c, 200, "application/json", "{\"success\":false,\"message\":\"Failed to connect\"}");
             }
         } else {
-            webConfigServer.send(500, "application/json", "{\"success\":false,\"message\":\"Failed to save credentials\"}");
+            http_send(c, 500, "application/json", "{\"success\":false,\"message\":\"Failed to save credentials\"}");
         }
     });
 
     // === STREAM ENDPOINT ===
-    webConfigServer.on("/stream", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    // The MJPEG stream never ends: its connection goes to a task of its own
+    // so the engine keeps serving the UI, the API and ONVIF
+    http_engine_on(WEB_PORT, "/stream", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+
+        // Guard: the heap monitor sheds this viewer first under memory pressure
+        if (heap_monitor_level() >= HEAP_SHED_VIEWER) {
+            http_send(c, 503, "text/plain", "Stream unavailable - low memory");
+            return;
+        }
 
         // Guard: only one concurrent stream client
         if (s_streamActive) {
-            webConfigServer.send(503, "text/plain", "Stream busy - another client is connected");
+            http_send(c, 503, "text/plain", "Stream busy - another client is connected");
             return;
         }
         s_streamActive = true;
-        
-        WiFiClient client = webConfigServer.client();
-        
-        // Security: restrict CORS to same-origin (removed wildcard)
-        String response = "HTTP/1.1 200 OK\r\n";
-        response += "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n";
-        response += "X-Content-Type-Options: nosniff\r\n";
-        response += "\r\n";
-        client.print(response);
 
-        Serial.println("[INFO] MJPEG Stream started");
-        
-        // Optimize TCP for streaming
-        client.setTimeout(2); // Set low timeout for writes (2s) to prevent blocking
-        
-        int64_t last_frame = 0;
-        const int frame_interval = 100; // 100ms = ~10 FPS
-
-        while (client.connected()) {
-            // CRITICAL: Feed the Watchdog Timer so the ESP32 doesn't reboot
-            esp_task_wdt_reset();
-            
-            // Keep critical background tasks alive (God Loop Pattern)
-            rtsp_server_loop();   
-            onvif_server_loop();
-            
-            int64_t now = esp_timer_get_time() / 1000;
-            if (now - last_frame < frame_interval) {
-                // Yield to allow WiFi stack to process
-                yield(); 
-                delay(10); // Sleep 10ms to save CPU
-                continue;
-            }
-            last_frame = now;
-
-            camera_fb_t *fb = esp_camera_fb_get();
-            if (!fb) {
-                Serial.println("[WARN] Frame buffer failed");
-                delay(100);
-                continue;
-            }
-            
-            // Send buffer using chunked writes if needed, but client.write handles it.
-            // Check if we can write to avoid stalling on full buffer
-            // (Standard Client doesn't expose availableForWrite easily on all cores, but write() is blocking with timeout)
-            
-            size_t dataLen = fb->len; // Cache before releasing!
-            size_t hlen = client.printf("--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", dataLen);
-            
-            // Implement chunked write to prevent WiFiClient buffer drops on large frames
-            size_t wlen = 0;
-            const size_t chunkSize = 2048;
-            for (size_t i = 0; i < dataLen; i += chunkSize) {
-                size_t toWrite = (dataLen - i < chunkSize) ? (dataLen - i) : chunkSize;
-                size_t written = client.write(fb->buf + i, toWrite);
-                if (written != toWrite) {
-                    break;
-                }
-                wlen += written;
-            }
-            
-            client.print("\r\n");
-            
-            esp_camera_fb_return(fb); // Release immediately
-            
-            if (wlen != dataLen) {
-                 Serial.printf("[WARN] Stream write failed (Sent %u of %u bytes). Client disconnected?\n", wlen, dataLen);
-                 break;
-            }
+        int fd = http_detach(c);
+        if (!task_spawn(TASK_MJPEG, mjpegStreamTask, nullptr, (void *)(intptr_t)fd)) {
+            Serial.println("[WARN] MJPEG Stream: no task");
+            close(fd);
+            s_streamActive = false;
         }
-        
-        Serial.println("[INFO] MJPEG Stream stopped");
-        s_streamActive = false;
     });
 
     // --- Snapshot endpoint ---
-    webConfigServer.on("/snapshot", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/snapshot", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        uint32_t t0 = metrics_cycles();
         camera_fb_t *fb = esp_camera_fb_get();
+        metrics_record_cycles(MT_FB_HTTP, t0);
         if (!fb) {
-            webConfigServer.send(500, "text/plain", "Camera Error");
+            http_send(c, 500, "text/plain", "Camera Error");
             return;
         }
-        webConfigServer.sendHeader("Content-Type", "image/jpeg");
-        webConfigServer.send_P(200, "image/jpeg", (char*)fb->buf, fb->len);
+        metrics_frame(MC_SNAPSHOT, MF_CAPTURED);
+        http_send(c, 200, "image/jpeg", (const char*)fb->buf, fb->len);
         esp_camera_fb_return(fb);
+        metrics_frame(MC_SNAPSHOT, MF_SENT);
     });
 
     // --- Bluetooth Endpoints ---
     #ifdef BLUETOOTH_ENABLED
-    webConfigServer.on("/api/bt/status", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/bt/status", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         String json = "{";
         json += "\"enabled\":" + String(appSettings.btEnabled ? "true" : "false") + ",";
         json += "\"stealth\":" + String(appSettings.btStealthMode ? "true" : "false") + ",";
@@ -998,15 +1317,15 @@ void web_config_start() {
         json += "\"gain\":" + String(appSettings.btMicGain) + ",";
         json += "\"timeout\":" + String(appSettings.btPresenceTimeout);
         json += "}";
-        webConfigServer.send(200, "application/json", json);
+        http_send(c, 200, "application/json", json.c_str());
     });
 
-    webConfigServer.on("/api/bt/config", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/bt/config", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<256> doc;
-        DeserializationError err = deserializeJson(doc, webConfigServer.arg("plain"));
+        DeserializationError err = deserializeJson(doc, c.body, c.bodyLen);
         if (err) {
-            webConfigServer.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+            http_send(c, 400, "application/json", "{\"error\":\"Invalid JSON\"}");
             return;
         }
         
@@ -1026,179 +1345,42 @@ void web_config_start() {
         // If enabling BT, start it
         if (appSettings.btEnabled) btManager.begin();
         
-        webConfigServer.send(200, "application/json", "{\"ok\":1}");
+        http_send(c, 200, "application/json", "{\"ok\":1}");
     });
 
-    webConfigServer.on("/api/bt/scan", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/bt/scan", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         // Trigger scan if not enabled?
         // Return latest cache
-        webConfigServer.send(200, "application/json", btManager.getLastScanResult());
+        http_send(c, 200, "application/json", btManager.getLastScanResult().c_str());
     });
     #endif // BLUETOOTH_ENABLED
     
-    // === OTA Backend State & Preparation ===
-    static volatile int ota_progress = -1;
-    static String ota_status_msg = "";
-
-    auto prepare_for_ota = []() {
-        Serial.println("[OTA] Preparing for OTA: Stopping services to free memory...");
-        sd_recorder_stop_manual();
-        // Stop camera to free massive framebuffers back to PSRAM/Heap
-        esp_camera_deinit();
-        delay(500); 
-    };
-
-    // === GitHub Background OTA Task ===
-    auto otaGithubTask = [](void *pvParameters) {
-        String url = String((char *)pvParameters);
-        free(pvParameters);
-        
-        ota_progress = 0;
-        ota_status_msg = "Connecting to GitHub...";
-        
-        WiFiClientSecure client;
-        client.setInsecure();
-        HTTPClient https;
-        https.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-        https.setTimeout(30000); 
-        
-        if (https.begin(client, url)) {
-            int httpCode = https.GET();
-            if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_MOVED_PERMANENTLY) {
-                int contentLength = https.getSize();
-                if (contentLength <= 0) {
-                    ota_status_msg = "Invalid content length";
-                    ota_progress = -2;
-                    https.end();
-                    vTaskDelete(NULL);
-                    return;
-                }
-                
-                if (Update.begin(contentLength, U_FLASH)) {
-                    ota_status_msg = "Downloading firmware...";
-                    WiFiClient *stream = https.getStreamPtr();
-                    
-                    uint8_t buff[1024];
-                    size_t written = 0;
-                    unsigned long lastDataTime = millis();
-                    
-                    while (https.connected() && written < contentLength) {
-                        size_t available = stream->available();
-                        if (available) {
-                            int c = stream->readBytes(buff, ((available > sizeof(buff)) ? sizeof(buff) : available));
-                            Update.write(buff, c);
-                            written += c;
-                            
-                            ota_progress = (written * 100) / contentLength;
-                            lastDataTime = millis();
-                            
-                            esp_task_wdt_reset();
-                            yield();
-                        } else {
-                            if (millis() - lastDataTime > 15000) {
-                                ota_status_msg = "Download timeout";
-                                ota_progress = -2;
-                                break;
-                            }
-                            delay(10);
-                        }
-                    }
-                    
-                    if (written == contentLength) {
-                        if (Update.end(true)) {
-                            ota_progress = 100;
-                            ota_status_msg = "Update Complete. Rebooting...";
-                            delay(1000);
-                            ESP.restart();
-                        } else {
-                            ota_status_msg = "Update failed on end()";
-                            ota_progress = -2;
-                        }
-                    } else {
-                        ota_status_msg = "Download incomplete";
-                        ota_progress = -2;
-                        Update.abort();
-                    }
-                } else {
-                    ota_status_msg = "Not enough space for OTA";
-                    ota_progress = -2;
-                }
-            } else {
-                ota_status_msg = "Failed to download (HTTP " + String(httpCode) + ")";
-                ota_progress = -2;
-            }
-            https.end();
-        } else {
-            ota_status_msg = "Unable to connect to GitHub";
-            ota_progress = -2;
-        }
-        
-        vTaskDelete(NULL);
-    };
-
-    // === OTA Backend State & Preparation ===
-    static volatile int ota_progress = -1;
-    static String ota_status_msg = "";
-    static String ota_status_detail = "";
-
-    auto prepare_for_ota = []() {
-        Serial.println("[OTA] Preparing for OTA: Stopping services to free memory...");
-        sd_recorder_stop_manual();
-        // Stop camera to free massive framebuffers back to PSRAM/Heap
-        esp_camera_deinit();
-        delay(500);
-    };
-
     // === OTA Firmware Update (with authentication) ===
-    webConfigServer.on("/api/update", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
-        HTTPUpload& upload = webConfigServer.upload();
-        if (upload.status == UPLOAD_FILE_START) {
-            Serial.printf("[OTA] Update: %s\n", upload.filename.c_str());
-            prepare_for_ota();
-            if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH)) {
-                Update.printError(Serial);
-            }
-        } else if (upload.status == UPLOAD_FILE_WRITE) {
-            if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-                Update.printError(Serial);
-            }
-        } else if (upload.status == UPLOAD_FILE_END) {
-            if (Update.end(true)) {
-                Serial.printf("[OTA] Success: %u bytes\n", upload.totalSize);
-            } else {
-                Update.printError(Serial);
-            }
+    // The firmware goes to flash as it arrives (otaUploadBody); the request
+    // itself only carries the verdict
+    http_engine_on_upload(WEB_PORT, "/api/update", VERB_POST, otaUploadBody, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
+        bool ok = s_ota.active && s_ota.done && Update.end(true);
+        if (ok) {
+            Serial.printf("[OTA] Success: %u bytes\n", (unsigned)s_ota.written);
+        } else {
+            Update.printError(Serial);
+            if (s_ota.active) Update.abort();
         }
-    }, [prepare_for_ota]() {
-        // Auth check on upload start
-        if (!webConfigServer.authenticate(WEB_USER, WEB_PASS)) {
+        s_ota.active = false;
+        if (!ok) {
+            http_send(c, 500, "application/json", "{\"error\":\"Update failed\"}");
             return;
         }
-        HTTPUpload& upload = webConfigServer.upload();
-        if (upload.status == UPLOAD_FILE_START) {
-            Serial.printf("[OTA] Update: %s\n", upload.filename.c_str());
-            prepare_for_ota();
-            if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH)) {
-                Update.printError(Serial);
-            }
-        } else if (upload.status == UPLOAD_FILE_WRITE) {
-            if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-                Update.printError(Serial);
-            }
-        } else if (upload.status == UPLOAD_FILE_END) {
-            if (Update.end(true)) {
-                Serial.printf("[OTA] Success: %u bytes\n", upload.totalSize);
-            } else {
-                Update.printError(Serial);
-            }
-        }
+        http_send(c, 200, "application/json", "{\"ok\":1, \"msg\":\"Rebooting...\"}");
+        delay(500);
+        ESP.restart();
     });
 
     // === GitHub OTA Check ===
-    webConfigServer.on("/api/update/check", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/update/check", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         WiFiClientSecure client;
         client.setInsecure(); // GitHub API requires HTTPS. Using insecure for simplicity/memory.
@@ -1234,33 +1416,33 @@ void web_config_start() {
                     response += "\"download_url\":\"" + downloadUrl + "\"";
                     response += "}";
                     
-                    webConfigServer.send(200, "application/json", response);
+                    http_send(c, 200, "application/json", response.c_str());
                 } else {
-                    webConfigServer.send(500, "application/json", "{\"error\":\"Failed to parse GitHub response\"}");
+                    http_send(c, 500, "application/json", "{\"error\":\"Failed to parse GitHub response\"}");
                 }
             } else {
-                webConfigServer.send(500, "application/json", "{\"error\":\"Failed to fetch from GitHub: " + String(httpCode) + "\"}");
+                http_send(c, 500, "application/json", ("{\"error\":\"Failed to fetch from GitHub: " + String(httpCode) + "\"}").c_str());
             }
             https.end();
         } else {
-            webConfigServer.send(500, "application/json", "{\"error\":\"Unable to connect to GitHub API\"}");
+            http_send(c, 500, "application/json", "{\"error\":\"Unable to connect to GitHub API\"}");
         }
     });
 
     // === GitHub OTA Download & Install (Async) ===
-    webConfigServer.on("/api/update/github", HTTP_POST, [prepare_for_ota, otaGithubTask]() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/update/github", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         if (ota_progress >= 0 && ota_progress < 100) {
-            webConfigServer.send(400, "application/json", "{\"error\":\"Update already in progress\"}");
+            http_send(c, 400, "application/json", "{\"error\":\"Update already in progress\"}");
             return;
         }
 
         StaticJsonDocument<512> doc;
-        DeserializationError err = deserializeJson(doc, webConfigServer.arg("plain"));
+        DeserializationError err = deserializeJson(doc, c.body, c.bodyLen);
         
         if (err || !doc.containsKey("url")) {
-            webConfigServer.send(400, "application/json", "{\"error\":\"Missing download URL\"}");
+            http_send(c, 400, "application/json", "{\"error\":\"Missing download URL\"}");
             return;
         }
         
@@ -1274,25 +1456,25 @@ void web_config_start() {
         
         xTaskCreate(otaGithubTask, "otaTask", 8192, (void *)urlStr, 1, NULL);
         
-        webConfigServer.send(200, "application/json", "{\"success\":true, \"message\":\"Downloading firmware in background\"}");
+        http_send(c, 200, "application/json", "{\"success\":true, \"message\":\"Downloading firmware in background\"}");
     });
 
     // === OTA Status Polling ===
-    webConfigServer.on("/api/update/status", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/update/status", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         
         String response = "{";
         response += "\"progress\":" + String(ota_progress) + ",";
         response += "\"message\":\"" + ota_status_msg + "\"";
         response += "}";
         
-        webConfigServer.send(200, "application/json", response);
+        http_send(c, 200, "application/json", response.c_str());
     });
 
 
     // === Integration Settings (MQTT + Telegram) ===
-    webConfigServer.on("/api/settings", HTTP_GET, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/settings", VERB_GET, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<1024> doc;
         doc["btEnabled"] = appSettings.btEnabled;
         doc["btStealth"] = appSettings.btStealthMode;
@@ -1324,15 +1506,15 @@ void web_config_start() {
 
         String response;
         serializeJson(doc, response);
-        webConfigServer.send(200, "application/json", response);
+        http_send(c, 200, "application/json", response.c_str());
     });
 
-    webConfigServer.on("/api/settings", HTTP_POST, []() {
-        if (!isAuthenticated(webConfigServer)) return;
+    http_engine_on(WEB_PORT, "/api/settings", VERB_POST, [](HttpConn &c) {
+        if (!isAuthenticated(c)) return;
         StaticJsonDocument<1024> doc;
-        DeserializationError err = deserializeJson(doc, webConfigServer.arg("plain"));
+        DeserializationError err = deserializeJson(doc, c.body, c.bodyLen);
         if (err) {
-            webConfigServer.send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+            http_send(c, 400, "application/json", "{\"error\":\"Invalid JSON\"}");
             return;
         }
 
@@ -1365,26 +1547,19 @@ void web_config_start() {
         if(doc.containsKey("tz")) strncpy(appSettings.timeZone, doc["tz"], sizeof(appSettings.timeZone) - 1);
 
         saveSettings();
-        webConfigServer.send(200, "application/json", "{\"success\":true,\"message\":\"Settings Saved\"}");
+        http_send(c, 200, "application/json", "{\"success\":true,\"message\":\"Settings Saved\"}");
     });
 
     // --- WebDAV Integration ---
-    const char * headerkeys[] = {"Depth"};
-    size_t headerkeyssize = sizeof(headerkeys) / sizeof(char*);
-    webConfigServer.collectHeaders(headerkeys, headerkeyssize);
-    webdav_server_init(&webConfigServer);
+    webdav_server_init(WEB_PORT);
 
-    webConfigServer.begin();
-        Serial.println("[INFO] Web config server started.");
-    }
+    Serial.println("[INFO] Web config server started.");
 }
 
 void web_config_loop() {
-        webConfigServer.handleClient();
-        
-        // Track heap low-water mark for fragmentation monitoring
-        uint32_t freeHeap = ESP.getFreeHeap();
-        if (freeHeap < s_minFreeHeap) {
-            s_minFreeHeap = freeHeap;
-        }
-    }
\ No newline at end of file
+    // Track heap low-water mark for fragmentation monitoring
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < s_minFreeHeap) {
+        s_minFreeHeap = freeHeap;
+    }
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "webdav_server.h"
 #include "config.h"
+#include "http_engine.h"
 #include "sd_recorder.h"
 #include <SD_MMC.h>
 
@@ -10,130 +11,126 @@ static const char* XML2 = "<D:response xmlns:D=\"DAV:\"><D:href>";
 static const char* XML3 = "</D:href><D:propstat><D:status>HTTP/1.1 200 OK</D:status><D:prop>";
 static const char* XML4 = "</D:prop></D:propstat></D:response>";
 
-static void sendContentProp(WebServer* server, const char* prop, const char* value) {
+static void sendContent(HttpConn& conn, const char* text) {
+    http_write(conn, text, strlen(text));
+}
+
+static void sendContentProp(HttpConn& conn, const char* prop, const char* value) {
     char propStr[256];
     snprintf(propStr, sizeof(propStr), "<D:%s>%s</D:%s>", prop, value, prop);
-    server->sendContent(propStr);
+    sendContent(conn, propStr);
 }
 
-static void sendPropResponse(WebServer* server, File& file, String basePath) {
+static void sendPropResponse(HttpConn& conn, File& file, String basePath) {
     String href = String(WEBDAV_PREFIX) + basePath + file.name();
     if (file.isDirectory() && !href.endsWith("/")) {
         href += "/";
     }
 
-    server->sendContent(XML2);
-    server->sendContent(href);
-    server->sendContent(XML3);
+    sendContent(conn, XML2);
+    sendContent(conn, href.c_str());
+    sendContent(conn, XML3);
 
     // Provide some dummy dates for simplicity, or get from file if available
-    sendContentProp(server, "getlastmodified", "Thu, 01 Jan 1970 00:00:00 GMT");
-    sendContentProp(server, "creationdate", "1970-01-01T00:00:00Z");
+    sendContentProp(conn, "getlastmodified", "Thu, 01 Jan 1970 00:00:00 GMT");
+    sendContentProp(conn, "creationdate", "1970-01-01T00:00:00Z");
 
     if (file.isDirectory()) {
-        server->sendContent("<D:resourcetype><D:collection/></D:resourcetype>");
+        sendContent(conn, "<D:resourcetype><D:collection/></D:resourcetype>");
     } else {
-        server->sendContent("<D:resourcetype/>");
+        sendContent(conn, "<D:resourcetype/>");
         char fsizeStr[32];
         snprintf(fsizeStr, sizeof(fsizeStr), "%u", file.size());
-        sendContentProp(server, "getcontentlength", fsizeStr);
-        sendContentProp(server, "getcontenttype", "application/octet-stream");
+        sendContentProp(conn, "getcontentlength", fsizeStr);
+        sendContentProp(conn, "getcontenttype", "application/octet-stream");
     }
     
-    sendContentProp(server, "displayname", file.name());
-    server->sendContent(XML4);
+    sendContentProp(conn, "displayname", file.name());
+    sendContent(conn, XML4);
 }
 
-void webdav_server_init(WebServer* server) {
-    // We bind a catch-all handler for the /webdav prefix
-    server->onNotFound([server]() {
-        if (!appSettings.webDavEnabled) {
-            server->send(403, "text/plain", "WebDAV Disabled");
+static void handle_webdav(HttpConn& conn) {
+    if (!appSettings.webDavEnabled) {
+        http_send(conn, 403, "text/plain", "WebDAV Disabled");
+        return;
+    }
+
+    String uri = conn.path;
+    if (!uri.startsWith(WEBDAV_PREFIX)) {
+        http_send(conn, 404, "text/plain", "Not Found");
+        return;
+    }
+
+    // Map /webdav to /recordings on SD Card
+    String sdPath = uri.substring(strlen(WEBDAV_PREFIX));
+    if (sdPath == "" || sdPath == "/") {
+        sdPath = "/recordings";
+    } else {
+        sdPath = "/recordings" + sdPath;
+    }
+
+    if (conn.verb == VERB_OPTIONS) {
+        http_add_header(conn, "Allow", "OPTIONS, PROPFIND, GET");
+        http_add_header(conn, "DAV", "1");
+        http_send(conn, 200, "text/plain", "");
+        return;
+    }
+
+    // Simple GET (Download)
+    if (conn.verb == VERB_GET) {
+        if (!SD_MMC.exists(sdPath)) {
+            http_send(conn, 404, "text/plain", "File Not Found");
             return;
         }
-
-        String uri = server->uri();
-        if (!uri.startsWith(WEBDAV_PREFIX)) {
-            server->send(404, "text/plain", "Not Found");
+        File f = SD_MMC.open(sdPath, "r");
+        if (!f || f.isDirectory()) {
+            http_send(conn, 400, "text/plain", "Invalid File");
+            if (f) f.close();
             return;
         }
+        http_send_file(conn, 200, "application/octet-stream", f);
+        return;
+    }
 
-        // Map /webdav to /recordings on SD Card
-        String sdPath = uri.substring(strlen(WEBDAV_PREFIX));
-        if (sdPath == "" || sdPath == "/") {
-            sdPath = "/recordings";
-        } else {
-            sdPath = "/recordings" + sdPath;
-        }
+    // Everything else is answered as PROPFIND, the only other verb a
+    // read-only WebDAV client sends
+    if (!SD_MMC.exists(sdPath)) {
+        http_send(conn, 404, "text/plain", "Not Found");
+        return;
+    }
 
-        int method = server->method();
+    File root = SD_MMC.open(sdPath);
+    if (!root) {
+        http_send(conn, 500, "text/plain", "FS Error");
+        return;
+    }
 
-        if (method == HTTP_OPTIONS) {
-            server->sendHeader("Allow", "OPTIONS, PROPFIND, GET");
-            server->sendHeader("DAV", "1");
-            server->send(200);
-            return;
-        }
+    http_begin_response(conn, 207, "application/xml;charset=utf-8", HTTP_LENGTH_UNKNOWN);
+    sendContent(conn, XML1);
 
-        if (method == HTTP_ANY) { // WebServer maps PROPFIND to HTTP_ANY if unknown
-            // Actually, Arduino WebServer might not expose method enum for PROPFIND.
-            // We check method string or just assume PROPFIND if not GET.
-        }
+    // Return details for the requested path itself
+    String basePath = uri.substring(strlen(WEBDAV_PREFIX));
+    if (basePath != "" && !basePath.endsWith("/")) basePath += "/";
 
-        // Simple GET (Download)
-        if (method == HTTP_GET) {
-            if (!SD_MMC.exists(sdPath)) {
-                server->send(404, "text/plain", "File Not Found");
-                return;
-            }
-            File f = SD_MMC.open(sdPath, "r");
-            if (!f || f.isDirectory()) {
-                server->send(400, "text/plain", "Invalid File");
-                if (f) f.close();
-                return;
-            }
-            server->streamFile(f, "application/octet-stream");
-            f.close();
-            return;
-        }
+    sendPropResponse(conn, root, "/"); // The root folder
 
-        // Handle PROPFIND (method() == HTTP_ANY, method string usually handled internally)
-        // Arduino's WebServer enum has HTTP_PROPFIND? Wait, it depends on the ESP32 core version.
-        // Let's just respond to PROPFIND. We check if the request body or headers imply PROPFIND.
-        
-        if (!SD_MMC.exists(sdPath)) {
-            server->send(404, "text/plain", "Not Found");
-            return;
+    // If Depth: 1 (or default), list children
+    char depth[8];
+    if (!http_header(conn, "Depth", depth, sizeof(depth))) depth[0] = '\0';
+    if (strcmp(depth, "0") != 0 && root.isDirectory()) {
+        File entry = root.openNextFile();
+        while (entry && !conn.broken) {
+            sendPropResponse(conn, entry, basePath);
+            entry.close();
+            entry = root.openNextFile();
         }
+    }
 
-        File root = SD_MMC.open(sdPath);
-        if (!root) {
-            server->send(500, "text/plain", "FS Error");
-            return;
-        }
+    root.close();
+    sendContent(conn, "</D:multistatus>");
+}
 
-        server->setContentLength(CONTENT_LENGTH_UNKNOWN);
-        server->send(207, "application/xml;charset=utf-8", XML1);
-        
-        // Return details for the requested path itself
-        String basePath = uri.substring(strlen(WEBDAV_PREFIX));
-        if (basePath != "" && !basePath.endsWith("/")) basePath += "/";
-        
-        sendPropResponse(server, root, "/"); // The root folder
-        
-        // If Depth: 1 (or default), list children
-        String depth = server->header("Depth");
-        if (depth != "0" && root.isDirectory()) {
-            File entry = root.openNextFile();
-            while (entry) {
-                sendPropResponse(server, entry, basePath);
-                entry.close();
-                entry = root.openNextFile();
-            }
-        }
-        
-        root.close();
-        server->sendContent("</D:multistatus>");
-        server->sendContent(""); // End chunked response
-    });
+void webdav_server_init(uint16_t port) {
+    // A catch-all handler: /webdav has no fixed paths
+    http_engine_on_not_found(port, handle_webdav);
 }
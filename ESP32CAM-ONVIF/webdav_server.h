@@ -1,5 +1,7 @@
 #pragma once
 
-#include <WebServer.h>
+#include <stdint.h>
 
-void webdav_server_init(WebServer* server);
+// Serves /webdav (the SD card's /recordings) as the not-found handler of
+// an http_engine port
+void webdav_server_init(uint16_t port);
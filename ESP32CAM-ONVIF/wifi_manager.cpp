@@ -4,6 +4,7 @@
 #include "config.h"
 #include "status_led.h"
 #include "onvif_server.h"
+#include "event_queue.h"
 #include <esp_wifi.h> // For esp_wifi_set_ps
 
 // RTC Data for Fast Reconnect
@@ -17,6 +18,9 @@ RTC_DATA_ATTR bool     rtc_valid = false;
 // Global instance
 WiFiManager wifiManager;
 
+// Link state from the previous loop() pass, used to detect the reconnect edge
+static bool s_wasConnected = true;
+
 WiFiManager::WiFiManager() : _apMode(false), _scannedNetworksCount(0), _scannedNetworks(nullptr), _lastConnectAttempt(0), _lastConnectedTime(0) {
 }
 
@@ -29,9 +33,9 @@ void WiFiManager::loop() {
         _lastConnectedTime = millis(); // Refresh timestamp
         
         // Handle post-reconnect state
-        static bool _wasConnected = true;
-        if (!_wasConnected) {
-            _wasConnected = true;
+        if (!s_wasConnected) {
+            s_wasConnected = true;
+            event_queue_push(EVENT_WIFI, true, "WiFi reconnected");
             Serial.println("[INFO] Re-broadcasting ONVIF WS-Discovery...");
             onvif_reconnect(); 
         }
@@ -39,10 +43,8 @@ void WiFiManager::loop() {
         status_led_error();
         
         // Track disconnection
-        static bool _wasConnected = true;
-        if (_wasConnected) {
-            _wasConnected = false;
-        }
+        if (s_wasConnected) event_queue_push(EVENT_WIFI, false, "WiFi lost");
+        s_wasConnected = false;
 
         unsigned long now = millis();
         
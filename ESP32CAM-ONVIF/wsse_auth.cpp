@@ -0,0 +1,299 @@
+#include "wsse_auth.h"
+#include "config.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+#include <string.h>
+
+// Tokens stay remembered for as long as their <Created> could still pass the
+// freshness check (it may be up to one skew window in the future). Before the
+// clock is set <Created> can't be checked at all, so entries don't expire
+// until it is.
+static const uint32_t TOKEN_TTL_MS = WSSE_MAX_CLOCK_SKEW_S * 2UL * 1000UL;
+
+// 2020-01-01: anything earlier means NTP/SetSystemDateAndTime hasn't run yet
+static const time_t CLOCK_VALID_EPOCH = 1577836800;
+
+struct TokenEntry {
+  uint8_t digest[20];
+  uint64_t fingerprint; // FNV-1a of raw nonce + Created
+  uint32_t clientIp;
+  uint32_t seenMs;
+  bool used;
+};
+
+static TokenEntry s_tokens[WSSE_NONCE_CACHE_SIZE];
+
+// Namespace prefixes seen in the wild (Hikvision, Dahua, ODM, onvif-zeep...)
+static const char *const XML_PREFIXES[] = {"wsse:", "wsu:", "",
+                                           "ns1:",  "ns2:", "sec:"};
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Finds <prefix:name ...>value</prefix:name> after `from` and returns the
+// whitespace-trimmed value span, pointing into the request.
+static bool find_element(const char *from, const char *name, const char **val,
+                         size_t *len) {
+  char open[32];
+  char close[36];
+
+  for (size_t i = 0; i < sizeof(XML_PREFIXES) / sizeof(XML_PREFIXES[0]); i++) {
+    int openLen = snprintf(open, sizeof(open), "<%s%s", XML_PREFIXES[i], name);
+    snprintf(close, sizeof(close), "</%s%s>", XML_PREFIXES[i], name);
+
+    const char *p = from;
+    while ((p = strstr(p, open)) != nullptr) {
+      // Reject partial matches such as <UsernameToken when seeking <Username
+      char next = p[openLen];
+      if (next != '>' && next != '/' && !is_space(next)) {
+        p++;
+        continue;
+      }
+      const char *gt = strchr(p, '>');
+      if (!gt || gt[-1] == '/')
+        return false; // truncated or empty element
+      const char *start = gt + 1;
+      const char *end = strstr(start, close);
+      if (!end)
+        return false;
+      while (start < end && is_space(*start))
+        start++;
+      while (end > start && is_space(end[-1]))
+        end--;
+      *val = start;
+      *len = end - start;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t fnv1a64(uint64_t h, const uint8_t *data, size_t len) {
+  while (len--) {
+    h ^= *data++;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static bool digest_equal(const uint8_t *a, const uint8_t *b) {
+  // Constant time: no early exit on the first differing byte
+  uint8_t diff = 0;
+  for (int i = 0; i < 20; i++)
+    diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+static bool entry_live(const TokenEntry &e, uint32_t nowMs, bool clockValid) {
+  return e.used &&
+         (!clockValid || (uint32_t)(nowMs - e.seenMs) < TOKEN_TTL_MS);
+}
+
+static uint32_t slot_of(const uint8_t *digest) {
+  // SHA-1 output is uniform, its first bytes make a fine hash
+  uint32_t h = digest[0] | (digest[1] << 8) | (digest[2] << 16) |
+               ((uint32_t)digest[3] << 24);
+  return h % WSSE_NONCE_CACHE_SIZE;
+}
+
+static TokenEntry *token_lookup(const uint8_t *digest, uint32_t nowMs,
+                                bool clockValid) {
+  uint32_t idx = slot_of(digest);
+  for (int i = 0; i < WSSE_NONCE_CACHE_SIZE; i++) {
+    TokenEntry &e = s_tokens[(idx + i) % WSSE_NONCE_CACHE_SIZE];
+    if (!e.used)
+      return nullptr; // end of probe chain
+    if (entry_live(e, nowMs, clockValid) && digest_equal(e.digest, digest))
+      return &e;
+  }
+  return nullptr;
+}
+
+// Returns false when every slot holds a token remembered before the clock was
+// set: evicting one would let it be replayed.
+static bool token_insert(const uint8_t *digest, uint64_t fingerprint,
+                         uint32_t clientIp, uint32_t nowMs, bool clockValid) {
+  uint32_t idx = slot_of(digest);
+  TokenEntry *victim = nullptr;
+  uint32_t oldestAge = 0;
+
+  for (int i = 0; i < WSSE_NONCE_CACHE_SIZE; i++) {
+    TokenEntry &e = s_tokens[(idx + i) % WSSE_NONCE_CACHE_SIZE];
+    if (!entry_live(e, nowMs, clockValid)) {
+      victim = &e;
+      break;
+    }
+    if (!clockValid)
+      continue;
+    uint32_t age = nowMs - e.seenMs;
+    if (age >= oldestAge) {
+      oldestAge = age;
+      victim = &e;
+    }
+  }
+  if (!victim)
+    return false;
+  // Expired slots are reused in place, so a probe chain never has holes that
+  // hide live entries behind an unused slot.
+  memcpy(victim->digest, digest, 20);
+  victim->fingerprint = fingerprint;
+  victim->clientIp = clientIp;
+  victim->seenMs = nowMs;
+  victim->used = true;
+  return true;
+}
+
+void wsse_reset_cache() { memset(s_tokens, 0, sizeof(s_tokens)); }
+
+static int parse_digits(const char *s, int n) {
+  int v = 0;
+  for (int i = 0; i < n; i++) {
+    if (s[i] < '0' || s[i] > '9')
+      return -1;
+    v = v * 10 + (s[i] - '0');
+  }
+  return v;
+}
+
+bool wsse_parse_datetime(const char *s, size_t len, time_t *out) {
+  // YYYY-MM-DDTHH:MM:SS
+  if (len < 19 || s[4] != '-' || s[7] != '-' || (s[10] != 'T' && s[10] != 't') ||
+      s[13] != ':' || s[16] != ':')
+    return false;
+  int y = parse_digits(s, 4), mo = parse_digits(s + 5, 2),
+      d = parse_digits(s + 8, 2), h = parse_digits(s + 11, 2),
+      mi = parse_digits(s + 14, 2), sec = parse_digits(s + 17, 2);
+  if (y < 1970 || mo < 1 || mo > 12 || d < 1 || d > 31 || h < 0 || h > 23 ||
+      mi < 0 || mi > 59 || sec < 0 || sec > 60)
+    return false;
+
+  size_t i = 19;
+  if (i < len && s[i] == '.') { // fractional seconds, ignored
+    i++;
+    while (i < len && s[i] >= '0' && s[i] <= '9')
+      i++;
+  }
+
+  long offset = 0;
+  if (i < len && (s[i] == '+' || s[i] == '-')) {
+    if (len - i < 6 || s[i + 3] != ':')
+      return false;
+    int oh = parse_digits(s + i + 1, 2), om = parse_digits(s + i + 4, 2);
+    if (oh < 0 || om < 0)
+      return false;
+    offset = (oh * 3600L + om * 60L) * (s[i] == '+' ? 1 : -1);
+  }
+
+  // Days since epoch (civil calendar, H. Hinnant)
+  y -= mo <= 2;
+  long era = y / 400;
+  long yoe = y - era * 400;
+  long doy = (153L * (mo + (mo > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  long days = era * 146097 + doe - 719468;
+
+  *out = (time_t)days * 86400 + h * 3600 + mi * 60 + sec - offset;
+  return true;
+}
+
+WsseResult wsse_verify(const char *req, const char *user, const char *pass,
+                       uint32_t clientIp, uint32_t nowMs, time_t nowEpoch) {
+  const char *sec = strstr(req, "Security");
+  if (!sec)
+    return WSSE_NO_TOKEN;
+
+  const char *userVal, *digestVal, *nonceVal, *createdVal;
+  size_t userLen, digestLen, nonceLen, createdLen;
+  if (!find_element(sec, "Username", &userVal, &userLen) ||
+      !find_element(sec, "Password", &digestVal, &digestLen) ||
+      !find_element(sec, "Nonce", &nonceVal, &nonceLen) ||
+      !find_element(sec, "Created", &createdVal, &createdLen))
+    return WSSE_NO_TOKEN;
+
+  if (userLen != strlen(user) || memcmp(userVal, user, userLen) != 0)
+    return WSSE_BAD_USER;
+
+  // Decode the client digest once; everything below works on raw bytes
+  uint8_t clientDigest[32];
+  size_t olen = 0;
+  if (mbedtls_base64_decode(clientDigest, sizeof(clientDigest), &olen,
+                            (const unsigned char *)digestVal, digestLen) != 0 ||
+      olen != 20)
+    return WSSE_BAD_ENCODING;
+
+  uint8_t nonce[64];
+  size_t nonceRawLen = 0;
+  if (mbedtls_base64_decode(nonce, sizeof(nonce), &nonceRawLen,
+                            (const unsigned char *)nonceVal, nonceLen) != 0 ||
+      nonceRawLen == 0 || createdLen > 64)
+    return WSSE_BAD_ENCODING;
+
+  uint64_t fp = fnv1a64(0xcbf29ce484222325ULL, nonce, nonceRawLen);
+  fp = fnv1a64(fp, (const uint8_t *)createdVal, createdLen);
+
+  bool clockValid = nowEpoch >= CLOCK_VALID_EPOCH;
+  TokenEntry *seen = token_lookup(clientDigest, nowMs, clockValid);
+  if (seen) {
+    if (seen->fingerprint == fp && seen->clientIp == clientIp &&
+        (uint32_t)(nowMs - seen->seenMs) < WSSE_REUSE_WINDOW_MS)
+      return WSSE_OK_CACHED;
+    return WSSE_REPLAY;
+  }
+
+  if (clockValid) {
+    time_t created;
+    if (!wsse_parse_datetime(createdVal, createdLen, &created))
+      return WSSE_BAD_ENCODING;
+    time_t skew = created > nowEpoch ? created - nowEpoch : nowEpoch - created;
+    if (skew > WSSE_MAX_CLOCK_SKEW_S)
+      return WSSE_STALE;
+  }
+
+  // SHA1(nonce + created + password)
+  size_t passLen = strlen(pass);
+  uint8_t buffer[64 + 64 + 64];
+  if (passLen > 64)
+    return WSSE_BAD_DIGEST;
+  size_t off = 0;
+  memcpy(buffer + off, nonce, nonceRawLen);
+  off += nonceRawLen;
+  memcpy(buffer + off, createdVal, createdLen);
+  off += createdLen;
+  memcpy(buffer + off, pass, passLen);
+  off += passLen;
+
+  uint8_t expected[20];
+  mbedtls_sha1(buffer, off, expected);
+
+  if (!digest_equal(expected, clientDigest))
+    return WSSE_BAD_DIGEST;
+
+  if (!token_insert(clientDigest, fp, clientIp, nowMs, clockValid))
+    return WSSE_CACHE_FULL;
+  return WSSE_OK;
+}
+
+const char *wsse_result_str(WsseResult r) {
+  switch (r) {
+  case WSSE_OK:
+    return "ok";
+  case WSSE_OK_CACHED:
+    return "ok (cached)";
+  case WSSE_NO_TOKEN:
+    return "missing UsernameToken element";
+  case WSSE_BAD_USER:
+    return "user mismatch";
+  case WSSE_BAD_ENCODING:
+    return "malformed nonce/digest/created";
+  case WSSE_STALE:
+    return "Created outside freshness window";
+  case WSSE_REPLAY:
+    return "token replay";
+  case WSSE_BAD_DIGEST:
+    return "digest mismatch";
+  case WSSE_CACHE_FULL:
+    return "token cache full, clock not set";
+  }
+  return "unknown";
+}
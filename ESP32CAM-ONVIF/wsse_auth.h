@@ -0,0 +1,48 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// ==============================================================================
+//   WS-Security UsernameToken verification (ONVIF PasswordDigest)
+// ==============================================================================
+// Digest = Base64(SHA1(Base64Decode(Nonce) + Created + Password))
+//
+// Tokens are parsed in place (no String temporaries) and digests compared as
+// raw 20-byte values in constant time. Every verified token is remembered in
+// a small fixed-size table:
+//   - the same client resending it within WSSE_REUSE_WINDOW_MS is accepted
+//     without hashing again (NVRs reuse one token for bursts of requests),
+//   - anyone else presenting it - or the same client later on - is a replay.
+// <Created> must be within WSSE_MAX_CLOCK_SKEW_S of our clock once that clock
+// is valid, so table entries only need to outlive that window. Until then
+// <Created> proves nothing: entries are kept without expiry, and once all
+// WSSE_NONCE_CACHE_SIZE are taken new tokens are refused (WSSE_CACHE_FULL)
+// until NTP or SetSystemDateAndTime sets the clock.
+// ==============================================================================
+
+enum WsseResult {
+  WSSE_OK = 0,
+  WSSE_OK_CACHED,    // Recently verified token from the same client
+  WSSE_NO_TOKEN,     // Missing Security header or token elements
+  WSSE_BAD_USER,
+  WSSE_BAD_ENCODING, // Nonce/Digest not valid base64 or wrong length
+  WSSE_STALE,        // Created outside the freshness window
+  WSSE_REPLAY,
+  WSSE_BAD_DIGEST,
+  WSSE_CACHE_FULL    // No room to remember the token while the clock is unset
+};
+
+// req: NUL-terminated SOAP envelope. clientIp identifies the peer for the
+// reuse window. nowEpoch is wall-clock UTC (before 2020 counts as unset).
+WsseResult wsse_verify(const char *req, const char *user, const char *pass,
+                       uint32_t clientIp, uint32_t nowMs, time_t nowEpoch);
+
+const char *wsse_result_str(WsseResult r);
+
+// Parses xsd:dateTime ("2024-05-01T12:00:00.123Z", "+05:30" offsets) to UTC
+// epoch seconds. Returns false if malformed.
+bool wsse_parse_datetime(const char *s, size_t len, time_t *out);
+
+// Forget all remembered tokens (e.g. after a credential change)
+void wsse_reset_cache();
@@ -0,0 +1,43 @@
+#include "alloc_track.h"
+#include <atomic>
+#include <stddef.h>
+
+static std::atomic<uint64_t> s_allocs{0};
+static std::atomic<uint64_t> s_bytes{0};
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) {
+  s_allocs++;
+  s_bytes += size;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  s_allocs++;
+  s_bytes += n * size;
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+  s_allocs++;
+  s_bytes += size;
+  return __libc_realloc(p, size);
+}
+}
+
+bool alloc_track_available() { return true; }
+#else
+bool alloc_track_available() { return false; }
+#endif
+
+AllocCount alloc_track_now() {
+  AllocCount c;
+  c.allocs = s_allocs;
+  c.bytes = s_bytes;
+  return c;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+
+// ==============================================================================
+//   alloc_track - counts heap allocations made by the host build
+// ==============================================================================
+// Interposes malloc/calloc/realloc (glibc; operator new goes through malloc)
+// and counts every call. Take a count before and after a steady-state run
+// of a hot path: any difference is an allocation the firmware would make
+// per frame or per request on the device, where it fragments the heap.
+// ==============================================================================
+
+struct AllocCount {
+  uint64_t allocs;
+  uint64_t bytes;
+};
+
+// false where the allocator can't be interposed (counts stay 0)
+bool alloc_track_available();
+
+AllocCount alloc_track_now();
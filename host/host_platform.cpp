@@ -0,0 +1,107 @@
+// Host implementations behind the shim headers (shim/): Arduino timing and
+// Serial, the mbedtls hashes on OpenSSL, and the few firmware hooks the
+// streaming sources call into.
+#include <Arduino.h>
+#include "mbedtls/base64.h"
+#include "mbedtls/md5.h"
+#include "mbedtls/sha1.h"
+#include "heap_monitor.h"
+#include "onvif_server.h"
+#include <openssl/evp.h>
+#include <stdarg.h>
+#include <time.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static uint64_t monotonic_us() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static const uint64_t s_bootUs = monotonic_us();
+
+unsigned long millis() { return (monotonic_us() - s_bootUs) / 1000; }
+unsigned long micros() { return monotonic_us() - s_bootUs; }
+
+void delay(unsigned long ms) {
+  timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+  nanosleep(&ts, nullptr);
+}
+
+// The packetizer's pauses pace the ESP32's WiFi buffers; on the host they
+// would only measure the scheduler
+void delayMicroseconds(unsigned int) {}
+void yield() {}
+
+long random(long max) { return max > 0 ? rand() % max : 0; }
+long random(long min, long max) { return max > min ? min + rand() % (max - min) : min; }
+
+bool psramFound() { return true; }
+uint32_t getCpuFrequencyMhz() { return 240; }
+
+size_t HardwareSerial::printf(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = vprintf(fmt, args);
+  va_end(args);
+  return n > 0 ? n : 0;
+}
+
+uint32_t EspClass::getFreeHeap() { return 4u << 20; }
+uint32_t EspClass::getMinFreeHeap() { return 4u << 20; }
+uint32_t EspClass::getCycleCount() { return (uint32_t)(micros() * 240); }
+
+int mbedtls_md5(const unsigned char *input, size_t ilen, unsigned char output[16]) {
+  return EVP_Digest(input, ilen, output, nullptr, EVP_md5(), nullptr) ? 0 : -1;
+}
+
+int mbedtls_sha1(const unsigned char *input, size_t ilen, unsigned char output[20]) {
+  return EVP_Digest(input, ilen, output, nullptr, EVP_sha1(), nullptr) ? 0 : -1;
+}
+
+static int base64_value(unsigned char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen,
+                          const unsigned char *src, size_t slen) {
+  // Padding only at the end; whitespace is not accepted (nor by callers)
+  while (slen && src[slen - 1] == '=')
+    slen--;
+  if (slen % 4 == 1)
+    return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+  size_t need = slen / 4 * 3 + (slen % 4 ? slen % 4 - 1 : 0);
+  *olen = need;
+  if (!dst || dlen < need)
+    return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+
+  uint32_t acc = 0;
+  int bits = 0;
+  size_t n = 0;
+  for (size_t i = 0; i < slen; i++) {
+    int v = base64_value(src[i]);
+    if (v < 0)
+      return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    acc = (acc << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      dst[n++] = (acc >> bits) & 0xFF;
+    }
+  }
+  *olen = n;
+  return 0;
+}
+
+// No ONVIF server on the host; media_config bumps its epoch on changes
+void onvif_bump_config_epoch() {}
+
+// No heap pressure on the host: https_client never sheds connections
+HeapLevel heap_monitor_level() { return HEAP_OK; }
@@ -0,0 +1,296 @@
+#include "mock_camera.h"
+#include "esp_camera.h"
+#include "platglue.h"
+#include <algorithm>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct MockFrame {
+  std::vector<uint8_t> data;
+  uint16_t width;
+  uint16_t height;
+};
+
+// Enough buffers for every client of the bench to hold two frames; the
+// real driver has one or two and blocks when they are all out
+#define MOCK_FB_COUNT 64
+
+static std::vector<MockFrame> s_frames;
+static MockCameraSource s_source = MOCK_JPEG;
+static camera_fb_t s_fbs[MOCK_FB_COUNT];
+static bool s_fbUsed[MOCK_FB_COUNT];
+static size_t s_next = 0;
+static uint32_t s_served = 0;
+static uint32_t s_out = 0;
+static PLATMUTEX s_lock = nullptr;
+
+const resolution_info_t resolution[FRAMESIZE_INVALID] = {
+    {96, 96, 0},    {160, 120, 0},  {176, 144, 0},   {240, 176, 0},
+    {240, 240, 0},  {320, 240, 0},  {400, 296, 0},   {480, 320, 0},
+    {640, 480, 0},  {800, 600, 0},  {1024, 768, 0},  {1280, 720, 0},
+    {1280, 1024, 0}, {1600, 1200, 0},
+};
+
+static int sensor_set_framesize(sensor_t *s, framesize_t fs) {
+  s->status.framesize = fs;
+  return 0;
+}
+
+static int sensor_set_quality(sensor_t *s, int q) {
+  s->status.quality = q;
+  return 0;
+}
+
+static sensor_t s_sensor = {{FRAMESIZE_VGA, 12}, PIXFORMAT_JPEG,
+                            sensor_set_framesize, sensor_set_quality};
+
+// --- JPEG ---
+
+// Frame size from the SOF0/SOF2 segment; false if there is none
+static bool jpeg_size(const std::vector<uint8_t> &j, uint16_t *w, uint16_t *h) {
+  size_t i = 2;
+  while (i + 9 < j.size()) {
+    if (j[i] != 0xFF)
+      return false;
+    uint8_t marker = j[i + 1];
+    size_t len = (j[i + 2] << 8) | j[i + 3];
+    if (marker == 0xC0 || marker == 0xC2) {
+      *h = (j[i + 5] << 8) | j[i + 6];
+      *w = (j[i + 7] << 8) | j[i + 8];
+      return true;
+    }
+    i += 2 + len;
+  }
+  return false;
+}
+
+static bool read_file(const std::string &path, std::vector<uint8_t> &out) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  out.resize(len > 0 ? len : 0);
+  bool ok = len > 0 && fread(out.data(), 1, len, f) == (size_t)len;
+  fclose(f);
+  return ok;
+}
+
+static bool ends_with(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && strcasecmp(s.c_str() + s.size() - n, suffix) == 0;
+}
+
+static bool load_jpeg_dir(const char *dir) {
+  DIR *d = opendir(dir);
+  if (!d)
+    return false;
+  std::vector<std::string> names;
+  while (dirent *e = readdir(d)) {
+    std::string name = e->d_name;
+    if (ends_with(name, ".jpg") || ends_with(name, ".jpeg"))
+      names.push_back(name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+
+  for (const std::string &name : names) {
+    MockFrame f;
+    if (!read_file(std::string(dir) + "/" + name, f.data) || f.data.size() < 4 ||
+        f.data[0] != 0xFF || f.data[1] != 0xD8 ||
+        !jpeg_size(f.data, &f.width, &f.height)) {
+      printf("[WARN] Mock camera: skipping %s (not a baseline JPEG)\n",
+             name.c_str());
+      continue;
+    }
+    s_frames.push_back(std::move(f));
+  }
+  return !s_frames.empty();
+}
+
+static void put_segment(std::vector<uint8_t> &j, uint8_t marker,
+                        std::initializer_list<uint8_t> body) {
+  size_t len = body.size() + 2;
+  j.insert(j.end(), {0xFF, marker, (uint8_t)(len >> 8), (uint8_t)len});
+  j.insert(j.end(), body);
+}
+
+// 640x480 4:2:0 header with two quant tables and ~25KB of entropy-coded
+// filler: not decodable, but the RTP/JPEG packetizer only reads headers
+static void synth_jpeg() {
+  MockFrame f;
+  f.width = 640;
+  f.height = 480;
+  std::vector<uint8_t> &j = f.data;
+  j = {0xFF, 0xD8};
+  for (uint8_t t = 0; t < 2; t++) {
+    j.insert(j.end(), {0xFF, 0xDB, 0x00, 67, t});
+    j.insert(j.end(), 64, (uint8_t)(t ? 17 : 16));
+  }
+  put_segment(j, 0xC0, {8, 480 >> 8, 480 & 0xFF, 640 >> 8, 640 & 0xFF, 3, 1,
+                        0x22, 0, 2, 0x11, 1, 3, 0x11, 1});
+  put_segment(j, 0xDA, {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0});
+  j.insert(j.end(), 25000, 0x55);
+  j.insert(j.end(), {0xFF, 0xD9});
+  s_frames.push_back(std::move(f));
+}
+
+// --- H.264 ---
+
+// Offset of the next start code at or after pos (its first zero byte), or
+// data.size()
+static size_t next_start_code(const std::vector<uint8_t> &d, size_t pos,
+                              size_t *codeLen) {
+  for (size_t i = pos; i + 3 <= d.size(); i++) {
+    if (d[i] == 0 && d[i + 1] == 0) {
+      if (d[i + 2] == 1) {
+        *codeLen = 3;
+        return i;
+      }
+      if (i + 4 <= d.size() && d[i + 2] == 0 && d[i + 3] == 1) {
+        *codeLen = 4;
+        return i;
+      }
+    }
+  }
+  *codeLen = 0;
+  return d.size();
+}
+
+// One access unit per coded picture: parameter sets and SEI travel with the
+// slice that follows them. Assumes one slice per picture, which is what the
+// ESP32 encoders produce.
+static bool load_annexb(const char *path) {
+  std::vector<uint8_t> file;
+  if (!read_file(path, file))
+    return false;
+
+  size_t codeLen;
+  size_t pos = next_start_code(file, 0, &codeLen);
+  size_t auStart = pos;
+  while (pos < file.size()) {
+    size_t nalHeader = pos + codeLen;
+    size_t nextLen;
+    size_t next = next_start_code(file, nalHeader, &nextLen);
+    uint8_t type = nalHeader < file.size() ? file[nalHeader] & 0x1F : 0;
+    if (type == 1 || type == 5) {
+      MockFrame f;
+      f.width = 640;
+      f.height = 480;
+      f.data.assign(file.begin() + auStart, file.begin() + next);
+      s_frames.push_back(std::move(f));
+      auStart = next;
+    }
+    pos = next;
+    codeLen = nextLen;
+  }
+  return !s_frames.empty();
+}
+
+static void put_nal(std::vector<uint8_t> &au, uint8_t header, size_t len) {
+  au.insert(au.end(), {0, 0, 0, 1, header});
+  au.insert(au.end(), len, 0x55);
+}
+
+// A 30-frame GOP: SPS + PPS + 20KB IDR, then 4KB P slices
+static void synth_h264() {
+  for (int i = 0; i < 30; i++) {
+    MockFrame f;
+    f.width = 640;
+    f.height = 480;
+    if (i == 0) {
+      put_nal(f.data, 0x67, 10); // SPS
+      put_nal(f.data, 0x68, 4);  // PPS
+      put_nal(f.data, 0x65, 20000);
+    } else {
+      put_nal(f.data, 0x41, 4000);
+    }
+    s_frames.push_back(std::move(f));
+  }
+}
+
+bool mock_camera_open(MockCameraSource source, const char *path) {
+  if (!s_lock)
+    s_lock = platmutexcreate();
+  s_frames.clear();
+  s_source = source;
+  s_next = 0;
+
+  bool synthetic = !path || !*path;
+  if (synthetic)
+    source == MOCK_H264 ? synth_h264() : synth_jpeg();
+  else if (source == MOCK_H264 ? !load_annexb(path) : !load_jpeg_dir(path)) {
+    printf("[ERROR] Mock camera: no frames in %s\n", path);
+    return false;
+  }
+
+  // The sensor reports the frame size being replayed
+  for (int fs = 0; fs < FRAMESIZE_INVALID; fs++)
+    if (resolution[fs].width == s_frames[0].width &&
+        resolution[fs].height == s_frames[0].height)
+      s_sensor.status.framesize = (framesize_t)fs;
+  s_sensor.pixformat = source == MOCK_H264 ? PIXFORMAT_YUV422 : PIXFORMAT_JPEG;
+
+  printf("[INFO] Mock camera: %u %s frames (%ux%u, avg %u bytes)%s\n",
+         (unsigned)s_frames.size(), source == MOCK_H264 ? "H.264" : "JPEG",
+         s_frames[0].width, s_frames[0].height,
+         (unsigned)mock_camera_avg_frame_len(), synthetic ? ", synthetic" : "");
+  return true;
+}
+
+size_t mock_camera_frame_count() { return s_frames.size(); }
+
+size_t mock_camera_avg_frame_len() {
+  size_t total = 0;
+  for (const MockFrame &f : s_frames)
+    total += f.data.size();
+  return s_frames.empty() ? 0 : total / s_frames.size();
+}
+
+uint32_t mock_camera_frames_served() { return s_served; }
+uint32_t mock_camera_frames_out() { return s_out; }
+
+camera_fb_t *esp_camera_fb_get() {
+  if (s_frames.empty())
+    return nullptr;
+  platmutexlock(s_lock);
+  camera_fb_t *fb = nullptr;
+  for (int i = 0; i < MOCK_FB_COUNT && !fb; i++) {
+    if (!s_fbUsed[i]) {
+      s_fbUsed[i] = true;
+      fb = &s_fbs[i];
+    }
+  }
+  if (fb) {
+    MockFrame &f = s_frames[s_next];
+    s_next = (s_next + 1) % s_frames.size();
+    fb->buf = f.data.data();
+    fb->len = f.data.size();
+    fb->width = f.width;
+    fb->height = f.height;
+    fb->format = s_source == MOCK_H264 ? PIXFORMAT_YUV422 : PIXFORMAT_JPEG;
+    // Same clock as esp_timer on the device: platmicros64()
+    uint64_t now = platmicros64();
+    fb->timestamp.tv_sec = now / 1000000;
+    fb->timestamp.tv_usec = now % 1000000;
+    s_served++;
+    s_out++;
+  }
+  platmutexunlock(s_lock);
+  return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb) {
+  if (!fb)
+    return;
+  platmutexlock(s_lock);
+  s_fbUsed[fb - s_fbs] = false;
+  s_out--;
+  platmutexunlock(s_lock);
+}
+
+sensor_t *esp_camera_sensor_get() { return &s_sensor; }
@@ -0,0 +1,32 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ==============================================================================
+//   Mock camera - esp_camera_fb_get() replaying recorded frames on the host
+// ==============================================================================
+// Frames come from
+//   - a directory of JPEG files (*.jpg / *.jpeg, in name order), served as
+//     PIXFORMAT_JPEG the way the sensor delivers them, or
+//   - an Annex-B H.264 file, split into access units and served as raw
+//     frames that mock_h264_encoder.cpp passes through as "encoded" output,
+//   - or, without a path, a synthetic frame of the requested kind.
+// Everything is loaded up front: esp_camera_fb_get() hands out pointers into
+// memory (timestamped now) and never allocates, so it does not distort the
+// bench's allocation count. The camera cycles through the frames; every
+// caller gets the next one, like consumers sharing the real sensor.
+// ==============================================================================
+
+enum MockCameraSource : uint8_t { MOCK_JPEG = 0, MOCK_H264 };
+
+// Loads path (directory of JPEGs, or Annex-B file when source is MOCK_H264);
+// nullptr or "" synthesizes frames. False if nothing could be loaded.
+bool mock_camera_open(MockCameraSource source, const char *path);
+
+size_t mock_camera_frame_count();
+// Average frame size in bytes
+size_t mock_camera_avg_frame_len();
+
+// Frames handed out / currently not returned
+uint32_t mock_camera_frames_served();
+uint32_t mock_camera_frames_out();
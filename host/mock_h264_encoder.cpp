@@ -0,0 +1,102 @@
+// Host stand-in for h264_encoder.cpp: the mock camera already delivers
+// encoded access units (Annex-B replay), so "encoding" hands the frame
+// buffer through and only classifies it. Keeps H264Streamer's NAL parsing
+// and FU-A packetization on the measured path.
+#include "h264_encoder.h"
+#include <string.h>
+
+#ifdef VIDEO_CODEC_H264
+
+static bool s_initialized = false;
+static uint8_t s_sps[64];
+static size_t s_spsSize = 0;
+static uint8_t s_pps[64];
+static size_t s_ppsSize = 0;
+
+h264_status_t h264_encoder_init(const h264_encoder_config_t *config) {
+  if (!config)
+    return H264_ERR_INVALID_PARAM;
+  s_initialized = true;
+  return H264_OK;
+}
+
+static void remember(uint8_t *dst, size_t *dstSize, const uint8_t *nal,
+                     size_t len) {
+  if (len > 64)
+    return;
+  memcpy(dst, nal, len);
+  *dstSize = len;
+}
+
+h264_status_t h264_encoder_encode(const uint8_t *raw_data, size_t raw_size,
+                                  h264_frame_t *out_frame) {
+  if (!s_initialized)
+    return H264_ERR_NOT_INITIALIZED;
+  if (!raw_data || !raw_size || !out_frame)
+    return H264_ERR_INVALID_PARAM;
+
+  out_frame->data = (uint8_t *)raw_data;
+  out_frame->size = raw_size;
+  out_frame->type = H264_FRAME_TYPE_P;
+  out_frame->contains_sps_pps = false;
+  out_frame->timestamp = 0;
+
+  // Walk the NAL units: 00 00 01 <header> ... up to the next start code
+  for (size_t i = 0; i + 3 < raw_size; i++) {
+    if (raw_data[i] || raw_data[i + 1] || raw_data[i + 2] != 1)
+      continue;
+    size_t hdr = i + 3;
+    size_t end = hdr + 1;
+    while (end + 3 <= raw_size &&
+           !(raw_data[end] == 0 && raw_data[end + 1] == 0 &&
+             raw_data[end + 2] <= 1))
+      end++;
+    if (end + 3 > raw_size)
+      end = raw_size;
+
+    uint8_t type = raw_data[hdr] & 0x1F;
+    if (type == 5)
+      out_frame->type = H264_FRAME_TYPE_IDR;
+    else if (type == 7) {
+      out_frame->contains_sps_pps = true;
+      remember(s_sps, &s_spsSize, raw_data + hdr, end - hdr);
+    } else if (type == 8)
+      remember(s_pps, &s_ppsSize, raw_data + hdr, end - hdr);
+    i = end - 1;
+  }
+  return H264_OK;
+}
+
+h264_status_t h264_encoder_encode_jpeg(const uint8_t *, size_t,
+                                       h264_frame_t *) {
+  return H264_ERR_NOT_SUPPORTED;
+}
+
+void h264_encoder_request_idr(void) {}
+
+static h264_status_t copy_out(const uint8_t *src, size_t len, uint8_t *dst,
+                              size_t *size) {
+  if (!len)
+    return H264_ERR_NOT_INITIALIZED;
+  if (!dst || !size || *size < len)
+    return H264_ERR_INVALID_PARAM;
+  memcpy(dst, src, len);
+  *size = len;
+  return H264_OK;
+}
+
+h264_status_t h264_encoder_get_sps(uint8_t *sps_data, size_t *sps_size) {
+  return copy_out(s_sps, s_spsSize, sps_data, sps_size);
+}
+
+h264_status_t h264_encoder_get_pps(uint8_t *pps_data, size_t *pps_size) {
+  return copy_out(s_pps, s_ppsSize, pps_data, pps_size);
+}
+
+bool h264_encoder_is_hw(void) { return false; }
+
+void h264_encoder_destroy(void) { s_initialized = false; }
+
+const char *h264_encoder_get_type_string(void) { return "Mock (replay)"; }
+
+#endif // VIDEO_CODEC_H264
@@ -0,0 +1,689 @@
+// ==============================================================================
+//   rtsp_bench - RTSP/RTP streaming core under load, on the host
+// ==============================================================================
+// Serves the mock camera through the firmware's own CRtspSession / CStreamer
+// code on 127.0.0.1 and drives N RTSP clients against it (Digest auth,
+// DESCRIBE, SETUP, PLAY, then RTP over interleaved TCP or UDP). Reports per
+// client frame rate, throughput, RTP sequence gaps and capture-to-receive
+// latency, plus the server's cost per frame and heap allocations per frame
+// over the measurement window.
+//
+// Server side, like rtsp_server.cpp: one control thread accepts clients and
+// runs every session's handleRequests(0). Frames are produced either
+//   - per client (default): each session has its own streamer; one sender
+//     thread runs capture -> send -> release for each in turn, so N clients
+//     cost N times the packetizing work, or
+//   - through frame_pipeline (-p): the device's capture/sender tasks and
+//     one shared streamer - exactly one unicast client, as on the device.
+// ==============================================================================
+
+#include "CRtspSession.h"
+#include "alloc_track.h"
+#include "fixed_pool.h"
+#include "H264Streamer.h"
+#include "MyStreamer.h"
+#include "config.h"
+#include "frame_pipeline.h"
+#include "mbedtls/md5.h"
+#include "media_config.h"
+#include "metrics.h"
+#include "mock_camera.h"
+#include "rtsp_auth.h"
+#include <atomic>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MAX_CLIENTS 32
+
+// --- Options ---
+
+static int s_clients = 1;
+static int s_seconds = 10;
+static int s_warmup = 2;
+static int s_fps = 0; // 0 = as fast as the sender can go
+static bool s_udp = false;
+static bool s_pipeline = false;
+static const char *s_input = nullptr;
+static bool s_zeroAlloc = false; // fail if the measured window allocates
+
+#ifdef VIDEO_CODEC_H264
+static const char *STREAM_PATH = "h264/1";
+#else
+static const char *STREAM_PATH = "mjpeg/1";
+#endif
+
+static std::atomic<bool> s_sendersStop{false}; // then clients, then control
+static std::atomic<bool> s_stop{false};
+static std::atomic<bool> s_serverStop{false};
+static int s_listenFd = -1;
+static uint16_t s_port = 0;
+
+// --- Server ---
+
+struct ServerSlot {
+  std::atomic<CRtspSession *> session;
+  CStreamer *streamer; // own streamer (per-client mode)
+  uint32_t nextDue;
+  LatencyHistogram frameUs; // capture + send + release
+};
+
+static ServerSlot s_slots[BENCH_MAX_CLIENTS];
+static CStreamer *s_shared = nullptr; // pipeline mode
+static FixedPool<CRtspSession, BENCH_MAX_CLIENTS> s_sessionPool; // as RTSP_Task
+
+static CStreamer *new_streamer() {
+#ifdef VIDEO_CODEC_H264
+  H264Streamer *h264 = new H264Streamer();
+  const VideoEncoderConfig &c = media_config_get(media_config_active());
+  if (!h264->init(c.width, c.height, c.fps, c.bitrateKbps * 1000UL,
+                  (uint8_t)c.gop)) {
+    delete h264;
+    return nullptr;
+  }
+  return h264;
+#else
+  return new MyStreamer();
+#endif
+}
+
+// Per-client mode: one thread serves every session in turn. The streamers
+// packetize through static buffers (the device sends from a single task), so
+// they must not run concurrently.
+static void *sender_main(void *) {
+  uint32_t intervalUs = s_fps ? 1000000 / s_fps : 0;
+  while (!s_sendersStop) {
+    bool sent = false;
+    for (int i = 0; i < BENCH_MAX_CLIENTS; i++) {
+      ServerSlot &slot = s_slots[i];
+      CRtspSession *session = slot.session.load();
+      if (!session || !session->m_streaming || session->m_stopped) {
+        slot.nextDue = platmicros();
+        continue;
+      }
+      if (intervalUs && (int32_t)(slot.nextDue - platmicros()) > 0)
+        continue;
+      slot.nextDue += intervalUs;
+
+      uint32_t start = platmicros();
+      StreamFrame frame;
+      if (!slot.streamer->captureFrame(frame))
+        continue;
+      slot.streamer->sendFrame(frame);
+      slot.streamer->releaseFrame(frame);
+      latency_hist_add(slot.frameUs, platmicros() - start);
+      sent = true;
+    }
+    if (!sent)
+      platdelayms(1);
+  }
+  return nullptr;
+}
+
+static void accept_clients() {
+  int fd = accept(s_listenFd, nullptr, nullptr);
+  if (fd < 0)
+    return;
+  for (int i = 0; i < BENCH_MAX_CLIENTS; i++) {
+    ServerSlot &slot = s_slots[i];
+    if (slot.session)
+      continue;
+    CStreamer *streamer = s_pipeline ? s_shared : new_streamer();
+    if (!streamer)
+      break;
+    // A client that stops reading must not wedge the sender forever
+    timeval tv = {RTSP_SEND_TIMEOUT_MS / 1000, (RTSP_SEND_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    slot.streamer = streamer;
+    slot.session = s_sessionPool.create(fd, streamer);
+    return;
+  }
+  printf("[WARN] rtsp_bench: no free session slot\n");
+  close(fd);
+}
+
+// RTSP_Task's job: accept, handle requests, feed the pipeline
+static void *control_main(void *) {
+  while (!s_serverStop) {
+    accept_clients();
+
+    uint32_t start = platmicros();
+    int playing = 0;
+    for (int i = 0; i < BENCH_MAX_CLIENTS; i++) {
+      CRtspSession *session = s_slots[i].session.load();
+      if (!session || session->m_stopped)
+        continue;
+      session->handleRequests(0);
+      if (session->m_streaming && !session->m_stopped)
+        playing++;
+    }
+    frame_pipeline_record(STAGE_CONTROL, platmicros() - start);
+
+    // Like RTSP_Task, this thread alone attaches and detaches the pipeline
+    if (s_sendersStop)
+      playing = 0;
+    if (s_pipeline) {
+      if (playing && !frame_pipeline_attached())
+        frame_pipeline_attach(s_shared);
+      else if (!playing && frame_pipeline_attached())
+        frame_pipeline_detach();
+    }
+    platdelayms(1);
+  }
+  return nullptr;
+}
+
+static bool server_listen() {
+  s_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(s_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t len = sizeof(addr);
+  if (bind(s_listenFd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(s_listenFd, BENCH_MAX_CLIENTS) != 0 ||
+      getsockname(s_listenFd, (sockaddr *)&addr, &len) != 0) {
+    perror("rtsp_bench: listen");
+    return false;
+  }
+  fcntl(s_listenFd, F_SETFL, fcntl(s_listenFd, F_GETFL) | O_NONBLOCK);
+  s_port = ntohs(addr.sin_port);
+  return true;
+}
+
+// --- Client ---
+
+struct ClientStats {
+  std::atomic<uint32_t> frames;
+  std::atomic<uint32_t> packets;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint32_t> seqGaps;
+  std::atomic<uint64_t> latencyUsTotal; // capture -> last packet received
+  std::atomic<uint32_t> latencyUsMax;
+};
+
+struct Client {
+  int id;
+  int fd;
+  int rtpFd; // UDP transport
+  pthread_t thread;
+  bool ok;
+  char session[32];
+  char nonce[64];
+  char realm[64];
+  char buf[64 * 1024];
+  size_t used;
+  bool haveSeq;
+  uint16_t lastSeq;
+  ClientStats stats;
+};
+
+static Client s_clientList[BENCH_MAX_CLIENTS];
+
+static void md5_hex(const char *s, char out[33]) {
+  uint8_t d[16];
+  mbedtls_md5((const unsigned char *)s, strlen(s), d);
+  for (int i = 0; i < 16; i++)
+    snprintf(out + i * 2, 3, "%02x", d[i]);
+}
+
+// Value of `name="..."` in a WWW-Authenticate header
+static bool auth_param(const char *hdr, const char *name, char *out,
+                       size_t size) {
+  char key[32];
+  snprintf(key, sizeof(key), "%s=\"", name);
+  const char *p = strstr(hdr, key);
+  if (!p)
+    return false;
+  p += strlen(key);
+  const char *end = strchr(p, '"');
+  if (!end || (size_t)(end - p) >= size)
+    return false;
+  memcpy(out, p, end - p);
+  out[end - p] = '\0';
+  return true;
+}
+
+static bool header_value(const char *resp, const char *name, char *out,
+                         size_t size) {
+  char key[48];
+  snprintf(key, sizeof(key), "\r\n%s:", name);
+  const char *p = strcasestr(resp, key);
+  if (!p)
+    return false;
+  p += strlen(key);
+  while (*p == ' ')
+    p++;
+  size_t n = strcspn(p, "\r\n");
+  if (n >= size)
+    n = size - 1;
+  memcpy(out, p, n);
+  out[n] = '\0';
+  return true;
+}
+
+// Reads one response into c.buf (NUL-terminated); bytes after it (e.g. RTP
+// following the PLAY reply) stay in the buffer. Returns its length, 0 on
+// error.
+static size_t read_response(Client &c) {
+  for (;;) {
+    c.buf[c.used] = '\0';
+    char *end = strstr(c.buf, "\r\n\r\n");
+    if (end) {
+      size_t len = end + 4 - c.buf;
+      char value[16];
+      if (header_value(c.buf, "Content-Length", value, sizeof(value)))
+        len += atoi(value);
+      if (c.used >= len)
+        return len;
+    }
+    if (c.used + 1 >= sizeof(c.buf))
+      return 0;
+    ssize_t n = recv(c.fd, c.buf + c.used, sizeof(c.buf) - 1 - c.used, 0);
+    if (n <= 0)
+      return 0;
+    c.used += n;
+  }
+}
+
+static void consume(Client &c, size_t len) {
+  memmove(c.buf, c.buf + len, c.used - len);
+  c.used -= len;
+}
+
+// Sends a request, answering a Digest challenge once; returns the status
+static int rtsp_request(Client &c, const char *method, const char *extra,
+                        int cseq) {
+  char url[128];
+  snprintf(url, sizeof(url), "rtsp://127.0.0.1:%u/%s%s", s_port, STREAM_PATH,
+           strcmp(method, "SETUP") == 0 ? "/track1" : "");
+  for (int attempt = 0; attempt < 2; attempt++) {
+    char auth[256] = "";
+    if (c.nonce[0]) {
+      char a1[128], a2[192], ha1[33], ha2[33], resp[33], all[128];
+      snprintf(a1, sizeof(a1), "%s:%s:%s", WEB_USER, c.realm, WEB_PASS);
+      snprintf(a2, sizeof(a2), "%s:%s", method, url);
+      md5_hex(a1, ha1);
+      md5_hex(a2, ha2);
+      snprintf(all, sizeof(all), "%s:%s:%s", ha1, c.nonce, ha2);
+      md5_hex(all, resp);
+      snprintf(auth, sizeof(auth),
+               "Authorization: Digest username=\"%s\", realm=\"%s\", "
+               "nonce=\"%s\", uri=\"%s\", response=\"%s\"\r\n",
+               WEB_USER, c.realm, c.nonce, url, resp);
+    }
+    char session[48] = "";
+    if (c.session[0])
+      snprintf(session, sizeof(session), "Session: %s\r\n", c.session);
+    char req[768];
+    int n = snprintf(req, sizeof(req), "%s %s RTSP/1.0\r\nCSeq: %d\r\n%s%s%s\r\n",
+                     method, url, cseq, auth, extra, session);
+    if (send(c.fd, req, n, MSG_NOSIGNAL) != n)
+      return 0;
+
+    size_t len = read_response(c);
+    if (!len)
+      return 0;
+    int status = 0;
+    sscanf(c.buf, "RTSP/1.0 %d", &status);
+    char value[256];
+    if (status == 401 && header_value(c.buf, "WWW-Authenticate", value, sizeof(value)) &&
+        auth_param(value, "nonce", c.nonce, sizeof(c.nonce)) &&
+        auth_param(value, "realm", c.realm, sizeof(c.realm))) {
+      consume(c, len);
+      continue;
+    }
+    if (header_value(c.buf, "Session", value, sizeof(value))) {
+      value[strcspn(value, ";")] = '\0';
+      snprintf(c.session, sizeof(c.session), "%s", value);
+    }
+    consume(c, len);
+    return status;
+  }
+  return 401;
+}
+
+static uint32_t rtp_now() { return CStreamer::rtpTimestamp(platmicros64()); }
+
+static void on_rtp(Client &c, const uint8_t *p, size_t len) {
+  if (len < 12)
+    return;
+  uint16_t seq = (p[2] << 8) | p[3];
+  if (c.haveSeq && seq != (uint16_t)(c.lastSeq + 1))
+    c.stats.seqGaps++;
+  c.haveSeq = true;
+  c.lastSeq = seq;
+  c.stats.packets++;
+  c.stats.bytes += len;
+  if (p[1] & 0x80) { // marker: last packet of the frame
+    uint32_t ts = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+    uint32_t us = (uint32_t)(rtp_now() - ts) * 100 / 9;
+    c.stats.frames++;
+    c.stats.latencyUsTotal += us;
+    if (us > c.stats.latencyUsMax)
+      c.stats.latencyUsMax = us;
+  }
+}
+
+// Not 0-1, so the server has to echo and use what SETUP asked for
+static const unsigned RTP_CHANNEL = 2;
+
+// Interleaved frames: '$' channel len16 payload
+static void drain_interleaved(Client &c) {
+  size_t off = 0;
+  while (c.used - off >= 4) {
+    const uint8_t *p = (const uint8_t *)c.buf + off;
+    if (p[0] != '$') { // RTSP reply (keep-alive) in between
+      char *end = strstr(c.buf + off, "\r\n\r\n");
+      if (!end)
+        break;
+      off = end + 4 - c.buf;
+      continue;
+    }
+    size_t len = (p[2] << 8) | p[3];
+    if (c.used - off < 4 + len)
+      break;
+    if (p[1] == RTP_CHANNEL)
+      on_rtp(c, p + 4, len);
+    off += 4 + len;
+  }
+  consume(c, off);
+}
+
+static int udp_bind_pair(int *rtpFd) {
+  for (uint16_t port = 20000 + (rand() % 1000) * 2; port < 60000; port += 2) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0) {
+      int rcv = 4 << 20;
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcv, sizeof(rcv));
+      timeval tv = {0, 100000};
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      *rtpFd = fd;
+      return port;
+    }
+    close(fd);
+  }
+  return 0;
+}
+
+static void *client_main(void *arg) {
+  Client &c = *(Client *)arg;
+  c.fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(s_port);
+  if (connect(c.fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+    perror("rtsp_bench: connect");
+    return nullptr;
+  }
+
+  char transport[128];
+  int cseq = 1;
+  if (s_udp) {
+    int port = udp_bind_pair(&c.rtpFd);
+    snprintf(transport, sizeof(transport),
+             "Transport: RTP/AVP;unicast;client_port=%d-%d\r\n", port, port + 1);
+  } else {
+    snprintf(transport, sizeof(transport),
+             "Transport: RTP/AVP/TCP;unicast;interleaved=%u-%u\r\n",
+             RTP_CHANNEL, RTP_CHANNEL + 1);
+  }
+  int status;
+  if ((status = rtsp_request(c, "OPTIONS", "", cseq++)) != 200 ||
+      (status = rtsp_request(c, "DESCRIBE", "Accept: application/sdp\r\n", cseq++)) != 200 ||
+      (status = rtsp_request(c, "SETUP", transport, cseq++)) != 200 ||
+      (status = rtsp_request(c, "PLAY", "Range: npt=0.000-\r\n", cseq++)) != 200) {
+    printf("[ERROR] rtsp_bench: client %d setup failed (RTSP %d)\n", c.id, status);
+    return nullptr;
+  }
+  c.ok = true;
+
+  timeval tv = {0, 100000};
+  setsockopt(c.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  static const size_t UDP_MAX = 2048;
+  uint8_t pkt[UDP_MAX];
+  while (!s_stop) {
+    if (s_udp) {
+      ssize_t n = recv(c.rtpFd, pkt, sizeof(pkt), 0);
+      if (n > 0)
+        on_rtp(c, pkt, n);
+    } else {
+      ssize_t n = recv(c.fd, c.buf + c.used, sizeof(c.buf) - 1 - c.used, 0);
+      if (n == 0)
+        break;
+      if (n > 0) {
+        c.used += n;
+        drain_interleaved(c);
+      }
+    }
+  }
+  return nullptr;
+}
+
+static void client_teardown(Client &c) {
+  if (!c.ok)
+    return;
+  // Stop reading RTP: the reply may sit behind queued packets, so don't wait
+  char req[256];
+  int n = snprintf(req, sizeof(req),
+                   "TEARDOWN rtsp://127.0.0.1:%u/%s RTSP/1.0\r\nCSeq: 99\r\n"
+                   "Session: %s\r\n\r\n",
+                   s_port, STREAM_PATH, c.session);
+  send(c.fd, req, n, MSG_NOSIGNAL);
+}
+
+// --- Report ---
+
+struct Snapshot {
+  uint32_t frames[BENCH_MAX_CLIENTS];
+  uint64_t bytes[BENCH_MAX_CLIENTS];
+  uint32_t gaps[BENCH_MAX_CLIENTS];
+  uint64_t latency[BENCH_MAX_CLIENTS];
+  uint32_t serverFrames;
+  uint64_t serverUs;
+  uint64_t allocs;
+  uint64_t allocBytes;
+  uint64_t atUs;
+};
+
+static void take_snapshot(Snapshot &s) {
+  s.atUs = platmicros64();
+  AllocCount heap = alloc_track_now();
+  s.allocs = heap.allocs;
+  s.allocBytes = heap.bytes;
+  s.serverFrames = 0;
+  s.serverUs = 0;
+  for (int i = 0; i < s_clients; i++) {
+    ClientStats &cs = s_clientList[i].stats;
+    s.frames[i] = cs.frames;
+    s.bytes[i] = cs.bytes;
+    s.gaps[i] = cs.seqGaps;
+    s.latency[i] = cs.latencyUsTotal;
+  }
+  if (s_pipeline) {
+    LatencyHistogram capture, send;
+    frame_pipeline_stats(STAGE_CAPTURE, &capture);
+    frame_pipeline_stats(STAGE_SEND, &send);
+    s.serverFrames = send.count;
+    s.serverUs = capture.totalUs + send.totalUs;
+  } else {
+    for (int i = 0; i < BENCH_MAX_CLIENTS; i++) {
+      s.serverFrames += s_slots[i].frameUs.count;
+      s.serverUs += s_slots[i].frameUs.totalUs;
+    }
+  }
+}
+
+static void report(const Snapshot &a, const Snapshot &b) {
+  double secs = (b.atUs - a.atUs) / 1e6;
+  printf("\nclient   frames     fps   Mbit/s  seq gaps  latency avg/max ms\n");
+  uint32_t frames = 0;
+  double mbit = 0;
+  for (int i = 0; i < s_clients; i++) {
+    uint32_t f = b.frames[i] - a.frames[i];
+    double m = (b.bytes[i] - a.bytes[i]) * 8 / secs / 1e6;
+    frames += f;
+    mbit += m;
+    printf("%6d %8u %7.1f %8.2f %9u  %8.2f / %.2f\n", i, f, f / secs, m,
+           b.gaps[i] - a.gaps[i],
+           f ? (b.latency[i] - a.latency[i]) / 1000.0 / f : 0.0,
+           s_clientList[i].stats.latencyUsMax / 1000.0);
+  }
+  printf(" total %8u %7.1f %8.2f\n", frames, frames / secs, mbit);
+
+  uint32_t served = b.serverFrames - a.serverFrames;
+  printf("\nserver: %u frames, %.1f us/frame (capture + packetize + send)\n",
+         served, served ? (double)(b.serverUs - a.serverUs) / served : 0.0);
+  if (alloc_track_available()) {
+    uint64_t allocs = b.allocs - a.allocs;
+    printf("heap:   %llu allocations (%llu bytes), %.3f per frame\n",
+           (unsigned long long)allocs,
+           (unsigned long long)(b.allocBytes - a.allocBytes),
+           served ? (double)allocs / served : 0.0);
+  } else {
+    printf("heap:   allocation counting needs glibc\n");
+  }
+  if (s_pipeline) {
+    static char json[1536];
+    frame_pipeline_stats_json(json, sizeof(json));
+    printf("pipeline: %s\n", json);
+  }
+}
+
+static void usage() {
+  printf("usage: rtsp_bench [-c clients] [-t seconds] [-w warmup_s] [-f fps]\n"
+         "                  [-u] [-p] [-z] [-i input]\n"
+         "  -c  RTSP clients (1..%d, default 1)\n"
+         "  -t  measured seconds (default 10), after -w warm-up (default 2)\n"
+         "  -f  frames per second per client, 0 = unpaced (default 0)\n"
+         "  -u  RTP over UDP instead of interleaved TCP\n"
+         "  -p  device pipeline (frame_pipeline, one shared streamer, 1 client,\n"
+         "      paced by the stream's FrameRateLimit or -f)\n"
+         "  -z  exit with status 3 if anything allocates after warm-up\n"
+#ifdef VIDEO_CODEC_H264
+         "  -i  Annex-B H.264 file to replay (default: synthetic GOP)\n",
+#else
+         "  -i  directory of JPEG files to replay (default: synthetic frame)\n",
+#endif
+         BENCH_MAX_CLIENTS);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "c:t:w:f:upzi:h")) != -1) {
+    switch (opt) {
+    case 'c': s_clients = atoi(optarg); break;
+    case 't': s_seconds = atoi(optarg); break;
+    case 'w': s_warmup = atoi(optarg); break;
+    case 'f': s_fps = atoi(optarg); break;
+    case 'u': s_udp = true; break;
+    case 'p': s_pipeline = true; break;
+    case 'z': s_zeroAlloc = true; break;
+    case 'i': s_input = optarg; break;
+    default: usage(); return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (s_clients < 1 || s_clients > BENCH_MAX_CLIENTS || s_seconds < 1 ||
+      (s_pipeline && s_clients != 1)) {
+    usage();
+    return 2;
+  }
+
+#ifdef VIDEO_CODEC_H264
+  if (!mock_camera_open(MOCK_H264, s_input))
+    return 1;
+#else
+  if (!mock_camera_open(MOCK_JPEG, s_input))
+    return 1;
+#endif
+  media_config_init();
+  rtsp_auth_init(WEB_USER, WEB_PASS, RTSP_AUTH_REALM);
+  metrics_init();
+
+  if (s_pipeline) {
+    if (s_fps) {
+      VideoEncoderConfig cfg = media_config_get(MEDIA_MAIN);
+      cfg.fps = s_fps;
+      media_config_set(MEDIA_MAIN, cfg);
+    }
+    s_shared = new_streamer();
+    if (!s_shared)
+      return 1;
+    frame_pipeline_start();
+  }
+  if (!server_listen())
+    return 1;
+
+  printf("[INFO] rtsp_bench: %d %s client(s) on port %u, %s, %s\n", s_clients,
+         s_udp ? "UDP" : "TCP", s_port, s_pipeline ? "frame pipeline" : "streamer per client",
+         s_fps ? "paced" : "unpaced");
+
+  pthread_t control, sender;
+  pthread_create(&control, nullptr, control_main, nullptr);
+  if (!s_pipeline)
+    pthread_create(&sender, nullptr, sender_main, nullptr);
+  for (int i = 0; i < s_clients; i++) {
+    s_clientList[i].id = i;
+    pthread_create(&s_clientList[i].thread, nullptr, client_main, &s_clientList[i]);
+  }
+
+  platdelayms(s_warmup * 1000);
+  Snapshot start, end;
+  take_snapshot(start);
+  platdelayms(s_seconds * 1000);
+  take_snapshot(end);
+
+  // Senders first, while the clients still read: a sender blocked on a full
+  // socket buffer would never return otherwise
+  s_sendersStop = true;
+  if (s_pipeline) {
+    while (frame_pipeline_attached())
+      platdelayms(1);
+  } else {
+    pthread_join(sender, nullptr);
+  }
+  s_stop = true;
+  int connected = 0;
+  for (int i = 0; i < s_clients; i++) {
+    pthread_join(s_clientList[i].thread, nullptr);
+    connected += s_clientList[i].ok;
+    client_teardown(s_clientList[i]);
+  }
+  platdelayms(50);
+  s_serverStop = true;
+  pthread_join(control, nullptr);
+
+  report(start, end);
+  for (int i = 0; i < BENCH_MAX_CLIENTS; i++) {
+    s_sessionPool.destroy(s_slots[i].session.load()); // closes the connection
+    if (!s_pipeline)
+      delete s_slots[i].streamer;
+  }
+  delete s_shared;
+  for (int i = 0; i < s_clients; i++) {
+    close(s_clientList[i].fd);
+    if (s_clientList[i].rtpFd > 0)
+      close(s_clientList[i].rtpFd);
+  }
+  if (connected != s_clients)
+    return 1;
+  if (s_zeroAlloc && end.allocs != start.allocs) {
+    printf("[ERROR] rtsp_bench: steady state allocated %llu times\n",
+           (unsigned long long)(end.allocs - start.allocs));
+    return 3;
+  }
+  return 0;
+}
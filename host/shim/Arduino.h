@@ -0,0 +1,72 @@
+#pragma once
+// Host (Linux) stand-in for the parts of the Arduino-ESP32 core used by the
+// streaming, RTSP and ONVIF parsing sources. Just enough to compile them
+// unchanged against platglue-posix.h; see host/CMakeLists.txt.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/time.h>
+#include <time.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define IRAM_ATTR
+
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+long random(long max);
+long random(long min, long max);
+bool psramFound();
+uint32_t getCpuFrequencyMhz();
+
+// Minimal Arduino String: what LOG_* and the error paths build
+class String {
+public:
+  String(const char *s = "") : m_s(s ? s : "") {}
+  String(const std::string &s) : m_s(s) {}
+  String(int v) : m_s(std::to_string(v)) {}
+  String(unsigned int v) : m_s(std::to_string(v)) {}
+  String(long v) : m_s(std::to_string(v)) {}
+  String(unsigned long v) : m_s(std::to_string(v)) {}
+  const char *c_str() const { return m_s.c_str(); }
+  unsigned int length() const { return m_s.size(); }
+  String &operator+=(const String &o) { m_s += o.m_s; return *this; }
+  friend String operator+(const String &a, const String &b) { return String(a.m_s + b.m_s); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.m_s); }
+  friend String operator+(const String &a, const char *b) { return String(a.m_s + b); }
+
+private:
+  std::string m_s;
+};
+
+// Serial goes to stdout
+class HardwareSerial {
+public:
+  void begin(unsigned long) {}
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char *s) { return fputs(s, stdout) >= 0 ? strlen(s) : 0; }
+  size_t print(const String &s) { return print(s.c_str()); }
+  size_t println(const char *s = "") { return print(s) + print("\n"); }
+  size_t println(const String &s) { return println(s.c_str()); }
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getCycleCount();
+  void restart() { exit(0); }
+};
+extern EspClass ESP;
@@ -0,0 +1,52 @@
+#pragma once
+// Host stand-in for the Arduino-ESP32 filesystem API: paths are host
+// paths. Files are shared handles like the ESP32's, closed with the last
+// copy or close().
+#include <Arduino.h>
+#include <memory>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File {
+public:
+  File() {}
+  explicit File(FILE *f) : m_f(f, fclose) {}
+  explicit operator bool() const { return m_f != nullptr; }
+  size_t read(uint8_t *buf, size_t size) { return m_f ? fread(buf, 1, size, m_f.get()) : 0; }
+  size_t write(const uint8_t *buf, size_t size) {
+    return m_f ? fwrite(buf, 1, size, m_f.get()) : 0;
+  }
+  bool seek(uint32_t pos) { return m_f && fseek(m_f.get(), pos, SEEK_SET) == 0; }
+  size_t size() const {
+    struct stat st;
+    return m_f && fstat(fileno(m_f.get()), &st) == 0 ? st.st_size : 0;
+  }
+  void close() { m_f.reset(); }
+
+private:
+  std::shared_ptr<FILE> m_f;
+};
+
+class FS {
+public:
+  File open(const char *path, const char *mode = FILE_READ) {
+    FILE *f = fopen(path, mode);
+    return f ? File(f) : File();
+  }
+  bool exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+  }
+  bool remove(const char *path) { return ::remove(path) == 0; }
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
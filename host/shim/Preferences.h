@@ -0,0 +1,14 @@
+#pragma once
+// Host stand-in for the NVS-backed Preferences: nothing is persisted, so
+// every run starts from the config.h defaults
+#include <stddef.h>
+#include <stdint.h>
+
+class Preferences {
+public:
+  bool begin(const char *ns, bool readOnly = false) { (void)ns; (void)readOnly; return false; }
+  void end() {}
+  size_t putBytes(const char *, const void *, size_t) { return 0; }
+  size_t getBytes(const char *, void *, size_t) { return 0; }
+  size_t getBytesLength(const char *) { return 0; }
+};
@@ -0,0 +1,4 @@
+#pragma once
+// Host stand-in: included through onvif_server.h; the host sources use
+// nothing from it
+#include <Arduino.h>
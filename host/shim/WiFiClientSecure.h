@@ -0,0 +1,31 @@
+#pragma once
+// Host stand-in: a TLS client on OpenSSL with the calls https_client makes.
+// Like the ESP32 client it verifies nothing after setInsecure(), reads
+// without blocking once connected, and connected() stays true while
+// decrypted bytes are left even after the peer closed.
+#include <Arduino.h>
+
+struct ssl_st;
+
+class WiFiClientSecure {
+public:
+  WiFiClientSecure() {}
+  ~WiFiClientSecure() { stop(); }
+  WiFiClientSecure(const WiFiClientSecure &) = delete;
+  WiFiClientSecure &operator=(const WiFiClientSecure &) = delete;
+
+  void setInsecure() { m_insecure = true; }
+  int connect(const char *host, uint16_t port);
+  uint8_t connected();
+  void stop();
+  size_t write(const uint8_t *buf, size_t size);
+  int available();
+  int read();
+  int read(uint8_t *buf, size_t size);
+
+private:
+  int m_fd = -1;
+  ssl_st *m_ssl = nullptr;
+  bool m_insecure = false;
+  bool m_eof = false; // peer closed or the connection failed
+};
@@ -0,0 +1,74 @@
+#pragma once
+// Host stand-in for the esp32-camera driver API. Types follow the driver's
+// (subset, same names and field order); the functions are implemented by
+// mock_camera.cpp, which replays recorded frames.
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef enum {
+  PIXFORMAT_RGB565,
+  PIXFORMAT_YUV422,
+  PIXFORMAT_YUV420,
+  PIXFORMAT_GRAYSCALE,
+  PIXFORMAT_JPEG,
+  PIXFORMAT_RGB888,
+  PIXFORMAT_RAW,
+} pixformat_t;
+
+typedef enum {
+  FRAMESIZE_96X96,
+  FRAMESIZE_QQVGA,
+  FRAMESIZE_QCIF,
+  FRAMESIZE_HQVGA,
+  FRAMESIZE_240X240,
+  FRAMESIZE_QVGA,
+  FRAMESIZE_CIF,
+  FRAMESIZE_HVGA,
+  FRAMESIZE_VGA,
+  FRAMESIZE_SVGA,
+  FRAMESIZE_XGA,
+  FRAMESIZE_HD,
+  FRAMESIZE_SXGA,
+  FRAMESIZE_UXGA,
+  FRAMESIZE_INVALID
+} framesize_t;
+
+typedef struct {
+  const uint16_t width;
+  const uint16_t height;
+  const uint8_t aspect_ratio;
+} resolution_info_t;
+
+// Indexed by framesize_t
+extern const resolution_info_t resolution[];
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t width;
+  size_t height;
+  pixformat_t format;
+  struct timeval timestamp;
+} camera_fb_t;
+
+typedef struct {
+  framesize_t framesize;
+  uint8_t quality;
+} camera_status_t;
+
+typedef struct _sensor sensor_t;
+struct _sensor {
+  camera_status_t status;
+  pixformat_t pixformat;
+  int (*set_framesize)(sensor_t *sensor, framesize_t framesize);
+  int (*set_quality)(sensor_t *sensor, int quality);
+};
+
+camera_fb_t *esp_camera_fb_get();
+void esp_camera_fb_return(camera_fb_t *fb);
+sensor_t *esp_camera_sensor_get();
@@ -0,0 +1,13 @@
+#pragma once
+// Host stand-in: every capability is plain malloc
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void *heap_caps_malloc(size_t size, unsigned caps) { (void)caps; return malloc(size); }
+inline void heap_caps_free(void *p) { free(p); }
+
+// Room for anything the host build asks for
+inline size_t heap_caps_get_largest_free_block(unsigned caps) { (void)caps; return 1u << 20; }
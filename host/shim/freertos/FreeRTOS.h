@@ -0,0 +1,14 @@
+#pragma once
+// Host stand-in: ticks are milliseconds, just what the firmware's timeouts
+// need (pdMS_TO_TICKS, portMAX_DELAY)
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
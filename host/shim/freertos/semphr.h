@@ -0,0 +1,61 @@
+#pragma once
+// Host stand-in: mutexes and counting semaphores on pthreads. A mutex is a
+// counting semaphore of one, which is all the firmware relies on (no
+// recursion, no priority inheritance).
+#include "FreeRTOS.h"
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+struct HostSemaphore {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  UBaseType_t count;
+  UBaseType_t max;
+};
+typedef HostSemaphore *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+  SemaphoreHandle_t s = new HostSemaphore;
+  pthread_mutex_init(&s->lock, nullptr);
+  pthread_cond_init(&s->cond, nullptr);
+  s->count = initial;
+  s->max = max;
+  return s;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return xSemaphoreCreateCounting(1, 1); }
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) {
+  timespec until;
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_sec += ticks / 1000;
+  until.tv_nsec += (long)(ticks % 1000) * 1000000L;
+  if (until.tv_nsec >= 1000000000L) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000L;
+  }
+  pthread_mutex_lock(&s->lock);
+  int err = 0;
+  while (!s->count && err != ETIMEDOUT) {
+    if (ticks == portMAX_DELAY)
+      pthread_cond_wait(&s->cond, &s->lock);
+    else
+      err = pthread_cond_timedwait(&s->cond, &s->lock, &until);
+  }
+  bool got = s->count > 0;
+  if (got)
+    s->count--;
+  pthread_mutex_unlock(&s->lock);
+  return got ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+  pthread_mutex_lock(&s->lock);
+  bool ok = s->count < s->max;
+  if (ok)
+    s->count++;
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+  return ok ? pdTRUE : pdFALSE;
+}
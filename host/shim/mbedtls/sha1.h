@@ -0,0 +1,5 @@
+#pragma once
+// Host stand-in, implemented on OpenSSL libcrypto (host_platform.cpp)
+#include <stddef.h>
+
+int mbedtls_sha1(const unsigned char *input, size_t ilen, unsigned char output[20]);
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+
+// ==============================================================================
+//   check.h - minimal assertions for the host tests (ctest)
+// ==============================================================================
+// A failed CHECK prints its location and lets the test carry on, so one run
+// reports every failure. main() returns check_result(): non-zero on failure.
+// ==============================================================================
+
+static int s_checkFailures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      s_checkFailures++;                                                       \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+  do {                                                                         \
+    long long va_ = (long long)(a), vb_ = (long long)(b);                      \
+    if (va_ != vb_) {                                                          \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n",        \
+              __FILE__, __LINE__, #a, #b, va_, vb_);                           \
+      s_checkFailures++;                                                       \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_STR(a, b)                                                        \
+  do {                                                                         \
+    const char *sa_ = (a), *sb_ = (b);                                         \
+    if (strcmp(sa_, sb_)) {                                                    \
+      fprintf(stderr, "%s:%d: CHECK_STR(%s, %s) failed:\n  \"%s\"\n  \"%s\"\n", \
+              __FILE__, __LINE__, #a, #b, sa_, sb_);                           \
+      s_checkFailures++;                                                       \
+    }                                                                          \
+  } while (0)
+
+static inline int check_result(const char *name) {
+  if (s_checkFailures) {
+    fprintf(stderr, "%s: %d check(s) failed\n", name, s_checkFailures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
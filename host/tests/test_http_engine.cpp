@@ -0,0 +1,288 @@
+// http_engine parking (http_defer), the way ONVIF PullMessages uses it: a
+// parked request doesn't hold up the loop or other connections, is answered
+// as soon as its condition holds or at its deadline, keeps the requests
+// pipelined behind it in order, and is dropped quietly if the client leaves.
+// Then the port-80 paths: header lookup and extra response headers, chunked
+// responses, a file sent to a slow reader while others are served, an upload
+// larger than the connection buffer, and a connection handed to a task.
+
+#include "check.h"
+#include "config.h"
+#include "http_engine.h"
+#include <FS.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const uint32_t PARK_MS = 300;
+static uint16_t s_port;
+static bool s_ready = false;
+static int s_resumeCalls = 0;
+
+static bool resume(HttpConn &conn, void *ctx, bool timedOut) {
+  s_resumeCalls++;
+  if (!s_ready && !timedOut)
+    return false;
+  http_send(conn, 200, "text/plain", s_ready ? (const char *)ctx : "timeout");
+  return true;
+}
+
+static void handle_wait(HttpConn &conn) {
+  static const char READY[] = "ready";
+  http_defer(conn, PARK_MS, resume, (void *)READY);
+}
+
+static void handle_now(HttpConn &conn) { http_send(conn, 200, "text/plain", "now"); }
+
+static void handle_chunked(HttpConn &conn) {
+  char name[16];
+  if (!http_header(conn, "x-name", name, sizeof(name)))
+    strcpy(name, "none");
+  http_add_header(conn, "X-Seen", name);
+  http_begin_response(conn, 200, "text/plain", HTTP_LENGTH_UNKNOWN);
+  http_write(conn, "ab", 2);
+  http_write(conn, "", 0);
+  http_write(conn, "cde", 3);
+}
+
+static char s_filePath[] = "/tmp/test_http_engine_XXXXXX";
+
+static void handle_file(HttpConn &conn) {
+  fs::FS disk;
+  fs::File f = disk.open(s_filePath);
+  http_send_file(conn, 200, "application/octet-stream", f);
+}
+
+static std::string s_upload;
+static bool s_uploadInOrder = true;
+
+static void upload_body(HttpConn &conn, size_t offset, const uint8_t *data, size_t len) {
+  s_uploadInOrder &= offset == s_upload.size() && conn.path[0] == '/';
+  s_upload.append((const char *)data, len);
+}
+
+static void handle_upload(HttpConn &conn) {
+  char size[16];
+  snprintf(size, sizeof(size), "%u/%u", (unsigned)s_upload.size(), (unsigned)conn.bodyLen);
+  http_send(conn, 200, "text/plain", size);
+}
+
+static int s_detached = -1;
+
+static void handle_detach(HttpConn &conn) { s_detached = http_detach(conn); }
+
+static int client_connect() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(s_port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  http_engine_poll(10); // accept
+  return fd;
+}
+
+static void client_send(int fd, const char *text) { send(fd, text, strlen(text), 0); }
+
+// Response body after the header, with the chunk framing left in
+static std::string body_of(const std::string &response) {
+  size_t at = response.find("\r\n\r\n");
+  return at == std::string::npos ? "" : response.substr(at + 4);
+}
+
+// Polls the engine for ms, collecting whatever the server sent on fd
+static std::string pump(int fd, uint32_t ms) {
+  std::string got;
+  uint32_t start = millis();
+  do {
+    http_engine_poll(5);
+    char buf[512];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+      got.append(buf, n);
+  } while (millis() - start < ms);
+  return got;
+}
+
+static int count(const std::string &s, const char *what) {
+  int n = 0;
+  for (size_t at = s.find(what); at != std::string::npos; at = s.find(what, at + 1))
+    n++;
+  return n;
+}
+
+static const char WAIT[] = "POST /wait HTTP/1.1\r\nHost: cam\r\nContent-Length: 4\r\n\r\nbody";
+static const char NOW[] = "GET /now HTTP/1.1\r\nHost: cam\r\n\r\n";
+
+int main() {
+  signal(SIGPIPE, SIG_IGN);
+  s_port = 20000 + getpid() % 20000;
+  if (!http_engine_listen(s_port)) {
+    fprintf(stderr, "cannot listen on %u\n", s_port);
+    return 1;
+  }
+  http_engine_on(s_port, "/wait", VERB_POST, handle_wait);
+  http_engine_on(s_port, "/now", VERB_GET, handle_now);
+  http_engine_on(s_port, "/chunked", VERB_GET, handle_chunked);
+  http_engine_on(s_port, "/file", VERB_GET, handle_file);
+  http_engine_on_upload(s_port, "/upload", VERB_POST, upload_body, handle_upload);
+  http_engine_on(s_port, "/detach", VERB_GET, handle_detach);
+
+  // The wait for traffic is not work: an idle round reports next to nothing
+  uint32_t waited = millis();
+  CHECK(http_engine_poll(30) < 5000);
+  CHECK(millis() - waited >= 25);
+
+  // Parked with a request pipelined behind it: nothing comes back, yet a
+  // second connection is served right away
+  int a = client_connect();
+  int b = client_connect();
+  CHECK(a >= 0 && b >= 0);
+  std::string wait = WAIT;
+  client_send(a, (wait + NOW).c_str());
+  CHECK_EQ(pump(a, 50).size(), 0);
+  client_send(b, NOW);
+  std::string other = pump(b, 20);
+  CHECK(other.find("200 OK") != std::string::npos);
+  CHECK(other.find("\r\n\r\nnow") != std::string::npos);
+  CHECK(s_resumeCalls > 0);
+
+  // Condition met: answered on the next round, then the pipelined request
+  s_ready = true;
+  std::string got = pump(a, 30);
+  CHECK_EQ(count(got, "HTTP/1.1 200 OK"), 2);
+  size_t ready = got.find("\r\n\r\nready");
+  size_t now = got.find("\r\n\r\nnow");
+  CHECK(ready != std::string::npos && now != std::string::npos && ready < now);
+  CHECK(got.find("Connection: keep-alive") != std::string::npos);
+
+  // Nothing happens: answered at the deadline, not before and not much after
+  s_ready = false;
+  uint32_t start = millis();
+  client_send(a, WAIT);
+  got.clear();
+  while (got.empty() && millis() - start < PARK_MS * 3)
+    got = pump(a, 5);
+  uint32_t took = millis() - start;
+  CHECK(got.find("\r\n\r\ntimeout") != std::string::npos);
+  CHECK(took >= PARK_MS);
+  CHECK(took < PARK_MS + 100);
+
+  // Client gone while parked: the request is dropped, resume never runs again
+  client_send(b, WAIT);
+  pump(b, 20);
+  close(b);
+  pump(a, 20);
+  int calls = s_resumeCalls;
+  pump(a, PARK_MS + 50);
+  CHECK_EQ(s_resumeCalls, calls);
+  HttpEngineStats stats;
+  http_engine_stats(&stats);
+  CHECK_EQ(stats.active, 1);
+
+  close(a);
+  pump(-1, 20);
+
+  // Header lookup, an extra header line and a chunked body, with the next
+  // request on the same connection answered after it
+  a = client_connect();
+  client_send(a, "GET /chunked HTTP/1.1\r\nHost: cam\r\nX-Name:  cam42\r\n\r\n");
+  client_send(a, NOW);
+  got = pump(a, 30);
+  CHECK(got.find("X-Seen: cam42\r\n") != std::string::npos);
+  CHECK(got.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+  CHECK(got.find("Content-Length") > got.find("\r\n\r\n"));
+  CHECK(body_of(got).compare(0, 28, "2\r\nab\r\n3\r\ncde\r\n0\r\n\r\nHTTP/1.1") == 0);
+  CHECK(got.find("\r\n\r\nnow") != std::string::npos);
+  client_send(a, NOW);
+  CHECK(pump(a, 20).find("X-Seen") == std::string::npos);
+
+  // A file much larger than the socket buffers, to a client that doesn't
+  // read for a while: the loop keeps serving others, then the whole file
+  // arrives and the connection carries on
+  std::string file(1 << 20, '\0');
+  for (size_t i = 0; i < file.size(); i++)
+    file[i] = (char)(i * 31 + i / 4096);
+  int tmp = mkstemp(s_filePath);
+  CHECK(tmp >= 0 && write(tmp, file.data(), file.size()) == (ssize_t)file.size());
+  close(tmp);
+  b = socket(AF_INET, SOCK_STREAM, 0);
+  int small = 4096;
+  setsockopt(b, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(s_port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  CHECK_EQ(connect(b, (struct sockaddr *)&addr, sizeof(addr)), 0);
+  http_engine_poll(10);
+  client_send(b, "GET /file HTTP/1.1\r\nHost: cam\r\n\r\n");
+  client_send(b, NOW);
+  start = millis();
+  for (int i = 0; i < 5; i++) {
+    client_send(a, NOW);
+    CHECK(pump(a, 10).find("\r\n\r\nnow") != std::string::npos);
+  }
+  CHECK(millis() - start < 500);
+  fcntl(b, F_SETFL, fcntl(b, F_GETFL, 0) | O_NONBLOCK);
+  got.clear();
+  start = millis();
+  while (got.find("\r\n\r\nnow", file.size()) == std::string::npos &&
+         millis() - start < 3000)
+    got += pump(b, 5);
+  std::string sent = body_of(got);
+  CHECK(sent.compare(0, file.size(), file) == 0);
+  CHECK(sent.find("\r\n\r\nnow", file.size()) != std::string::npos);
+  unlink(s_filePath);
+
+  // An upload several times the connection buffer, sent in pieces
+  std::string image(5 * HTTP_CONN_BUFFER_SIZE + 123, '\0');
+  for (size_t i = 0; i < image.size(); i++)
+    image[i] = (char)(i * 13);
+  char head[128];
+  snprintf(head, sizeof(head), "POST /upload HTTP/1.1\r\nContent-Length: %u\r\n\r\n",
+           (unsigned)image.size());
+  client_send(a, head);
+  got.clear();
+  for (size_t at = 0; at < image.size(); at += 1000) {
+    size_t n = image.size() - at < 1000 ? image.size() - at : 1000;
+    CHECK_EQ(send(a, image.data() + at, n, 0), (ssize_t)n);
+    got += pump(a, 1);
+  }
+  client_send(a, NOW);
+  got += pump(a, 20);
+  CHECK(s_upload == image);
+  CHECK(s_uploadInOrder);
+  char expect[32];
+  snprintf(expect, sizeof(expect), "\r\n\r\n%u/0", (unsigned)image.size());
+  CHECK(got.find(expect) != std::string::npos);
+  CHECK(got.find("\r\n\r\nnow") != std::string::npos);
+
+  // Too large for the buffer and no body callback: refused before the body
+  client_send(b, "POST /now HTTP/1.1\r\nContent-Length: 100000\r\n\r\n");
+  CHECK(pump(b, 20).find("413 Payload Too Large") != std::string::npos);
+  close(b);
+
+  // Handed over: the engine lets go of the connection, its new owner writes
+  // to the blocking socket and closes it
+  client_send(a, "GET /detach HTTP/1.1\r\nHost: cam\r\n\r\n");
+  pump(a, 20);
+  CHECK(s_detached >= 0);
+  CHECK_EQ(fcntl(s_detached, F_GETFL, 0) & O_NONBLOCK, 0);
+  http_engine_stats(&stats);
+  CHECK_EQ(stats.active, 0);
+  CHECK_EQ(write(s_detached, "raw", 3), 3);
+  close(s_detached);
+  got = pump(a, 20);
+  CHECK_STR(got.c_str(), "raw");
+  close(a);
+  return check_result("test_http_engine");
+}
@@ -0,0 +1,286 @@
+// https_client against a local TLS server: a kept-alive connection carries
+// the next request without a handshake, one the server closed while idle
+// is noticed and replaced, one the server drops as a request arrives is
+// retried once on a fresh connection, and never more than once; a fresh
+// connection that got the whole request is never retried. Multipart
+// files go out whole, from memory or streamed from a file.
+
+#include "check.h"
+#include "config.h"
+#include "https_client.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <mutex>
+#include <netinet/in.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static uint16_t s_port;
+static std::atomic<int> s_accepted{0};
+static std::atomic<int> s_requests{0};
+static std::atomic<int> s_dropNext{0};      // requests to read, then close unanswered
+static std::atomic<bool> s_closeIdle{false}; // close the connection while idle
+static std::atomic<bool> s_stop{false};
+static std::mutex s_bodyLock;
+static std::string s_lastBody; // of the last request
+
+// Self-signed P-256 certificate made up for the run
+static SSL_CTX *server_ctx() {
+  EVP_PKEY *key = EVP_EC_gen("P-256");
+  X509 *cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, key);
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost",
+                             -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  X509_sign(cert, key, EVP_sha256());
+
+  SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+  SSL_CTX_use_certificate(ctx, cert);
+  SSL_CTX_use_PrivateKey(ctx, key);
+  X509_free(cert);
+  EVP_PKEY_free(key);
+  return ctx;
+}
+
+// Waits for the next request, false when it's time to close the connection
+static bool wait_request(SSL *ssl, int fd) {
+  while (!s_stop) {
+    if (SSL_pending(ssl))
+      return true;
+    if (s_closeIdle.exchange(false)) {
+      SSL_shutdown(ssl);
+      return false;
+    }
+    pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, 10) > 0)
+      return true;
+  }
+  return false;
+}
+
+// Headers and Content-Length body of one request; false if the client left
+static bool read_request(SSL *ssl, std::string *body) {
+  std::string req;
+  char buf[1024];
+  size_t end;
+  while ((end = req.find("\r\n\r\n")) == std::string::npos) {
+    int n = SSL_read(ssl, buf, sizeof(buf));
+    if (n <= 0)
+      return false;
+    req.append(buf, n);
+  }
+  size_t at = req.find("Content-Length: ");
+  size_t want = at == std::string::npos ? 0 : strtoul(req.c_str() + at + 16, nullptr, 10);
+  *body = req.substr(end + 4);
+  while (body->size() < want) {
+    int n = SSL_read(ssl, buf, sizeof(buf));
+    if (n <= 0)
+      return false;
+    body->append(buf, n);
+  }
+  return true;
+}
+
+static void serve(SSL_CTX *ctx, int listenFd) {
+  static const char REPLY[] =
+      "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nok";
+  while (!s_stop) {
+    pollfd p = {listenFd, POLLIN, 0};
+    if (poll(&p, 1, 10) <= 0)
+      continue;
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+    s_accepted++;
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (SSL_accept(ssl) == 1) {
+      std::string body;
+      while (wait_request(ssl, fd) && read_request(ssl, &body)) {
+        s_requests++;
+        {
+          std::lock_guard<std::mutex> lock(s_bodyLock);
+          s_lastBody = body;
+        }
+        if (s_dropNext > 0) {
+          s_dropNext--;
+          break;
+        }
+        SSL_write(ssl, REPLY, sizeof(REPLY) - 1);
+      }
+    }
+    SSL_free(ssl);
+    close(fd);
+  }
+}
+
+static int listen_local() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (bind(fd, (struct sockaddr *)&addr, len) != 0 || listen(fd, 4) != 0) {
+    close(fd);
+    return -1;
+  }
+  getsockname(fd, (struct sockaddr *)&addr, &len);
+  s_port = ntohs(addr.sin_port);
+  return fd;
+}
+
+static std::string last_body() {
+  std::lock_guard<std::mutex> lock(s_bodyLock);
+  return s_lastBody;
+}
+
+static int get(char *body, size_t size) {
+  HttpsResponse resp;
+  return https_request("127.0.0.1", s_port, "GET", "/ping", nullptr, &resp, body, size);
+}
+
+int main() {
+  int listenFd = listen_local();
+  if (listenFd < 0) {
+    fprintf(stderr, "cannot listen\n");
+    return 1;
+  }
+  SSL_CTX *ctx = server_ctx();
+  std::thread server(serve, ctx, listenFd);
+  HttpsStats st;
+  char body[16];
+
+  // First request pays the handshake
+  CHECK_EQ(get(body, sizeof(body)), 200);
+  CHECK_STR(body, "ok");
+  https_stats(&st);
+  CHECK_EQ(st.handshakes, 1);
+  CHECK_EQ(st.reused, 0);
+  CHECK_EQ(st.open, 1);
+
+  // Keep-alive: a multipart upload on the same connection, sent in full
+  static const uint8_t PHOTO[3000] = {0xff, 0xd8};
+  HttpsMultipart mp;
+  https_multipart_begin(&mp);
+  https_multipart_field(&mp, "chat_id", "42");
+  https_multipart_file(&mp, "photo", "a.jpg", "image/jpeg", PHOTO, sizeof(PHOTO));
+  CHECK(https_multipart_end(&mp));
+  HttpsResponse resp;
+  CHECK_EQ(https_request("127.0.0.1", s_port, "POST", "/up", &mp, &resp), 200);
+  CHECK(resp.keepAlive);
+  std::string sent = last_body();
+  CHECK_EQ(sent.size(), mp.length);
+  CHECK(sent.find("\r\n\r\n42\r\n") != std::string::npos);
+  CHECK(sent.find(std::string((const char *)PHOTO, sizeof(PHOTO))) != std::string::npos);
+  https_stats(&st);
+  CHECK_EQ(st.handshakes, 1);
+  CHECK_EQ(st.reused, 1);
+  CHECK_EQ(s_accepted.load(), 1);
+
+  // A file part read from disk while it is sent, in several chunks
+  std::string photo(5000, '\0');
+  for (size_t i = 0; i < photo.size(); i++)
+    photo[i] = (char)(i * 7);
+  char path[] = "/tmp/test_https_client_XXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0 && write(fd, photo.data(), photo.size()) == (ssize_t)photo.size());
+  close(fd);
+  fs::FS disk;
+  HttpsMultipart fromDisk;
+  https_multipart_begin(&fromDisk);
+  https_multipart_file(&fromDisk, "p0", "p0.jpg", "image/jpeg", disk, path, photo.size());
+  https_multipart_file(&fromDisk, "p1", "p1.jpg", "image/jpeg", PHOTO, sizeof(PHOTO));
+  CHECK(https_multipart_end(&fromDisk));
+  CHECK_EQ(https_request("127.0.0.1", s_port, "POST", "/up", &fromDisk, &resp), 200);
+  sent = last_body();
+  CHECK_EQ(sent.size(), fromDisk.length);
+  size_t at = sent.find(photo);
+  CHECK(at != std::string::npos);
+  CHECK(sent.compare(at + photo.size(), 4, "\r\n--") == 0);
+
+  // Sized for HTTPS_MULTIPART_FILES photos and no more
+  https_multipart_begin(&mp);
+  for (int i = 0; i <= HTTPS_MULTIPART_FILES; i++) {
+    CHECK(!mp.overflow);
+    https_multipart_file(&mp, "p0", "p0.jpg", "image/jpeg", PHOTO, sizeof(PHOTO));
+  }
+  CHECK(!https_multipart_end(&mp));
+
+  // Server closed the idle connection: noticed on acquire, replaced
+  // without a failed attempt
+  s_closeIdle = true;
+  while (s_closeIdle)
+    delay(1);
+  delay(50);
+  int requests = s_requests;
+  CHECK_EQ(get(body, sizeof(body)), 200);
+  CHECK_EQ(s_requests - requests, 1);
+  https_stats(&st);
+  CHECK_EQ(st.handshakes, 2);
+  CHECK_EQ(st.reused, 2);
+  CHECK_EQ(s_accepted.load(), 2);
+
+  // Server drops the reused connection as the request arrives: one retry
+  // on a fresh connection gets the answer
+  s_dropNext = 1;
+  requests = s_requests;
+  CHECK_EQ(get(body, sizeof(body)), 200);
+  CHECK_STR(body, "ok");
+  CHECK_EQ(s_requests - requests, 2);
+  https_stats(&st);
+  CHECK_EQ(st.reused, 3);
+  CHECK_EQ(st.handshakes, 3);
+  CHECK_EQ(s_accepted.load(), 3);
+
+  // And only one: the second failure is returned
+  s_dropNext = 5;
+  requests = s_requests;
+  CHECK_EQ(get(body, sizeof(body)), 0);
+  CHECK_EQ(s_requests - requests, 2);
+  CHECK_EQ(s_dropNext.load(), 3);
+  https_stats(&st);
+  CHECK_EQ(st.handshakes, 4);
+  CHECK_EQ(st.open, 0);
+
+  // A fresh connection carried the whole request: the server may have acted
+  // on it, so its failure is returned as is
+  s_dropNext = 1;
+  requests = s_requests;
+  CHECK_EQ(get(body, sizeof(body)), 0);
+  CHECK_EQ(s_requests - requests, 1);
+  https_stats(&st);
+  CHECK_EQ(st.handshakes, 5);
+
+  s_dropNext = 0;
+  CHECK_EQ(get(body, sizeof(body)), 200);
+
+  // A file that is gone fails the request, on both attempts, before the
+  // server has a whole request to answer
+  unlink(path);
+  requests = s_requests;
+  CHECK_EQ(https_request("127.0.0.1", s_port, "POST", "/up", &fromDisk, &resp), 0);
+  CHECK_EQ(s_requests - requests, 0);
+
+  CHECK_EQ(get(body, sizeof(body)), 200);
+  https_stats(&st);
+  CHECK_EQ(st.failed, 0);
+  CHECK_EQ(st.open, 1);
+
+  s_stop = true;
+  server.join();
+  SSL_CTX_free(ctx);
+  close(listenFd);
+  return check_result("test_https_client");
+}
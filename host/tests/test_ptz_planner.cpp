@@ -0,0 +1,150 @@
+// ptz_planner stepped at the PTZ task's control rate: the acceleration and
+// speed limits hold on every step, position moves stop exactly on target
+// without overshoot, velocity moves brake into the end stops, and a move
+// reversed halfway ramps through zero instead of jumping.
+
+#include "check.h"
+#include "config.h"
+#include "ptz_planner.h"
+#include <math.h>
+
+static const PtzAxisLimits PAN = {PTZ_PAN_MIN, PTZ_PAN_MAX, PTZ_MAX_SPEED, PTZ_MAX_ACCEL};
+static const float DT = 1.0f / PTZ_CONTROL_HZ;
+static const float EPS = 1e-3f;
+
+// What the servo sees: velocity and acceleration from successive positions
+struct Trace {
+  int steps;
+  float minPos, maxPos;
+  float maxAccel;
+  float maxSpeed;
+  int signChanges; // of the velocity
+};
+
+// Steps the pan axis until it settles (or maxSteps), recording the extremes
+static Trace run(PtzAxisState &a, int maxSteps = 5000) {
+  Trace t = {0, a.pos, a.pos, 0.0f, 0.0f, 0};
+  float lastPos = a.pos;
+  float lastVel = a.vel;
+  float lastSign = a.vel > 0 ? 1.0f : (a.vel < 0 ? -1.0f : 0.0f);
+  while (t.steps < maxSteps) {
+    bool moving = ptz_axis_step(a, PAN, DT);
+    float vel = (a.pos - lastPos) / DT;
+    t.steps++;
+    t.minPos = fminf(t.minPos, a.pos);
+    t.maxPos = fmaxf(t.maxPos, a.pos);
+    t.maxAccel = fmaxf(t.maxAccel, fabsf(vel - lastVel) / DT);
+    t.maxSpeed = fmaxf(t.maxSpeed, fabsf(vel));
+    float sign = vel > 0 ? 1.0f : (vel < 0 ? -1.0f : 0.0f);
+    if (sign != 0.0f) {
+      if (lastSign != 0.0f && sign != lastSign)
+        t.signChanges++;
+      lastSign = sign;
+    }
+    lastPos = a.pos;
+    lastVel = vel;
+    if (!moving)
+      break;
+  }
+  // Standing still afterwards is one more step of the profile
+  t.maxAccel = fmaxf(t.maxAccel, fabsf(a.vel - lastVel) / DT);
+  return t;
+}
+
+static void check_limits(const Trace &t, const PtzAxisLimits &lim) {
+  CHECK(t.maxAccel <= lim.maxAccel * (1 + EPS));
+  CHECK(t.maxSpeed <= lim.maxSpeed * (1 + EPS));
+  CHECK(t.minPos >= lim.min);
+  CHECK(t.maxPos <= lim.max);
+}
+
+int main() {
+  PtzAxisState a;
+
+  // Long move: trapezoid at full speed, lands exactly, no overshoot
+  ptz_axis_reset(a, -80);
+  ptz_axis_goto(a, PAN, 80, 1.0f);
+  Trace t = run(a);
+  check_limits(t, PAN);
+  CHECK(t.maxPos <= 80.0f);
+  CHECK(t.maxSpeed >= PAN.maxSpeed * 0.99f);
+  CHECK_EQ(a.pos, 80.0f);
+  CHECK_EQ(a.vel, 0.0f);
+  CHECK(!ptz_axis_moving(a));
+  // 160 degrees at 90 deg/s plus one 0.5 s ramp: about 2.3 s
+  float expected = 160.0f / PAN.maxSpeed + PAN.maxSpeed / PAN.maxAccel;
+  CHECK(fabsf(t.steps * DT - expected) < 0.1f);
+
+  // Short move never reaches cruise speed (triangle), still no overshoot
+  ptz_axis_reset(a, 0);
+  ptz_axis_goto(a, PAN, -5, 1.0f);
+  t = run(a);
+  check_limits(t, PAN);
+  CHECK(t.minPos >= -5.0f);
+  CHECK(t.maxSpeed < PAN.maxSpeed);
+  CHECK_EQ(a.pos, -5.0f);
+
+  // Slow move honours the requested fraction of maxSpeed
+  ptz_axis_reset(a, 0);
+  ptz_axis_goto(a, PAN, 60, 0.25f);
+  t = run(a);
+  CHECK(t.maxSpeed <= PAN.maxSpeed * 0.25f * (1 + EPS));
+  CHECK_EQ(a.pos, 60.0f);
+
+  // Targets past the end stops are clamped
+  ptz_axis_reset(a, 0);
+  ptz_axis_goto(a, PAN, 400, 1.0f);
+  t = run(a);
+  check_limits(t, PAN);
+  CHECK_EQ(a.pos, (float)PTZ_PAN_MAX);
+
+  // ContinuousMove into an end stop: brakes within the acceleration limit
+  // and parks on it
+  ptz_axis_reset(a, 0);
+  ptz_axis_velocity(a, PAN, 1.0f);
+  t = run(a);
+  check_limits(t, PAN);
+  CHECK(fabsf(a.pos - PTZ_PAN_MAX) <= 0.05f);
+  CHECK_EQ(a.vel, 0.0f);
+  CHECK(!ptz_axis_moving(a));
+  CHECK(t.steps < 5000);
+
+  // ...and back out of it the other way
+  ptz_axis_velocity(a, PAN, -0.5f);
+  t = run(a);
+  check_limits(t, PAN);
+  CHECK(fabsf(a.pos - PTZ_PAN_MIN) <= 0.05f);
+
+  // Reversal mid-move: position target
+  ptz_axis_reset(a, 0);
+  ptz_axis_goto(a, PAN, 60, 1.0f);
+  run(a, 30); // cruising, not yet braking for 60
+  CHECK(a.vel > PAN.maxSpeed * 0.9f);
+  float turnedAt = a.pos;
+  ptz_axis_goto(a, PAN, -60, 1.0f);
+  t = run(a);
+  check_limits(t, PAN);
+  CHECK_EQ(t.signChanges, 1);
+  // It can't stop on the spot: braking distance v^2 / 2a past the turn
+  CHECK(t.maxPos > turnedAt);
+  CHECK(t.maxPos <= turnedAt + PAN.maxSpeed * PAN.maxSpeed / (2 * PAN.maxAccel) + 1.0f);
+  CHECK(t.minPos >= -60.0f);
+  CHECK_EQ(a.pos, -60.0f);
+
+  // Reversal mid-move: ContinuousMove, then Stop
+  ptz_axis_reset(a, 0);
+  ptz_axis_velocity(a, PAN, 1.0f);
+  run(a, 40);
+  ptz_axis_velocity(a, PAN, -1.0f);
+  t = run(a, 50);
+  check_limits(t, PAN);
+  CHECK_EQ(t.signChanges, 1);
+  CHECK(a.vel < 0.0f);
+  ptz_axis_stop(a);
+  t = run(a);
+  check_limits(t, PAN);
+  CHECK_EQ(a.vel, 0.0f);
+  CHECK(!ptz_axis_moving(a));
+
+  return check_result("test_ptz_planner");
+}
@@ -0,0 +1,188 @@
+// rate_controller against a simulated lossy link. Each trace phase is a
+// link (throughput, loss, RTT, RSSI) held for some windows; the simulator
+// turns the controller's quality and frame interval into what the sender
+// would have seen in that window. Checks: it steps down under congestion
+// (quality first, both on stalls), holds instead of oscillating on a link
+// near capacity, and recovers only after clean windows.
+//
+//   RATE_TRACE=1 test_rate_controller   prints every window
+
+#include "check.h"
+#include "config.h"
+#include "rate_controller.h"
+#include <stdlib.h>
+
+static const RateControlLimits LIMITS = {RATE_CTRL_QUALITY_STEP, RATE_CTRL_MAX_QUALITY_DROP,
+                                         RATE_CTRL_MAX_INTERVAL_MS, RATE_CTRL_RECOVER_WINDOWS,
+                                         RATE_CTRL_WEAK_RSSI};
+static const uint32_t BASE_INTERVAL_MS = 50; // 20 fps configured
+
+struct Link {
+  const char *name;
+  uint32_t kbytesPerS; // goodput without loss
+  uint32_t lossPermille;
+  uint32_t rttMs;
+  int8_t rssi;
+  int windows;
+};
+
+// A 640x480 JPEG at the configured quality; every quality step shrinks it
+static uint32_t frame_bytes(uint8_t qualityDrop) {
+  return 24000 - qualityDrop * 800;
+}
+
+// One RATE_CTRL_WINDOW_MS of sending on the link at the current settings.
+// Each lost 1460-byte segment costs one RTT for its retransmission; a frame
+// whose write takes longer than RTSP_SEND_TIMEOUT_MS counts as a stall. The
+// camera keeps producing at intervalMs, so a sender that can't keep up sees
+// frames superseded.
+static RateWindow simulate(const Link &l, const RateControlState &st) {
+  uint32_t bytes = frame_bytes(st.qualityDrop);
+  uint32_t segments = (bytes + 1459) / 1460;
+  double sendMs = (double)bytes / l.kbytesPerS + segments * l.lossPermille / 1000.0 * l.rttMs;
+
+  uint32_t offered = RATE_CTRL_WINDOW_MS / st.intervalMs;
+  double slotMs = sendMs > st.intervalMs ? sendMs : st.intervalMs;
+  uint32_t sent = (uint32_t)(RATE_CTRL_WINDOW_MS / slotMs);
+  if (sent == 0)
+    sent = 1;
+  if (sent > offered)
+    sent = offered;
+
+  RateWindow w;
+  w.frames = sent;
+  w.dropped = offered - sent;
+  w.stalls = sendMs > RTSP_SEND_TIMEOUT_MS ? sent : 0;
+  w.sendUsTotal = (uint64_t)(sendMs * 1000) * sent;
+  w.rssi = l.rssi;
+  return w;
+}
+
+struct PhaseResult {
+  uint32_t steps;     // adjustments during the phase
+  uint32_t reversals; // step-down after step-up or the other way round
+  int firstChange;    // window of the first adjustment, -1 if none
+  RateControlState end;
+};
+
+static bool s_trace = false;
+
+static PhaseResult run(RateControlState &st, const Link &l) {
+  PhaseResult r = {0, 0, -1, st};
+  int lastDir = 0;
+  for (int i = 0; i < l.windows; i++) {
+    RateWindow w = simulate(l, st);
+    uint8_t q = st.qualityDrop;
+    uint32_t iv = st.intervalMs;
+    if (rate_control_update(st, LIMITS, BASE_INTERVAL_MS, w)) {
+      int dir = (st.qualityDrop > q || st.intervalMs > iv) ? -1 : 1;
+      if (lastDir && dir != lastDir)
+        r.reversals++;
+      lastDir = dir;
+      r.steps++;
+      if (r.firstChange < 0)
+        r.firstChange = i;
+    }
+    if (s_trace)
+      printf("%-10s %3d: frames %2u dropped %2u stalls %2u avg %6.1f ms -> q+%-2u %4u ms %s\n",
+             l.name, i, w.frames, w.dropped, w.stalls,
+             w.frames ? w.sendUsTotal / 1000.0 / w.frames : 0.0, st.qualityDrop,
+             st.intervalMs, rate_control_reason_str(st.reason));
+  }
+  r.end = st;
+  return r;
+}
+
+int main() {
+  s_trace = getenv("RATE_TRACE") != nullptr;
+  RateControlState st;
+
+  // A good link never adapts
+  rate_control_reset(st, BASE_INTERVAL_MS);
+  PhaseResult good = run(st, {"good", 2000, 0, 5, -50, 30});
+  CHECK_EQ(good.steps, 0);
+  CHECK_EQ(st.reason, RATE_STEADY);
+
+  // Loss on a long RTT: sends get slow. Quality goes first, the frame rate
+  // only once quality is used up, and it settles without oscillating.
+  rate_control_reset(st, BASE_INTERVAL_MS);
+  run(st, {"good", 2000, 0, 5, -50, 5});
+  PhaseResult lossy = run(st, {"lossy", 1000, 60, 120, -60, 60});
+  CHECK_EQ(lossy.firstChange, 0);
+  CHECK(st.qualityDrop > 0);
+  CHECK_EQ(lossy.reversals, 0);
+  // Steady link, steady decision: nothing moves in the second half
+  PhaseResult settled = run(st, {"lossy", 1000, 60, 120, -60, 30});
+  CHECK_EQ(settled.steps, 0);
+  CHECK(st.reason == RATE_HOLD || st.reason == RATE_RECOVERING);
+
+  // Quality is stepped down before the frame rate
+  {
+    RateControlState q;
+    rate_control_reset(q, BASE_INTERVAL_MS);
+    Link slow = {"slow", 250, 20, 80, -60, 1};
+    run(q, slow);
+    CHECK(q.qualityDrop == RATE_CTRL_QUALITY_STEP);
+    CHECK_EQ(q.intervalMs, BASE_INTERVAL_MS);
+    slow.windows = 60;
+    run(q, slow);
+    CHECK_EQ(q.qualityDrop, RATE_CTRL_MAX_QUALITY_DROP);
+    CHECK(q.intervalMs > BASE_INTERVAL_MS);
+  }
+
+  // Link restored: the first RECOVER_WINDOWS - 1 clean windows change
+  // nothing, then it climbs back, frame rate first, to the configured
+  // settings and stays there
+  RateControlState before = st;
+  Link restored = {"restored", 2000, 0, 5, -50, RATE_CTRL_RECOVER_WINDOWS - 1};
+  PhaseResult waiting = run(st, restored);
+  CHECK_EQ(waiting.steps, 0);
+  CHECK_EQ(st.qualityDrop, before.qualityDrop);
+  CHECK_EQ(st.intervalMs, before.intervalMs);
+  restored.windows = 1;
+  run(st, restored);
+  if (before.intervalMs > BASE_INTERVAL_MS) {
+    CHECK(st.intervalMs < before.intervalMs);
+    CHECK_EQ(st.qualityDrop, before.qualityDrop);
+  } else {
+    CHECK(st.qualityDrop < before.qualityDrop);
+  }
+  restored.windows = 100;
+  PhaseResult recovered = run(st, restored);
+  CHECK_EQ(recovered.reversals, 0);
+  CHECK_EQ(st.qualityDrop, 0);
+  CHECK_EQ(st.intervalMs, BASE_INTERVAL_MS);
+  CHECK_EQ(st.reason, RATE_STEADY);
+
+  // A loss burst bad enough to stall writes steps quality and rate at once
+  {
+    RateControlState s;
+    rate_control_reset(s, BASE_INTERVAL_MS);
+    PhaseResult burst = run(s, {"burst", 100, 300, 400, -70, 1});
+    CHECK_EQ(burst.steps, 1);
+    CHECK_EQ(s.reason, RATE_STALLS);
+    CHECK(s.qualityDrop > 0);
+    CHECK(s.intervalMs > BASE_INTERVAL_MS);
+    // Sustained, it ends at the floor: worst quality, slowest rate
+    run(s, {"burst", 100, 300, 400, -70, 40});
+    CHECK_EQ(s.qualityDrop, RATE_CTRL_MAX_QUALITY_DROP);
+    CHECK_EQ(s.intervalMs, RATE_CTRL_MAX_INTERVAL_MS);
+  }
+
+  // Weak RSSI keeps more headroom: the same link is congested at -80 dBm
+  // and left alone at -50 dBm
+  {
+    Link marginal = {"marginal", 1000, 10, 60, -50, 20};
+    RateControlState strong, weak;
+    rate_control_reset(strong, BASE_INTERVAL_MS);
+    rate_control_reset(weak, BASE_INTERVAL_MS);
+    PhaseResult a = run(strong, marginal);
+    marginal.rssi = -80;
+    PhaseResult b = run(weak, marginal);
+    CHECK_EQ(a.steps, 0);
+    CHECK(b.steps > 0);
+    CHECK_EQ(b.reversals, 0);
+  }
+
+  return check_result("test_rate_controller");
+}
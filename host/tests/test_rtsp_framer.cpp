@@ -0,0 +1,150 @@
+// CRtspFramer must split the control connection into the same messages no
+// matter how TCP slices it: one byte per read, everything in one read, or
+// anything in between.
+
+#include "check.h"
+#include "CRtspFramer.h"
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+struct Msg {
+  RTSP_FRAME_TYPES type;
+  uint8_t channel;
+  std::string data;
+};
+
+static std::string interleaved(uint8_t channel, const std::string &payload) {
+  std::string s = "$";
+  s += (char)channel;
+  s += (char)(payload.size() >> 8);
+  s += (char)(payload.size() & 0xff);
+  return s + payload;
+}
+
+// The messages a session sees: pipelined requests, a body that contains a
+// blank line, bare-LF line ends, keep-alive CRLFs and RTCP over TCP whose
+// payload holds '$', CR and LF bytes.
+static const std::string OPTIONS = "OPTIONS rtsp://cam/mjpeg/1 RTSP/1.0\r\nCSeq: 1\r\n\r\n";
+static const std::string SETUP =
+    "SETUP rtsp://cam/mjpeg/1/track1 RTSP/1.0\r\nCSeq: 2\r\n"
+    "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n\r\n";
+static const std::string PLAY = "PLAY rtsp://cam/mjpeg/1 RTSP/1.0\nCSeq: 3\nSession: 1\n\n";
+static const std::string SET_PARAMETER =
+    "SET_PARAMETER rtsp://cam/mjpeg/1 RTSP/1.0\r\nCSeq: 4\r\n"
+    "content-LENGTH: 12\r\n\r\nx: 1\r\n\r\ny: 2";
+static const std::string RTCP_PAYLOAD = std::string("\x81\xc9\x00\x07$\r\n\r\n\0\0", 12);
+static const std::string TEARDOWN = "TEARDOWN rtsp://cam/mjpeg/1 RTSP/1.0\r\nCSeq: 5\r\n\r\n";
+
+static std::string stream() {
+  return OPTIONS + SETUP + PLAY + "\r\n" + interleaved(1, RTCP_PAYLOAD) +
+         SET_PARAMETER + "\r\n\r\n" + interleaved(1, "") + TEARDOWN;
+}
+
+static std::vector<Msg> expected() {
+  return {{RTSP_FRAME_REQUEST, 0, OPTIONS},
+          {RTSP_FRAME_REQUEST, 0, SETUP},
+          {RTSP_FRAME_REQUEST, 0, PLAY},
+          {RTSP_FRAME_INTERLEAVED, 1, RTCP_PAYLOAD},
+          {RTSP_FRAME_REQUEST, 0, SET_PARAMETER},
+          {RTSP_FRAME_INTERLEAVED, 1, ""},
+          {RTSP_FRAME_REQUEST, 0, TEARDOWN}};
+}
+
+static void drain(CRtspFramer &framer, std::vector<Msg> &out) {
+  RtspFrame frame;
+  while (framer.next(frame)) {
+    Msg m{frame.type, frame.channel, std::string(frame.data ? frame.data : "", frame.size)};
+    // Requests are handed out NUL-terminated for the string parsers
+    if (frame.type == RTSP_FRAME_REQUEST)
+      CHECK(frame.data[frame.size] == '\0');
+    out.push_back(m);
+  }
+}
+
+// Feeds `in` in slices of the given sizes (cycled) through writePtr/commit,
+// the way CRtspSession reads the socket
+static std::vector<Msg> frame_all(const std::string &in, const std::vector<unsigned> &slices) {
+  CRtspFramer framer;
+  std::vector<Msg> out;
+  size_t off = 0, i = 0;
+  while (off < in.size()) {
+    unsigned n = slices[i++ % slices.size()];
+    if (n > in.size() - off)
+      n = in.size() - off;
+    if (n > framer.writeSpace())
+      n = framer.writeSpace();
+    memcpy(framer.writePtr(), in.data() + off, n);
+    framer.commit(n);
+    off += n;
+    drain(framer, out);
+  }
+  CHECK_EQ(framer.buffered(), 0);
+  return out;
+}
+
+static void expect_messages(const std::vector<Msg> &got, const std::vector<Msg> &want,
+                            const char *how) {
+  if (got.size() != want.size()) {
+    fprintf(stderr, "%s: %zu messages, want %zu\n", how, got.size(), want.size());
+    s_checkFailures++;
+    return;
+  }
+  for (size_t i = 0; i < want.size(); i++) {
+    if (got[i].type != want[i].type || got[i].channel != want[i].channel ||
+        got[i].data != want[i].data) {
+      fprintf(stderr, "%s: message %zu differs:\n  want [%d/%d] \"%s\"\n  got  [%d/%d] \"%s\"\n",
+              how, i, want[i].type, want[i].channel, want[i].data.c_str(), got[i].type,
+              got[i].channel, got[i].data.c_str());
+      s_checkFailures++;
+    }
+  }
+}
+
+int main() {
+  const std::string in = stream();
+
+  expect_messages(frame_all(in, {1}), expected(), "byte at a time");
+  expect_messages(frame_all(in, {(unsigned)in.size()}), expected(), "coalesced");
+  expect_messages(frame_all(in, {2, 3, 5, 7, 11, 13}), expected(), "uneven reads");
+
+  // Every single split point, as two reads
+  for (size_t cut = 1; cut < in.size(); cut++) {
+    char how[32];
+    snprintf(how, sizeof(how), "split at %zu", cut);
+    expect_messages(frame_all(in, {(unsigned)cut, (unsigned)in.size()}), expected(), how);
+  }
+
+  // feed() takes only what fits and the caller keeps the rest
+  {
+    CRtspFramer framer;
+    std::vector<Msg> out;
+    size_t off = 0;
+    while (off < in.size()) {
+      off += framer.feed(in.data() + off, (unsigned)(in.size() - off));
+      drain(framer, out);
+    }
+    expect_messages(out, expected(), "feed");
+  }
+
+  // Oversized messages are dropped without losing the ones around them:
+  // a request whose body can't fit, a headerless flood, a huge '$' frame
+  {
+    std::string body(RTSP_FRAMER_BUFFER_SIZE, 'b');
+    std::string big = "SET_PARAMETER rtsp://cam/ RTSP/1.0\r\nCSeq: 6\r\nContent-Length: " +
+                      std::to_string(body.size()) + "\r\n\r\n" + body;
+    std::string flood(RTSP_FRAMER_BUFFER_SIZE, 'A');
+    std::string hugeRtcp = interleaved(1, std::string(RTSP_FRAMER_BUFFER_SIZE, '\n'));
+    std::string mixed = OPTIONS + big + TEARDOWN + hugeRtcp + PLAY + flood;
+    std::vector<Msg> want = {{RTSP_FRAME_REQUEST, 0, OPTIONS},
+                             {RTSP_FRAME_ERROR, 0, ""},
+                             {RTSP_FRAME_REQUEST, 0, TEARDOWN},
+                             {RTSP_FRAME_REQUEST, 0, PLAY},
+                             {RTSP_FRAME_ERROR, 0, ""}};
+    expect_messages(frame_all(mixed, {1}), want, "oversized, byte at a time");
+    expect_messages(frame_all(mixed, {RTSP_FRAMER_BUFFER_SIZE}), want, "oversized, full reads");
+    expect_messages(frame_all(mixed, {700, 1}), want, "oversized, uneven reads");
+  }
+
+  return check_result("test_rtsp_framer");
+}
@@ -0,0 +1,114 @@
+// soap_parse on requests as NVRs send them: the action and the values the
+// handlers read come out right whatever namespace prefixes the client uses,
+// and parsing a request makes no heap allocation once warmed up.
+
+#include "alloc_track.h"
+#include "check.h"
+#include "soap_parse.h"
+#include <stdlib.h>
+
+// Hikvision probe, WS-Security header, default prefixes
+static const char *GET_PROFILES =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+    "<s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\">"
+    "<s:Header><Security s:mustUnderstand=\"1\" xmlns=\"http://docs.oasis-open.org/"
+    "wss/2004/01/oasis-200401-wss-wssecurity-secext-1.0.xsd\"><UsernameToken>"
+    "<Username>admin</Username><Password Type=\"...#PasswordDigest\">"
+    "tuOSpGlFlIXsozq4HFNeeGeFLEI=</Password><Nonce>LKqI6G/AikKCQrN0zqZFlg==</Nonce>"
+    "<Created>2026-10-18T12:00:00Z</Created></UsernameToken></Security></s:Header>"
+    "<s:Body><GetProfiles xmlns=\"http://www.onvif.org/ver10/media/wsdl\"/></s:Body>"
+    "</s:Envelope>";
+
+// ONVIF Device Manager, Media2 with token and prefixed elements
+static const char *SET_VIDEO_CONFIG =
+    "<s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\"><s:Body>"
+    "<tr2:SetVideoEncoderConfiguration><tr2:Configuration token=\"VideoEncoder_1\" "
+    "GovLength=\"30\"><tt:Name>Main</tt:Name><tt:Encoding>H264</tt:Encoding>"
+    "<tt:Resolution><tt:Width>1280</tt:Width><tt:Height>720</tt:Height></tt:Resolution>"
+    "<tt:Quality> 4.5 </tt:Quality><tt:RateControl><tt:FrameRateLimit>15"
+    "</tt:FrameRateLimit></tt:RateControl></tr2:Configuration>"
+    "</tr2:SetVideoEncoderConfiguration></s:Body></s:Envelope>";
+
+static const char *PULL_MESSAGES =
+    "<s:Envelope><s:Header><a:To>http://192.168.1.50:8000/onvif/events_service?sub=7"
+    "</a:To></s:Header><s:Body><PullMessages xmlns=\"http://www.onvif.org/ver10/events/"
+    "wsdl\"><Timeout>PT5S</Timeout><MessageLimit>10</MessageLimit></PullMessages>"
+    "</s:Body></s:Envelope>";
+
+static const char *SET_DATE_TIME =
+    "<s:Body><tds:SetSystemDateAndTime><tds:DateTimeType>Manual</tds:DateTimeType>"
+    "<tds:UTCDateTime><tt:Time><tt:Hour>13</tt:Hour><tt:Minute>5</tt:Minute>"
+    "<tt:Second>9</tt:Second></tt:Time><tt:Date><tt:Year>2026</tt:Year>"
+    "<tt:Month>10</tt:Month><tt:Day>18</tt:Day></tt:Date></tds:UTCDateTime>"
+    "</tds:SetSystemDateAndTime></s:Body>";
+
+static const char *SERVICE_CAPS =
+    "<s:Body><GetServiceCapabilities xmlns=\"http://www.onvif.org/ver20/media/wsdl\"/>"
+    "</s:Body>";
+
+static const char *PTZ_STATUS = "<s:Body><tptz:GetStatus><tptz:ProfileToken>Profile_1"
+                                "</tptz:ProfileToken></tptz:GetStatus></s:Body>";
+
+// Everything the SOAP handlers read from these requests
+static void parse_all(char *text, size_t size) {
+  CHECK_EQ(soap_action(GET_PROFILES, "/onvif/media_service"), SOAP_GET_PROFILES);
+  CHECK(soap_action_protected(SOAP_GET_PROFILES));
+  CHECK(soap_has(GET_PROFILES, "Security"));
+
+  CHECK_EQ(soap_action(SET_VIDEO_CONFIG, "/onvif/media2_service"), SOAP_SET_VIDEO_CONFIG);
+  CHECK(soap_text(SET_VIDEO_CONFIG, "Encoding", text, size));
+  CHECK_STR(text, "H264");
+  CHECK(soap_number(SET_VIDEO_CONFIG, "Width") == 1280.0f);
+  CHECK(soap_number(SET_VIDEO_CONFIG, "Height") == 720.0f);
+  CHECK(soap_number(SET_VIDEO_CONFIG, "Quality") == 4.5f);
+  CHECK(soap_number(SET_VIDEO_CONFIG, "FrameRateLimit") == 15.0f);
+  CHECK(soap_number(SET_VIDEO_CONFIG, "BitrateLimit") == -1.0f);
+  CHECK(soap_text(SET_VIDEO_CONFIG, "Quality", text, size));
+  CHECK_STR(text, "4.5");
+
+  CHECK_EQ(soap_action(PULL_MESSAGES, "/onvif/events_service"), SOAP_PULL_MESSAGES);
+  const char *timeout = soap_value(PULL_MESSAGES, "Timeout");
+  CHECK(timeout && strncmp(timeout, "PT5S<", 5) == 0);
+  CHECK_EQ(atoi(soap_value(PULL_MESSAGES, "MessageLimit")), 10);
+  CHECK(soap_value(PULL_MESSAGES, "TerminationTime") == nullptr);
+
+  const char *utc = strstr(SET_DATE_TIME, "UTCDateTime");
+  CHECK_EQ(soap_action(SET_DATE_TIME, "/onvif/device_service"), SOAP_SET_SYSTEM_DATE_AND_TIME);
+  CHECK_EQ(soap_int_after(utc, "Year"), 2026);
+  CHECK_EQ(soap_int_after(utc, "Month"), 10);
+  CHECK_EQ(soap_int_after(utc, "Day"), 18);
+  CHECK_EQ(soap_int_after(utc, "Hour"), 13);
+  CHECK_EQ(soap_int_after(utc, "Minute"), 5);
+  CHECK_EQ(soap_int_after(utc, "Second"), 9);
+  CHECK_EQ(soap_int_after(utc, "Millisecond"), 0);
+
+  // Same operation name, told apart by the service it was posted to
+  CHECK_EQ(soap_action(SERVICE_CAPS, "/onvif/media2_service"), SOAP_GET_MEDIA2_SERVICE_CAPS);
+  CHECK_EQ(soap_action(SERVICE_CAPS, "/onvif/events_service"), SOAP_GET_EVENT_SERVICE_CAPS);
+  CHECK_EQ(soap_action(SERVICE_CAPS, "/onvif/device_service"), SOAP_UNKNOWN);
+  CHECK_EQ(soap_action(PTZ_STATUS, "/onvif/ptz_service"), SOAP_PTZ);
+  CHECK(!soap_action_protected(SOAP_GET_SYSTEM_DATE_AND_TIME));
+}
+
+int main() {
+  char text[16];
+  parse_all(text, sizeof(text));
+
+  // Values longer than the caller's buffer are cut, not overrun
+  char small[4];
+  CHECK(soap_text(SET_VIDEO_CONFIG, "Name", small, sizeof(small)));
+  CHECK_STR(small, "Mai");
+  CHECK(!soap_text(SET_VIDEO_CONFIG, "Name", small, 0));
+  CHECK_STR(soap_action_name(SOAP_PULL_MESSAGES), "PullMessages");
+  CHECK_STR(soap_action_name(SOAP_ACTION_COUNT), "Unknown");
+
+  // Steady state: the same requests again must not touch the heap
+  AllocCount before = alloc_track_now();
+  for (int i = 0; i < 100; i++)
+    parse_all(text, sizeof(text));
+  AllocCount after = alloc_track_now();
+  if (alloc_track_available())
+    CHECK_EQ(after.allocs - before.allocs, 0);
+
+  return check_result("test_soap_parse");
+}
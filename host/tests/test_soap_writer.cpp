@@ -0,0 +1,108 @@
+// SoapWriter::printf_P must produce exactly the bytes vsnprintf does, for
+// every block size (conversions and literal runs split across blocks), and
+// its dry run must count the same length.
+
+#include "check.h"
+#include "soap_writer.h"
+#include <stdarg.h>
+#include <string>
+
+static void collect(void *ctx, const char *data, size_t len) {
+  ((std::string *)ctx)->append(data, len);
+}
+
+static const size_t BLOCK_SIZES[] = {1, 2, 3, 7, 64, 100, SOAP_WRITER_BLOCK_SIZE};
+
+static void expect_same(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  char want[4096];
+  va_list copy;
+  va_copy(copy, ap);
+  int wantLen = vsnprintf(want, sizeof(want), fmt, copy);
+  va_end(copy);
+
+  for (size_t blockSize : BLOCK_SIZES) {
+    char block[SOAP_WRITER_BLOCK_SIZE];
+    std::string got;
+    SoapWriter w(block, blockSize, collect, &got);
+    va_copy(copy, ap);
+    w.vprintf_P(fmt, copy);
+    va_end(copy);
+    w.flush();
+    if (got != want) {
+      fprintf(stderr, "format \"%s\", block %zu:\n  want \"%s\"\n  got  \"%s\"\n",
+              fmt, blockSize, want, got.c_str());
+      s_checkFailures++;
+    }
+    CHECK_EQ(w.length(), wantLen);
+
+    SoapWriter dry(nullptr, 0, nullptr, nullptr);
+    va_copy(copy, ap);
+    dry.vprintf_P(fmt, copy);
+    va_end(copy);
+    CHECK_EQ(dry.length(), wantLen);
+  }
+  va_end(ap);
+}
+
+int main() {
+  // Shapes used by the ONVIF templates
+  expect_same("<tt:Width>%d</tt:Width><tt:Height>%d</tt:Height>", 640, 480);
+  expect_same("<tds:Manufacturer>%s</tds:Manufacturer><tds:Model>%s</tds:Model>",
+              "Espressif", "ESP32-CAM-ONVIF");
+  expect_same("<tt:Uri>rtsp://%s:%u/%s</tt:Uri>", "192.168.1.50", 554u, "mjpeg/1");
+  expect_same("<tt:Year>%04d</tt:Year><tt:Month>%02d</tt:Month>", 2026, 7);
+  expect_same("<wsa:MessageID>urn:uuid:%08lx-%04x-%04x</wsa:MessageID>",
+              0xdeadbeefUL, 0x12u, 0xabcdu);
+  expect_same("TerminationTime=%lld Quality=%.1f", 1760000000LL, 4.5);
+
+  // The rest of the accepted printf subset
+  expect_same("[%5s|%-5s|%.2s|%-7.3s]", "ab", "ab", "abcdef", "abcdef");
+  expect_same("[%*d|%-*d|%.*s|%*.*s]", 6, 42, 6, 42, 3, "abcdef", 8, 2, "xyz");
+  expect_same("[%*d|%.*s]", -6, 42, -1, "negative precision");
+  expect_same("[%+d|% d|%05d|%-5d|%x|%X|%#x|%o]", 7, 7, -42, -42, 255u, 255u, 255u, 8u);
+  expect_same("[%hd|%hhu|%ld|%lu|%lld|%llu|%zu|%zd]", (short)-3, 200,
+              -123456L, 123456UL, -9000000000LL, 9000000000ULL, (size_t)77,
+              (ptrdiff_t)-77);
+  expect_same("[%f|%.3f|%10.2f|%-10.2e|%g|%G]", 3.14159, 2.0 / 3, -1.5, 12345.678,
+              0.0001, 1e20);
+  expect_same("[%c|%3c|%-3c] 100%% done", 'a', 'b', 'c');
+  expect_same("[%s]", (const char *)nullptr);
+
+  // Literal runs longer than the internal 64-byte copy buffer
+  std::string longText(300, 'x');
+  longText += "%s";
+  longText += std::string(130, 'y');
+  expect_same(longText.c_str(), "middle");
+  expect_same("%s", std::string(5000 / 2, 'z').c_str());
+
+  // write_P runs
+  for (size_t blockSize : BLOCK_SIZES) {
+    char block[SOAP_WRITER_BLOCK_SIZE];
+    std::string got;
+    SoapWriter w(block, blockSize, collect, &got);
+    std::string text(200, 'q');
+    w.write_P(text.c_str());
+    w.write("!", 1);
+    w.flush();
+    CHECK(got == text + "!");
+    CHECK_EQ(w.length(), text.size() + 1);
+  }
+
+  // Into a fixed buffer: NUL-terminated, cut at size - 1
+  for (size_t size : {1, 8, 20, 64}) {
+    char buf[64];
+    memset(buf, '#', sizeof(buf));
+    SoapBufferSink out = {buf, size, 0};
+    char block[7];
+    SoapWriter w(block, sizeof(block), soap_buffer_sink, &out);
+    w.printf_P("{\"count\":%u,\"name\":\"%s\"}", 42u, "fb_acquire_rtsp");
+    w.flush();
+    std::string want = std::string("{\"count\":42,\"name\":\"fb_acquire_rtsp\"}").substr(0, size - 1);
+    CHECK_EQ(out.len, want.size());
+    CHECK_STR(buf, want.c_str());
+  }
+
+  return check_result("test_soap_writer");
+}
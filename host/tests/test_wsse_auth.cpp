@@ -0,0 +1,94 @@
+// wsse_verify replay protection on both sides of clock sync: before the
+// clock is set, a verified token must stay a replay no matter how long ago it
+// was seen, and the table must refuse new tokens rather than forget old ones.
+
+#include "check.h"
+#include "config.h"
+#include "mbedtls/sha1.h"
+#include "wsse_auth.h"
+#include <openssl/evp.h>
+#include <string>
+
+static const char *USER = "admin";
+static const char *PASS = "secret";
+static const uint32_t CLIENT = 0x0a000002;
+static const uint32_t OTHER = 0x0a000003;
+static const time_t UNSET = 30;           // 1970: clock not set yet
+static const time_t SYNCED = 1760000000;  // 2025-10-09T08:53:20Z
+static const char *SYNCED_STR = "2025-10-09T08:53:20Z";
+
+static std::string b64(const uint8_t *data, size_t len) {
+  char out[128];
+  int n = EVP_EncodeBlock((unsigned char *)out, data, (int)len);
+  return std::string(out, n);
+}
+
+// A SOAP envelope carrying a UsernameToken whose nonce is derived from seq
+static std::string token(int seq, const char *created, const char *pass = PASS) {
+  uint8_t nonce[16];
+  for (int i = 0; i < 16; i++)
+    nonce[i] = (uint8_t)(seq * 31 + i);
+  std::string input((const char *)nonce, sizeof(nonce));
+  input += created;
+  input += pass;
+  uint8_t digest[20];
+  mbedtls_sha1((const unsigned char *)input.data(), input.size(), digest);
+
+  return std::string("<s:Envelope><s:Header><wsse:Security><wsse:UsernameToken>"
+                     "<wsse:Username>") +
+         USER + "</wsse:Username><wsse:Password Type=\"...#PasswordDigest\">" +
+         b64(digest, 20) + "</wsse:Password><wsse:Nonce>" + b64(nonce, 16) +
+         "</wsse:Nonce><wsu:Created>" + created +
+         "</wsu:Created></wsse:UsernameToken></wsse:Security></s:Header>"
+         "<s:Body/></s:Envelope>";
+}
+
+static WsseResult verify(const std::string &req, uint32_t ip, uint32_t ms,
+                         time_t epoch) {
+  return wsse_verify(req.c_str(), USER, PASS, ip, ms, epoch);
+}
+
+int main() {
+  const uint32_t HOUR_MS = 3600UL * 1000UL;
+
+  // Basic outcomes
+  wsse_reset_cache();
+  CHECK_EQ(verify(token(1, SYNCED_STR), CLIENT, 0, SYNCED), WSSE_OK);
+  CHECK_EQ(verify(token(1, SYNCED_STR), CLIENT, 100, SYNCED), WSSE_OK_CACHED);
+  CHECK_EQ(verify(token(1, SYNCED_STR), OTHER, 200, SYNCED), WSSE_REPLAY);
+  CHECK_EQ(verify(token(1, SYNCED_STR),
+                  CLIENT, WSSE_REUSE_WINDOW_MS + 1, SYNCED), WSSE_REPLAY);
+  CHECK_EQ(verify(token(2, SYNCED_STR, "wrong"), CLIENT, 0, SYNCED),
+           WSSE_BAD_DIGEST);
+  CHECK_EQ(verify(token(3, "2025-10-09T07:00:00Z"), CLIENT, 0, SYNCED),
+           WSSE_STALE);
+  CHECK_EQ(verify("<s:Envelope/>", CLIENT, 0, SYNCED), WSSE_NO_TOKEN);
+
+  // Clock set: an entry may expire once its Created can no longer pass
+  wsse_reset_cache();
+  CHECK_EQ(verify(token(4, SYNCED_STR), CLIENT, 0, SYNCED), WSSE_OK);
+  CHECK_EQ(verify(token(4, SYNCED_STR), OTHER, HOUR_MS, SYNCED + 3600),
+           WSSE_STALE);
+
+  // Clock unset: Created is unchecked, so the token must stay a replay
+  wsse_reset_cache();
+  CHECK_EQ(verify(token(5, SYNCED_STR), CLIENT, 0, UNSET), WSSE_OK);
+  CHECK_EQ(verify(token(5, SYNCED_STR), OTHER, HOUR_MS, UNSET), WSSE_REPLAY);
+  CHECK_EQ(verify(token(5, SYNCED_STR), CLIENT, 24 * HOUR_MS, UNSET),
+           WSSE_REPLAY);
+
+  // ...and a full table refuses new tokens instead of evicting one
+  wsse_reset_cache();
+  for (int i = 0; i < WSSE_NONCE_CACHE_SIZE; i++)
+    CHECK_EQ(verify(token(100 + i, SYNCED_STR), CLIENT, i, UNSET), WSSE_OK);
+  CHECK_EQ(verify(token(999, SYNCED_STR), CLIENT, HOUR_MS, UNSET),
+           WSSE_CACHE_FULL);
+  for (int i = 0; i < WSSE_NONCE_CACHE_SIZE; i++)
+    CHECK_EQ(verify(token(100 + i, SYNCED_STR), OTHER, HOUR_MS, UNSET),
+             WSSE_REPLAY);
+
+  // Once the clock is set, the old entries age out normally
+  CHECK_EQ(verify(token(999, SYNCED_STR), CLIENT, HOUR_MS, SYNCED), WSSE_OK);
+
+  return check_result("test_wsse_auth");
+}
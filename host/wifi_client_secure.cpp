@@ -0,0 +1,118 @@
+// WiFiClientSecure (shim/WiFiClientSecure.h) on OpenSSL, for https_client
+#include <WiFiClientSecure.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/ssl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WRITE_TIMEOUT_MS 10000
+
+static SSL_CTX *client_ctx() {
+  static SSL_CTX *ctx = [] {
+    signal(SIGPIPE, SIG_IGN); // lwIP reports a reset peer as a failed write
+    return SSL_CTX_new(TLS_client_method());
+  }();
+  return ctx;
+}
+
+int WiFiClientSecure::connect(const char *host, uint16_t port) {
+  stop();
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  if (getaddrinfo(host, service, &hints, &res) != 0)
+    return 0;
+  m_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  bool ok = m_fd >= 0 && ::connect(m_fd, res->ai_addr, res->ai_addrlen) == 0;
+  freeaddrinfo(res);
+  if (!ok) {
+    stop();
+    return 0;
+  }
+  int one = 1;
+  setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  m_ssl = SSL_new(client_ctx());
+  SSL_set_verify(m_ssl, m_insecure ? SSL_VERIFY_NONE : SSL_VERIFY_PEER, nullptr);
+  SSL_set_tlsext_host_name(m_ssl, host);
+  SSL_set_fd(m_ssl, m_fd);
+  if (SSL_connect(m_ssl) != 1) {
+    stop();
+    return 0;
+  }
+  fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL, 0) | O_NONBLOCK);
+  m_eof = false;
+  return 1;
+}
+
+void WiFiClientSecure::stop() {
+  if (m_ssl) {
+    if (!m_eof)
+      SSL_shutdown(m_ssl); // close_notify, without waiting for the peer's
+    SSL_free(m_ssl);
+    m_ssl = nullptr;
+  }
+  if (m_fd >= 0)
+    close(m_fd);
+  m_fd = -1;
+  m_eof = true;
+}
+
+int WiFiClientSecure::available() {
+  if (!m_ssl)
+    return 0;
+  int n = SSL_pending(m_ssl);
+  if (n > 0 || m_eof)
+    return n;
+  uint8_t peek;
+  if (SSL_peek(m_ssl, &peek, 1) > 0)
+    return SSL_pending(m_ssl);
+  int err = SSL_get_error(m_ssl, 0);
+  if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+    m_eof = true; // close_notify, FIN or reset
+  return 0;
+}
+
+uint8_t WiFiClientSecure::connected() {
+  return available() > 0 || (m_ssl && !m_eof);
+}
+
+size_t WiFiClientSecure::write(const uint8_t *buf, size_t size) {
+  size_t done = 0;
+  while (m_ssl && !m_eof && done < size) {
+    int n = SSL_write(m_ssl, buf + done, size - done);
+    if (n > 0) {
+      done += n;
+      continue;
+    }
+    int err = SSL_get_error(m_ssl, n);
+    if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+      m_eof = true;
+      break;
+    }
+    pollfd p = {m_fd, (short)(err == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT), 0};
+    if (poll(&p, 1, WRITE_TIMEOUT_MS) <= 0)
+      break;
+  }
+  return done;
+}
+
+int WiFiClientSecure::read(uint8_t *buf, size_t size) {
+  if (!available())
+    return -1;
+  int n = SSL_read(m_ssl, buf, size);
+  return n > 0 ? n : -1;
+}
+
+int WiFiClientSecure::read() {
+  uint8_t ch;
+  return read(&ch, 1) == 1 ? ch : -1;
+}